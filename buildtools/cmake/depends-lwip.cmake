@@ -16,6 +16,7 @@ set(lwip_source
   ${lwip_base}/src/core/def.c
   ${lwip_base}/src/core/mem.c
   ${lwip_base}/src/core/tcp_in.c
+  ${lwip_base}/src/core/tcp_cc.c
   ${lwip_base}/src/core/stats.c
   ${lwip_base}/src/core/inet_chksum.c
   ${lwip_base}/src/core/ip.c
@@ -31,6 +32,7 @@ set(lwip_source
   ${lwip_base}/src/api/err.c
   ${CMAKE_CURRENT_LIST_DIR}/../custom/lwip/sys.c
   ${CMAKE_CURRENT_LIST_DIR}/../custom/lwip/error.c
+  ${CMAKE_CURRENT_LIST_DIR}/../custom/lwip/chksum.c
   )
 
 if (MSVC)
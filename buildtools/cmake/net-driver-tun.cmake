@@ -9,6 +9,21 @@ if (APPLE)
   set(net_driver_tun_source ${net_driver_tun_source} ${net_driver_tun_source_oc})
 else()
   set(net_driver_tun_compile_definitions ${net_driver_tun_compile_definitions} NET_TUN_USE_DEV_TUN=1)
+
+  include(CheckIncludeFile)
+  check_include_file(linux/io_uring.h net_driver_tun_have_io_uring)
+  if (net_driver_tun_have_io_uring)
+    set(net_driver_tun_compile_definitions ${net_driver_tun_compile_definitions} NET_TUN_USE_IO_URING=1)
+  endif()
+
+  include(CheckSymbolExists)
+  check_symbol_exists(TPACKET3_HDRLEN linux/if_packet.h net_driver_tun_have_tpacket_v3)
+  if (net_driver_tun_have_tpacket_v3)
+    set(net_driver_tun_compile_definitions ${net_driver_tun_compile_definitions} NET_TUN_USE_AF_PACKET=1)
+  endif()
+
+  find_package(Threads)
+  set(net_driver_tun_link_libraries ${net_driver_tun_link_libraries} ${CMAKE_THREAD_LIBS_INIT})
 endif()
 
 add_library(net_driver_tun STATIC ${net_driver_tun_source})
@@ -27,4 +42,28 @@ set_property(TARGET net_driver_tun PROPERTY INCLUDE_DIRECTORIES
   ${net_driver_tun_base}/include
   )
 
-target_link_libraries(net_driver_tun INTERFACE lwip)
+target_link_libraries(net_driver_tun INTERFACE lwip ${net_driver_tun_link_libraries})
+
+# end to end benchmark over a socketpair, needs the net core and the ev driver of the parent project
+if (NOT APPLE AND TARGET net_core AND TARGET net_driver_ev)
+  file(GLOB net_driver_tun_bench_source ${net_driver_tun_base}/bench/*.c)
+
+  add_executable(net_driver_tun_bench ${net_driver_tun_bench_source})
+  set_property(TARGET net_driver_tun_bench PROPERTY COMPILE_DEFINITIONS ${net_driver_tun_compile_definitions})
+
+  set_property(TARGET net_driver_tun_bench PROPERTY INCLUDE_DIRECTORIES
+    ${lwip_custom}
+    ${lwip_base}/src/include
+    ${lwip_base}/src/include/ipv4
+    ${lwip_base}/src/include/ipv6
+    ${cpe_pal_base}/include
+    ${cpe_utils_base}/include
+    ${net_core_base}/include
+    ${net_driver_ev_base}/include
+    ${ev_base}
+    ${net_driver_tun_base}/include
+    ${net_driver_tun_base}/bench
+    )
+
+  target_link_libraries(net_driver_tun_bench net_driver_tun net_driver_ev net_core ${net_driver_tun_link_libraries})
+endif()
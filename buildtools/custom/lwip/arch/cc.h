@@ -26,6 +26,13 @@
 #define PACK_STRUCT_END CPE_END_PACKED
 #define PACK_STRUCT_STRUCT CPE_PACKED
 
+/*every thread owns a private lwip instance (see net_tun_shard)*/
+#if defined(_MSC_VER)
+#define LWIP_TLS __declspec(thread)
+#else
+#define LWIP_TLS __thread
+#endif
+
 #define LWIP_PLATFORM_DIAG(x) do { lwip_em_info_printf x; } while(0)
 #define LWIP_PLATFORM_ASSERT(x) { lwip_em_error_printf("%s: lwip assertion failure: %s\n", __FUNCTION__, (x)); abort(); }
 
@@ -54,7 +61,10 @@ extern "C" {
 
 void lwip_em_info_printf(const char * msg, ...);
 void lwip_em_error_printf(const char * msg, ...);
-extern error_monitor_t g_lwip_em;
+extern LWIP_TLS error_monitor_t g_lwip_em;
+
+u16_t lwip_chksum(const void * dataptr, int len);
+u16_t lwip_chksum_memcpy(void * dst, const void * src, u16_t len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,32 @@
+#ifndef LWIP_CUSTOM_CHKSUM_H
+#define LWIP_CUSTOM_CHKSUM_H
+#include "lwip/arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * internet checksum kernels (see chksum.c), all return the same host order non-inverted
+ * sum as lwip_standard_chksum. LWIP_CHKSUM goes through lwip_chksum and LWIP_CHKSUM_COPY
+ * through lwip_chksum_memcpy, both bound on first use to the fastest kernel this cpu runs.
+ */
+typedef u16_t (*lwip_chksum_fn)(const void * dataptr, int len);
+typedef u16_t (*lwip_chksum_copy_fn)(void * dst, const void * src, u16_t len);
+
+struct lwip_chksum_kernel {
+    const char * name;
+    lwip_chksum_fn chksum;
+    lwip_chksum_copy_fn chksum_copy; /*memcpy, returns the sum of the copied bytes*/
+};
+
+/*kernels this cpu can run, the scalar lwip one first, the selected one last*/
+u8_t lwip_chksum_kernel_count(void);
+const struct lwip_chksum_kernel * lwip_chksum_kernel_at(u8_t i);
+const struct lwip_chksum_kernel * lwip_chksum_kernel_selected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
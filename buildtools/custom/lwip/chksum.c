@@ -0,0 +1,379 @@
+#include <string.h>
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "arch/chksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LWIP_CHKSUM_X86 1
+#else
+#define LWIP_CHKSUM_X86 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LWIP_CHKSUM_NEON 1
+#else
+#define LWIP_CHKSUM_NEON 0
+#endif
+
+/*
+ * the vector kernels sum 16 bit words into 32 bit lanes and spill the lanes into a
+ * 64 bit total every block, a lane takes at most 4 words per 64 bytes so 64k blocks
+ * never overflow. words are taken relative to dataptr, which is the same ones
+ * complement sum lwip_standard_chksum gets by aligning and swapping back.
+ */
+#define LWIP_CHKSUM_BLOCK 65536
+
+u16_t lwip_standard_chksum(const void * dataptr, int len);
+
+static u16_t lwip_chksum_fold(uint64_t sum) {
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 16) + (sum & 0xffffu);
+    sum = (sum >> 16) + (sum & 0xffffu);
+    sum = (sum >> 16) + (sum & 0xffffu);
+    return (u16_t)sum;
+}
+
+static uint64_t lwip_chksum_tail(const u8_t * p, int len, uint64_t sum) {
+    uint64_t q;
+    u16_t w;
+
+    /*32 bit halves fold to the same 16 bit sum*/
+    for(; len >= 8; len -= 8, p += 8) {
+        memcpy(&q, p, 8);
+        sum += (q & 0xffffffffu) + (q >> 32);
+    }
+
+    for(; len > 1; len -= 2, p += 2) {
+        memcpy(&w, p, 2);
+        sum += w;
+    }
+
+    if (len > 0) {
+        w = 0;
+        ((u8_t *)&w)[0] = *p;
+        sum += w;
+    }
+
+    return sum;
+}
+
+static u16_t lwip_chksum_copy_scalar(void * dst, const void * src, u16_t len) {
+    memcpy(dst, src, len);
+    return lwip_standard_chksum(dst, len);
+}
+
+#if LWIP_CHKSUM_X86
+
+__attribute__((target("sse2")))
+static u16_t lwip_chksum_sse2(const void * dataptr, int len) {
+    const u8_t * p = (const u8_t *)dataptr;
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+
+    while(len >= 64) {
+        int block = len > LWIP_CHKSUM_BLOCK ? LWIP_CHKSUM_BLOCK : (len & ~63);
+        __m128i lo = zero;
+        __m128i hi = zero;
+        uint64_t lanes[2];
+
+        len -= block;
+        for(; block > 0; block -= 64, p += 64) {
+            __m128i v0 = _mm_loadu_si128((const __m128i *)(p + 0));
+            __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+            __m128i v2 = _mm_loadu_si128((const __m128i *)(p + 32));
+            __m128i v3 = _mm_loadu_si128((const __m128i *)(p + 48));
+
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v0, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v0, zero));
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v1, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v1, zero));
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v2, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v2, zero));
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v3, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v3, zero));
+        }
+
+        /*64 bit lanes, no carry can get lost*/
+        __m128i acc = _mm_add_epi64(
+            _mm_add_epi64(_mm_unpacklo_epi32(lo, zero), _mm_unpackhi_epi32(lo, zero)),
+            _mm_add_epi64(_mm_unpacklo_epi32(hi, zero), _mm_unpackhi_epi32(hi, zero)));
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum += lanes[0] + lanes[1];
+    }
+
+    return lwip_chksum_fold(lwip_chksum_tail(p, len, sum));
+}
+
+/*
+ * fused copy + sum, every byte is loaded once. len is a tcp segment (u16_t) so
+ * the lanes never need an intermediate spill.
+ */
+__attribute__((target("sse2")))
+static u16_t lwip_chksum_copy_sse2(void * dst, const void * src, u16_t len) {
+    const u8_t * s = (const u8_t *)src;
+    u8_t * d = (u8_t *)dst;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = zero;
+    __m128i hi = zero;
+    uint64_t lanes[2];
+    int left = len;
+
+    for(; left >= 64; left -= 64, s += 64, d += 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(s + 0));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(s + 48));
+
+        _mm_storeu_si128((__m128i *)(d + 0), v0);
+        _mm_storeu_si128((__m128i *)(d + 16), v1);
+        _mm_storeu_si128((__m128i *)(d + 32), v2);
+        _mm_storeu_si128((__m128i *)(d + 48), v3);
+
+        lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v0, zero));
+        hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v0, zero));
+        lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v1, zero));
+        hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v1, zero));
+        lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v2, zero));
+        hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v2, zero));
+        lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v3, zero));
+        hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v3, zero));
+    }
+
+    __m128i acc = _mm_add_epi64(
+        _mm_add_epi64(_mm_unpacklo_epi32(lo, zero), _mm_unpackhi_epi32(lo, zero)),
+        _mm_add_epi64(_mm_unpacklo_epi32(hi, zero), _mm_unpackhi_epi32(hi, zero)));
+    _mm_storeu_si128((__m128i *)lanes, acc);
+
+    memcpy(d, s, (size_t)left);
+    return lwip_chksum_fold(lwip_chksum_tail(d, left, lanes[0] + lanes[1]));
+}
+
+__attribute__((target("avx2")))
+static u16_t lwip_chksum_avx2(const void * dataptr, int len) {
+    const u8_t * p = (const u8_t *)dataptr;
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+
+    while(len >= 64) {
+        int block = len > LWIP_CHKSUM_BLOCK ? LWIP_CHKSUM_BLOCK : (len & ~63);
+        __m256i lo = zero;
+        __m256i hi = zero;
+        uint64_t lanes[4];
+
+        len -= block;
+        for(; block >= 128; block -= 128, p += 128) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i *)(p + 0));
+            __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+            __m256i v2 = _mm256_loadu_si256((const __m256i *)(p + 64));
+            __m256i v3 = _mm256_loadu_si256((const __m256i *)(p + 96));
+
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v0, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v0, zero));
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v1, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v1, zero));
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v2, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v2, zero));
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v3, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v3, zero));
+        }
+
+        /*odd 64 bytes stay in avx2 code, calling out to the sse2 kernel costs a state transition*/
+        if (block > 0) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i *)(p + 0));
+            __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v0, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v0, zero));
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v1, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v1, zero));
+            p += 64;
+        }
+
+        __m256i acc = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_unpacklo_epi32(lo, zero), _mm256_unpackhi_epi32(lo, zero)),
+            _mm256_add_epi64(_mm256_unpacklo_epi32(hi, zero), _mm256_unpackhi_epi32(hi, zero)));
+        _mm256_storeu_si256((__m256i *)lanes, acc);
+        sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return lwip_chksum_fold(lwip_chksum_tail(p, len, sum));
+}
+
+__attribute__((target("avx2")))
+static u16_t lwip_chksum_copy_avx2(void * dst, const void * src, u16_t len) {
+    const u8_t * s = (const u8_t *)src;
+    u8_t * d = (u8_t *)dst;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = zero;
+    __m256i hi = zero;
+    uint64_t lanes[4];
+    int left = len;
+
+    for(; left >= 64; left -= 64, s += 64, d += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(s + 0));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+
+        _mm256_storeu_si256((__m256i *)(d + 0), v0);
+        _mm256_storeu_si256((__m256i *)(d + 32), v1);
+
+        lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v0, zero));
+        hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v0, zero));
+        lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v1, zero));
+        hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v1, zero));
+    }
+
+    __m256i acc = _mm256_add_epi64(
+        _mm256_add_epi64(_mm256_unpacklo_epi32(lo, zero), _mm256_unpackhi_epi32(lo, zero)),
+        _mm256_add_epi64(_mm256_unpacklo_epi32(hi, zero), _mm256_unpackhi_epi32(hi, zero)));
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+
+    memcpy(d, s, (size_t)left);
+    return lwip_chksum_fold(lwip_chksum_tail(d, left, lanes[0] + lanes[1] + lanes[2] + lanes[3]));
+}
+
+static int lwip_chksum_has_sse2(void) {
+#if defined(__x86_64__)
+    return 1;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int lwip_chksum_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif /*LWIP_CHKSUM_X86*/
+
+#if LWIP_CHKSUM_NEON
+
+static u16_t lwip_chksum_neon(const void * dataptr, int len) {
+    const u8_t * p = (const u8_t *)dataptr;
+    uint64_t sum = 0;
+
+    while(len >= 64) {
+        int block = len > LWIP_CHKSUM_BLOCK ? LWIP_CHKSUM_BLOCK : (len & ~63);
+        uint32x4_t a = vdupq_n_u32(0);
+        uint32x4_t b = vdupq_n_u32(0);
+
+        len -= block;
+        for(; block > 0; block -= 64, p += 64) {
+            /*byte loads, dataptr may be odd*/
+            a = vpadalq_u16(a, vreinterpretq_u16_u8(vld1q_u8(p + 0)));
+            b = vpadalq_u16(b, vreinterpretq_u16_u8(vld1q_u8(p + 16)));
+            a = vpadalq_u16(a, vreinterpretq_u16_u8(vld1q_u8(p + 32)));
+            b = vpadalq_u16(b, vreinterpretq_u16_u8(vld1q_u8(p + 48)));
+        }
+
+        uint64x2_t acc = vaddq_u64(vpaddlq_u32(a), vpaddlq_u32(b));
+        sum += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+    }
+
+    return lwip_chksum_fold(lwip_chksum_tail(p, len, sum));
+}
+
+static u16_t lwip_chksum_copy_neon(void * dst, const void * src, u16_t len) {
+    const u8_t * s = (const u8_t *)src;
+    u8_t * d = (u8_t *)dst;
+    uint32x4_t a = vdupq_n_u32(0);
+    uint32x4_t b = vdupq_n_u32(0);
+    int left = len;
+
+    for(; left >= 64; left -= 64, s += 64, d += 64) {
+        uint8x16_t v0 = vld1q_u8(s + 0);
+        uint8x16_t v1 = vld1q_u8(s + 16);
+        uint8x16_t v2 = vld1q_u8(s + 32);
+        uint8x16_t v3 = vld1q_u8(s + 48);
+
+        vst1q_u8(d + 0, v0);
+        vst1q_u8(d + 16, v1);
+        vst1q_u8(d + 32, v2);
+        vst1q_u8(d + 48, v3);
+
+        a = vpadalq_u16(a, vreinterpretq_u16_u8(v0));
+        b = vpadalq_u16(b, vreinterpretq_u16_u8(v1));
+        a = vpadalq_u16(a, vreinterpretq_u16_u8(v2));
+        b = vpadalq_u16(b, vreinterpretq_u16_u8(v3));
+    }
+
+    uint64x2_t acc = vaddq_u64(vpaddlq_u32(a), vpaddlq_u32(b));
+
+    memcpy(d, s, (size_t)left);
+    return lwip_chksum_fold(lwip_chksum_tail(d, left, vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1)));
+}
+
+#endif /*LWIP_CHKSUM_NEON*/
+
+struct lwip_chksum_kernel_def {
+    struct lwip_chksum_kernel kernel;
+    int (*supported)(void);
+};
+
+static const struct lwip_chksum_kernel_def s_lwip_chksum_kernels[] = {
+    { { "scalar", lwip_standard_chksum, lwip_chksum_copy_scalar }, NULL },
+#if LWIP_CHKSUM_X86
+    { { "sse2", lwip_chksum_sse2, lwip_chksum_copy_sse2 }, lwip_chksum_has_sse2 },
+    { { "avx2", lwip_chksum_avx2, lwip_chksum_copy_avx2 }, lwip_chksum_has_avx2 },
+#endif
+#if LWIP_CHKSUM_NEON
+    { { "neon", lwip_chksum_neon, lwip_chksum_copy_neon }, NULL },
+#endif
+};
+
+#define LWIP_CHKSUM_KERNEL_DEF_COUNT (sizeof(s_lwip_chksum_kernels) / sizeof(s_lwip_chksum_kernels[0]))
+
+u8_t lwip_chksum_kernel_count(void) {
+    u8_t count = 0;
+    u8_t i;
+
+    for(i = 0; i < LWIP_CHKSUM_KERNEL_DEF_COUNT; ++i) {
+        if (s_lwip_chksum_kernels[i].supported == NULL || s_lwip_chksum_kernels[i].supported()) count++;
+    }
+
+    return count;
+}
+
+const struct lwip_chksum_kernel * lwip_chksum_kernel_at(u8_t pos) {
+    u8_t i;
+
+    for(i = 0; i < LWIP_CHKSUM_KERNEL_DEF_COUNT; ++i) {
+        if (s_lwip_chksum_kernels[i].supported && !s_lwip_chksum_kernels[i].supported()) continue;
+        if (pos-- == 0) return &s_lwip_chksum_kernels[i].kernel;
+    }
+
+    return NULL;
+}
+
+const struct lwip_chksum_kernel * lwip_chksum_kernel_selected(void) {
+    return lwip_chksum_kernel_at((u8_t)(lwip_chksum_kernel_count() - 1));
+}
+
+/*
+ * every shard thread may race on the first call, they all store the same pointer.
+ */
+static u16_t lwip_chksum_resolve(const void * dataptr, int len);
+static lwip_chksum_fn s_lwip_chksum = lwip_chksum_resolve;
+
+static u16_t lwip_chksum_resolve(const void * dataptr, int len) {
+    s_lwip_chksum = lwip_chksum_kernel_selected()->chksum;
+    return s_lwip_chksum(dataptr, len);
+}
+
+u16_t lwip_chksum(const void * dataptr, int len) {
+    return s_lwip_chksum(dataptr, len);
+}
+
+static u16_t lwip_chksum_copy_resolve(void * dst, const void * src, u16_t len);
+static lwip_chksum_copy_fn s_lwip_chksum_copy = lwip_chksum_copy_resolve;
+
+static u16_t lwip_chksum_copy_resolve(void * dst, const void * src, u16_t len) {
+    s_lwip_chksum_copy = lwip_chksum_kernel_selected()->chksum_copy;
+    return s_lwip_chksum_copy(dst, src, len);
+}
+
+u16_t lwip_chksum_memcpy(void * dst, const void * src, u16_t len) {
+    return s_lwip_chksum_copy(dst, src, len);
+}
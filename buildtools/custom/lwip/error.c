@@ -1,7 +1,7 @@
 #include "cpe/utils/error.h"
 #include "arch/cc.h"
 
-error_monitor_t g_lwip_em = NULL;
+LWIP_TLS error_monitor_t g_lwip_em = NULL;
 
 void lwip_em_info_printf(const char * fmt, ...) {
     va_list args;
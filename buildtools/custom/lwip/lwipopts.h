@@ -61,16 +61,63 @@
 
 #define MEMP_NUM_TCP_PCB_LISTEN 16
 #define MEMP_NUM_TCP_PCB 1024
+/*with that many pcbs tcp_input looks them up by hash instead of walking the lists*/
+#define LWIP_TCP_PCB_HASH 1
+#define TCP_PCB_HASH_SIZE 1024
+/*and the tcp timers only visit the pcbs that have something due*/
+#define LWIP_TCP_TIMER_WHEEL 1
+
 #define TCP_MSS 1460
-#define TCP_SND_BUF 16384
+/*scaled windows, TCP_WND / TCP_SND_BUF are only the ceilings of the per pcb limits the driver sets*/
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 7
+#define LWIP_TCP_BUF_LIMITS 1
+#define TCP_WND (4 * 1024 * 1024)
+#define TCP_SND_BUF (4 * 1024 * 1024)
 #define TCP_SND_QUEUELEN (4 * (TCP_SND_BUF)/(TCP_MSS))
+/*compared against tcp_sndbuf(), which stays 16 bit*/
+#define TCP_SNDLOWAT (32 * 1024)
+
+/*lossy mobile links: sack both ways, out of order data capped per pcb and over all pcbs*/
+#define LWIP_TCP_SACK_OUT 1
+#define LWIP_TCP_SACK_IN 1
+/*a pcb holds out of order data up to its receive window, held in at most four pbufs per mss of window*/
+#define TCP_OOSEQ_BYTES_LIMIT(pcb) TCP_WND_LIMIT(pcb)
+#define TCP_OOSEQ_PBUFS_LIMIT(pcb) ((u16_t)LWIP_MIN(0xFFFF, TCP_WND_LIMIT(pcb) / (TCP_MSS / 4)))
+#define TCP_OOSEQ_GLOBAL_MAX_BYTES (32 * 1024 * 1024)
+#define TCP_OOSEQ_MERGE 1
+/*congestion control per pcb, set per driver or endpoint (net_tun_driver_set_tcp_cc)*/
+#define LWIP_TCP_CC 1
+/*one ack per pcb for a whole tun read burst, the driver opens the batch*/
+#define LWIP_TCP_ACK_BATCH 1
+/*established bulk flows skip the state machine per segment*/
+#define LWIP_TCP_HDR_PREDICT 1
+
+/*tun devices with virtio-net header segment and checksum for us*/
+#define LWIP_TCP_TSO 1
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+
+/*software checksums go through the simd kernels in chksum.c, algorithm 2 stays the fallback*/
+#define LWIP_CHKSUM lwip_chksum
+#define LWIP_CHKSUM_ALGORITHM 2
+/*tcp_write checksums the bytes while copying them, tcp_output only sums the headers*/
+#define LWIP_CHECKSUM_ON_COPY 1
+#define LWIP_CHKSUM_COPY(dst, src, len) lwip_chksum_memcpy(dst, src, len)
+
+/*zero copy input hands device frame buffers to lwip as custom pbufs*/
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
 
 #define MEM_LIBC_MALLOC 1
 #define MEMP_MEM_MALLOC 1
+/*pools and heap blocks come from per-size slabs on the driver's allocator*/
+#define MEMP_MEM_SLAB 1
 
 #define LWIP_DONT_PROVIDE_BYTEORDER_FUNCTIONS 1
 #define SYS_LIGHTWEIGHT_PROT 0
 
+/*lwip state is thread local (LWIP_TLS), the shared stats block is not*/
+#define LWIP_STATS 0
+
 /* #define LWIP_DEBUG 1 */
 /* #define TCP_OUTPUT_DEBUG LWIP_DBG_ON */
 /* #define TCP_RST_DEBUG LWIP_DBG_ON */
@@ -166,6 +166,9 @@ PACK_STRUCT_END
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && !TCP_QUEUE_OOSEQ)
 #error "To use LWIP_TCP_SACK_OUT, TCP_QUEUE_OOSEQ needs to be enabled"
 #endif
+#if (LWIP_TCP && LWIP_TCP_SACK_IN && !LWIP_TCP_SACK_OUT)
+#error "To use LWIP_TCP_SACK_IN, LWIP_TCP_SACK_OUT needs to be enabled"
+#endif
 #if (LWIP_TCP && LWIP_TCP_SACK_OUT && (LWIP_TCP_MAX_SACK_NUM < 1))
 #error "LWIP_TCP_MAX_SACK_NUM must be greater than 0"
 #endif
@@ -289,6 +292,12 @@ PACK_STRUCT_END
 #error "LWIP_HOOK_MEMP_AVAILABLE doesn't make sense with MEMP_MEM_MALLOC"
 #endif
 #endif /* MEMP_MEM_MALLOC */
+#if MEMP_MEM_SLAB && (!MEMP_MEM_MALLOC || !MEM_LIBC_MALLOC)
+#error "MEMP_MEM_SLAB needs MEMP_MEM_MALLOC and MEM_LIBC_MALLOC"
+#endif
+#if MEMP_MEM_SLAB && MEMP_OVERFLOW_CHECK
+#error "MEMP_OVERFLOW_CHECK doesn't work with MEMP_MEM_SLAB"
+#endif
 
 /* TCP sanity checks */
 #if !LWIP_DISABLE_TCP_SANITY_CHECKS
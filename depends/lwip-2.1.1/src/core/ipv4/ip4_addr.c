@@ -266,7 +266,7 @@ ip4addr_aton(const char *cp, ip4_addr_t *addr)
 char *
 ip4addr_ntoa(const ip4_addr_t *addr)
 {
-  static char str[IP4ADDR_STRLEN_MAX];
+  static LWIP_TLS char str[IP4ADDR_STRLEN_MAX];
   return ip4addr_ntoa_r(addr, str, IP4ADDR_STRLEN_MAX);
 }
 
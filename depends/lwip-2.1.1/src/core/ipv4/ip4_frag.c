@@ -111,8 +111,8 @@ PACK_STRUCT_END
    IPH_ID(iphdrA) == IPH_ID(iphdrB)) ? 1 : 0
 
 /* global variables */
-static struct ip_reassdata *reassdatagrams;
-static u16_t ip_reass_pbufcount;
+static LWIP_TLS struct ip_reassdata *reassdatagrams;
+static LWIP_TLS u16_t ip_reass_pbufcount;
 
 /* function prototypes */
 static void ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
@@ -151,6 +151,15 @@ ip_reass_tmr(void)
   }
 }
 
+/**
+ * Tells if ip_reass_tmr() has datagrams to age, it does nothing otherwise.
+ */
+u8_t
+ip_reass_pending(void)
+{
+  return reassdatagrams != NULL;
+}
+
 /**
  * Free a datagram (struct ip_reassdata) and all its pbufs.
  * Updates the total count of enqueued pbufs (ip_reass_pbufcount),
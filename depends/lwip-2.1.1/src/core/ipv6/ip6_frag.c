@@ -100,8 +100,8 @@ PACK_STRUCT_END
 #endif
 
 /* static variables */
-static struct ip6_reassdata *reassdatagrams;
-static u16_t ip6_reass_pbufcount;
+static LWIP_TLS struct ip6_reassdata *reassdatagrams;
+static LWIP_TLS u16_t ip6_reass_pbufcount;
 
 /* Forward declarations. */
 static void ip6_reass_free_complete_datagram(struct ip6_reassdata *ipr);
@@ -137,6 +137,15 @@ ip6_reass_tmr(void)
    }
 }
 
+/**
+ * Tells if ip6_reass_tmr() has datagrams to age, it does nothing otherwise.
+ */
+u8_t
+ip6_reass_pending(void)
+{
+  return reassdatagrams != NULL;
+}
+
 /**
  * Free a datagram (struct ip6_reassdata) and all its pbufs.
  * Updates the total count of enqueued pbufs (ip6_reass_pbufcount),
@@ -728,7 +737,7 @@ ip6_frag(struct pbuf *p, struct netif *netif, const ip6_addr_t *dest)
   u16_t newpbuflen = 0;
   u16_t left_to_copy;
 #endif
-  static u32_t identification;
+  static LWIP_TLS u32_t identification;
   u16_t left, cop;
   const u16_t mtu = nd6_get_destination_mtu(dest, netif);
   const u16_t nfb = (u16_t)((mtu - (IP6_HLEN + IP6_FRAG_HLEN)) & IP6_FRAG_OFFSET_MASK);
@@ -74,23 +74,23 @@
 #endif
 
 /* Router tables. */
-struct nd6_neighbor_cache_entry neighbor_cache[LWIP_ND6_NUM_NEIGHBORS];
-struct nd6_destination_cache_entry destination_cache[LWIP_ND6_NUM_DESTINATIONS];
-struct nd6_prefix_list_entry prefix_list[LWIP_ND6_NUM_PREFIXES];
-struct nd6_router_list_entry default_router_list[LWIP_ND6_NUM_ROUTERS];
+LWIP_TLS struct nd6_neighbor_cache_entry neighbor_cache[LWIP_ND6_NUM_NEIGHBORS];
+LWIP_TLS struct nd6_destination_cache_entry destination_cache[LWIP_ND6_NUM_DESTINATIONS];
+LWIP_TLS struct nd6_prefix_list_entry prefix_list[LWIP_ND6_NUM_PREFIXES];
+LWIP_TLS struct nd6_router_list_entry default_router_list[LWIP_ND6_NUM_ROUTERS];
 
 /* Default values, can be updated by a RA message. */
-u32_t reachable_time = LWIP_ND6_REACHABLE_TIME;
-u32_t retrans_timer = LWIP_ND6_RETRANS_TIMER; /* @todo implement this value in timer */
+LWIP_TLS u32_t reachable_time = LWIP_ND6_REACHABLE_TIME;
+LWIP_TLS u32_t retrans_timer = LWIP_ND6_RETRANS_TIMER; /* @todo implement this value in timer */
 
 /* Index for cache entries. */
-static u8_t nd6_cached_neighbor_index;
-static netif_addr_idx_t nd6_cached_destination_index;
+static LWIP_TLS u8_t nd6_cached_neighbor_index;
+static LWIP_TLS netif_addr_idx_t nd6_cached_destination_index;
 
 /* Multicast address holder. */
-static ip6_addr_t multicast_address;
+static LWIP_TLS ip6_addr_t multicast_address;
 
-static u8_t nd6_tmr_rs_reduction;
+static LWIP_TLS u8_t nd6_tmr_rs_reduction;
 
 /* Static buffer to parse RA packet options */
 union ra_options {
@@ -101,7 +101,7 @@ union ra_options {
   struct rdnss_option   rdnss;
 #endif
 };
-static union ra_options nd6_ra_buffer;
+static LWIP_TLS union ra_options nd6_ra_buffer;
 
 /* Forward declarations. */
 static s8_t nd6_find_neighbor_cache_entry(const ip6_addr_t *ip6addr);
@@ -1159,6 +1159,60 @@ nd6_tmr(void)
 
 }
 
+/**
+ * Tells if nd6_tmr() has something to send or to expire: neighbors being
+ * resolved or probed, tentative or expiring addresses, router solicitations.
+ * Everything else it does is aging state nobody waits on, which may be
+ * caught up on by calling it later.
+ */
+u8_t
+nd6_tmr_pending(void)
+{
+  s8_t i;
+  struct netif *netif;
+
+  for (i = 0; i < LWIP_ND6_NUM_NEIGHBORS; i++) {
+    switch (neighbor_cache[i].state) {
+    case ND6_INCOMPLETE:
+    case ND6_DELAY:
+    case ND6_PROBE:
+      return 1;
+    case ND6_REACHABLE:
+      if (neighbor_cache[i].q != NULL) {
+        return 1;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  NETIF_FOREACH(netif) {
+    for (i = 0; i < LWIP_IPV6_NUM_ADDRESSES; ++i) {
+      u8_t addr_state = netif_ip6_addr_state(netif, i);
+      if (ip6_addr_istentative(addr_state)) {
+        return 1;
+      }
+#if LWIP_IPV6_ADDRESS_LIFETIMES
+      if (!ip6_addr_isinvalid(addr_state) &&
+          !netif_ip6_addr_isstatic(netif, i)) {
+        return 1;
+      }
+#endif /* LWIP_IPV6_ADDRESS_LIFETIMES */
+    }
+#if LWIP_IPV6_SEND_ROUTER_SOLICIT
+    if ((netif->rs_count > 0) && netif_is_up(netif) &&
+        netif_is_link_up(netif) &&
+        !ip6_addr_isinvalid(netif_ip6_addr_state(netif, 0)) &&
+        !ip6_addr_isduplicated(netif_ip6_addr_state(netif, 0))) {
+      return 1;
+    }
+#endif /* LWIP_IPV6_SEND_ROUTER_SOLICIT */
+  }
+
+  return 0;
+}
+
 /** Send a neighbor solicitation message for a specific neighbor cache entry
  *
  * @param entry the neightbor cache entry for wich to send the message
@@ -1671,7 +1725,7 @@ nd6_select_router(const ip6_addr_t *ip6addr, struct netif *netif)
 {
   struct netif *router_netif;
   s8_t i, j, valid_router;
-  static s8_t last_router;
+  static LWIP_TLS s8_t last_router;
 
   LWIP_UNUSED_ARG(ip6addr); /* @todo match preferred routes!! (must implement ND6_OPTION_TYPE_ROUTE_INFO) */
 
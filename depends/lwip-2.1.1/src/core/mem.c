@@ -179,6 +179,13 @@ mem_trim(void *mem, mem_size_t size)
 /* in case C library malloc() needs extra protection,
  * allow these defines to be overridden.
  */
+#if MEMP_MEM_SLAB
+/* heap blocks come from the size class slabs in memp.c */
+#include "lwip/memp.h"
+#define mem_clib_free memp_slab_heap_free
+#define mem_clib_malloc memp_slab_heap_malloc
+#define mem_clib_calloc memp_slab_heap_calloc
+#endif /* MEMP_MEM_SLAB */
 #ifndef mem_clib_free
 #define mem_clib_free free
 #endif
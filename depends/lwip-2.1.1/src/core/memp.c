@@ -50,6 +50,9 @@
 #include "lwip/stats.h"
 
 #include <string.h>
+#if MEMP_MEM_SLAB
+#include <stdlib.h> /* for malloc()/free() */
+#endif
 
 /* Make sure we include everything we need for size calculation required by memp_std.h */
 #include "lwip/pbuf.h"
@@ -87,6 +90,297 @@ const struct memp_desc *const memp_pools[MEMP_MAX] = {
 #include LWIP_HOOK_FILENAME
 #endif
 
+#if MEMP_MEM_SLAB
+/* elements hold pointers and 64 bit counters, MEM_ALIGNMENT may be less */
+#define MEMP_SLAB_ALIGN_SIZE(x) (((x) + 2 * sizeof(void *) - 1) & ~(2 * sizeof(void *) - 1))
+
+struct memp_slab_elem {
+  struct memp_slab_elem *next;
+};
+
+struct memp_slab_chunk {
+  struct memp_slab_chunk *next;
+};
+
+struct memp_slab {
+  struct memp_slab_elem *free;
+  struct memp_slab_chunk *chunks;
+  u32_t size;
+  u32_t used;
+  u32_t max;
+  u32_t avail;
+  u32_t chunk_count;
+};
+
+/* what pbuf_alloc(PBUF_TRANSPORT, TCP_MSS, PBUF_RAM) asks the heap for */
+#define MEMP_SLAB_HEAP_SEGMENT (LWIP_MEM_ALIGN_SIZE(LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)) + \
+                                 PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN) + \
+                                LWIP_MEM_ALIGN_SIZE(TCP_MSS))
+
+/* heap size classes, the last one fits a full sized tcp segment */
+static const u32_t memp_slab_heap_sizes[] = {
+  64, 128, 256, 512, 1024, MEMP_SLAB_HEAP_SEGMENT
+};
+#define MEMP_SLAB_HEAP_CLASSES LWIP_ARRAYSIZE(memp_slab_heap_sizes)
+/* heap blocks carry their size class in front */
+#define MEMP_SLAB_HEAP_HDR MEMP_SLAB_ALIGN_SIZE(sizeof(u32_t))
+
+static const char *const memp_slab_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+
+/* the pools by memp_t, then the heap classes */
+static LWIP_TLS struct memp_slab memp_slabs[MEMP_MAX + MEMP_SLAB_HEAP_CLASSES];
+static LWIP_TLS memp_slab_alloc_fn memp_slab_alloc_hook;
+static LWIP_TLS memp_slab_free_fn memp_slab_free_hook;
+static LWIP_TLS void *memp_slab_hook_ctx;
+
+static void *
+memp_slab_chunk_alloc(size_t size)
+{
+  if (memp_slab_alloc_hook != NULL) {
+    return memp_slab_alloc_hook(memp_slab_hook_ctx, size);
+  }
+  return malloc(size);
+}
+
+static void
+memp_slab_chunk_free(void *mem)
+{
+  if (memp_slab_free_hook != NULL) {
+    memp_slab_free_hook(memp_slab_hook_ctx, mem);
+  } else {
+    free(mem);
+  }
+}
+
+static void
+memp_slab_init(void)
+{
+  u16_t i;
+
+  memset(memp_slabs, 0, sizeof(memp_slabs));
+  for (i = 0; i < MEMP_MAX; i++) {
+    memp_slabs[i].size = MEMP_SLAB_ALIGN_SIZE(memp_pools[i]->size);
+  }
+  for (i = 0; i < MEMP_SLAB_HEAP_CLASSES; i++) {
+    memp_slabs[MEMP_MAX + i].size = MEMP_SLAB_ALIGN_SIZE(MEMP_SLAB_HEAP_HDR + memp_slab_heap_sizes[i]);
+  }
+}
+
+/** Takes one more chunk from the allocator and puts its elements on the free list */
+static err_t
+memp_slab_grow(struct memp_slab *slab)
+{
+  const u32_t hdr = MEMP_SLAB_ALIGN_SIZE(sizeof(struct memp_slab_chunk));
+  struct memp_slab_chunk *chunk;
+  struct memp_slab_elem *elem;
+  u32_t num = 1;
+  u32_t i;
+
+  if (MEMP_SLAB_CHUNK_SIZE > hdr + slab->size) {
+    num = (MEMP_SLAB_CHUNK_SIZE - hdr) / slab->size;
+  }
+
+  chunk = (struct memp_slab_chunk *)memp_slab_chunk_alloc(hdr + num * slab->size);
+  if (chunk == NULL) {
+    return ERR_MEM;
+  }
+  chunk->next = slab->chunks;
+  slab->chunks = chunk;
+  slab->chunk_count++;
+
+  /* pushed back to front, so elements are handed out in address order */
+  for (i = num; i > 0; i--) {
+    elem = (struct memp_slab_elem *)(void *)((u8_t *)chunk + hdr + (i - 1) * slab->size);
+    elem->next = slab->free;
+    slab->free = elem;
+  }
+  slab->avail += num;
+
+  return ERR_OK;
+}
+
+static void *
+memp_slab_alloc(struct memp_slab *slab)
+{
+  struct memp_slab_elem *elem;
+
+  if ((slab->free == NULL) && (memp_slab_grow(slab) != ERR_OK)) {
+    return NULL;
+  }
+
+  elem = slab->free;
+  slab->free = elem->next;
+  slab->avail--;
+  if (++slab->used > slab->max) {
+    slab->max = slab->used;
+  }
+  return elem;
+}
+
+static void
+memp_slab_free(struct memp_slab *slab, void *mem)
+{
+  struct memp_slab_elem *elem = (struct memp_slab_elem *)mem;
+
+  LWIP_ASSERT("memp_slab_free: slab not in use", slab->used > 0);
+  elem->next = slab->free;
+  slab->free = elem;
+  slab->avail++;
+  slab->used--;
+}
+
+static err_t
+memp_slab_reserve(struct memp_slab *slab, u32_t num)
+{
+  while (slab->avail < num) {
+    if (memp_slab_grow(slab) != ERR_OK) {
+      return ERR_MEM;
+    }
+  }
+  return ERR_OK;
+}
+
+static u16_t
+memp_slab_heap_class(size_t size)
+{
+  u16_t i;
+
+  for (i = 0; i < MEMP_SLAB_HEAP_CLASSES; i++) {
+    if (size <= memp_slab_heap_sizes[i]) {
+      break;
+    }
+  }
+  return i;
+}
+
+/**
+ * Sets the allocator the slabs take their chunks from, to be called before
+ * lwip_init(). lwip_init() starts from empty slabs: a previous instance must
+ * free its pcbs and timeouts and give its chunks back with memp_slab_trim()
+ * first, chunks still in use then are lost to it.
+ */
+void
+memp_slab_set_allocator(memp_slab_alloc_fn alloc_fn, memp_slab_free_fn free_fn, void *ctx)
+{
+  memp_slab_alloc_hook = alloc_fn;
+  memp_slab_free_hook = free_fn;
+  memp_slab_hook_ctx = ctx;
+}
+
+/** Makes sure num elements of a pool are free without going to the allocator */
+err_t
+memp_slab_prewarm(memp_t type, u32_t num)
+{
+  LWIP_ERROR("memp_slab_prewarm: type < MEMP_MAX", (type < MEMP_MAX), return ERR_ARG;);
+  return memp_slab_reserve(&memp_slabs[type], num);
+}
+
+/** Makes sure num heap blocks of the given size are free */
+err_t
+memp_slab_heap_prewarm(size_t size, u32_t num)
+{
+  u16_t i = memp_slab_heap_class(size);
+  LWIP_ERROR("memp_slab_heap_prewarm: size too big for the heap classes", (i < MEMP_SLAB_HEAP_CLASSES), return ERR_ARG;);
+  return memp_slab_reserve(&memp_slabs[MEMP_MAX + i], num);
+}
+
+/** Gives the chunks of slabs with no element in use back to the allocator */
+void
+memp_slab_trim(void)
+{
+  struct memp_slab *slab;
+  struct memp_slab_chunk *chunk;
+  u16_t i;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(memp_slabs); i++) {
+    slab = &memp_slabs[i];
+    if (slab->used > 0) {
+      continue;
+    }
+    while ((chunk = slab->chunks) != NULL) {
+      slab->chunks = chunk->next;
+      memp_slab_chunk_free(chunk);
+    }
+    slab->free = NULL;
+    slab->avail = 0;
+    slab->chunk_count = 0;
+  }
+}
+
+/** Number of slabs, for memp_slab_get_stats() */
+u16_t
+memp_slab_count(void)
+{
+  return (u16_t)LWIP_ARRAYSIZE(memp_slabs);
+}
+
+void
+memp_slab_get_stats(u16_t idx, struct memp_slab_stats *stats)
+{
+  const struct memp_slab *slab;
+
+  LWIP_ASSERT("memp_slab_get_stats: idx < memp_slab_count()", idx < LWIP_ARRAYSIZE(memp_slabs));
+  slab = &memp_slabs[idx];
+
+  if (idx < MEMP_MAX) {
+    stats->name = memp_slab_names[idx];
+    stats->size = memp_pools[idx]->size;
+  } else {
+    stats->name = "HEAP";
+    stats->size = memp_slab_heap_sizes[idx - MEMP_MAX];
+  }
+  stats->used = slab->used;
+  stats->max = slab->max;
+  stats->avail = slab->avail;
+  stats->chunks = slab->chunk_count;
+}
+
+void *
+memp_slab_heap_malloc(size_t size)
+{
+  u16_t i = memp_slab_heap_class(size);
+  u32_t *hdr;
+
+  if (i < MEMP_SLAB_HEAP_CLASSES) {
+    hdr = (u32_t *)memp_slab_alloc(&memp_slabs[MEMP_MAX + i]);
+  } else {
+    /* larger than any class, straight from the allocator */
+    hdr = (u32_t *)memp_slab_chunk_alloc(MEMP_SLAB_HEAP_HDR + size);
+  }
+  if (hdr == NULL) {
+    return NULL;
+  }
+
+  *hdr = i;
+  return (u8_t *)hdr + MEMP_SLAB_HEAP_HDR;
+}
+
+void *
+memp_slab_heap_calloc(size_t count, size_t size)
+{
+  void *mem = memp_slab_heap_malloc(count * size);
+  if (mem != NULL) {
+    memset(mem, 0, count * size);
+  }
+  return mem;
+}
+
+void
+memp_slab_heap_free(void *mem)
+{
+  u32_t *hdr = (u32_t *)(void *)((u8_t *)mem - MEMP_SLAB_HEAP_HDR);
+
+  if (*hdr < MEMP_SLAB_HEAP_CLASSES) {
+    memp_slab_free(&memp_slabs[MEMP_MAX + *hdr], hdr);
+  } else {
+    memp_slab_chunk_free(hdr);
+  }
+}
+#endif /* MEMP_MEM_SLAB */
+
 #if MEMP_MEM_MALLOC && MEMP_OVERFLOW_CHECK >= 2
 #undef MEMP_OVERFLOW_CHECK
 /* MEMP_OVERFLOW_CHECK >= 2 does not work with MEMP_MEM_MALLOC, use 1 instead */
@@ -234,6 +528,10 @@ memp_init(void)
 #endif
   }
 
+#if MEMP_MEM_SLAB
+  memp_slab_init();
+#endif /* MEMP_MEM_SLAB */
+
 #if MEMP_OVERFLOW_CHECK >= 2
   /* check everything a first time to see if it worked */
   memp_overflow_check_all();
@@ -346,7 +644,12 @@ memp_malloc_fn(memp_t type, const char *file, const int line)
   memp_overflow_check_all();
 #endif /* MEMP_OVERFLOW_CHECK >= 2 */
 
-#if !MEMP_OVERFLOW_CHECK
+#if MEMP_MEM_SLAB
+  memp = memp_slab_alloc(&memp_slabs[type]);
+  if (memp == NULL) {
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in slab %s\n", memp_slab_names[type]));
+  }
+#elif !MEMP_OVERFLOW_CHECK
   memp = do_memp_malloc_pool(memp_pools[type]);
 #else
   memp = do_memp_malloc_pool_fn(memp_pools[type], file, line);
@@ -437,7 +740,11 @@ memp_free(memp_t type, void *mem)
   old_first = *memp_pools[type]->tab;
 #endif
 
+#if MEMP_MEM_SLAB
+  memp_slab_free(&memp_slabs[type], mem);
+#else /* MEMP_MEM_SLAB */
   do_memp_free_pool(memp_pools[type], mem);
+#endif /* MEMP_MEM_SLAB */
 
 #ifdef LWIP_HOOK_MEMP_AVAILABLE
   if (old_first == NULL) {
@@ -156,10 +156,10 @@ static const char *const tcp_state_str[] = {
 };
 
 /* last local TCP port */
-static u16_t tcp_port = TCP_LOCAL_PORT_RANGE_START;
+static LWIP_TLS u16_t tcp_port = TCP_LOCAL_PORT_RANGE_START;
 
 /* Incremented every coarse grained timer shot (typically every 500 ms). */
-u32_t tcp_ticks;
+LWIP_TLS u32_t tcp_ticks;
 static const u8_t tcp_backoff[13] =
 { 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7};
 /* Times per slowtmr hits */
@@ -168,28 +168,77 @@ static const u8_t tcp_persist_backoff[7] = { 3, 6, 12, 24, 48, 96, 120 };
 /* The TCP PCB lists. */
 
 /** List of all TCP PCBs bound but not yet (connected || listening) */
-struct tcp_pcb *tcp_bound_pcbs;
+LWIP_TLS struct tcp_pcb *tcp_bound_pcbs;
 /** List of all TCP PCBs in LISTEN state */
-union tcp_listen_pcbs_t tcp_listen_pcbs;
+LWIP_TLS union tcp_listen_pcbs_t tcp_listen_pcbs;
 /** List of all TCP PCBs that are in a state in which
  * they accept or send data. */
-struct tcp_pcb *tcp_active_pcbs;
+LWIP_TLS struct tcp_pcb *tcp_active_pcbs;
 /** List of all TCP PCBs in TIME-WAIT state */
-struct tcp_pcb *tcp_tw_pcbs;
+LWIP_TLS struct tcp_pcb *tcp_tw_pcbs;
 
-/** An array with all (non-temporary) PCB lists, mainly used for smaller code size */
-struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs,
-         &tcp_active_pcbs, &tcp_tw_pcbs
-};
+/** An array with all (non-temporary) PCB lists, mainly used for smaller code size.
+ * Filled in tcp_init(): with LWIP_TLS the list heads have no link-time address. */
+LWIP_TLS struct tcp_pcb **tcp_pcb_lists[NUM_TCP_PCB_LISTS];
+
+LWIP_TLS u8_t tcp_active_pcbs_changed;
 
-u8_t tcp_active_pcbs_changed;
+#if TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES
+/** Bytes on the ooseq queues of all pcbs, checked against TCP_OOSEQ_GLOBAL_MAX_BYTES */
+LWIP_TLS u32_t tcp_ooseq_bytes;
+#endif /* TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES */
+
+#if LWIP_TCP_ACK_BATCH
+/** Nesting of tcp_batch_begin(), ACKs are held back while > 0 */
+LWIP_TLS u8_t tcp_batch_depth;
+/** pcbs with TF_ACK_BATCHED set, linked through batch_next */
+LWIP_TLS struct tcp_pcb *tcp_batch_pcbs;
+#endif /* LWIP_TCP_ACK_BATCH */
+
+#if LWIP_TCP_PCB_HASH
+#if (TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) != 0
+#error "TCP_PCB_HASH_SIZE must be a power of 2"
+#endif
+/** Buckets of the 4-tuple hash over tcp_active_pcbs and tcp_tw_pcbs */
+static LWIP_TLS struct tcp_pcb *tcp_pcb_hash_table[TCP_PCB_HASH_SIZE];
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_TIMER_WHEEL
+/* where the wheel link of a pcb is */
+#define TCP_WHEEL_NONE    0 /* not on tcp_active_pcbs / tcp_tw_pcbs */
+#define TCP_WHEEL_IDLE    1 /* no deadline, not linked */
+#define TCP_WHEEL_SLOT    2 /* in the wheel slot of wheel_due */
+#define TCP_WHEEL_DIRTY   3 /* on tcp_wheel_dirty */
+
+#define TCP_WHEEL_L0_BITS 8
+#define TCP_WHEEL_L1_BITS 6
+#define TCP_WHEEL_L0_SIZE (1L << TCP_WHEEL_L0_BITS)
+#define TCP_WHEEL_L1_SIZE (1L << TCP_WHEEL_L1_BITS)
+/* deadlines further away are cut to this and recomputed when reached */
+#define TCP_WHEEL_SPAN    (TCP_WHEEL_L0_SIZE * TCP_WHEEL_L1_SIZE)
+#define TCP_WHEEL_NEVER   0x7FFFFFFFL
+
+/** Slow timer wheel: a slot per tick on level 0, a slot per TCP_WHEEL_L0_SIZE
+ * ticks on level 1 which is cascaded down to level 0 as it comes due */
+static LWIP_TLS struct tcp_pcb *tcp_wheel_l0[TCP_WHEEL_L0_SIZE];
+static LWIP_TLS struct tcp_pcb *tcp_wheel_l1[TCP_WHEEL_L1_SIZE];
+/** pcbs whose deadline has to be recomputed before the next timer run */
+static LWIP_TLS struct tcp_pcb *tcp_wheel_dirty;
+/** pcbs with a delayed ACK, a pending FIN or refused data */
+static LWIP_TLS struct tcp_pcb *tcp_fast_pcbs;
+/** set while tcp_slowtmr() runs the pcbs due this tick */
+static LWIP_TLS u8_t tcp_wheel_expiring;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
-static u8_t tcp_timer;
-static u8_t tcp_timer_ctr;
+static LWIP_TLS u8_t tcp_timer;
+static LWIP_TLS u8_t tcp_timer_ctr;
 static u16_t tcp_new_port(void);
 
 static err_t tcp_close_shutdown_fin(struct tcp_pcb *pcb);
+#if LWIP_TCP_TIMER_WHEEL
+static void tcp_timer_flush(void);
+#endif /* LWIP_TCP_TIMER_WHEEL */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 static void tcp_ext_arg_invoke_callbacks_destroyed(struct tcp_pcb_ext_args *ext_args);
 #endif
@@ -200,6 +249,11 @@ static void tcp_ext_arg_invoke_callbacks_destroyed(struct tcp_pcb_ext_args *ext_
 void
 tcp_init(void)
 {
+  tcp_pcb_lists[0] = &tcp_listen_pcbs.pcbs;
+  tcp_pcb_lists[1] = &tcp_bound_pcbs;
+  tcp_pcb_lists[2] = &tcp_active_pcbs;
+  tcp_pcb_lists[3] = &tcp_tw_pcbs;
+
 #ifdef LWIP_RAND
   tcp_port = TCP_ENSURE_LOCAL_PORT_RANGE(LWIP_RAND());
 #endif /* LWIP_RAND */
@@ -213,6 +267,15 @@ tcp_free(struct tcp_pcb *pcb)
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
   tcp_ext_arg_invoke_callbacks_destroyed(pcb->ext_args);
 #endif
+#if LWIP_TCP_ACK_BATCH
+  if (pcb->flags & TF_ACK_BATCHED) {
+    struct tcp_pcb **link = &tcp_batch_pcbs;
+    while (*link != pcb) {
+      link = &(*link)->batch_next;
+    }
+    *link = pcb->batch_next;
+  }
+#endif /* LWIP_TCP_ACK_BATCH */
   memp_free(MEMP_TCP_PCB, pcb);
 }
 
@@ -243,6 +306,55 @@ tcp_tmr(void)
   }
 }
 
+/**
+ * Tells how many tcp_tmr() calls from now the first one with work is, so a
+ * driver may skip calling it until then (the skipped calls still have to be
+ * made, e.g. when input arrives, to keep tcp_ticks exact). 0 if there is no
+ * pending timer at all.
+ */
+u32_t
+tcp_tmr_next(void)
+{
+#if LWIP_TCP_TIMER_WHEEL
+  struct tcp_pcb *pcb;
+  u32_t due = 0;
+  u32_t i;
+
+  tcp_timer_flush();
+  if (tcp_fast_pcbs != NULL) {
+    return 1;
+  }
+
+  /* level 0 holds the next TCP_WHEEL_L0_SIZE - 1 ticks, one tick per slot */
+  for (i = 1; i < TCP_WHEEL_L0_SIZE; i++) {
+    if (tcp_wheel_l0[(tcp_ticks + i) & (TCP_WHEEL_L0_SIZE - 1)] != NULL) {
+      due = i;
+      break;
+    }
+  }
+  /* level 1 blocks are only cascaded at their start, they may be due earlier */
+  for (i = 1; i <= TCP_WHEEL_L1_SIZE; i++) {
+    pcb = tcp_wheel_l1[((tcp_ticks >> TCP_WHEEL_L0_BITS) + i) & (TCP_WHEEL_L1_SIZE - 1)];
+    if (pcb != NULL) {
+      for (; pcb != NULL; pcb = pcb->wheel_next) {
+        if ((due == 0) || ((s32_t)(pcb->wheel_due - tcp_ticks) < (s32_t)due)) {
+          due = pcb->wheel_due - tcp_ticks;
+        }
+      }
+      break;
+    }
+  }
+  if (due == 0) {
+    return 0;
+  }
+
+  /* tcp_slowtmr() runs on every other call */
+  return ((tcp_timer & 1) ? 2 : 1) + 2 * (due - 1);
+#else /* LWIP_TCP_TIMER_WHEEL */
+  return ((tcp_active_pcbs != NULL) || (tcp_tw_pcbs != NULL)) ? 1 : 0;
+#endif /* LWIP_TCP_TIMER_WHEEL */
+}
+
 #if LWIP_CALLBACK_API || TCP_LISTEN_BACKLOG
 /** Called when a listen pcb is closed. Iterates one pcb list and removes the
  * closed listener pcb from pcb->listener if matching.
@@ -410,6 +522,7 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
 {
   err_t err;
   LWIP_ASSERT("pcb != NULL", pcb != NULL);
+  TCP_TIMER_TOUCH(pcb);
 
   switch (pcb->state) {
     case SYN_RCVD:
@@ -524,6 +637,8 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
   if (shut_rx) {
     /* shut down the receive side: set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    /* a FIN-WAIT-2 pcb starts timing out now */
+    TCP_TIMER_TOUCH(pcb);
     if (shut_tx) {
       /* shutting down the tx AND rx side is the same as closing for the raw API */
       return tcp_close_shutdown(pcb, 1);
@@ -608,9 +723,7 @@ tcp_abandon(struct tcp_pcb *pcb, int reset)
       tcp_segs_free(pcb->unsent);
     }
 #if TCP_QUEUE_OOSEQ
-    if (pcb->ooseq != NULL) {
-      tcp_segs_free(pcb->ooseq);
-    }
+    tcp_free_ooseq(pcb);
 #endif /* TCP_QUEUE_OOSEQ */
     tcp_backlog_accepted(pcb);
     if (send_rst) {
@@ -1012,6 +1125,118 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
                           len, pcb->rcv_wnd, (u16_t)(TCP_WND_MAX(pcb) - pcb->rcv_wnd)));
 }
 
+#if LWIP_TCP_ACK_BATCH
+/**
+ * @ingroup tcp_raw
+ * Start holding back pure ACKs and window updates, e.g. around one burst of
+ * packets read from a netif. Calls nest, the outermost tcp_batch_end() sends.
+ */
+void
+tcp_batch_begin(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ASSERT("tcp_batch_begin: nested too deep", tcp_batch_depth < 0xFF);
+  tcp_batch_depth++;
+}
+
+/**
+ * @ingroup tcp_raw
+ * End a batch started with tcp_batch_begin(): every pcb that held back an
+ * ACK sends one now, carrying the latest rcv_nxt and window.
+ */
+void
+tcp_batch_end(void)
+{
+  struct tcp_pcb *pcb;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ASSERT("tcp_batch_end: not in a batch", tcp_batch_depth > 0);
+  if (--tcp_batch_depth > 0) {
+    return;
+  }
+
+  while (tcp_batch_pcbs != NULL) {
+    pcb = tcp_batch_pcbs;
+    tcp_batch_pcbs = pcb->batch_next;
+    pcb->batch_next = NULL;
+    tcp_clear_flags(pcb, TF_ACK_BATCHED);
+
+    /* data sent since then may have carried the ACK already */
+    if (pcb->flags & TF_ACK_NOW) {
+      tcp_output(pcb);
+    }
+  }
+}
+#endif /* LWIP_TCP_ACK_BATCH */
+
+#if LWIP_TCP_BUF_LIMITS
+/**
+ * @ingroup tcp_raw
+ * Limit the bytes tcp_write may queue on a pcb (sent but unacked included).
+ * Shrinking below what is queued only blocks tcp_write until enough is acked.
+ *
+ * @param pcb the tcp_pcb to limit
+ * @param max the new limit, clamped to [2 * TCP_MSS, TCP_SND_BUF]
+ */
+void
+tcp_set_sndbuf_max(struct tcp_pcb *pcb, tcpwnd_size_t max)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_sndbuf_max: invalid pcb", pcb != NULL, return);
+
+  /* snd_buf keeps counting down from TCP_SND_BUF, tcp_sndbuf() holds back the rest */
+  pcb->snd_buf_max = (tcpwnd_size_t)LWIP_MIN(LWIP_MAX(max, 2 * TCP_MSS), TCP_SND_BUF);
+}
+
+/**
+ * @ingroup tcp_raw
+ * Change the receive window a pcb opens up to. Growing it advertises the
+ * extra space right away, shrinking it never moves the announced right edge
+ * back: the window closes as data arrives and reopens only to the new size.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param max the new window, clamped to [2 * TCP_MSS, TCP_WND]
+ */
+void
+tcp_set_rcv_wnd_max(struct tcp_pcb *pcb, tcpwnd_size_t max)
+{
+  tcpwnd_size_t old_max;
+  tcpwnd_size_t new_max;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_rcv_wnd_max: invalid pcb", pcb != NULL, return);
+
+  /* pcb->state LISTEN not allowed here */
+  LWIP_ASSERT("don't call tcp_set_rcv_wnd_max for listen-pcbs",
+              pcb->state != LISTEN);
+
+  old_max = TCP_WND_MAX(pcb);
+  pcb->rcv_wnd_max = (tcpwnd_size_t)LWIP_MIN(LWIP_MAX(max, 2 * TCP_MSS), TCP_WND);
+  new_max = TCP_WND_MAX(pcb);
+
+  if (new_max >= old_max) {
+    pcb->rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd + (new_max - old_max));
+  } else if (pcb->rcv_wnd > old_max - new_max) {
+    pcb->rcv_wnd = (tcpwnd_size_t)(pcb->rcv_wnd - (old_max - new_max));
+  } else {
+    /* more than the new window is waiting for tcp_recved, which clamps */
+    pcb->rcv_wnd = 0;
+  }
+
+  if (pcb->state < SYN_RCVD) {
+    /* nothing received yet, the SYN carries the (unscaled) window */
+    pcb->rcv_ann_wnd = pcb->rcv_wnd;
+  } else if (tcp_update_rcv_ann_wnd(pcb) >= TCP_WND_UPDATE_THRESHOLD) {
+    tcp_ack_now(pcb);
+    tcp_output(pcb);
+  }
+}
+#endif /* LWIP_TCP_BUF_LIMITS */
+
 /**
  * Allocate a new local TCP port.
  *
@@ -1159,7 +1384,7 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   pcb->snd_lbb = iss - 1;
   /* Start with a window that does not need scaling. When window scaling is
      enabled and used, the window is enlarged when both sides agree on scaling. */
-  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
+  pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND_LIMIT(pcb));
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -1191,6 +1416,505 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+/**
+ * One slow timer step of an active pcb: runs its retransmission, persist and
+ * keepalive timers and checks the timeouts of its state.
+ *
+ * @param pcb the active pcb
+ * @param pcb_reset incremented if a RST should be sent when removing the pcb
+ * @return != 0 if the pcb should be removed
+ */
+static u8_t
+tcp_slowtmr_active(struct tcp_pcb *pcb, u8_t *pcb_reset)
+{
+#if !LWIP_TCP_CC
+  tcpwnd_size_t eff_wnd;
+#endif /* !LWIP_TCP_CC */
+  u8_t pcb_remove = 0;
+  err_t err;
+
+  if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
+  } else if (pcb->nrtx >= TCP_MAXRTX) {
+    ++pcb_remove;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
+  } else {
+    if (pcb->persist_backoff > 0) {
+      LWIP_ASSERT("tcp_slowtimr: persist ticking with in-flight data", pcb->unacked == NULL);
+      LWIP_ASSERT("tcp_slowtimr: persist ticking with empty send buffer", pcb->unsent != NULL);
+      if (pcb->persist_probe >= TCP_MAXRTX) {
+        ++pcb_remove; /* max probes reached */
+      } else {
+        u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+        if (pcb->persist_cnt < backoff_cnt) {
+          pcb->persist_cnt++;
+        }
+        if (pcb->persist_cnt >= backoff_cnt) {
+          int next_slot = 1; /* increment timer to next slot */
+          /* If snd_wnd is zero, send 1 byte probes */
+          if (pcb->snd_wnd == 0) {
+            if (tcp_zero_window_probe(pcb) != ERR_OK) {
+              next_slot = 0; /* try probe again with current slot */
+            }
+            /* snd_wnd not fully closed, split unsent head and fill window */
+          } else {
+            if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
+              if (tcp_output(pcb) == ERR_OK) {
+                /* sending will cancel persist timer, else retry with current slot */
+                next_slot = 0;
+              }
+            }
+          }
+          if (next_slot) {
+            pcb->persist_cnt = 0;
+            if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
+              pcb->persist_backoff++;
+            }
+          }
+        }
+      }
+    } else {
+      /* Increase the retransmission timer if it is running */
+      if ((pcb->rtime >= 0) && (pcb->rtime < 0x7FFF)) {
+        ++pcb->rtime;
+      }
+
+      if (pcb->rtime >= pcb->rto) {
+        /* Time for a retransmission. */
+        LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
+                                    " pcb->rto %"S16_F"\n",
+                                    pcb->rtime, pcb->rto));
+        /* If prepare phase fails but we have unsent data but no unacked data,
+           still execute the backoff calculations below, as this means we somehow
+           failed to send segment. */
+        if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
+          /* Double retransmission time-out unless we are trying to
+           * connect to somebody (i.e., we are in SYN_SENT). */
+          if (pcb->state != SYN_SENT) {
+            u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
+            int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
+            pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
+          }
+
+          /* Reset the retransmission timer. */
+          pcb->rtime = 0;
+
+          /* Reduce congestion window and ssthresh. */
+#if LWIP_TCP_CC
+          pcb->cc->loss(pcb, 1);
+#else /* LWIP_TCP_CC */
+          eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+          pcb->ssthresh = eff_wnd >> 1;
+          if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+            pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+          }
+          pcb->cwnd = pcb->mss;
+#endif /* LWIP_TCP_CC */
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                       " ssthresh %"TCPWNDSIZE_F"\n",
+                                       pcb->cwnd, pcb->ssthresh));
+          pcb->bytes_acked = 0;
+
+          /* The following needs to be called AFTER cwnd is set to one
+             mss - STJ */
+          tcp_rexmit_rto_commit(pcb);
+        }
+      }
+    }
+  }
+  /* Check if this PCB has stayed too long in FIN-WAIT-2 */
+  if (pcb->state == FIN_WAIT_2) {
+    /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
+    if (pcb->flags & TF_RXCLOSED) {
+      /* PCB was fully closed (either through close() or SHUT_RDWR):
+         normal FIN-WAIT timeout handling. */
+      if ((u32_t)(tcp_ticks - pcb->tmr) >
+          TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
+        ++pcb_remove;
+        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
+      }
+    }
+  }
+
+  /* Check if KEEPALIVE should be sent */
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) ||
+       (pcb->state == CLOSE_WAIT))) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
+      ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
+      LWIP_DEBUGF(TCP_DEBUG, ("\n"));
+
+      ++pcb_remove;
+      ++*pcb_reset;
+    } else if ((u32_t)(tcp_ticks - pcb->tmr) >
+               (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+               / TCP_SLOW_INTERVAL) {
+      err = tcp_keepalive(pcb);
+      if (err == ERR_OK) {
+        pcb->keep_cnt_sent++;
+      }
+    }
+  }
+
+  /* If this PCB has queued out of sequence data, but has been
+     inactive for too long, will drop the data (it will eventually
+     be retransmitted). */
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL &&
+      (tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
+    tcp_free_ooseq(pcb);
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  /* Check if this PCB has stayed too long in SYN-RCVD */
+  if (pcb->state == SYN_RCVD) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) >
+        TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
+    }
+  }
+
+  /* Check if this PCB has stayed too long in LAST-ACK */
+  if (pcb->state == LAST_ACK) {
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      ++pcb_remove;
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
+    }
+  }
+
+  return pcb_remove;
+}
+
+#if LWIP_TCP_TIMER_WHEEL
+static void
+tcp_wheel_link(struct tcp_pcb **head, struct tcp_pcb *pcb)
+{
+  pcb->wheel_next = *head;
+  if (*head != NULL) {
+    (*head)->wheel_pprev = &pcb->wheel_next;
+  }
+  pcb->wheel_pprev = head;
+  *head = pcb;
+}
+
+static void
+tcp_wheel_unlink(struct tcp_pcb *pcb)
+{
+  if (pcb->wheel_pprev != NULL) {
+    *pcb->wheel_pprev = pcb->wheel_next;
+    if (pcb->wheel_next != NULL) {
+      pcb->wheel_next->wheel_pprev = pcb->wheel_pprev;
+    }
+    pcb->wheel_next = NULL;
+    pcb->wheel_pprev = NULL;
+  }
+}
+
+static void
+tcp_fast_link(struct tcp_pcb **head, struct tcp_pcb *pcb)
+{
+  pcb->fast_next = *head;
+  if (*head != NULL) {
+    (*head)->fast_pprev = &pcb->fast_next;
+  }
+  pcb->fast_pprev = head;
+  *head = pcb;
+}
+
+static void
+tcp_fast_unlink(struct tcp_pcb *pcb)
+{
+  if (pcb->fast_pprev != NULL) {
+    *pcb->fast_pprev = pcb->fast_next;
+    if (pcb->fast_next != NULL) {
+      pcb->fast_next->fast_pprev = pcb->fast_pprev;
+    }
+    pcb->fast_next = NULL;
+    pcb->fast_pprev = NULL;
+  }
+}
+
+/**
+ * Brings rtime, persist_cnt and polltmr forward to tick 'now' as if
+ * tcp_slowtmr() had visited the pcb on every tick since wheel_base. The wheel
+ * never skips a tick on which the pcb's timers do more than count.
+ */
+static void
+tcp_timer_sync(struct tcp_pcb *pcb, u32_t now)
+{
+  u32_t ticks = now - pcb->wheel_base;
+
+  if ((s32_t)ticks <= 0) {
+    return;
+  }
+  pcb->wheel_base = now;
+
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+    if (pcb->persist_cnt < backoff_cnt) {
+      pcb->persist_cnt = (u8_t)LWIP_MIN(pcb->persist_cnt + ticks, backoff_cnt);
+    }
+  } else if (pcb->rtime >= 0) {
+    pcb->rtime = (s16_t)LWIP_MIN((u32_t)pcb->rtime + ticks, 0x7FFF);
+  }
+
+  if (pcb->pollinterval == 0) {
+    pcb->polltmr = 0;
+  } else {
+    u32_t polltmr = pcb->polltmr;
+    if (polltmr >= pcb->pollinterval) {
+      /* the interval was shortened, the first tick resets it */
+      polltmr = 0;
+      ticks--;
+    }
+    pcb->polltmr = (u8_t)((polltmr + ticks) % pcb->pollinterval);
+  }
+}
+
+/**
+ * Number of ticks from now until tcp_slowtmr() has more to do for an up to
+ * date pcb than counting, TCP_WHEEL_NEVER if nothing is pending.
+ * Mirrors the checks of tcp_slowtmr_active().
+ */
+static s32_t
+tcp_timer_next(struct tcp_pcb *pcb)
+{
+  s32_t next = TCP_WHEEL_NEVER;
+
+  if (pcb->state == TIME_WAIT) {
+    return (s32_t)(pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1 - tcp_ticks);
+  }
+
+  if ((pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) || (pcb->nrtx >= TCP_MAXRTX)) {
+    return 1;
+  }
+  if (pcb->persist_backoff > 0) {
+    if (pcb->persist_probe >= TCP_MAXRTX) {
+      return 1;
+    }
+    next = tcp_persist_backoff[pcb->persist_backoff - 1] - pcb->persist_cnt;
+  } else if (pcb->rtime >= 0) {
+    next = pcb->rto - pcb->rtime;
+  }
+
+  if ((pcb->state == FIN_WAIT_2) && (pcb->flags & TF_RXCLOSED)) {
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL + 1 - tcp_ticks));
+  }
+
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) ||
+       (pcb->state == CLOSE_WAIT))) {
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL + 1 - tcp_ticks));
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+                                  / TCP_SLOW_INTERVAL + 1 - tcp_ticks));
+  }
+
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL) {
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT - tcp_ticks));
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  if (pcb->state == SYN_RCVD) {
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL + 1 - tcp_ticks));
+  }
+
+  if (pcb->state == LAST_ACK) {
+    next = LWIP_MIN(next, (s32_t)(pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1 - tcp_ticks));
+  }
+
+  /* polling only matters if it calls back or has something to send */
+#if LWIP_CALLBACK_API
+  if ((pcb->poll != NULL) || (pcb->unsent != NULL) || (pcb->flags & TF_ACK_NOW))
+#endif /* LWIP_CALLBACK_API */
+  {
+    if (pcb->polltmr + 1 >= pcb->pollinterval) {
+      next = 1;
+    } else {
+      next = LWIP_MIN(next, (s32_t)(pcb->pollinterval - pcb->polltmr));
+    }
+  }
+
+  return next;
+}
+
+/** Puts a pcb off the wheel back on it according to its current timers */
+static void
+tcp_timer_schedule(struct tcp_pcb *pcb)
+{
+  s32_t next;
+
+  tcp_timer_sync(pcb, tcp_ticks);
+  next = tcp_timer_next(pcb);
+  if (next == TCP_WHEEL_NEVER) {
+    pcb->wheel_where = TCP_WHEEL_IDLE;
+  } else {
+    if (next < 1) {
+      next = 1;
+    } else if (next >= TCP_WHEEL_SPAN) {
+      next = TCP_WHEEL_SPAN - 1;
+    }
+    pcb->wheel_due = tcp_ticks + (u32_t)next;
+    pcb->wheel_where = TCP_WHEEL_SLOT;
+    if (next < TCP_WHEEL_L0_SIZE) {
+      tcp_wheel_link(&tcp_wheel_l0[pcb->wheel_due & (TCP_WHEEL_L0_SIZE - 1)], pcb);
+    } else {
+      tcp_wheel_link(&tcp_wheel_l1[(pcb->wheel_due >> TCP_WHEEL_L0_BITS) & (TCP_WHEEL_L1_SIZE - 1)], pcb);
+    }
+  }
+
+  if ((pcb->fast_pprev == NULL) &&
+      ((pcb->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) || (pcb->refused_data != NULL))) {
+    tcp_fast_link(&tcp_fast_pcbs, pcb);
+  }
+}
+
+/** Reschedules the pcbs touched since the last timer run */
+static void
+tcp_timer_flush(void)
+{
+  struct tcp_pcb *pcb;
+
+  while ((pcb = tcp_wheel_dirty) != NULL) {
+    tcp_wheel_unlink(pcb);
+    tcp_timer_schedule(pcb);
+  }
+}
+
+/** Starts tracking the timers of a pcb put on tcp_active_pcbs or tcp_tw_pcbs */
+void
+tcp_timer_track(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("tcp_timer_track: already tracked", pcb->wheel_where == TCP_WHEEL_NONE);
+  pcb->wheel_where = TCP_WHEEL_DIRTY;
+  tcp_wheel_link(&tcp_wheel_dirty, pcb);
+}
+
+/** Stops tracking the timers of a pcb taken off tcp_active_pcbs or tcp_tw_pcbs */
+void
+tcp_timer_untrack(struct tcp_pcb *pcb)
+{
+  tcp_wheel_unlink(pcb);
+  tcp_fast_unlink(pcb);
+  pcb->wheel_where = TCP_WHEEL_NONE;
+}
+
+/**
+ * Called before the timers or the state of a pcb are changed outside of the
+ * timer functions: brings its counters up to date and queues it to have its
+ * deadline recomputed before the next timer run.
+ */
+void
+tcp_timer_touch(struct tcp_pcb *pcb)
+{
+  /* while the due pcbs run, this tick is counted by their timer */
+  tcp_timer_sync(pcb, tcp_ticks - tcp_wheel_expiring);
+  if ((pcb->wheel_where == TCP_WHEEL_SLOT) && tcp_wheel_expiring && (pcb->wheel_due == tcp_ticks)) {
+    /* still to run this tick, which queues it anyway */
+    return;
+  }
+  if ((pcb->wheel_where == TCP_WHEEL_IDLE) || (pcb->wheel_where == TCP_WHEEL_SLOT)) {
+    tcp_wheel_unlink(pcb);
+    pcb->wheel_where = TCP_WHEEL_DIRTY;
+    tcp_wheel_link(&tcp_wheel_dirty, pcb);
+  }
+}
+
+/** tcp_slowtmr() for one active or TIME-WAIT pcb that is due */
+static void
+tcp_timer_run(struct tcp_pcb *pcb)
+{
+  u8_t pcb_reset = 0;
+  err_t err;
+
+  /* tcp_slowtmr_active() counts this tick itself */
+  tcp_timer_sync(pcb, tcp_ticks - 1);
+  pcb->wheel_base = tcp_ticks;
+  pcb->last_timer = tcp_timer_ctr;
+
+  if (pcb->state == TIME_WAIT) {
+    /* Check if this PCB has stayed long enough in TIME-WAIT */
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      tcp_pcb_purge(pcb);
+      TCP_RMV(&tcp_tw_pcbs, pcb);
+      tcp_free(pcb);
+    }
+    return;
+  }
+
+  LWIP_ASSERT("tcp_timer_run: active pcb->state != CLOSED\n", pcb->state != CLOSED);
+  LWIP_ASSERT("tcp_timer_run: active pcb->state != LISTEN\n", pcb->state != LISTEN);
+
+  if (tcp_slowtmr_active(pcb, &pcb_reset)) {
+#if LWIP_CALLBACK_API
+    tcp_err_fn err_fn = pcb->errf;
+#endif /* LWIP_CALLBACK_API */
+    void *err_arg;
+    enum tcp_state last_state;
+    tcp_pcb_purge(pcb);
+    TCP_RMV_ACTIVE(pcb);
+
+    if (pcb_reset) {
+      tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
+              pcb->local_port, pcb->remote_port);
+    }
+
+    err_arg = pcb->callback_arg;
+    last_state = pcb->state;
+    tcp_free(pcb);
+
+    TCP_EVENT_ERR(last_state, err_fn, err_arg, ERR_ABRT);
+    return;
+  }
+
+  /* We check if we should poll the connection. */
+  ++pcb->polltmr;
+  if (pcb->polltmr >= pcb->pollinterval) {
+    pcb->polltmr = 0;
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
+    TCP_EVENT_POLL(pcb, err);
+    /* if err == ERR_ABRT, 'pcb' is already deallocated */
+    if (err == ERR_OK) {
+      tcp_output(pcb);
+    }
+  }
+}
+
+/** Runs the pcbs due at tcp_ticks */
+static void
+tcp_timer_expire(void)
+{
+  struct tcp_pcb **slot;
+  struct tcp_pcb *pcb;
+
+  if ((tcp_ticks & (TCP_WHEEL_L0_SIZE - 1)) == 0) {
+    /* the next TCP_WHEEL_L0_SIZE ticks move down from level 1 */
+    slot = &tcp_wheel_l1[(tcp_ticks >> TCP_WHEEL_L0_BITS) & (TCP_WHEEL_L1_SIZE - 1)];
+    while ((pcb = *slot) != NULL) {
+      tcp_wheel_unlink(pcb);
+      tcp_wheel_link(&tcp_wheel_l0[pcb->wheel_due & (TCP_WHEEL_L0_SIZE - 1)], pcb);
+    }
+  }
+
+  tcp_wheel_expiring = 1;
+  slot = &tcp_wheel_l0[tcp_ticks & (TCP_WHEEL_L0_SIZE - 1)];
+  while ((pcb = *slot) != NULL) {
+    LWIP_ASSERT("tcp_timer_expire: pcb due now", pcb->wheel_due == tcp_ticks);
+    /* rescheduled by the next tcp_timer_flush(), also if its timer does nothing */
+    tcp_wheel_unlink(pcb);
+    pcb->wheel_where = TCP_WHEEL_DIRTY;
+    tcp_wheel_link(&tcp_wheel_dirty, pcb);
+    tcp_timer_run(pcb);
+  }
+  tcp_wheel_expiring = 0;
+}
+#endif /* LWIP_TCP_TIMER_WHEEL */
+
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -1201,8 +1925,15 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
 void
 tcp_slowtmr(void)
 {
+#if LWIP_TCP_TIMER_WHEEL
+  tcp_timer_flush();
+
+  ++tcp_ticks;
+  ++tcp_timer_ctr;
+
+  tcp_timer_expire();
+#else /* LWIP_TCP_TIMER_WHEEL */
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1232,158 +1963,8 @@ tcp_slowtmr_start:
     }
     pcb->last_timer = tcp_timer_ctr;
 
-    pcb_remove = 0;
     pcb_reset = 0;
-
-    if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max SYN retries reached\n"));
-    } else if (pcb->nrtx >= TCP_MAXRTX) {
-      ++pcb_remove;
-      LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: max DATA retries reached\n"));
-    } else {
-      if (pcb->persist_backoff > 0) {
-        LWIP_ASSERT("tcp_slowtimr: persist ticking with in-flight data", pcb->unacked == NULL);
-        LWIP_ASSERT("tcp_slowtimr: persist ticking with empty send buffer", pcb->unsent != NULL);
-        if (pcb->persist_probe >= TCP_MAXRTX) {
-          ++pcb_remove; /* max probes reached */
-        } else {
-          u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
-          if (pcb->persist_cnt < backoff_cnt) {
-            pcb->persist_cnt++;
-          }
-          if (pcb->persist_cnt >= backoff_cnt) {
-            int next_slot = 1; /* increment timer to next slot */
-            /* If snd_wnd is zero, send 1 byte probes */
-            if (pcb->snd_wnd == 0) {
-              if (tcp_zero_window_probe(pcb) != ERR_OK) {
-                next_slot = 0; /* try probe again with current slot */
-              }
-              /* snd_wnd not fully closed, split unsent head and fill window */
-            } else {
-              if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK) {
-                if (tcp_output(pcb) == ERR_OK) {
-                  /* sending will cancel persist timer, else retry with current slot */
-                  next_slot = 0;
-                }
-              }
-            }
-            if (next_slot) {
-              pcb->persist_cnt = 0;
-              if (pcb->persist_backoff < sizeof(tcp_persist_backoff)) {
-                pcb->persist_backoff++;
-              }
-            }
-          }
-        }
-      } else {
-        /* Increase the retransmission timer if it is running */
-        if ((pcb->rtime >= 0) && (pcb->rtime < 0x7FFF)) {
-          ++pcb->rtime;
-        }
-
-        if (pcb->rtime >= pcb->rto) {
-          /* Time for a retransmission. */
-          LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
-                                      " pcb->rto %"S16_F"\n",
-                                      pcb->rtime, pcb->rto));
-          /* If prepare phase fails but we have unsent data but no unacked data,
-             still execute the backoff calculations below, as this means we somehow
-             failed to send segment. */
-          if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
-            /* Double retransmission time-out unless we are trying to
-             * connect to somebody (i.e., we are in SYN_SENT). */
-            if (pcb->state != SYN_SENT) {
-              u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
-              int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
-              pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
-            }
-
-            /* Reset the retransmission timer. */
-            pcb->rtime = 0;
-
-            /* Reduce congestion window and ssthresh. */
-            eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
-            }
-            pcb->cwnd = pcb->mss;
-            LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                         " ssthresh %"TCPWNDSIZE_F"\n",
-                                         pcb->cwnd, pcb->ssthresh));
-            pcb->bytes_acked = 0;
-
-            /* The following needs to be called AFTER cwnd is set to one
-               mss - STJ */
-            tcp_rexmit_rto_commit(pcb);
-          }
-        }
-      }
-    }
-    /* Check if this PCB has stayed too long in FIN-WAIT-2 */
-    if (pcb->state == FIN_WAIT_2) {
-      /* If this PCB is in FIN_WAIT_2 because of SHUT_WR don't let it time out. */
-      if (pcb->flags & TF_RXCLOSED) {
-        /* PCB was fully closed (either through close() or SHUT_RDWR):
-           normal FIN-WAIT timeout handling. */
-        if ((u32_t)(tcp_ticks - pcb->tmr) >
-            TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
-          ++pcb_remove;
-          LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in FIN-WAIT-2\n"));
-        }
-      }
-    }
-
-    /* Check if KEEPALIVE should be sent */
-    if (ip_get_option(pcb, SOF_KEEPALIVE) &&
-        ((pcb->state == ESTABLISHED) ||
-         (pcb->state == CLOSE_WAIT))) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL) {
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: KEEPALIVE timeout. Aborting connection to "));
-        ip_addr_debug_print_val(TCP_DEBUG, pcb->remote_ip);
-        LWIP_DEBUGF(TCP_DEBUG, ("\n"));
-
-        ++pcb_remove;
-        ++pcb_reset;
-      } else if ((u32_t)(tcp_ticks - pcb->tmr) >
-                 (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
-                 / TCP_SLOW_INTERVAL) {
-        err = tcp_keepalive(pcb);
-        if (err == ERR_OK) {
-          pcb->keep_cnt_sent++;
-        }
-      }
-    }
-
-    /* If this PCB has queued out of sequence data, but has been
-       inactive for too long, will drop the data (it will eventually
-       be retransmitted). */
-#if TCP_QUEUE_OOSEQ
-    if (pcb->ooseq != NULL &&
-        (tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
-      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
-      tcp_free_ooseq(pcb);
-    }
-#endif /* TCP_QUEUE_OOSEQ */
-
-    /* Check if this PCB has stayed too long in SYN-RCVD */
-    if (pcb->state == SYN_RCVD) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) >
-          TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in SYN-RCVD\n"));
-      }
-    }
-
-    /* Check if this PCB has stayed too long in LAST-ACK */
-    if (pcb->state == LAST_ACK) {
-      if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
-        ++pcb_remove;
-        LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: removing pcb stuck in LAST-ACK\n"));
-      }
-    }
+    pcb_remove = tcp_slowtmr_active(pcb, &pcb_reset);
 
     /* If the PCB should be removed, do it. */
     if (pcb_remove) {
@@ -1395,6 +1976,9 @@ tcp_slowtmr_start:
       enum tcp_state last_state;
       tcp_pcb_purge(pcb);
       /* Remove PCB from tcp_active_pcbs list. */
+#if LWIP_TCP_PCB_HASH
+      tcp_pcb_hash_remove(pcb);
+#endif /* LWIP_TCP_PCB_HASH */
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_active_pcbs", pcb != tcp_active_pcbs);
         prev->next = pcb->next;
@@ -1461,6 +2045,9 @@ tcp_slowtmr_start:
       struct tcp_pcb *pcb2;
       tcp_pcb_purge(pcb);
       /* Remove PCB from tcp_tw_pcbs list. */
+#if LWIP_TCP_PCB_HASH
+      tcp_pcb_hash_remove(pcb);
+#endif /* LWIP_TCP_PCB_HASH */
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_tw_pcbs", pcb != tcp_tw_pcbs);
         prev->next = pcb->next;
@@ -1477,6 +2064,7 @@ tcp_slowtmr_start:
       pcb = pcb->next;
     }
   }
+#endif /* LWIP_TCP_TIMER_WHEEL */
 }
 
 /**
@@ -1488,6 +2076,45 @@ tcp_slowtmr_start:
 void
 tcp_fasttmr(void)
 {
+#if LWIP_TCP_TIMER_WHEEL
+  struct tcp_pcb *pcbs;
+  struct tcp_pcb *pcb;
+
+  ++tcp_timer_ctr;
+
+  tcp_timer_flush();
+
+  /* take the list over, pcbs that still have work are put back by the flush */
+  pcbs = tcp_fast_pcbs;
+  tcp_fast_pcbs = NULL;
+  if (pcbs != NULL) {
+    pcbs->fast_pprev = &pcbs;
+  }
+  while ((pcb = pcbs) != NULL) {
+    tcp_fast_unlink(pcb);
+    pcb->last_timer = tcp_timer_ctr;
+    tcp_timer_touch(pcb);
+    /* send delayed ACKs */
+    if (pcb->flags & TF_ACK_DELAY) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: delayed ACK\n"));
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+      tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    }
+    /* send pending FIN */
+    if (pcb->flags & TF_CLOSEPEND) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: pending FIN\n"));
+      tcp_clear_flags(pcb, TF_CLOSEPEND);
+      tcp_close_shutdown_fin(pcb);
+    }
+    /* If there is data which was previously "refused" by upper layer */
+    if (pcb->refused_data != NULL) {
+      tcp_process_refused_data(pcb);
+    }
+  }
+
+  tcp_timer_flush();
+#else /* LWIP_TCP_TIMER_WHEEL */
   struct tcp_pcb *pcb;
 
   ++tcp_timer_ctr;
@@ -1529,6 +2156,7 @@ tcp_fasttmr_start:
       pcb = pcb->next;
     }
   }
+#endif /* LWIP_TCP_TIMER_WHEEL */
 }
 
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
@@ -1553,6 +2181,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
 
   LWIP_ERROR("tcp_process_refused_data: invalid pcb", pcb != NULL, return ERR_ARG);
+  TCP_TIMER_TOUCH(pcb);
 
 #if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
   while (pcb->refused_data != NULL)
@@ -1900,6 +2529,10 @@ tcp_alloc(u8_t prio)
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = prio;
     pcb->snd_buf = TCP_SND_BUF;
+#if LWIP_TCP_BUF_LIMITS
+    pcb->snd_buf_max = TCP_SND_BUF;
+    pcb->rcv_wnd_max = TCP_WND;
+#endif /* LWIP_TCP_BUF_LIMITS */
     /* Start with a window that does not need scaling. When window scaling is
        enabled and used, the window is enlarged when both sides agree on scaling. */
     pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
@@ -1913,6 +2546,9 @@ tcp_alloc(u8_t prio)
     pcb->cwnd = 1;
     pcb->tmr = tcp_ticks;
     pcb->last_timer = tcp_timer_ctr;
+#if LWIP_TCP_TIMER_WHEEL
+    pcb->wheel_base = tcp_ticks;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
     /* RFC 5681 recommends setting ssthresh abritrarily high and gives an example
     of using the largest advertised receive window.  We've seen complications with
@@ -1921,6 +2557,9 @@ tcp_alloc(u8_t prio)
     connection is established. To avoid these complications, we set ssthresh to the
     largest effective cwnd (amount of in-flight data) that the sender can have. */
     pcb->ssthresh = TCP_SND_BUF;
+#if LWIP_TCP_CC
+    tcp_set_cc(pcb, &LWIP_TCP_CC_DEFAULT);
+#endif /* LWIP_TCP_CC */
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
@@ -2124,6 +2763,7 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
 #else /* LWIP_CALLBACK_API */
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
+  TCP_TIMER_TOUCH(pcb);
   pcb->pollinterval = interval;
 }
 
@@ -2216,6 +2856,102 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: tcp_pcbs_sane()", tcp_pcbs_sane());
 }
 
+#if LWIP_TCP_PCB_HASH
+static u32_t
+tcp_pcb_hash_addr(const ip_addr_t *addr)
+{
+#if LWIP_IPV6
+  if (IP_IS_V6(addr)) {
+    const ip6_addr_t *addr6 = ip_2_ip6(addr);
+    return addr6->addr[0] ^ addr6->addr[1] ^ addr6->addr[2] ^ addr6->addr[3];
+  }
+#endif /* LWIP_IPV6 */
+#if LWIP_IPV4
+  return ip4_addr_get_u32(ip_2_ip4(addr));
+#else
+  return 0;
+#endif /* LWIP_IPV4 */
+}
+
+static u32_t
+tcp_pcb_hash_bucket(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h = tcp_pcb_hash_addr(local_ip);
+  h ^= (tcp_pcb_hash_addr(remote_ip) << 16) | (tcp_pcb_hash_addr(remote_ip) >> 16);
+  h ^= ((u32_t)local_port << 16) | remote_port;
+  /* murmur3 finalizer, spreads the low bits taken by the mask */
+  h ^= h >> 16;
+  h *= 0x85ebca6bUL;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35UL;
+  h ^= h >> 16;
+  return h & (TCP_PCB_HASH_SIZE - 1);
+}
+
+/**
+ * Index a pcb that just joined tcp_active_pcbs or tcp_tw_pcbs.
+ * The 4-tuple must not change while the pcb is indexed.
+ */
+void
+tcp_pcb_hash_add(struct tcp_pcb *pcb)
+{
+  u32_t bucket = tcp_pcb_hash_bucket(&pcb->local_ip, pcb->local_port,
+                                     &pcb->remote_ip, pcb->remote_port);
+  pcb->hash_next = tcp_pcb_hash_table[bucket];
+  tcp_pcb_hash_table[bucket] = pcb;
+}
+
+/** Drop a pcb leaving tcp_active_pcbs or tcp_tw_pcbs from the index */
+void
+tcp_pcb_hash_remove(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **pp;
+  u32_t bucket = tcp_pcb_hash_bucket(&pcb->local_ip, pcb->local_port,
+                                     &pcb->remote_ip, pcb->remote_port);
+
+  for (pp = &tcp_pcb_hash_table[bucket]; *pp != NULL; pp = &(*pp)->hash_next) {
+    if (*pp == pcb) {
+      *pp = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+
+/**
+ * Find the active or TIME-WAIT pcb of a segment.
+ *
+ * @param netif_idx index of the input netif, pcbs bound to another netif are skipped
+ * @return the matching pcb or NULL
+ */
+struct tcp_pcb *
+tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                    const ip_addr_t *remote_ip, u16_t remote_port,
+                    u8_t netif_idx)
+{
+  struct tcp_pcb *pcb;
+  u32_t bucket = tcp_pcb_hash_bucket(local_ip, local_port, remote_ip, remote_port);
+
+  for (pcb = tcp_pcb_hash_table[bucket]; pcb != NULL; pcb = pcb->hash_next) {
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != CLOSED", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_pcb_hash_lookup: pcb->state != LISTEN", pcb->state != LISTEN);
+
+    if ((pcb->netif_idx != NETIF_NO_INDEX) && (pcb->netif_idx != netif_idx)) {
+      continue;
+    }
+
+    if (pcb->remote_port == remote_port &&
+        pcb->local_port == local_port &&
+        ip_addr_cmp(&pcb->remote_ip, remote_ip) &&
+        ip_addr_cmp(&pcb->local_ip, local_ip)) {
+      return pcb;
+    }
+  }
+  return NULL;
+}
+#endif /* LWIP_TCP_PCB_HASH */
+
 /**
  * Calculates a new initial sequence number for new connections.
  *
@@ -2228,7 +2964,7 @@ tcp_next_iss(struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_next_iss: invalid pcb", pcb != NULL);
   return LWIP_HOOK_TCP_ISN(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
 #else /* LWIP_HOOK_TCP_ISN */
-  static u32_t iss = 6510;
+  static LWIP_TLS u32_t iss = 6510;
 
   LWIP_ASSERT("tcp_next_iss: invalid pcb", pcb != NULL);
   LWIP_UNUSED_ARG(pcb);
@@ -2398,6 +3134,10 @@ tcp_free_ooseq(struct tcp_pcb *pcb)
   if (pcb->ooseq) {
     tcp_segs_free(pcb->ooseq);
     pcb->ooseq = NULL;
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+    tcp_ooseq_bytes -= pcb->ooseq_bytes;
+    pcb->ooseq_bytes = 0;
+#endif /* TCP_OOSEQ_GLOBAL_MAX_BYTES */
 #if LWIP_TCP_SACK_OUT
     memset(pcb->rcv_sacks, 0, sizeof(pcb->rcv_sacks));
 #endif /* LWIP_TCP_SACK_OUT */
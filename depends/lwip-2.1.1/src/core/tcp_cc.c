@@ -0,0 +1,666 @@
+/**
+ * @file
+ * Transmission Control Protocol, congestion control
+ *
+ * The algorithms tcp_in.c, tcp_out.c and tcp.c call through pcb->cc:
+ * - reno: what lwIP does without LWIP_TCP_CC (RFC 5681, RFC 3465)
+ * - cubic: RFC 8312, times from sys_now()
+ * - bbr: the BBR v1 state machine (STARTUP, DRAIN, PROBE_BW, PROBE_RTT)
+ *   driving cwnd only, lwIP does not pace. cwnd follows gain * max
+ *   delivery rate * min rtt and loss does not shrink it.
+ */
+
+/*
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+ * OF SUCH DAMAGE.
+ *
+ * This file is part of the lwIP TCP/IP stack.
+ *
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP && LWIP_TCP_CC /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include "lwip/debug.h"
+
+#include <string.h>
+
+#define TCP_CC_PRIV(pcb, type) ((type *)(void *)(pcb)->cc_priv)
+
+/* Rounds: a round starts at snd_nxt and ends once that byte is acked,
+   the shortest one is the rtt. The delivery rate is sampled over ACKs at
+   least an rtt apart, so bursts lwIP sends unpaced average out. */
+struct tcp_cc_round {
+  u32_t seq;
+  u32_t stamp;
+  u32_t rtt_min;       /* ms, 0 while unknown */
+  u32_t rtt_min_stamp;
+  u32_t rate_stamp;
+  u32_t rate_delivered;
+  u8_t started;
+};
+
+/* rtt_min is kept for this long unless a lower one shows up (RFC 8312 does
+   not say, BBR uses 10s) */
+#define TCP_CC_RTT_MIN_WIN 10000
+
+/* returns 1 when a round ended, *rate is bytes per second when sampled, else 0 */
+static u8_t
+tcp_cc_round_update(struct tcp_pcb *pcb, struct tcp_cc_round *r, u32_t now, u32_t *rate)
+{
+  u32_t elapsed;
+  u8_t ended = 0;
+
+  elapsed = now - r->stamp;
+  /* a round shorter than the clock is not an rtt */
+  if (r->started && TCP_SEQ_GT(pcb->lastack, r->seq) && elapsed > 0) {
+    if (r->rtt_min == 0 || elapsed <= r->rtt_min || (u32_t)(now - r->rtt_min_stamp) > TCP_CC_RTT_MIN_WIN) {
+      r->rtt_min = elapsed;
+      r->rtt_min_stamp = now;
+    }
+    r->started = 0;
+    ended = 1;
+  }
+
+  if (!r->started) {
+    if (r->rtt_min == 0) {
+      r->rate_stamp = now;
+      r->rate_delivered = pcb->cc_delivered;
+    }
+    r->seq = pcb->snd_nxt;
+    r->stamp = now;
+    r->started = 1;
+  }
+
+  *rate = 0;
+  elapsed = now - r->rate_stamp;
+  if (r->rtt_min != 0 && elapsed >= r->rtt_min) {
+    *rate = (u32_t)LWIP_MIN(0xFFFFFFFFUL, (u64_t)(u32_t)(pcb->cc_delivered - r->rate_delivered) * 1000 / elapsed);
+    r->rate_stamp = now;
+    r->rate_delivered = pcb->cc_delivered;
+  }
+
+  return ended;
+}
+
+/* RFC 3465 slow start, limited to 1 SMSS per ACK following an RTO */
+static void
+tcp_cc_slow_start(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  tcpwnd_size_t increase;
+  u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
+
+  increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
+  TCP_WND_INC(pcb->cwnd, increase);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+}
+
+/* ssthresh at least 2 MSS */
+static void
+tcp_cc_set_ssthresh(struct tcp_pcb *pcb, tcpwnd_size_t ssthresh)
+{
+  if (ssthresh < (tcpwnd_size_t)(2 * pcb->mss)) {
+    LWIP_DEBUGF(TCP_FR_DEBUG,
+                ("tcp_cc: The minimum value for ssthresh %"TCPWNDSIZE_F
+                 " should be min 2 mss %"U16_F"...\n",
+                 ssthresh, (u16_t)(2 * pcb->mss)));
+    ssthresh = (tcpwnd_size_t)(2 * pcb->mss);
+  }
+  pcb->ssthresh = ssthresh;
+}
+
+/* cwnd after a loss: one MSS after an RTO, ssthresh + 3 MSS in fast recovery */
+static void
+tcp_cc_loss_cwnd(struct tcp_pcb *pcb, u8_t rto)
+{
+  if (rto) {
+    pcb->cwnd = pcb->mss;
+  } else {
+    pcb->cwnd = pcb->ssthresh;
+    TCP_WND_INC(pcb->cwnd, 3 * pcb->mss);
+  }
+  pcb->bytes_acked = 0;
+}
+
+/* RFC 5681 inflation, each dupack past the third made room for a segment */
+static void
+tcp_cc_dupack_inflate(struct tcp_pcb *pcb)
+{
+  TCP_WND_INC(pcb->cwnd, pcb->mss);
+}
+
+static void
+tcp_cc_recovered_ssthresh(struct tcp_pcb *pcb)
+{
+  pcb->cwnd = pcb->ssthresh;
+  pcb->bytes_acked = 0;
+}
+
+/* Reno */
+
+static void
+tcp_cc_reno_init(struct tcp_pcb *pcb)
+{
+  LWIP_UNUSED_ARG(pcb);
+}
+
+static void
+tcp_cc_reno_acked(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  if (pcb->flags & TF_INFR) {
+    return;
+  }
+
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+  } else {
+    /* RFC 3465, section 2.1 Congestion Avoidance */
+    TCP_WND_INC(pcb->bytes_acked, acked);
+    if (pcb->bytes_acked >= pcb->cwnd) {
+      pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
+      TCP_WND_INC(pcb->cwnd, pcb->mss);
+    }
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+  }
+}
+
+static void
+tcp_cc_reno_loss(struct tcp_pcb *pcb, u8_t rto)
+{
+  /* half of the minimum of the current cwnd and the advertised window */
+  tcp_cc_set_ssthresh(pcb, (tcpwnd_size_t)(LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2));
+  tcp_cc_loss_cwnd(pcb, rto);
+}
+
+const struct tcp_cc_ops tcp_cc_reno = {
+  "reno",
+  tcp_cc_reno_init,
+  tcp_cc_reno_acked,
+  tcp_cc_dupack_inflate,
+  tcp_cc_reno_loss,
+  tcp_cc_recovered_ssthresh
+};
+
+/* CUBIC, RFC 8312 */
+
+/* beta_cubic 0.7, C 0.4 */
+#define TCP_CC_CUBIC_BETA_NUM   7
+#define TCP_CC_CUBIC_BETA_DEN   10
+/* K^3 = W_max * (1 - beta) / C in MSS and s, here in bytes and ms */
+#define TCP_CC_CUBIC_K3_SCALE   2500000000ULL
+/* cwnd grows at most by half of what an ACK acks, 1.5 * cwnd per rtt */
+#define TCP_CC_CUBIC_CNT_MIN(pcb) (2U * (pcb)->mss)
+/* |t - K| is clamped so (t - K)^3 * 4 * mss stays in a s64_t */
+#define TCP_CC_CUBIC_T_MAX      60000
+
+struct tcp_cc_cubic {
+  struct tcp_cc_round round;
+  u32_t w_max;
+  u32_t k;            /* ms */
+  u32_t origin;
+  u32_t epoch;
+  u32_t w_est;
+  u32_t est_acked;
+  u8_t epoch_started;
+};
+
+/* floor(cbrt(a)), Hacker's Delight icbrt */
+static u32_t
+tcp_cc_cbrt(u64_t a)
+{
+  u64_t y = 0;
+  int s;
+
+  for (s = 63; s >= 0; s -= 3) {
+    u64_t b;
+    y <<= 1;
+    b = 3 * y * (y + 1) + 1;
+    if ((a >> s) >= b) {
+      a -= b << s;
+      y++;
+    }
+  }
+  return (u32_t)y;
+}
+
+static void
+tcp_cc_cubic_init(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("tcp_cc_cubic: cc_priv too small",
+              sizeof(struct tcp_cc_cubic) <= sizeof(pcb->cc_priv));
+  LWIP_UNUSED_ARG(pcb);
+}
+
+/* bytes acked per MSS cwnd grows by (Linux' cnt, in bytes) */
+static u32_t
+tcp_cc_cubic_cnt(struct tcp_pcb *pcb, struct tcp_cc_cubic *cubic, u32_t now)
+{
+  u32_t cwnd = pcb->cwnd;
+  u32_t mss = pcb->mss;
+  s64_t t;
+  s64_t off;
+  s64_t target;
+  u64_t cnt;
+
+  if (!cubic->epoch_started) {
+    cubic->epoch_started = 1;
+    cubic->epoch = now;
+    if (cwnd < cubic->w_max) {
+      cubic->k = tcp_cc_cbrt((u64_t)(cubic->w_max - cwnd) * TCP_CC_CUBIC_K3_SCALE / mss);
+      cubic->origin = cubic->w_max;
+    } else {
+      cubic->k = 0;
+      cubic->origin = cwnd;
+    }
+    cubic->w_est = cwnd;
+    cubic->est_acked = 0;
+  }
+
+  /* W_cubic(t + rtt) */
+  t = (s64_t)(u32_t)(now - cubic->epoch) + cubic->round.rtt_min - cubic->k;
+  t = LWIP_MAX(LWIP_MIN(t, TCP_CC_CUBIC_T_MAX), -TCP_CC_CUBIC_T_MAX);
+  off = t * t * t * 4 * (s64_t)mss / 10000000000LL;
+  target = (s64_t)cubic->origin + off;
+
+  if (target > (s64_t)cwnd) {
+    cnt = (u64_t)cwnd * mss / (u64_t)(target - cwnd);
+  } else {
+    /* at or over the plateau: next to nothing */
+    cnt = (u64_t)100 * cwnd;
+  }
+
+  /* TCP friendly region: never slower than Reno would grow with beta 0.7 */
+  if (cubic->w_est > cwnd) {
+    u64_t est_cnt = (u64_t)cwnd * mss / (cubic->w_est - cwnd);
+    cnt = LWIP_MIN(cnt, est_cnt);
+  }
+
+  return (u32_t)LWIP_MAX(LWIP_MIN(cnt, 0xFFFFFFFFUL), TCP_CC_CUBIC_CNT_MIN(pcb));
+}
+
+static void
+tcp_cc_cubic_acked(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct tcp_cc_cubic *cubic = TCP_CC_PRIV(pcb, struct tcp_cc_cubic);
+  u32_t now = sys_now();
+  u32_t rate;
+  u32_t cnt;
+
+  tcp_cc_round_update(pcb, &cubic->round, now, &rate);
+
+  if (pcb->flags & TF_INFR) {
+    return;
+  }
+
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+    return;
+  }
+
+  cnt = tcp_cc_cubic_cnt(pcb, cubic, now);
+
+  /* W_est grows 3 * (1 - beta) / (1 + beta) = 9 / 17 MSS per cwnd acked */
+  cubic->est_acked += acked;
+  while ((u64_t)cubic->est_acked * 9 >= (u64_t)pcb->cwnd * 17) {
+    cubic->est_acked -= (u32_t)((u64_t)pcb->cwnd * 17 / 9);
+    cubic->w_est += pcb->mss;
+  }
+
+  TCP_WND_INC(pcb->bytes_acked, acked);
+  while (pcb->bytes_acked >= cnt) {
+    pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - cnt);
+    TCP_WND_INC(pcb->cwnd, pcb->mss);
+  }
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: cubic cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+}
+
+static void
+tcp_cc_cubic_loss(struct tcp_pcb *pcb, u8_t rto)
+{
+  struct tcp_cc_cubic *cubic = TCP_CC_PRIV(pcb, struct tcp_cc_cubic);
+  u32_t wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+
+  cubic->epoch_started = 0;
+  /* fast convergence: release bandwidth when W_max is shrinking */
+  if (wnd < cubic->w_max) {
+    cubic->w_max = (u32_t)((u64_t)wnd * (TCP_CC_CUBIC_BETA_DEN + TCP_CC_CUBIC_BETA_NUM) / (2 * TCP_CC_CUBIC_BETA_DEN));
+  } else {
+    cubic->w_max = wnd;
+  }
+  if (rto) {
+    cubic->round.started = 0;
+  }
+
+  tcp_cc_set_ssthresh(pcb, (tcpwnd_size_t)((u64_t)wnd * TCP_CC_CUBIC_BETA_NUM / TCP_CC_CUBIC_BETA_DEN));
+  tcp_cc_loss_cwnd(pcb, rto);
+}
+
+const struct tcp_cc_ops tcp_cc_cubic = {
+  "cubic",
+  tcp_cc_cubic_init,
+  tcp_cc_cubic_acked,
+  tcp_cc_dupack_inflate,
+  tcp_cc_cubic_loss,
+  tcp_cc_recovered_ssthresh
+};
+
+/* BBR */
+
+#define TCP_CC_BBR_STARTUP      0
+#define TCP_CC_BBR_DRAIN        1
+#define TCP_CC_BBR_PROBE_BW     2
+#define TCP_CC_BBR_PROBE_RTT    3
+
+/* max delivery rate over this many rounds */
+#define TCP_CC_BBR_BW_ROUNDS    8
+/* gains in 1/1000. Without pacing cwnd alone carries the probing gains,
+   the usual cwnd gain of 2 would keep a bdp queued at the bottleneck */
+#define TCP_CC_BBR_HIGH_GAIN    2885
+#define TCP_CC_BBR_CYCLE_LEN    8
+/* STARTUP is over when the rate grew less than 25% in 3 rounds */
+#define TCP_CC_BBR_FULL_BW_NUM  5
+#define TCP_CC_BBR_FULL_BW_DEN  4
+#define TCP_CC_BBR_FULL_BW_ROUNDS 3
+/* PROBE_RTT holds cwnd at 4 MSS for 200ms */
+#define TCP_CC_BBR_PROBE_RTT_MS 200
+#define TCP_CC_BBR_MIN_CWND(pcb) (4U * (pcb)->mss)
+
+static const u16_t tcp_cc_bbr_cycle_gain[TCP_CC_BBR_CYCLE_LEN] = {
+  1250, 750, 1000, 1000, 1000, 1000, 1000, 1000
+};
+
+struct tcp_cc_bbr {
+  struct tcp_cc_round round;
+  u32_t bw[TCP_CC_BBR_BW_ROUNDS]; /* bytes per second */
+  u32_t full_bw;
+  u32_t target;       /* bytes in flight the model asks for, 0 while unknown */
+  u32_t acked;        /* cumulatively acked, cc_delivered - acked is sacked */
+  u32_t cycle_stamp;
+  u32_t probe_rtt_done;
+  u32_t prior_cwnd;
+  u8_t mode;
+  u8_t round_idx;
+  u8_t full_bw_rounds;
+  u8_t full_bw_reached;
+  u8_t cycle_idx;
+  u8_t probe_rtt_round;
+};
+
+static void
+tcp_cc_bbr_init(struct tcp_pcb *pcb)
+{
+  struct tcp_cc_bbr *bbr = TCP_CC_PRIV(pcb, struct tcp_cc_bbr);
+
+  LWIP_ASSERT("tcp_cc_bbr: cc_priv too small",
+              sizeof(struct tcp_cc_bbr) <= sizeof(pcb->cc_priv));
+  bbr->acked = pcb->cc_delivered;
+}
+
+static u32_t
+tcp_cc_bbr_max_bw(struct tcp_cc_bbr *bbr)
+{
+  u32_t bw = 0;
+  u8_t i;
+
+  for (i = 0; i < TCP_CC_BBR_BW_ROUNDS; i++) {
+    bw = LWIP_MAX(bw, bbr->bw[i]);
+  }
+  return bw;
+}
+
+/* sacked bytes above lastack have left the network, lwIP's cwnd counts from
+   lastack so it has to leave room for them */
+static u32_t
+tcp_cc_bbr_sacked(struct tcp_pcb *pcb, struct tcp_cc_bbr *bbr)
+{
+  s32_t sacked = (s32_t)(pcb->cc_delivered - bbr->acked);
+  return sacked > 0 ? (u32_t)sacked : 0;
+}
+
+static void
+tcp_cc_bbr_set_cwnd(struct tcp_pcb *pcb, struct tcp_cc_bbr *bbr, tcpwnd_size_t acked)
+{
+  u32_t sacked = tcp_cc_bbr_sacked(pcb, bbr);
+  u32_t cwnd = pcb->cwnd;
+
+  /* a lost retransmission holds lastack until the RTO, don't run further
+     than another bdp past it */
+  if (bbr->target != 0) {
+    sacked = LWIP_MIN(sacked, bbr->target);
+  }
+
+  if (bbr->mode == TCP_CC_BBR_PROBE_RTT) {
+    cwnd = LWIP_MIN(cwnd, TCP_CC_BBR_MIN_CWND(pcb) + sacked);
+  } else if (bbr->target == 0 || (!bbr->full_bw_reached && cwnd < bbr->target + sacked)) {
+    /* no model yet, or still starting up: grow like slow start */
+    cwnd += acked;
+  } else if (cwnd < bbr->target + sacked && !(pcb->flags & TF_INFR)) {
+    cwnd = LWIP_MIN(cwnd + acked, bbr->target + sacked);
+  } else if (bbr->full_bw_reached) {
+    cwnd = bbr->target + sacked;
+  }
+  pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(LWIP_MAX(cwnd, TCP_CC_BBR_MIN_CWND(pcb)), (tcpwnd_size_t)-1);
+}
+
+static void
+tcp_cc_bbr_acked(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct tcp_cc_bbr *bbr = TCP_CC_PRIV(pcb, struct tcp_cc_bbr);
+  u32_t now = sys_now();
+  u32_t inflight;
+  u8_t rtt_min_expired;
+  u8_t round_ended;
+  u32_t rate = 0;
+  u32_t bdp;
+  u32_t gain;
+
+  bbr->acked += acked;
+  inflight = pcb->snd_nxt - pcb->lastack - tcp_cc_bbr_sacked(pcb, bbr);
+
+  rtt_min_expired = bbr->round.rtt_min != 0 && (u32_t)(now - bbr->round.rtt_min_stamp) > TCP_CC_RTT_MIN_WIN;
+  round_ended = tcp_cc_round_update(pcb, &bbr->round, now, &rate);
+  if (round_ended) {
+    bbr->round_idx = (u8_t)((bbr->round_idx + 1) % TCP_CC_BBR_BW_ROUNDS);
+    bbr->bw[bbr->round_idx] = 0;
+  }
+  bbr->bw[bbr->round_idx] = LWIP_MAX(bbr->bw[bbr->round_idx], rate);
+  bdp = (u32_t)LWIP_MIN(0xFFFFFFFFUL, (u64_t)tcp_cc_bbr_max_bw(bbr) * bbr->round.rtt_min / 1000);
+
+  switch (bbr->mode) {
+    case TCP_CC_BBR_STARTUP:
+      if (round_ended) {
+        u32_t bw = tcp_cc_bbr_max_bw(bbr);
+        if ((u64_t)bw * TCP_CC_BBR_FULL_BW_DEN >= (u64_t)bbr->full_bw * TCP_CC_BBR_FULL_BW_NUM) {
+          bbr->full_bw = bw;
+          bbr->full_bw_rounds = 0;
+        } else if (++bbr->full_bw_rounds >= TCP_CC_BBR_FULL_BW_ROUNDS) {
+          bbr->full_bw_reached = 1;
+          bbr->mode = TCP_CC_BBR_DRAIN;
+        }
+      }
+      break;
+    case TCP_CC_BBR_DRAIN:
+      if (inflight <= bdp) {
+        bbr->mode = TCP_CC_BBR_PROBE_BW;
+        bbr->cycle_idx = 2;
+        bbr->cycle_stamp = now;
+      }
+      break;
+    case TCP_CC_BBR_PROBE_BW:
+      if ((u32_t)(now - bbr->cycle_stamp) > bbr->round.rtt_min) {
+        bbr->cycle_idx = (u8_t)((bbr->cycle_idx + 1) % TCP_CC_BBR_CYCLE_LEN);
+        bbr->cycle_stamp = now;
+      }
+      break;
+    case TCP_CC_BBR_PROBE_RTT:
+      if (bbr->probe_rtt_done == 0 && inflight <= TCP_CC_BBR_MIN_CWND(pcb)) {
+        /* 200ms and at least one round at the floor */
+        bbr->probe_rtt_done = now + TCP_CC_BBR_PROBE_RTT_MS;
+        bbr->probe_rtt_round = 0;
+      } else if (bbr->probe_rtt_done != 0) {
+        bbr->probe_rtt_round |= round_ended;
+        if (bbr->probe_rtt_round && (s32_t)(now - bbr->probe_rtt_done) >= 0) {
+          bbr->round.rtt_min_stamp = now;
+          bbr->mode = bbr->full_bw_reached ? TCP_CC_BBR_PROBE_BW : TCP_CC_BBR_STARTUP;
+          bbr->cycle_stamp = now;
+          pcb->cwnd = (tcpwnd_size_t)LWIP_MAX(pcb->cwnd, bbr->prior_cwnd);
+        }
+      }
+      break;
+    default:
+      break;
+  }
+
+  if (rtt_min_expired && bbr->mode != TCP_CC_BBR_PROBE_RTT) {
+    bbr->mode = TCP_CC_BBR_PROBE_RTT;
+    bbr->prior_cwnd = pcb->cwnd;
+    bbr->probe_rtt_done = 0;
+  }
+
+  switch (bbr->mode) {
+    case TCP_CC_BBR_STARTUP:
+      gain = TCP_CC_BBR_HIGH_GAIN;
+      break;
+    case TCP_CC_BBR_PROBE_BW:
+      gain = tcp_cc_bbr_cycle_gain[bbr->cycle_idx];
+      break;
+    default:
+      gain = 1000;
+      break;
+  }
+  bbr->target = (u32_t)LWIP_MIN(0xFFFFFFFFUL, (u64_t)bdp * gain / 1000);
+
+  tcp_cc_bbr_set_cwnd(pcb, bbr, acked);
+  LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: bbr mode %"U16_F" cwnd %"TCPWNDSIZE_F"\n", (u16_t)bbr->mode, pcb->cwnd));
+}
+
+static void
+tcp_cc_bbr_dupack(struct tcp_pcb *pcb)
+{
+  struct tcp_cc_bbr *bbr = TCP_CC_PRIV(pcb, struct tcp_cc_bbr);
+
+  /* SACKs move the room for new data, not the count of dupacks */
+  tcp_cc_bbr_set_cwnd(pcb, bbr, 0);
+}
+
+static void
+tcp_cc_bbr_loss(struct tcp_pcb *pcb, u8_t rto)
+{
+  struct tcp_cc_bbr *bbr = TCP_CC_PRIV(pcb, struct tcp_cc_bbr);
+
+  /* loss is not a congestion signal here, fast recovery keeps the model's
+     cwnd and an RTO restarts from one MSS, growing back by what is acked */
+  if (bbr->mode != TCP_CC_BBR_PROBE_RTT) {
+    bbr->prior_cwnd = pcb->cwnd;
+  }
+  /* except a loss once the rate stopped growing: STARTUP overflowed the
+     bottleneck queue */
+  if (bbr->mode == TCP_CC_BBR_STARTUP && bbr->full_bw_rounds > 0) {
+    bbr->full_bw_reached = 1;
+    bbr->mode = TCP_CC_BBR_DRAIN;
+    bbr->target = (u32_t)((u64_t)bbr->target * 1000 / TCP_CC_BBR_HIGH_GAIN);
+  }
+  pcb->ssthresh = pcb->cwnd;
+  if (rto) {
+    bbr->round.started = 0;
+    pcb->cwnd = pcb->mss;
+  } else {
+    tcp_cc_bbr_set_cwnd(pcb, bbr, 0);
+  }
+  pcb->bytes_acked = 0;
+}
+
+static void
+tcp_cc_bbr_recovered(struct tcp_pcb *pcb)
+{
+  struct tcp_cc_bbr *bbr = TCP_CC_PRIV(pcb, struct tcp_cc_bbr);
+
+  tcp_cc_bbr_set_cwnd(pcb, bbr, 0);
+}
+
+const struct tcp_cc_ops tcp_cc_bbr = {
+  "bbr",
+  tcp_cc_bbr_init,
+  tcp_cc_bbr_acked,
+  tcp_cc_bbr_dupack,
+  tcp_cc_bbr_loss,
+  tcp_cc_bbr_recovered
+};
+
+static const struct tcp_cc_ops *const tcp_cc_builtin[] = {
+  &tcp_cc_reno,
+  &tcp_cc_cubic,
+  &tcp_cc_bbr
+};
+
+/**
+ * @ingroup tcp_raw
+ * Look up a built in congestion control algorithm ("reno", "cubic", "bbr").
+ *
+ * @param name the algorithm's name
+ * @return the algorithm or NULL if there is none called name
+ */
+const struct tcp_cc_ops *
+tcp_cc_find(const char *name)
+{
+  size_t i;
+
+  LWIP_ERROR("tcp_cc_find: invalid name", name != NULL, return NULL);
+
+  for (i = 0; i < LWIP_ARRAYSIZE(tcp_cc_builtin); i++) {
+    if (strcmp(tcp_cc_builtin[i]->name, name) == 0) {
+      return tcp_cc_builtin[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Switch a pcb to another congestion control algorithm. cwnd and ssthresh
+ * are kept, the algorithm's own state starts over.
+ *
+ * @param pcb the tcp_pcb to change
+ * @param cc the algorithm, e.g. &tcp_cc_cubic or from tcp_cc_find()
+ */
+void
+tcp_set_cc(struct tcp_pcb *pcb, const struct tcp_cc_ops *cc)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+
+  LWIP_ERROR("tcp_set_cc: invalid pcb", pcb != NULL, return);
+  LWIP_ERROR("tcp_set_cc: invalid cc", cc != NULL, return);
+
+  /* pcb->state LISTEN not allowed here */
+  LWIP_ASSERT("don't call tcp_set_cc for listen-pcbs",
+              pcb->state != LISTEN);
+
+  pcb->cc = cc;
+  memset(pcb->cc_priv, 0, sizeof(pcb->cc_priv));
+  cc->init(pcb);
+}
+
+#endif /* LWIP_TCP && LWIP_TCP_CC */
@@ -71,25 +71,35 @@
 /* These variables are global to all functions involved in the input
    processing of TCP segments. They are set by the tcp_input()
    function. */
-static struct tcp_seg inseg;
-static struct tcp_hdr *tcphdr;
-static u16_t tcphdr_optlen;
-static u16_t tcphdr_opt1len;
-static u8_t *tcphdr_opt2;
-static u16_t tcp_optidx;
-static u32_t seqno, ackno;
-static tcpwnd_size_t recv_acked;
-static u16_t tcplen;
-static u8_t flags;
-
-static u8_t recv_flags;
-static struct pbuf *recv_data;
-
-struct tcp_pcb *tcp_input_pcb;
+static LWIP_TLS struct tcp_seg inseg;
+static LWIP_TLS struct tcp_hdr *tcphdr;
+static LWIP_TLS u16_t tcphdr_optlen;
+static LWIP_TLS u16_t tcphdr_opt1len;
+static LWIP_TLS u8_t *tcphdr_opt2;
+static LWIP_TLS u16_t tcp_optidx;
+static LWIP_TLS u32_t seqno, ackno;
+static LWIP_TLS tcpwnd_size_t recv_acked;
+static LWIP_TLS u16_t tcplen;
+static LWIP_TLS u8_t flags;
+
+static LWIP_TLS u8_t recv_flags;
+static LWIP_TLS struct pbuf *recv_data;
+
+LWIP_TLS struct tcp_pcb *tcp_input_pcb;
+
+#if LWIP_TCP_HDR_PREDICT
+static LWIP_TLS u8_t tcp_hdr_predict_enabled = 1;
+/* segments taken by the fast path, pure ACKs and in order data */
+static LWIP_TLS u32_t tcp_hdr_predict_acks;
+static LWIP_TLS u32_t tcp_hdr_predict_data;
+#endif /* LWIP_TCP_HDR_PREDICT */
 
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
+#if LWIP_TCP_HDR_PREDICT
+static u8_t tcp_receive_predicted(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_HDR_PREDICT */
 static void tcp_parseopt(struct tcp_pcb *pcb);
 
 static void tcp_listen_input(struct tcp_pcb_listen *pcb);
@@ -97,13 +107,46 @@ static void tcp_timewait_input(struct tcp_pcb *pcb);
 
 static int tcp_input_delayed_close(struct tcp_pcb *pcb);
 
+/* ooseq is cut back to the per pcb and global limits after each insert */
+#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT) || TCP_OOSEQ_GLOBAL_MAX_BYTES
+#define TCP_OOSEQ_LIMITED 1
+#else
+#define TCP_OOSEQ_LIMITED 0
+#endif
+
+#if TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES
+/* a segment leaves ooseq for the application or the bin */
+#define TCP_OOSEQ_BYTES_DEQUEUED(pcb, seg) do { \
+    tcp_ooseq_bytes -= (seg)->p->tot_len; \
+    (pcb)->ooseq_bytes -= (seg)->p->tot_len; \
+  } while (0)
+#else
+#define TCP_OOSEQ_BYTES_DEQUEUED(pcb, seg)
+#endif /* TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES */
+
+#if LWIP_TCP_CC
+/* an acked or sacked segment reached the remote host, counted once (an RTO
+   drops the SACK marks but not TF_SEG_DELIVERED) */
+#define TCP_CC_DELIVERED(pcb, seg) do { \
+    if (!((seg)->flags & TF_SEG_DELIVERED)) { \
+      (seg)->flags |= TF_SEG_DELIVERED; \
+      (pcb)->cc_delivered += (seg)->len; \
+    } \
+  } while (0)
+#else
+#define TCP_CC_DELIVERED(pcb, seg)
+#endif /* LWIP_TCP_CC */
+
 #if LWIP_TCP_SACK_OUT
 static void tcp_add_sack(struct tcp_pcb *pcb, u32_t left, u32_t right);
 static void tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq);
-#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
+#if TCP_OOSEQ_LIMITED
 static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
-#endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
+#endif /* TCP_OOSEQ_LIMITED */
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+static void tcp_sack_mark(struct tcp_pcb *pcb, u32_t left, u32_t right);
+#endif /* LWIP_TCP_SACK_IN */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -247,6 +290,23 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if LWIP_TCP_PCB_HASH
+  pcb = tcp_pcb_hash_lookup(ip_current_dest_addr(), tcphdr->dest,
+                            ip_current_src_addr(), tcphdr->src,
+                            netif_get_index(ip_data.current_input_netif));
+  if ((pcb != NULL) && (pcb->state == TIME_WAIT)) {
+    LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for TIME_WAITing connection.\n"));
+#ifdef LWIP_HOOK_TCP_INPACKET_PCB
+    if (LWIP_HOOK_TCP_INPACKET_PCB(pcb, tcphdr, tcphdr_optlen, tcphdr_opt1len,
+                                   tcphdr_opt2, p) == ERR_OK)
+#endif
+    {
+      tcp_timewait_input(pcb);
+    }
+    pbuf_free(p);
+    return;
+  }
+#else /* LWIP_TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
@@ -269,6 +329,13 @@ tcp_input(struct pbuf *p, struct netif *inp)
       LWIP_ASSERT("tcp_input: pcb->next != pcb (before cache)", pcb->next != pcb);
       if (prev != NULL) {
         prev->next = pcb->next;
+#if LWIP_TCP_TIMER_WHEEL
+        if (pcb->next != NULL) {
+          pcb->next->list_pprev = &prev->next;
+        }
+        tcp_active_pcbs->list_pprev = &pcb->next;
+        pcb->list_pprev = &tcp_active_pcbs;
+#endif /* LWIP_TCP_TIMER_WHEEL */
         pcb->next = tcp_active_pcbs;
         tcp_active_pcbs = pcb;
       } else {
@@ -279,8 +346,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
     prev = pcb;
   }
+#endif /* LWIP_TCP_PCB_HASH */
 
   if (pcb == NULL) {
+#if !LWIP_TCP_PCB_HASH
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
@@ -311,6 +380,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         return;
       }
     }
+#endif /* !LWIP_TCP_PCB_HASH */
 
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
@@ -401,6 +471,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
 #endif
   if (pcb != NULL) {
     /* The incoming segment belongs to a connection. */
+    TCP_TIMER_TOUCH(pcb);
 #if TCP_INPUT_DEBUG
     tcp_debug_print_state(pcb->state);
 #endif /* TCP_INPUT_DEBUG */
@@ -796,6 +867,12 @@ tcp_process(struct tcp_pcb *pcb)
 
   LWIP_ASSERT("tcp_process: invalid pcb", pcb != NULL);
 
+#if LWIP_TCP_HDR_PREDICT
+  if (tcp_receive_predicted(pcb)) {
+    return ERR_OK;
+  }
+#endif /* LWIP_TCP_HDR_PREDICT */
+
   /* Process incoming RST segments. */
   if (flags & TCP_RST) {
     /* First, determine if the reset is acceptable. */
@@ -1113,6 +1190,7 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 
     pcb->snd_queuelen = (u16_t)(pcb->snd_queuelen - clen);
     recv_acked = (tcpwnd_size_t)(recv_acked + next->len);
+    TCP_CC_DELIVERED(pcb, next);
     tcp_seg_free(next);
 
     LWIP_DEBUGF(TCP_QLEN_DEBUG, ("%"TCPWNDSIZE_F" (after freeing %s)\n",
@@ -1126,6 +1204,308 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
   return seg_list;
 }
 
+/**
+ * Called by tcp_receive() for an ACK that acknowledges new data: leaves
+ * fast recovery, frees the acknowledged segments and updates the
+ * congestion window.
+ */
+static void
+tcp_receive_ack(struct tcp_pcb *pcb)
+{
+  tcpwnd_size_t acked;
+
+  /* Reset the "IN Fast Retransmit" flag, since we are no longer
+     in fast retransmit. Also reset the congestion window to the
+     slow start threshold. */
+#if LWIP_TCP_SACK_IN
+  /* With SACK a partial ACK (below the recovery point) keeps us in
+     fast recovery, the next hole goes out once the ACK is processed */
+  if ((pcb->flags & TF_INFR) && (pcb->flags & TF_SACK) && TCP_SEQ_LT(ackno, pcb->sack_recover)) {
+    tcpwnd_size_t partial = (tcpwnd_size_t)(ackno - pcb->lastack);
+    /* RFC 6582: deflate by what left the network, add back one mss */
+    pcb->cwnd = (pcb->cwnd > partial) ? (tcpwnd_size_t)(pcb->cwnd - partial) : 0;
+    TCP_WND_INC(pcb->cwnd, pcb->mss);
+  } else
+#endif /* LWIP_TCP_SACK_IN */
+  if (pcb->flags & TF_INFR) {
+    tcp_clear_flags(pcb, TF_INFR);
+#if LWIP_TCP_CC
+    pcb->cc->recovered(pcb);
+#else /* LWIP_TCP_CC */
+    pcb->cwnd = pcb->ssthresh;
+    pcb->bytes_acked = 0;
+#endif /* LWIP_TCP_CC */
+  }
+
+  /* Reset the number of retransmissions. */
+  pcb->nrtx = 0;
+
+  /* Reset the retransmission time-out. */
+  pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+
+  /* Record how much data this ACK acks */
+  acked = (tcpwnd_size_t)(ackno - pcb->lastack);
+
+  /* Reset the fast retransmit variables (still in recovery after a
+     partial ACK, every dupack keeps retransmitting) */
+  if (!(pcb->flags & TF_INFR)) {
+    pcb->dupacks = 0;
+  }
+  pcb->lastack = ackno;
+
+  /* Update the congestion control variables (cwnd and
+     ssthresh). */
+#if !LWIP_TCP_CC
+  if ((pcb->state >= ESTABLISHED) && !(pcb->flags & TF_INFR)) {
+    if (pcb->cwnd < pcb->ssthresh) {
+      tcpwnd_size_t increase;
+      /* limit to 1 SMSS segment during period following RTO */
+      u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
+      /* RFC 3465, section 2.2 Slow Start */
+      increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
+      TCP_WND_INC(pcb->cwnd, increase);
+      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+    } else {
+      /* RFC 3465, section 2.1 Congestion Avoidance */
+      TCP_WND_INC(pcb->bytes_acked, acked);
+      if (pcb->bytes_acked >= pcb->cwnd) {
+        pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
+        TCP_WND_INC(pcb->cwnd, pcb->mss);
+      }
+      LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
+    }
+  }
+#endif /* !LWIP_TCP_CC */
+  LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
+                                ackno,
+                                pcb->unacked != NULL ?
+                                lwip_ntohl(pcb->unacked->tcphdr->seqno) : 0,
+                                pcb->unacked != NULL ?
+                                lwip_ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked) : 0));
+
+  /* Remove segment from the unacknowledged list if the incoming
+     ACK acknowledges them. */
+  pcb->unacked = tcp_free_acked_segments(pcb, pcb->unacked, "unacked", pcb->unsent);
+  /* We go through the ->unsent list to see if any of the segments
+     on the list are acknowledged by the ACK. This may seem
+     strange since an "unsent" segment shouldn't be acked. The
+     rationale is that lwIP puts all outstanding segments on the
+     ->unsent list after a retransmission, so these segments may
+     in fact have been sent once. */
+  pcb->unsent = tcp_free_acked_segments(pcb, pcb->unsent, "unsent", pcb->unacked);
+
+#if LWIP_TCP_CC
+  /* after the segments are freed, so cc_delivered counts this ACK */
+  if (pcb->state >= ESTABLISHED) {
+    pcb->cc->acked(pcb, acked);
+  }
+#endif /* LWIP_TCP_CC */
+
+#if LWIP_TCP_SACK_IN
+  if (pcb->flags & TF_INFR) {
+    tcp_rexmit_sack_hole(pcb);
+  }
+#endif /* LWIP_TCP_SACK_IN */
+
+  /* If there's nothing left to acknowledge, stop the retransmit
+     timer, otherwise reset it to start again */
+  if (pcb->unacked == NULL) {
+    pcb->rtime = -1;
+  } else {
+    pcb->rtime = 0;
+  }
+
+  pcb->polltmr = 0;
+
+#if TCP_OVERSIZE
+  if (pcb->unsent == NULL) {
+    pcb->unsent_oversize = 0;
+  }
+#endif /* TCP_OVERSIZE */
+
+#if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
+  if (ip_current_is_v6()) {
+    /* Inform neighbor reachability of forward progress. */
+    nd6_reachability_hint(ip6_current_src_addr());
+  }
+#endif /* LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS*/
+
+  pcb->snd_buf = (tcpwnd_size_t)(pcb->snd_buf + recv_acked);
+  /* check if this ACK ends our retransmission of in-flight data */
+  if (pcb->flags & TF_RTO) {
+    /* RTO is done if
+        1) both queues are empty or
+        2) unacked is empty and unsent head contains data not part of RTO or
+        3) unacked head contains data not part of RTO */
+    if (pcb->unacked == NULL) {
+      if ((pcb->unsent == NULL) ||
+          (TCP_SEQ_LEQ(pcb->rto_end, lwip_ntohl(pcb->unsent->tcphdr->seqno)))) {
+        tcp_clear_flags(pcb, TF_RTO);
+      }
+    } else if (TCP_SEQ_LEQ(pcb->rto_end, lwip_ntohl(pcb->unacked->tcphdr->seqno))) {
+      tcp_clear_flags(pcb, TF_RTO);
+    }
+  }
+}
+
+/**
+ * RTT estimation calculations. This is done by checking if the
+ * incoming segment acknowledges the segment we use to take a
+ * round-trip time measurement.
+ */
+static void
+tcp_receive_rtt(struct tcp_pcb *pcb)
+{
+  s16_t m;
+
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: pcb->rttest %"U32_F" rtseq %"U32_F" ackno %"U32_F"\n",
+                              pcb->rttest, pcb->rtseq, ackno));
+
+  if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
+    /* diff between this shouldn't exceed 32K since this are tcp timer ticks
+       and a round-trip shouldn't be that long... */
+    m = (s16_t)(tcp_ticks - pcb->rttest);
+
+    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"U16_F" ticks (%"U16_F" msec).\n",
+                                m, (u16_t)(m * TCP_SLOW_INTERVAL)));
+
+    /* This is taken directly from VJs original code in his paper */
+    m = (s16_t)(m - (pcb->sa >> 3));
+    pcb->sa = (s16_t)(pcb->sa + m);
+    if (m < 0) {
+      m = (s16_t) - m;
+    }
+    m = (s16_t)(m - (pcb->sv >> 2));
+    pcb->sv = (s16_t)(pcb->sv + m);
+    pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+
+    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
+                                pcb->rto, (u16_t)(pcb->rto * TCP_SLOW_INTERVAL)));
+
+    pcb->rttest = 0;
+  }
+}
+
+#if LWIP_TCP_HDR_PREDICT
+/**
+ * Header prediction (Van Jacobson), called first by tcp_process().
+ * In ESTABLISHED, a segment with no options, only ACK (and PSH) set, the
+ * expected sequence number and an unchanged window is handled here when it
+ * is a pure ACK for new data or the next in order data with nothing new
+ * acknowledged. Everything else goes through the state machine.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @return 1 if the segment was handled, 0 otherwise
+ */
+static u8_t
+tcp_receive_predicted(struct tcp_pcb *pcb)
+{
+  if (!tcp_hdr_predict_enabled ||
+      (pcb->state != ESTABLISHED) ||
+      ((flags & (TCP_SYN | TCP_FIN | TCP_RST | TCP_URG | TCP_ACK)) != TCP_ACK) ||
+      (tcphdr_optlen != 0) ||
+      (seqno != pcb->rcv_nxt) ||
+      ((u32_t)SND_WND_SCALE(pcb, tcphdr->wnd) != pcb->snd_wnd) ||
+      ((pcb->flags & (TF_INFR | TF_RTO | TF_RXCLOSED)) != 0)) {
+    return 0;
+  }
+
+  if (tcplen == 0) {
+    /* pure ACK, the sender side of a bulk transfer */
+    if (!TCP_SEQ_BETWEEN(ackno, pcb->lastack + 1, pcb->snd_nxt)) {
+      return 0;
+    }
+  } else {
+    /* in order data, the receiver side */
+    if ((ackno != pcb->lastack) || (tcplen > pcb->rcv_wnd)) {
+      return 0;
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq != NULL) {
+      return 0;
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+#if LWIP_TCP_SACK_OUT
+    if (LWIP_TCP_SACK_VALID(pcb, 0)) {
+      return 0;
+    }
+#endif /* LWIP_TCP_SACK_OUT */
+  }
+
+  /* what tcp_process() does before the state machine */
+  pcb->tmr = tcp_ticks;
+  pcb->keep_cnt_sent = 0;
+  pcb->persist_probe = 0;
+
+  /* the window itself did not change */
+  if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
+      (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno))) {
+    pcb->snd_wl1 = seqno;
+    pcb->snd_wl2 = ackno;
+  }
+
+  if (tcplen == 0) {
+    tcp_hdr_predict_acks++;
+    tcp_receive_ack(pcb);
+    tcp_receive_rtt(pcb);
+    return 1;
+  }
+
+  tcp_hdr_predict_data++;
+  pcb->dupacks = 0;
+  tcp_receive_rtt(pcb);
+
+  pcb->rcv_nxt = seqno + tcplen;
+  pcb->rcv_wnd -= tcplen;
+  tcp_update_rcv_ann_wnd(pcb);
+
+  recv_data = inseg.p;
+  inseg.p = NULL;
+
+  /* same rule as tcp_receive() */
+  if (tcplen >= 2 * pcb->mss) {
+    tcp_ack_now(pcb);
+  } else {
+    tcp_ack(pcb);
+  }
+
+#if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
+  if (ip_current_is_v6()) {
+    /* Inform neighbor reachability of forward progress. */
+    nd6_reachability_hint(ip6_current_src_addr());
+  }
+#endif /* LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS*/
+
+  return 1;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Turn header prediction on (the default) or off, e.g. to compare both.
+ */
+void
+tcp_hdr_predict_set(u8_t enable)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  tcp_hdr_predict_enabled = enable ? 1 : 0;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Segments handled by header prediction so far.
+ *
+ * @param acks pure ACKs for new data
+ * @param data in order data segments
+ */
+void
+tcp_hdr_predict_stat(u32_t *acks, u32_t *data)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  *acks = tcp_hdr_predict_acks;
+  *data = tcp_hdr_predict_data;
+}
+#endif /* LWIP_TCP_HDR_PREDICT */
+
 /**
  * Called by tcp_process. Checks if the given segment is an ACK for outstanding
  * data, and if so frees the memory of the buffered data. Next, it places the
@@ -1141,7 +1521,6 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 static void
 tcp_receive(struct tcp_pcb *pcb)
 {
-  s16_t m;
   u32_t right_wnd_edge;
   int found_dupack = 0;
 
@@ -1211,7 +1590,11 @@ tcp_receive(struct tcp_pcb *pcb)
               }
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window */
+#if LWIP_TCP_CC
+                pcb->cc->dupack(pcb);
+#else /* LWIP_TCP_CC */
                 TCP_WND_INC(pcb->cwnd, pcb->mss);
+#endif /* LWIP_TCP_CC */
               }
               if (pcb->dupacks >= 3) {
                 /* Do fast retransmit (checked via TF_INFR, not via dupacks count) */
@@ -1228,143 +1611,13 @@ tcp_receive(struct tcp_pcb *pcb)
       }
     } else if (TCP_SEQ_BETWEEN(ackno, pcb->lastack + 1, pcb->snd_nxt)) {
       /* We come here when the ACK acknowledges new data. */
-      tcpwnd_size_t acked;
-
-      /* Reset the "IN Fast Retransmit" flag, since we are no longer
-         in fast retransmit. Also reset the congestion window to the
-         slow start threshold. */
-      if (pcb->flags & TF_INFR) {
-        tcp_clear_flags(pcb, TF_INFR);
-        pcb->cwnd = pcb->ssthresh;
-        pcb->bytes_acked = 0;
-      }
-
-      /* Reset the number of retransmissions. */
-      pcb->nrtx = 0;
-
-      /* Reset the retransmission time-out. */
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
-
-      /* Record how much data this ACK acks */
-      acked = (tcpwnd_size_t)(ackno - pcb->lastack);
-
-      /* Reset the fast retransmit variables. */
-      pcb->dupacks = 0;
-      pcb->lastack = ackno;
-
-      /* Update the congestion control variables (cwnd and
-         ssthresh). */
-      if (pcb->state >= ESTABLISHED) {
-        if (pcb->cwnd < pcb->ssthresh) {
-          tcpwnd_size_t increase;
-          /* limit to 1 SMSS segment during period following RTO */
-          u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
-          /* RFC 3465, section 2.2 Slow Start */
-          increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
-          TCP_WND_INC(pcb->cwnd, increase);
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        } else {
-          /* RFC 3465, section 2.1 Congestion Avoidance */
-          TCP_WND_INC(pcb->bytes_acked, acked);
-          if (pcb->bytes_acked >= pcb->cwnd) {
-            pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
-            TCP_WND_INC(pcb->cwnd, pcb->mss);
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        }
-      }
-      LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
-                                    ackno,
-                                    pcb->unacked != NULL ?
-                                    lwip_ntohl(pcb->unacked->tcphdr->seqno) : 0,
-                                    pcb->unacked != NULL ?
-                                    lwip_ntohl(pcb->unacked->tcphdr->seqno) + TCP_TCPLEN(pcb->unacked) : 0));
-
-      /* Remove segment from the unacknowledged list if the incoming
-         ACK acknowledges them. */
-      pcb->unacked = tcp_free_acked_segments(pcb, pcb->unacked, "unacked", pcb->unsent);
-      /* We go through the ->unsent list to see if any of the segments
-         on the list are acknowledged by the ACK. This may seem
-         strange since an "unsent" segment shouldn't be acked. The
-         rationale is that lwIP puts all outstanding segments on the
-         ->unsent list after a retransmission, so these segments may
-         in fact have been sent once. */
-      pcb->unsent = tcp_free_acked_segments(pcb, pcb->unsent, "unsent", pcb->unacked);
-
-      /* If there's nothing left to acknowledge, stop the retransmit
-         timer, otherwise reset it to start again */
-      if (pcb->unacked == NULL) {
-        pcb->rtime = -1;
-      } else {
-        pcb->rtime = 0;
-      }
-
-      pcb->polltmr = 0;
-
-#if TCP_OVERSIZE
-      if (pcb->unsent == NULL) {
-        pcb->unsent_oversize = 0;
-      }
-#endif /* TCP_OVERSIZE */
-
-#if LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS
-      if (ip_current_is_v6()) {
-        /* Inform neighbor reachability of forward progress. */
-        nd6_reachability_hint(ip6_current_src_addr());
-      }
-#endif /* LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS*/
-
-      pcb->snd_buf = (tcpwnd_size_t)(pcb->snd_buf + recv_acked);
-      /* check if this ACK ends our retransmission of in-flight data */
-      if (pcb->flags & TF_RTO) {
-        /* RTO is done if
-            1) both queues are empty or
-            2) unacked is empty and unsent head contains data not part of RTO or
-            3) unacked head contains data not part of RTO */
-        if (pcb->unacked == NULL) {
-          if ((pcb->unsent == NULL) ||
-              (TCP_SEQ_LEQ(pcb->rto_end, lwip_ntohl(pcb->unsent->tcphdr->seqno)))) {
-            tcp_clear_flags(pcb, TF_RTO);
-          }
-        } else if (TCP_SEQ_LEQ(pcb->rto_end, lwip_ntohl(pcb->unacked->tcphdr->seqno))) {
-          tcp_clear_flags(pcb, TF_RTO);
-        }
-      }
-      /* End of ACK for new data processing. */
+      tcp_receive_ack(pcb);
     } else {
       /* Out of sequence ACK, didn't really ack anything */
       tcp_send_empty_ack(pcb);
     }
 
-    LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: pcb->rttest %"U32_F" rtseq %"U32_F" ackno %"U32_F"\n",
-                                pcb->rttest, pcb->rtseq, ackno));
-
-    /* RTT estimation calculations. This is done by checking if the
-       incoming segment acknowledges the segment we use to take a
-       round-trip time measurement. */
-    if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
-      /* diff between this shouldn't exceed 32K since this are tcp timer ticks
-         and a round-trip shouldn't be that long... */
-      m = (s16_t)(tcp_ticks - pcb->rttest);
-
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"U16_F" ticks (%"U16_F" msec).\n",
-                                  m, (u16_t)(m * TCP_SLOW_INTERVAL)));
-
-      /* This is taken directly from VJs original code in his paper */
-      m = (s16_t)(m - (pcb->sa >> 3));
-      pcb->sa = (s16_t)(pcb->sa + m);
-      if (m < 0) {
-        m = (s16_t) - m;
-      }
-      m = (s16_t)(m - (pcb->sv >> 2));
-      pcb->sv = (s16_t)(pcb->sv + m);
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
-
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
-                                  pcb->rto, (u16_t)(pcb->rto * TCP_SLOW_INTERVAL)));
-
-      pcb->rttest = 0;
-    }
+    tcp_receive_rtt(pcb);
   }
 
   /* If the incoming segment contains data, we must process it
@@ -1498,6 +1751,7 @@ tcp_receive(struct tcp_pcb *pcb)
             while (pcb->ooseq != NULL) {
               struct tcp_seg *old_ooseq = pcb->ooseq;
               pcb->ooseq = pcb->ooseq->next;
+              TCP_OOSEQ_BYTES_DEQUEUED(pcb, old_ooseq);
               tcp_seg_free(old_ooseq);
             }
           } else {
@@ -1516,6 +1770,7 @@ tcp_receive(struct tcp_pcb *pcb)
               }
               tmp = next;
               next = next->next;
+              TCP_OOSEQ_BYTES_DEQUEUED(pcb, tmp);
               tcp_seg_free(tmp);
             }
             /* Now trim right side of inseg if it overlaps with the first
@@ -1583,6 +1838,7 @@ tcp_receive(struct tcp_pcb *pcb)
 
           tcp_update_rcv_ann_wnd(pcb);
 
+          TCP_OOSEQ_BYTES_DEQUEUED(pcb, cseg);
           if (cseg->p->tot_len > 0) {
             /* Chain this pbuf onto the pbuf that we will pass to
                the application. */
@@ -1622,8 +1878,13 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* TCP_QUEUE_OOSEQ */
 
 
-        /* Acknowledge the segment(s). */
-        tcp_ack(pcb);
+        /* Acknowledge the segment(s). A segment coalesced from several (GRO on
+           the input path) is worth two full-sized ones on its own (RFC 5681 4.2) */
+        if (tcplen >= 2 * pcb->mss) {
+          tcp_ack_now(pcb);
+        } else {
+          tcp_ack(pcb);
+        }
 
 #if LWIP_TCP_SACK_OUT
         if (LWIP_TCP_SACK_VALID(pcb, 0)) {
@@ -1817,7 +2078,7 @@ tcp_receive(struct tcp_pcb *pcb)
           }
 #endif /* LWIP_TCP_SACK_OUT */
         }
-#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
+#if TCP_OOSEQ_LIMITED || TCP_OOSEQ_MERGE
         {
           /* Check that the data on ooseq doesn't exceed one of the limits
              and throw away everything above that limit. */
@@ -1828,11 +2089,38 @@ tcp_receive(struct tcp_pcb *pcb)
 #ifdef TCP_OOSEQ_PBUFS_LIMIT
           const u16_t ooseq_max_qlen = TCP_OOSEQ_PBUFS_LIMIT(pcb);
           u16_t ooseq_qlen = 0;
+#endif
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+          /* what the other pcbs hold leaves this much for this one */
+          const u32_t ooseq_others = tcp_ooseq_bytes - pcb->ooseq_bytes;
+          const u32_t ooseq_max_glen = (ooseq_others < TCP_OOSEQ_GLOBAL_MAX_BYTES) ?
+                                       (u32_t)(TCP_OOSEQ_GLOBAL_MAX_BYTES - ooseq_others) : 0;
+          u32_t ooseq_glen = 0;
 #endif
           struct tcp_seg *next, *prev = NULL;
           for (next = pcb->ooseq; next != NULL; prev = next, next = next->next) {
-            struct pbuf *p = next->p;
+            struct pbuf *p;
             int stop_here = 0;
+#if TCP_OOSEQ_MERGE
+            /* Append the segments contiguous to this one, a FIN ends the merge */
+            while ((next->next != NULL) &&
+                   (next->tcphdr->seqno + next->len == next->next->tcphdr->seqno) &&
+                   ((u32_t)next->len + next->next->len <= 0xFFFF) &&
+                   !((TCPH_FLAGS(next->tcphdr) | TCPH_FLAGS(next->next->tcphdr)) & TCP_FIN)) {
+              struct tcp_seg *merged = next->next;
+              pbuf_cat(next->p, merged->p);
+              next->len = (u16_t)(next->len + merged->len);
+              next->next = merged->next;
+              merged->p = NULL;
+              tcp_seg_free(merged);
+            }
+#endif /* TCP_OOSEQ_MERGE */
+            p = next->p;
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+            if (ooseq_glen + p->tot_len > ooseq_max_glen) {
+              stop_here = 1;
+            }
+#endif
 #ifdef TCP_OOSEQ_BYTES_LIMIT
             ooseq_blen += p->tot_len;
             if (ooseq_blen > ooseq_max_blen) {
@@ -1863,9 +2151,17 @@ tcp_receive(struct tcp_pcb *pcb)
               }
               break;
             }
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+            ooseq_glen += p->tot_len;
+#endif
           }
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+          /* the walk recounted what is left after trimming, merging and the limits */
+          tcp_ooseq_bytes = ooseq_others + ooseq_glen;
+          pcb->ooseq_bytes = ooseq_glen;
+#endif
         }
-#endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
+#endif /* TCP_OOSEQ_LIMITED || TCP_OOSEQ_MERGE */
 #endif /* TCP_QUEUE_OOSEQ */
 
         /* We send the ACK packet after we've (potentially) dealt with SACKs,
@@ -1963,9 +2259,9 @@ tcp_parseopt(struct tcp_pcb *pcb)
             pcb->rcv_scale = TCP_RCV_SCALE;
             tcp_set_flags(pcb, TF_WND_SCALE);
             /* window scaling is enabled, we can use the full receive window */
-            LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(TCP_WND));
-            LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_WND));
-            pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND;
+            LWIP_ASSERT("window not at default value", pcb->rcv_wnd == TCPWND_MIN16(TCP_WND_LIMIT(pcb)));
+            LWIP_ASSERT("window not at default value", pcb->rcv_ann_wnd == TCPWND_MIN16(TCP_WND_LIMIT(pcb)));
+            pcb->rcv_wnd = pcb->rcv_ann_wnd = TCP_WND_LIMIT(pcb);
           }
           break;
 #endif /* LWIP_WND_SCALE */
@@ -2009,6 +2305,34 @@ tcp_parseopt(struct tcp_pcb *pcb)
           }
           break;
 #endif /* LWIP_TCP_SACK_OUT */
+#if LWIP_TCP_SACK_IN
+        case LWIP_TCP_OPT_SACK:
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+          data = tcp_get_next_optbyte();
+          if ((data < 2 + 8) || (((data - 2) & 7) != 0) || (tcp_optidx - 2 + data) > tcphdr_optlen) {
+            /* Bad length */
+            LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+            return;
+          }
+          if ((pcb->flags & TF_SACK) && (flags & TCP_ACK) && !(flags & TCP_SYN)) {
+            /* One left and right edge (8 bytes) per block */
+            for (data = (u8_t)((data - 2) / 8); data > 0; data--) {
+              u32_t left, right;
+              left = (u32_t)tcp_get_next_optbyte() << 24;
+              left |= (u32_t)tcp_get_next_optbyte() << 16;
+              left |= (u32_t)tcp_get_next_optbyte() << 8;
+              left |= tcp_get_next_optbyte();
+              right = (u32_t)tcp_get_next_optbyte() << 24;
+              right |= (u32_t)tcp_get_next_optbyte() << 16;
+              right |= (u32_t)tcp_get_next_optbyte() << 8;
+              right |= tcp_get_next_optbyte();
+              tcp_sack_mark(pcb, left, right);
+            }
+          } else {
+            tcp_optidx += data - 2;
+          }
+          break;
+#endif /* LWIP_TCP_SACK_IN */
         default:
           LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
           data = tcp_get_next_optbyte();
@@ -2032,6 +2356,44 @@ tcp_trigger_input_pcb_close(void)
   recv_flags |= TF_CLOSED;
 }
 
+#if LWIP_TCP_SACK_IN
+/**
+ * Called by tcp_parseopt() for each SACK block of an incoming ACK.
+ *
+ * Marks the unacked segments the block covers completely (a partly sacked
+ * segment still counts as missing) and raises pcb->sack_high.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @param left the first sequence number of the block
+ * @param right the first sequence number past the block
+ */
+static void
+tcp_sack_mark(struct tcp_pcb *pcb, u32_t left, u32_t right)
+{
+  struct tcp_seg *seg;
+
+  /* D-SACKs (RFC 2883) and blocks outside of what was sent tell us nothing */
+  if (!TCP_SEQ_LT(left, right) || TCP_SEQ_LEQ(right, ackno) || TCP_SEQ_GT(right, pcb->snd_nxt)) {
+    return;
+  }
+
+  if (!TCP_SEQ_BETWEEN(pcb->sack_high, pcb->lastack, pcb->snd_nxt) || TCP_SEQ_GT(right, pcb->sack_high)) {
+    pcb->sack_high = right;
+  }
+
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    u32_t seg_seqno = lwip_ntohl(seg->tcphdr->seqno);
+    if (TCP_SEQ_GEQ(seg_seqno, right)) {
+      break;
+    }
+    if (TCP_SEQ_GEQ(seg_seqno, left) && TCP_SEQ_LEQ(seg_seqno + TCP_TCPLEN(seg), right)) {
+      TCP_CC_DELIVERED(pcb, seg);
+      seg->flags |= TF_SEG_SACKED;
+    }
+  }
+}
+#endif /* LWIP_TCP_SACK_IN */
+
 #if LWIP_TCP_SACK_OUT
 /**
  * Called by tcp_receive() to add new SACK entry.
@@ -2133,7 +2495,7 @@ tcp_remove_sacks_lt(struct tcp_pcb *pcb, u32_t seq)
   }
 }
 
-#if defined(TCP_OOSEQ_BYTES_LIMIT) || defined(TCP_OOSEQ_PBUFS_LIMIT)
+#if TCP_OOSEQ_LIMITED
 /**
  * Called to remove a range of SACKs.
  *
@@ -2172,7 +2534,7 @@ tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq)
     pcb->rcv_sacks[i].left = pcb->rcv_sacks[i].right = 0;
   }
 }
-#endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
+#endif /* TCP_OOSEQ_LIMITED */
 
 #endif /* LWIP_TCP_SACK_OUT */
 
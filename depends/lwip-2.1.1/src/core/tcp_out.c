@@ -94,15 +94,25 @@
 /* Define some copy-macros for checksum-on-copy so that the code looks
    nicer by preventing too many ifdef's. */
 #if TCP_CHECKSUM_ON_COPY
-#define TCP_DATA_COPY(dst, src, len, seg) do { \
-  tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), \
-                     len, &seg->chksum, &seg->chksum_swapped); \
-  seg->flags |= TF_SEG_DATA_CHECKSUMMED; } while(0)
-#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped)  \
-  tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), len, chksum, chksum_swapped);
+/* Data copied without a checksum (on_copy == 0, see tcp_chksum_on_copy)
+   leaves the segment without TF_SEG_DATA_CHECKSUMMED for good. */
+#define TCP_DATA_COPY(dst, src, len, seg, on_copy) do { \
+  if (on_copy) { \
+    tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), \
+                       len, &seg->chksum, &seg->chksum_swapped); \
+  } else { \
+    MEMCPY(dst, src, len); \
+    seg->flags &= ~TF_SEG_DATA_CHECKSUMMED; \
+  } } while(0)
+#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped, on_copy) do { \
+  if (on_copy) { \
+    tcp_seg_add_chksum(LWIP_CHKSUM_COPY(dst, src, len), len, chksum, chksum_swapped); \
+  } else { \
+    MEMCPY(dst, src, len); \
+  } } while(0)
 #else /* TCP_CHECKSUM_ON_COPY*/
-#define TCP_DATA_COPY(dst, src, len, seg)                     MEMCPY(dst, src, len)
-#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped) MEMCPY(dst, src, len)
+#define TCP_DATA_COPY(dst, src, len, seg, on_copy)                     MEMCPY(dst, src, len)
+#define TCP_DATA_COPY2(dst, src, len, chksum, chksum_swapped, on_copy) MEMCPY(dst, src, len)
 #endif /* TCP_CHECKSUM_ON_COPY*/
 
 /** Define this to 1 for an extra check that the output checksum is valid
@@ -293,6 +303,25 @@ tcp_seg_add_chksum(u16_t chksum, u16_t len, u16_t *seg_chksum,
   }
   *seg_chksum = chksum;
 }
+
+/** Checksumming while copying only pays off if the netif generates TCP
+ * checksums in software. Netifs that offload them (LWIP_CHECKSUM_CTRL_PER_NETIF)
+ * get plain copies and tcp_output_segment checksums those segments itself
+ * should they ever leave through a netif that does need it.
+ */
+static u8_t
+tcp_chksum_on_copy(const struct tcp_pcb *pcb)
+{
+#if LWIP_CHECKSUM_CTRL_PER_NETIF
+  struct netif *netif = tcp_route(pcb, &pcb->local_ip, &pcb->remote_ip);
+  if ((netif != NULL) && ((netif->chksum_flags & NETIF_CHECKSUM_GEN_TCP) == 0)) {
+    return 0;
+  }
+#else /* LWIP_CHECKSUM_CTRL_PER_NETIF */
+  LWIP_UNUSED_ARG(pcb);
+#endif /* LWIP_CHECKSUM_CTRL_PER_NETIF */
+  return 1;
+}
 #endif /* TCP_CHECKSUM_ON_COPY */
 
 /** Checks if tcp_write is allowed or not (checks state, snd_buf and snd_queuelen).
@@ -318,9 +347,9 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
   }
 
   /* fail on too much data */
-  if (len > pcb->snd_buf) {
+  if (len > tcp_sndbuf_avail(pcb)) {
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n",
-                len, pcb->snd_buf));
+                len, tcp_sndbuf_avail(pcb)));
     tcp_set_flags(pcb, TF_NAGLEMEMERR);
     return ERR_MEM;
   }
@@ -407,15 +436,26 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   u16_t concat_chksum = 0;
   u8_t concat_chksum_swapped = 0;
   u16_t concat_chksummed = 0;
+  u8_t chksum_on_copy;
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   u16_t mss_local;
 
   LWIP_ERROR("tcp_write: invalid pcb", pcb != NULL, return ERR_ARG);
+  TCP_TIMER_TOUCH(pcb);
 
   /* don't allocate segments bigger than half the maximum window we ever received */
-  mss_local = LWIP_MIN(pcb->mss, TCPWND_MIN16(pcb->snd_wnd_max / 2));
-  mss_local = mss_local ? mss_local : pcb->mss;
+#if LWIP_TCP_TSO
+  if (pcb->tso_max > pcb->mss) {
+    /* the netif cuts these to mss sized packets */
+    mss_local = LWIP_MIN(pcb->tso_max, TCPWND_MIN16(pcb->snd_wnd_max / 2));
+    mss_local = LWIP_MAX(mss_local, pcb->mss);
+  } else
+#endif /* LWIP_TCP_TSO */
+  {
+    mss_local = LWIP_MIN(pcb->mss, TCPWND_MIN16(pcb->snd_wnd_max / 2));
+    mss_local = mss_local ? mss_local : pcb->mss;
+  }
 
   LWIP_ASSERT_CORE_LOCKED();
 
@@ -434,6 +474,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     return err;
   }
   queuelen = pcb->snd_queuelen;
+#if TCP_CHECKSUM_ON_COPY
+  chksum_on_copy = tcp_chksum_on_copy(pcb);
+#endif /* TCP_CHECKSUM_ON_COPY */
 
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -546,9 +589,11 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #if TCP_OVERSIZE_DBGCHECK
         oversize_add = oversize;
 #endif /* TCP_OVERSIZE_DBGCHECK */
-        TCP_DATA_COPY2(concat_p->payload, (const u8_t *)arg + pos, seglen, &concat_chksum, &concat_chksum_swapped);
+        TCP_DATA_COPY2(concat_p->payload, (const u8_t *)arg + pos, seglen, &concat_chksum, &concat_chksum_swapped, chksum_on_copy);
 #if TCP_CHECKSUM_ON_COPY
-        concat_chksummed += seglen;
+        if (chksum_on_copy) {
+          concat_chksummed += seglen;
+        }
 #endif /* TCP_CHECKSUM_ON_COPY */
         queuelen += pbuf_clen(concat_p);
       } else {
@@ -572,9 +617,11 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         }
 #if TCP_CHECKSUM_ON_COPY
         /* calculate the checksum of nocopy-data */
-        tcp_seg_add_chksum(~inet_chksum((const u8_t *)arg + pos, seglen), seglen,
-                           &concat_chksum, &concat_chksum_swapped);
-        concat_chksummed += seglen;
+        if (chksum_on_copy) {
+          tcp_seg_add_chksum(~inet_chksum((const u8_t *)arg + pos, seglen), seglen,
+                             &concat_chksum, &concat_chksum_swapped);
+          concat_chksummed += seglen;
+        }
 #endif /* TCP_CHECKSUM_ON_COPY */
       }
 
@@ -613,7 +660,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
       }
       LWIP_ASSERT("tcp_write: check that first pbuf can hold the complete seglen",
                   (p->len >= seglen));
-      TCP_DATA_COPY2((char *)p->payload + optlen, (const u8_t *)arg + pos, seglen, &chksum, &chksum_swapped);
+      TCP_DATA_COPY2((char *)p->payload + optlen, (const u8_t *)arg + pos, seglen, &chksum, &chksum_swapped, chksum_on_copy);
     } else {
       /* Copy is not set: First allocate a pbuf for holding the data.
        * Since the referenced data is available at least until it is
@@ -630,10 +677,12 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
       }
 #if TCP_CHECKSUM_ON_COPY
       /* calculate the checksum of nocopy-data */
-      chksum = ~inet_chksum((const u8_t *)arg + pos, seglen);
-      if (seglen & 1) {
-        chksum_swapped = 1;
-        chksum = SWAP_BYTES_IN_WORD(chksum);
+      if (chksum_on_copy) {
+        chksum = ~inet_chksum((const u8_t *)arg + pos, seglen);
+        if (seglen & 1) {
+          chksum_swapped = 1;
+          chksum = SWAP_BYTES_IN_WORD(chksum);
+        }
       }
 #endif /* TCP_CHECKSUM_ON_COPY */
       /* reference the non-volatile payload data */
@@ -670,9 +719,11 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     seg->oversize_left = oversize;
 #endif /* TCP_OVERSIZE_DBGCHECK */
 #if TCP_CHECKSUM_ON_COPY
-    seg->chksum = chksum;
-    seg->chksum_swapped = chksum_swapped;
-    seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+    if (chksum_on_copy) {
+      seg->chksum = chksum;
+      seg->chksum_swapped = chksum_swapped;
+      seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+    }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
     /* first segment of to-be-queued data? */
@@ -714,7 +765,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     for (p = last_unsent->p; p; p = p->next) {
       p->tot_len += oversize_used;
       if (p->next == NULL) {
-        TCP_DATA_COPY((char *)p->payload + p->len, arg, oversize_used, last_unsent);
+        TCP_DATA_COPY((char *)p->payload + p->len, arg, oversize_used, last_unsent, chksum_on_copy);
         p->len += oversize_used;
       }
     }
@@ -759,7 +810,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     }
     tcp_seg_add_chksum(concat_chksum, concat_chksummed, &last_unsent->chksum,
                        &last_unsent->chksum_swapped);
-    last_unsent->flags |= TF_SEG_DATA_CHECKSUMMED;
+  } else if ((concat_p != NULL) || (extendlen > 0)) {
+    /* appended without a checksum */
+    last_unsent->flags &= ~TF_SEG_DATA_CHECKSUMMED;
   }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
@@ -856,7 +909,11 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
     return ERR_OK;
   }
 
+#if LWIP_TCP_TSO
+  LWIP_ASSERT("split <= mss", split <= pcb->mss || pcb->tso_max > pcb->mss);
+#else /* LWIP_TCP_TSO */
   LWIP_ASSERT("split <= mss", split <= pcb->mss);
+#endif /* LWIP_TCP_TSO */
   LWIP_ASSERT("useg->len > 0", useg->len > 0);
 
   /* We should check that we don't exceed TCP_SND_QUEUELEN but we need
@@ -891,8 +948,10 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   }
 #if TCP_CHECKSUM_ON_COPY
   /* calculate the checksum on remainder data */
-  tcp_seg_add_chksum(~inet_chksum((const u8_t *)p->payload + optlen, remainder), remainder,
-                     &chksum, &chksum_swapped);
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    tcp_seg_add_chksum(~inet_chksum((const u8_t *)p->payload + optlen, remainder), remainder,
+                       &chksum, &chksum_swapped);
+  }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
   /* Options are created when calling tcp_output() */
@@ -919,9 +978,11 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
   }
 
 #if TCP_CHECKSUM_ON_COPY
-  seg->chksum = chksum;
-  seg->chksum_swapped = chksum_swapped;
-  seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    seg->chksum = chksum;
+    seg->chksum_swapped = chksum_swapped;
+    seg->flags |= TF_SEG_DATA_CHECKSUMMED;
+  }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
   /* Remove this segment from the queue since trimming it may free pbufs */
@@ -942,21 +1003,23 @@ tcp_split_unsent_seg(struct tcp_pcb *pcb, u16_t split)
 
 #if TCP_CHECKSUM_ON_COPY
   /* The checksum on the split segment is now incorrect. We need to re-run it over the split */
-  useg->chksum = 0;
-  useg->chksum_swapped = 0;
-  q = useg->p;
-  offset = q->tot_len - useg->len; /* Offset due to exposed headers */
-
-  /* Advance to the pbuf where the offset ends */
-  while (q != NULL && offset > q->len) {
-    offset -= q->len;
-    q = q->next;
-  }
-  LWIP_ASSERT("Found start of payload pbuf", q != NULL);
-  /* Checksum the first payload pbuf accounting for offset, then other pbufs are all payload */
-  for (; q != NULL; offset = 0, q = q->next) {
-    tcp_seg_add_chksum(~inet_chksum((const u8_t *)q->payload + offset, q->len - offset), q->len - offset,
-                       &useg->chksum, &useg->chksum_swapped);
+  if (useg->flags & TF_SEG_DATA_CHECKSUMMED) {
+    useg->chksum = 0;
+    useg->chksum_swapped = 0;
+    q = useg->p;
+    offset = q->tot_len - useg->len; /* Offset due to exposed headers */
+
+    /* Advance to the pbuf where the offset ends */
+    while (q != NULL && offset > q->len) {
+      offset -= q->len;
+      q = q->next;
+    }
+    LWIP_ASSERT("Found start of payload pbuf", q != NULL);
+    /* Checksum the first payload pbuf accounting for offset, then other pbufs are all payload */
+    for (; q != NULL; offset = 0, q = q->next) {
+      tcp_seg_add_chksum(~inet_chksum((const u8_t *)q->payload + offset, q->len - offset), q->len - offset,
+                         &useg->chksum, &useg->chksum_swapped);
+    }
   }
 #endif /* TCP_CHECKSUM_ON_COPY */
 
@@ -1041,6 +1104,7 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
   LWIP_ASSERT("tcp_enqueue_flags: need either TCP_SYN or TCP_FIN in flags (programmer violates API)",
               (flags & (TCP_SYN | TCP_FIN)) != 0);
   LWIP_ASSERT("tcp_enqueue_flags: invalid pcb", pcb != NULL);
+  TCP_TIMER_TOUCH(pcb);
 
   /* No need to check pcb->snd_queuelen if only SYN or FIN are allowed! */
 
@@ -1225,6 +1289,42 @@ tcp_build_wnd_scale_option(u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_ACK_BATCH
+/** Hold back a pure ACK while a batch is open (see tcp_batch_begin()).
+ *
+ * @param pcb tcp_pcb with TF_ACK_NOW set
+ * @return 1 if the ACK is left to tcp_batch_end(), 0 if it has to go now
+ */
+static u8_t
+tcp_output_batch_ack(struct tcp_pcb *pcb)
+{
+  if (tcp_batch_depth == 0) {
+    return 0;
+  }
+#if TCP_QUEUE_OOSEQ
+  /* duplicate ACKs drive the fast retransmit of the sender, one per segment */
+  if (pcb->ooseq != NULL) {
+    return 0;
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+
+  if (!(pcb->flags & TF_ACK_BATCHED)) {
+    tcp_set_flags(pcb, TF_ACK_BATCHED);
+    pcb->batch_next = tcp_batch_pcbs;
+    tcp_batch_pcbs = pcb;
+    pcb->batch_rcv_nxt = pcb->rcv_nxt;
+    return 1;
+  }
+
+  /* enough held back for one ACK, the next one is held from here */
+  if ((u32_t)(pcb->rcv_nxt - pcb->batch_rcv_nxt) >= TCP_ACK_BATCH_MAX_BYTES) {
+    pcb->batch_rcv_nxt = pcb->rcv_nxt;
+    return 0;
+  }
+  return 1;
+}
+#endif /* LWIP_TCP_ACK_BATCH */
+
 /**
  * @ingroup tcp_raw
  * Find out what we can send and send it
@@ -1250,6 +1350,8 @@ tcp_output(struct tcp_pcb *pcb)
   /* pcb->state LISTEN not allowed here */
   LWIP_ASSERT("don't call tcp_output for listen-pcbs",
               pcb->state != LISTEN);
+  /* rtime and the persist timer may start or stop below */
+  TCP_TIMER_TOUCH(pcb);
 
   /* First, check if we are invoked by the TCP input processing
      code. If so, we do not output anything. Instead, we rely on the
@@ -1274,6 +1376,11 @@ tcp_output(struct tcp_pcb *pcb)
     /* If the TF_ACK_NOW flag is set and the ->unsent queue is empty, construct
      * an empty ACK segment and send it. */
     if (pcb->flags & TF_ACK_NOW) {
+#if LWIP_TCP_ACK_BATCH
+      if (tcp_output_batch_ack(pcb)) {
+        goto output_done;
+      }
+#endif /* LWIP_TCP_ACK_BATCH */
       return tcp_send_empty_ack(pcb);
     }
     /* nothing to send: shortcut out of here */
@@ -1301,6 +1408,17 @@ tcp_output(struct tcp_pcb *pcb)
     ip_addr_copy(pcb->local_ip, *local_ip);
   }
 
+#if LWIP_TCP_TSO
+  /* A segment built larger than the MSS may not fit a small congestion
+     window (e.g. after an RTO): cut the head down to what can go out now */
+  if (seg->len > pcb->mss &&
+      lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len > wnd &&
+      lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + pcb->mss <= wnd) {
+    u32_t space = wnd - (lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack);
+    tcp_split_unsent_seg(pcb, (u16_t)(space - space % pcb->mss));
+  }
+#endif /* LWIP_TCP_TSO */
+
   /* Handle the current segment not fitting within the window */
   if (lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len > wnd) {
     /* We need to start the persistent timer when the next unsent segment does not fit
@@ -1316,6 +1434,11 @@ tcp_output(struct tcp_pcb *pcb)
     }
     /* We need an ACK, but can't send data now, so send an empty ACK */
     if (pcb->flags & TF_ACK_NOW) {
+#if LWIP_TCP_ACK_BATCH
+      if (tcp_output_batch_ack(pcb)) {
+        goto output_done;
+      }
+#endif /* LWIP_TCP_ACK_BATCH */
       return tcp_send_empty_ack(pcb);
     }
     goto output_done;
@@ -1482,14 +1605,16 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     /* The Window field in a SYN segment itself (the only type where we send
        the window scale option) is never scaled. */
     seg->tcphdr->wnd = lwip_htons(TCPWND_MIN16(pcb->rcv_ann_wnd));
+    /* only that much is announced, a window narrowed before the handshake
+       completes must not count as already promised */
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + TCPWND_MIN16(pcb->rcv_ann_wnd);
   } else
 #endif /* LWIP_WND_SCALE */
   {
     seg->tcphdr->wnd = lwip_htons(TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
   }
 
-  pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
-
   /* Add any requested options.  NB MSS option is only set on SYN
      packets, so ignore it here */
   /* cast through void* to get rid of alignment warnings */
@@ -1558,6 +1683,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 
   seg->tcphdr->chksum = 0;
 
+#if LWIP_TCP_TSO
+  {
+    u16_t seg_mss = (u16_t)(pcb->mss - LWIP_TCP_OPT_LENGTH_SEGMENT(seg->flags, pcb));
+    seg->p->tso_mss = seg->len > seg_mss ? seg_mss : 0;
+  }
+#endif /* LWIP_TCP_TSO */
+
 #ifdef LWIP_HOOK_TCP_OUT_ADD_TCPOPTS
   opts = LWIP_HOOK_TCP_OUT_ADD_TCPOPTS(seg->p, seg->tcphdr, pcb, opts);
 #endif
@@ -1571,22 +1703,24 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
     u16_t chksum_slow = ip_chksum_pseudo(seg->p, IP_PROTO_TCP,
                                          seg->p->tot_len, &pcb->local_ip, &pcb->remote_ip);
 #endif /* TCP_CHECKSUM_ON_COPY_SANITY_CHECK */
-    if ((seg->flags & TF_SEG_DATA_CHECKSUMMED) == 0) {
-      LWIP_ASSERT("data included but not checksummed",
-                  seg->p->tot_len == TCPH_HDRLEN_BYTES(seg->tcphdr));
-    }
-
-    /* rebuild TCP header checksum (TCP header changes for retransmissions!) */
-    acc = ip_chksum_pseudo_partial(seg->p, IP_PROTO_TCP,
-                                   seg->p->tot_len, TCPH_HDRLEN_BYTES(seg->tcphdr), &pcb->local_ip, &pcb->remote_ip);
-    /* add payload checksum */
-    if (seg->chksum_swapped) {
-      seg_chksum_was_swapped = 1;
-      seg->chksum = SWAP_BYTES_IN_WORD(seg->chksum);
-      seg->chksum_swapped = 0;
+    if (((seg->flags & TF_SEG_DATA_CHECKSUMMED) == 0) &&
+        (seg->p->tot_len != TCPH_HDRLEN_BYTES(seg->tcphdr))) {
+      /* data was queued for a netif that offloads the checksum */
+      seg->tcphdr->chksum = ip_chksum_pseudo(seg->p, IP_PROTO_TCP,
+                                             seg->p->tot_len, &pcb->local_ip, &pcb->remote_ip);
+    } else {
+      /* rebuild TCP header checksum (TCP header changes for retransmissions!) */
+      acc = ip_chksum_pseudo_partial(seg->p, IP_PROTO_TCP,
+                                     seg->p->tot_len, TCPH_HDRLEN_BYTES(seg->tcphdr), &pcb->local_ip, &pcb->remote_ip);
+      /* add payload checksum */
+      if (seg->chksum_swapped) {
+        seg_chksum_was_swapped = 1;
+        seg->chksum = SWAP_BYTES_IN_WORD(seg->chksum);
+        seg->chksum_swapped = 0;
+      }
+      acc = (u16_t)~acc + seg->chksum;
+      seg->tcphdr->chksum = (u16_t)~FOLD_U32T(acc);
     }
-    acc = (u16_t)~acc + seg->chksum;
-    seg->tcphdr->chksum = (u16_t)~FOLD_U32T(acc);
 #if TCP_CHECKSUM_ON_COPY_SANITY_CHECK
     if (chksum_slow != seg->tcphdr->chksum) {
       TCP_CHECKSUM_ON_COPY_SANITY_CHECK_FAIL(
@@ -1652,6 +1786,18 @@ tcp_rexmit_rto_prepare(struct tcp_pcb *pcb)
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_rexmit_rto: segment busy\n"));
     return ERR_VAL;
   }
+#if LWIP_TCP_SACK_IN
+  {
+    /* The receiver may have reneged on its SACKs (RFC 2018): forget them,
+       everything goes out again and the timeout ends fast recovery */
+    struct tcp_seg *sacked;
+    for (sacked = pcb->unacked; sacked != NULL; sacked = sacked->next) {
+      sacked->flags &= (u8_t)~(TF_SEG_SACKED | TF_SEG_SACK_REXMIT);
+    }
+    pcb->sack_high = pcb->lastack;
+    tcp_clear_flags(pcb, TF_INFR);
+  }
+#endif /* LWIP_TCP_SACK_IN */
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
 #if TCP_OVERSIZE_DBGCHECK
@@ -1714,26 +1860,17 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Requeue an unacked segment for retransmission
  *
- * Called by tcp_receive() for fast retransmit.
- *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb the segment belongs to
+ * @param seg_ptr the link to the segment on pcb->unacked
  */
-err_t
-tcp_rexmit(struct tcp_pcb *pcb)
+static err_t
+tcp_rexmit_segment(struct tcp_pcb *pcb, struct tcp_seg **seg_ptr)
 {
-  struct tcp_seg *seg;
+  struct tcp_seg *seg = *seg_ptr;
   struct tcp_seg **cur_seg;
 
-  LWIP_ASSERT("tcp_rexmit: invalid pcb", pcb != NULL);
-
-  if (pcb->unacked == NULL) {
-    return ERR_VAL;
-  }
-
-  seg = pcb->unacked;
-
   /* Give up if the segment is still referenced by the netif driver
      due to deferred transmission. */
   if (tcp_output_segment_busy(seg)) {
@@ -1741,9 +1878,9 @@ tcp_rexmit(struct tcp_pcb *pcb)
     return ERR_VAL;
   }
 
-  /* Move the first unacked segment to the unsent queue */
+  /* Move the unacked segment to the unsent queue */
   /* Keep the unsent queue sorted. */
-  pcb->unacked = seg->next;
+  *seg_ptr = seg->next;
 
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
@@ -1759,10 +1896,6 @@ tcp_rexmit(struct tcp_pcb *pcb)
   }
 #endif /* TCP_OVERSIZE */
 
-  if (pcb->nrtx < 0xFF) {
-    ++pcb->nrtx;
-  }
-
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
 
@@ -1773,6 +1906,73 @@ tcp_rexmit(struct tcp_pcb *pcb)
   return ERR_OK;
 }
 
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retransmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+err_t
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("tcp_rexmit: invalid pcb", pcb != NULL);
+
+  if (pcb->unacked == NULL) {
+    return ERR_VAL;
+  }
+
+  if (tcp_rexmit_segment(pcb, &pcb->unacked) != ERR_OK) {
+    return ERR_VAL;
+  }
+
+  /* holes sent in fast recovery don't count, their connection is not timing out */
+  if (pcb->nrtx < 0xFF) {
+    ++pcb->nrtx;
+  }
+  return ERR_OK;
+}
+
+#if LWIP_TCP_SACK_IN
+/**
+ * Requeue the next hole for retransmission: the first unacked segment that is
+ * neither sacked nor retransmitted in this recovery yet, and has sacked data
+ * above it. The first unacked segment always qualifies, after a partial ACK it
+ * is known lost (RFC 6582).
+ *
+ * Called by tcp_receive() for dupacks and partial ACKs in fast recovery.
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ */
+err_t
+tcp_rexmit_sack_hole(struct tcp_pcb *pcb)
+{
+  struct tcp_seg **seg_ptr;
+  u32_t high;
+
+  LWIP_ASSERT("tcp_rexmit_sack_hole: invalid pcb", pcb != NULL);
+
+  high = TCP_SEQ_BETWEEN(pcb->sack_high, pcb->lastack, pcb->snd_nxt) ? pcb->sack_high : pcb->lastack;
+
+  for (seg_ptr = &pcb->unacked; *seg_ptr != NULL; seg_ptr = &(*seg_ptr)->next) {
+    struct tcp_seg *seg = *seg_ptr;
+    if ((seg_ptr != &pcb->unacked) && TCP_SEQ_GEQ(lwip_ntohl(seg->tcphdr->seqno), high)) {
+      break;
+    }
+    if (!(seg->flags & (TF_SEG_SACKED | TF_SEG_SACK_REXMIT))) {
+      LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack_hole: %"U32_F", sacked up to %"U32_F"\n",
+                                 lwip_ntohl(seg->tcphdr->seqno), high));
+      if (tcp_rexmit_segment(pcb, seg_ptr) != ERR_OK) {
+        return ERR_VAL;
+      }
+      seg->flags |= TF_SEG_SACK_REXMIT;
+      return ERR_OK;
+    }
+  }
+  return ERR_VAL;
+}
+#endif /* LWIP_TCP_SACK_IN */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1785,6 +1985,9 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_rexmit_fast: invalid pcb", pcb != NULL);
 
   if (pcb->unacked != NULL && !(pcb->flags & TF_INFR)) {
+#if LWIP_TCP_SACK_IN
+    struct tcp_seg *seg = pcb->unacked;
+#endif /* LWIP_TCP_SACK_IN */
     /* This is fast retransmit. Retransmit the first unacked segment. */
     LWIP_DEBUGF(TCP_FR_DEBUG,
                 ("tcp_receive: dupacks %"U16_F" (%"U32_F
@@ -1792,6 +1995,14 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  (u16_t)pcb->dupacks, pcb->lastack,
                  lwip_ntohl(pcb->unacked->tcphdr->seqno)));
     if (tcp_rexmit(pcb) == ERR_OK) {
+#if LWIP_TCP_SACK_IN
+      /* recovery lasts until everything sent so far is acked */
+      seg->flags |= TF_SEG_SACK_REXMIT;
+      pcb->sack_recover = pcb->snd_nxt;
+#endif /* LWIP_TCP_SACK_IN */
+#if LWIP_TCP_CC
+      pcb->cc->loss(pcb, 0);
+#else /* LWIP_TCP_CC */
       /* Set ssthresh to half of the minimum of the current
        * cwnd and the advertised window */
       pcb->ssthresh = LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2;
@@ -1806,12 +2017,19 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
       }
 
       pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+#endif /* LWIP_TCP_CC */
       tcp_set_flags(pcb, TF_INFR);
 
       /* Reset the retransmission timer to prevent immediate rto retransmissions */
       pcb->rtime = 0;
     }
   }
+#if LWIP_TCP_SACK_IN
+  else if ((pcb->flags & TF_INFR) && (pcb->flags & TF_SACK)) {
+    /* Every further dupack in recovery sends the next hole */
+    tcp_rexmit_sack_hole(pcb);
+  }
+#endif /* LWIP_TCP_SACK_IN */
 }
 
 static struct pbuf *
@@ -2024,6 +2242,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   u8_t num_sacks = 0;
 
   LWIP_ASSERT("tcp_send_empty_ack: invalid pcb", pcb != NULL);
+  TCP_TIMER_TOUCH(pcb);
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
@@ -119,9 +119,9 @@ const int lwip_num_cyclic_timers = LWIP_ARRAYSIZE(lwip_cyclic_timers);
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
 /** The one and only timeout list */
-static struct sys_timeo *next_timeout;
+static LWIP_TLS struct sys_timeo *next_timeout;
 
-static u32_t current_timeout_due_time;
+static LWIP_TLS u32_t current_timeout_due_time;
 
 #if LWIP_TESTMODE
 struct sys_timeo**
@@ -133,7 +133,7 @@ sys_timeouts_get_next_timeout(void)
 
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
-static int tcpip_tcp_timer_active;
+static LWIP_TLS int tcpip_tcp_timer_active;
 
 /**
  * Timer callback function that calls tcp_tmr() and reschedules itself.
@@ -340,6 +340,24 @@ sys_untimeout(sys_timeout_handler handler, void *arg)
   return;
 }
 
+/**
+ * Removes every pending timeout, the cyclic ones included. For a stack that
+ * is dropped, so the next lwip_init() does not leave them behind.
+ */
+void
+sys_untimeout_all(void)
+{
+  struct sys_timeo *t;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  while (next_timeout != NULL) {
+    t = next_timeout;
+    next_timeout = t->next;
+    memp_free(MEMP_SYS_TIMEOUT, t);
+  }
+}
+
 /**
  * @ingroup lwip_nosys
  * Handle timeouts for NO_SYS==1 (i.e. without using
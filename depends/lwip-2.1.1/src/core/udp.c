@@ -74,11 +74,11 @@
 #endif
 
 /* last local UDP port */
-static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
+static LWIP_TLS u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 
 /* The list of UDP PCBs */
 /* exported in udp.h (was static) */
-struct udp_pcb *udp_pcbs;
+LWIP_TLS struct udp_pcb *udp_pcbs;
 
 /**
  * Initialize this module.
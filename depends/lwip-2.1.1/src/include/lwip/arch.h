@@ -373,6 +373,14 @@ extern "C" {
 #define LWIP_UNUSED_ARG(x) (void)x
 #endif /* LWIP_UNUSED_ARG */
 
+/** Storage class applied to the stack's mutable globals (pcb lists, timers,
+ * input state, ...). Define it to the compiler's thread-local qualifier
+ * (e.g. \_\_thread) to run one independent stack instance per thread.
+ */
+#ifndef LWIP_TLS
+#define LWIP_TLS
+#endif /* LWIP_TLS */
+
 /** LWIP_PROVIDE_ERRNO==1: Let lwIP provide ERRNO values and the 'errno' variable.
  * If this is disabled, cc.h must either define 'errno', include <errno.h>,
  * define LWIP_ERRNO_STDINCLUDE to get <errno.h> included or
@@ -39,6 +39,7 @@
 #define LWIP_HDR_MEMP_H
 
 #include "lwip/opt.h"
+#include "lwip/err.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -148,6 +149,37 @@ void *memp_malloc(memp_t type);
 #endif
 void  memp_free(memp_t type, void *mem);
 
+#if MEMP_MEM_SLAB
+/** Allocator the slabs take their chunks from, malloc() if not set */
+typedef void *(*memp_slab_alloc_fn)(void *ctx, size_t size);
+typedef void (*memp_slab_free_fn)(void *ctx, void *mem);
+
+/** Occupancy of one slab */
+struct memp_slab_stats {
+  /** pool name, "HEAP" for the heap size classes */
+  const char *name;
+  /** element size, for heap classes the largest block served */
+  u32_t size;
+  u32_t used;
+  /** high-water mark of used */
+  u32_t max;
+  /** elements on the free list */
+  u32_t avail;
+  u32_t chunks;
+};
+
+void  memp_slab_set_allocator(memp_slab_alloc_fn alloc_fn, memp_slab_free_fn free_fn, void *ctx);
+err_t memp_slab_prewarm(memp_t type, u32_t num);
+err_t memp_slab_heap_prewarm(size_t size, u32_t num);
+void  memp_slab_trim(void);
+u16_t memp_slab_count(void);
+void  memp_slab_get_stats(u16_t idx, struct memp_slab_stats *stats);
+
+void *memp_slab_heap_malloc(size_t size);
+void *memp_slab_heap_calloc(size_t count, size_t size);
+void  memp_slab_heap_free(void *mem);
+#endif /* MEMP_MEM_SLAB */
+
 #ifdef __cplusplus
 }
 #endif
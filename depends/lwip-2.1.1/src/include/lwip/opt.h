@@ -280,6 +280,25 @@
 #define MEMP_MEM_INIT                   0
 #endif
 
+/**
+ * MEMP_MEM_SLAB==1: With MEMP_MEM_MALLOC and MEM_LIBC_MALLOC, carve the
+ * internal pools (one slab per memp_t) and the heap (a few size classes) out
+ * of chunks taken from a pluggable allocator, see memp_slab_set_allocator().
+ * Freed elements stay on the free list of their slab for reuse until
+ * memp_slab_trim() is called. Private pools keep going through the heap.
+ */
+#if !defined MEMP_MEM_SLAB || defined __DOXYGEN__
+#define MEMP_MEM_SLAB                   0
+#endif
+
+/**
+ * MEMP_SLAB_CHUNK_SIZE: bytes a slab takes from the allocator when its free
+ * list runs empty (at least one element).
+ */
+#if !defined MEMP_SLAB_CHUNK_SIZE || defined __DOXYGEN__
+#define MEMP_SLAB_CHUNK_SIZE            16384
+#endif
+
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
  *    4 byte alignment -> \#define MEM_ALIGNMENT 4
@@ -1268,6 +1287,16 @@
 #define LWIP_TCP_SACK_OUT               0
 #endif
 
+/**
+ * LWIP_TCP_SACK_IN==1: TCP will use the SACK blocks the remote host sends:
+ * fully sacked unacked segments are skipped by fast recovery, which stays in
+ * recovery over partial ACKs and retransmits one hole per ACK.
+ * Requires LWIP_TCP_SACK_OUT to negotiate SACK_PERM.
+ */
+#if !defined LWIP_TCP_SACK_IN || defined __DOXYGEN__
+#define LWIP_TCP_SACK_IN                0
+#endif
+
 /**
  * LWIP_TCP_MAX_SACK_NUM: The maximum number of SACK values to include in TCP segments.
  * Must be at least 1, but is only used if LWIP_TCP_SACK_OUT is enabled.
@@ -1386,6 +1415,24 @@
 #endif
 #endif
 
+/**
+ * TCP_OOSEQ_GLOBAL_MAX_BYTES: The maximum number of bytes queued on ooseq by
+ * all pcbs together. A segment that would exceed it is dropped like one over
+ * the per pcb limits. Default is 0 (no limit). Only valid for TCP_QUEUE_OOSEQ==1.
+ */
+#if !defined TCP_OOSEQ_GLOBAL_MAX_BYTES || defined __DOXYGEN__
+#define TCP_OOSEQ_GLOBAL_MAX_BYTES      0
+#endif
+
+/**
+ * TCP_OOSEQ_MERGE==1: Contiguous segments on ooseq are merged into one (up to
+ * 64K each), which keeps the queue short for the walks done per received segment.
+ * Only valid for TCP_QUEUE_OOSEQ==1.
+ */
+#if !defined TCP_OOSEQ_MERGE || defined __DOXYGEN__
+#define TCP_OOSEQ_MERGE                 0
+#endif
+
 /**
  * TCP_LISTEN_BACKLOG: Enable the backlog option for tcp listen pcb.
  */
@@ -1420,6 +1467,46 @@
 #define TCP_OVERSIZE                    TCP_MSS
 #endif
 
+/**
+ * LWIP_TCP_TSO==1: allow tcp_write to build segments larger than the MSS
+ * (up to pcb->tso_max) for netifs that can segment them (e.g. a tun device
+ * with a virtio-net header). The MSS to cut them with is passed to the
+ * netif in pbuf->tso_mss of the first pbuf.
+ */
+#if !defined LWIP_TCP_TSO || defined __DOXYGEN__
+#define LWIP_TCP_TSO                    0
+#endif
+
+/**
+ * LWIP_TCP_PCB_HASH==1: find the pcb of an incoming segment through a hash
+ * table over the active and TIME-WAIT pcbs, keyed by the 4-tuple, instead of
+ * walking tcp_active_pcbs and tcp_tw_pcbs.
+ */
+#if !defined LWIP_TCP_PCB_HASH || defined __DOXYGEN__
+#define LWIP_TCP_PCB_HASH               0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: number of buckets of the pcb hash table, must be a
+ * power of 2.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               256
+#endif
+
+/**
+ * LWIP_TCP_TIMER_WHEEL==1: keep the slow timer deadline of every active and
+ * TIME-WAIT pcb on a timer wheel and the pcbs with delayed ACKs, pending FINs
+ * or refused data on a list of their own, so tcp_slowtmr() and tcp_fasttmr()
+ * only visit the pcbs that have something to do instead of all of them.
+ * A pcb's deadline is recomputed whenever it sends or receives a segment;
+ * changing SOF_KEEPALIVE or the keepalive settings of an idle connection takes
+ * effect with its next segment.
+ */
+#if !defined LWIP_TCP_TIMER_WHEEL || defined __DOXYGEN__
+#define LWIP_TCP_TIMER_WHEEL            0
+#endif
+
 /**
  * LWIP_TCP_TIMESTAMPS==1: support the TCP timestamp option.
  * The timestamp option is currently only used to help remote hosts, it is not
@@ -1470,6 +1557,72 @@
 #define TCP_RCV_SCALE                   0
 #endif
 
+/**
+ * LWIP_TCP_BUF_LIMITS==1: TCP_SND_BUF and TCP_WND become ceilings, each pcb
+ * carries its own send buffer and receive window limit (pcb->snd_buf_max,
+ * pcb->rcv_wnd_max) which starts at the ceiling and can be changed at runtime
+ * with tcp_set_sndbuf_max() / tcp_set_rcv_wnd_max().
+ */
+#if !defined LWIP_TCP_BUF_LIMITS || defined __DOXYGEN__
+#define LWIP_TCP_BUF_LIMITS             0
+#endif
+
+/**
+ * LWIP_TCP_CC==1: congestion control goes through the hooks in pcb->cc
+ * (struct tcp_cc_ops, see tcp_cc.c) which can be changed per pcb with
+ * tcp_set_cc(). Reno (the stock lwIP behaviour), CUBIC and BBR are built in.
+ */
+#if !defined LWIP_TCP_CC || defined __DOXYGEN__
+#define LWIP_TCP_CC                     0
+#endif
+
+/**
+ * LWIP_TCP_CC_DEFAULT: the struct tcp_cc_ops every new pcb starts with.
+ */
+#if !defined LWIP_TCP_CC_DEFAULT || defined __DOXYGEN__
+#define LWIP_TCP_CC_DEFAULT             tcp_cc_reno
+#endif
+
+/**
+ * LWIP_TCP_CC_PRIV_WORDS: u32_t words of per pcb state an algorithm may keep
+ * in pcb->cc_priv.
+ */
+#if !defined LWIP_TCP_CC_PRIV_WORDS || defined __DOXYGEN__
+#define LWIP_TCP_CC_PRIV_WORDS          32
+#endif
+
+/**
+ * LWIP_TCP_ACK_BATCH==1: between tcp_batch_begin() and tcp_batch_end() a
+ * pure ACK or window update of an in order pcb is held back and sent once
+ * when the batch ends (or every TCP_ACK_BATCH_MAX_BYTES), so a burst of input
+ * segments is answered by a few ACKs. Duplicate ACKs (out of order data) still
+ * go out at once.
+ */
+#if !defined LWIP_TCP_ACK_BATCH || defined __DOXYGEN__
+#define LWIP_TCP_ACK_BATCH              0
+#endif
+
+/**
+ * TCP_ACK_BATCH_MAX_BYTES: in order bytes a pcb may take in during a batch
+ * before a held back ACK goes out anyway. Senders grow cwnd per ACK (RFC 3465
+ * limits slow start to 2 MSS per ACK), one ACK for a whole burst would starve
+ * them.
+ */
+#if !defined TCP_ACK_BATCH_MAX_BYTES || defined __DOXYGEN__
+#define TCP_ACK_BATCH_MAX_BYTES         (4 * TCP_MSS)
+#endif
+
+/**
+ * LWIP_TCP_HDR_PREDICT==1: Van Jacobson header prediction in tcp_input().
+ * An ESTABLISHED segment without options, flags other than ACK/PSH or a
+ * window change that is either a pure ACK for new data or the next in order
+ * data skips the state machine and the general receive paths. Can be turned
+ * off at runtime for measurements (tcp_hdr_predict_set()).
+ */
+#if !defined LWIP_TCP_HDR_PREDICT || defined __DOXYGEN__
+#define LWIP_TCP_HDR_PREDICT            0
+#endif
+
 /**
  * LWIP_TCP_PCB_NUM_EXT_ARGS:
  * When this is > 0, every tcp pcb (including listen pcb) includes a number of
@@ -124,14 +124,14 @@ enum nd6_neighbor_cache_entry_state {
 
 /* Router tables. */
 /* @todo make these static? and entries accessible through API? */
-extern struct nd6_neighbor_cache_entry neighbor_cache[];
-extern struct nd6_destination_cache_entry destination_cache[];
-extern struct nd6_prefix_list_entry prefix_list[];
-extern struct nd6_router_list_entry default_router_list[];
+extern LWIP_TLS struct nd6_neighbor_cache_entry neighbor_cache[];
+extern LWIP_TLS struct nd6_destination_cache_entry destination_cache[];
+extern LWIP_TLS struct nd6_prefix_list_entry prefix_list[];
+extern LWIP_TLS struct nd6_router_list_entry default_router_list[];
 
 /* Default values, can be updated by a RA message. */
-extern u32_t reachable_time;
-extern u32_t retrans_timer;
+extern LWIP_TLS u32_t reachable_time;
+extern LWIP_TLS u32_t retrans_timer;
 
 #ifdef __cplusplus
 }
@@ -66,6 +66,8 @@ void             tcp_tmr     (void);  /* Must be called every
    intervals (instead of calling tcp_tmr()). */
 void             tcp_slowtmr (void);
 void             tcp_fasttmr (void);
+/* Number of tcp_tmr() calls until one that has work, 0 if TCP is idle. */
+u32_t            tcp_tmr_next(void);
 
 /* Call this from a netif driver (watch out for threading issues!) that has
    returned a memory error on transmit and now has free buffers to send more.
@@ -85,6 +87,9 @@ err_t            tcp_rexmit_rto_prepare(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto_commit(struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK_IN
+err_t            tcp_rexmit_sack_hole(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK_IN */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
@@ -270,6 +275,9 @@ struct tcp_seg {
                                                checksummed into 'chksum' */
 #define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option (only used in SYN segments) */
 #define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option (only used in SYN segments) */
+#define TF_SEG_SACKED           (u8_t)0x20U /* unacked segment fully covered by a SACK block */
+#define TF_SEG_SACK_REXMIT      (u8_t)0x40U /* already retransmitted in this fast recovery */
+#define TF_SEG_DELIVERED        (u8_t)0x80U /* sacked once, counted in pcb->cc_delivered */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
@@ -278,6 +286,7 @@ struct tcp_seg {
 #define LWIP_TCP_OPT_MSS        2
 #define LWIP_TCP_OPT_WS         3
 #define LWIP_TCP_OPT_SACK_PERM  4
+#define LWIP_TCP_OPT_SACK       5
 #define LWIP_TCP_OPT_TS         8
 
 #define LWIP_TCP_OPT_LEN_MSS    4
@@ -323,25 +332,93 @@ struct tcp_seg {
 #endif /* LWIP_WND_SCALE */
 
 /* Global variables: */
-extern struct tcp_pcb *tcp_input_pcb;
-extern u32_t tcp_ticks;
-extern u8_t tcp_active_pcbs_changed;
+extern LWIP_TLS struct tcp_pcb *tcp_input_pcb;
+extern LWIP_TLS u32_t tcp_ticks;
+extern LWIP_TLS u8_t tcp_active_pcbs_changed;
+#if TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES
+extern LWIP_TLS u32_t tcp_ooseq_bytes;
+#endif /* TCP_QUEUE_OOSEQ && TCP_OOSEQ_GLOBAL_MAX_BYTES */
+#if LWIP_TCP_ACK_BATCH
+extern LWIP_TLS u8_t tcp_batch_depth;
+extern LWIP_TLS struct tcp_pcb *tcp_batch_pcbs;
+#endif /* LWIP_TCP_ACK_BATCH */
 
 /* The TCP PCB lists. */
 union tcp_listen_pcbs_t { /* List of all TCP PCBs in LISTEN state. */
   struct tcp_pcb_listen *listen_pcbs;
   struct tcp_pcb *pcbs;
 };
-extern struct tcp_pcb *tcp_bound_pcbs;
-extern union tcp_listen_pcbs_t tcp_listen_pcbs;
-extern struct tcp_pcb *tcp_active_pcbs;  /* List of all TCP PCBs that are in a
+extern LWIP_TLS struct tcp_pcb *tcp_bound_pcbs;
+extern LWIP_TLS union tcp_listen_pcbs_t tcp_listen_pcbs;
+extern LWIP_TLS struct tcp_pcb *tcp_active_pcbs;  /* List of all TCP PCBs that are in a
               state in which they accept or send
               data. */
-extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. */
+extern LWIP_TLS struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. */
+
+#if LWIP_TCP_PCB_HASH
+/* 4-tuple index over tcp_active_pcbs and tcp_tw_pcbs, kept by TCP_REG / TCP_RMV */
+void tcp_pcb_hash_add(struct tcp_pcb *pcb);
+void tcp_pcb_hash_remove(struct tcp_pcb *pcb);
+struct tcp_pcb *tcp_pcb_hash_lookup(const ip_addr_t *local_ip, u16_t local_port,
+                                    const ip_addr_t *remote_ip, u16_t remote_port,
+                                    u8_t netif_idx);
+#define TCP_PCB_HASH_REG(pcbs, npcb) do { \
+    if (((pcbs) == &tcp_active_pcbs) || ((pcbs) == &tcp_tw_pcbs)) { \
+      tcp_pcb_hash_add(npcb); \
+    } \
+  } while (0)
+#define TCP_PCB_HASH_RMV(pcbs, npcb) do { \
+    if (((pcbs) == &tcp_active_pcbs) || ((pcbs) == &tcp_tw_pcbs)) { \
+      tcp_pcb_hash_remove(npcb); \
+    } \
+  } while (0)
+#else /* LWIP_TCP_PCB_HASH */
+#define TCP_PCB_HASH_REG(pcbs, npcb)
+#define TCP_PCB_HASH_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_PCB_HASH */
+
+#if LWIP_TCP_TIMER_WHEEL
+/* slow timer wheel and fast timer list over tcp_active_pcbs and tcp_tw_pcbs,
+   kept by TCP_REG / TCP_RMV; TCP_TIMER_TOUCH queues a pcb whose timers may
+   have changed to have its deadline recomputed before the next timer run */
+void tcp_timer_track(struct tcp_pcb *pcb);
+void tcp_timer_untrack(struct tcp_pcb *pcb);
+void tcp_timer_touch(struct tcp_pcb *pcb);
+#define TCP_TIMER_TOUCH(pcb) tcp_timer_touch(pcb)
+/* the active and TIME-WAIT lists are doubly linked through list_pprev */
+#define TCP_PCB_LIST_LINKED(pcbs) (((pcbs) == &tcp_active_pcbs) || ((pcbs) == &tcp_tw_pcbs))
+#define TCP_PCB_LIST_UNLINK(npcb) do { \
+    *(npcb)->list_pprev = (npcb)->next; \
+    if ((npcb)->next != NULL) { \
+      (npcb)->next->list_pprev = (npcb)->list_pprev; \
+    } \
+    (npcb)->list_pprev = NULL; \
+  } while (0)
+#define TCP_PCB_TIMER_REG(pcbs, npcb) do { \
+    if (TCP_PCB_LIST_LINKED(pcbs)) { \
+      (npcb)->list_pprev = (pcbs); \
+      if ((npcb)->next != NULL) { \
+        (npcb)->next->list_pprev = &(npcb)->next; \
+      } \
+      tcp_timer_track(npcb); \
+    } \
+  } while (0)
+#define TCP_PCB_TIMER_RMV(pcbs, npcb) do { \
+    if (TCP_PCB_LIST_LINKED(pcbs)) { \
+      tcp_timer_untrack(npcb); \
+    } \
+  } while (0)
+#else /* LWIP_TCP_TIMER_WHEEL */
+#define TCP_TIMER_TOUCH(pcb)
+#define TCP_PCB_LIST_LINKED(pcbs) 0
+#define TCP_PCB_LIST_UNLINK(npcb)
+#define TCP_PCB_TIMER_REG(pcbs, npcb)
+#define TCP_PCB_TIMER_RMV(pcbs, npcb)
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
 #define NUM_TCP_PCB_LISTS_NO_TIME_WAIT  3
 #define NUM_TCP_PCB_LISTS               4
-extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
+extern LWIP_TLS struct tcp_pcb ** tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
 /* Axioms about the above lists:
    1) Every TCP PCB that is not CLOSED is in one of the lists.
@@ -367,6 +444,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_PCB_HASH_REG(pcbs, npcb); \
+                            TCP_PCB_TIMER_REG(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -374,7 +453,9 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             struct tcp_pcb *tcp_tmp_pcb; \
                             LWIP_ASSERT("TCP_RMV: pcbs != NULL", *(pcbs) != NULL); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removing %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
-                            if(*(pcbs) == (npcb)) { \
+                            if (TCP_PCB_LIST_LINKED(pcbs)) { \
+                               TCP_PCB_LIST_UNLINK(npcb); \
+                            } else if(*(pcbs) == (npcb)) { \
                                *(pcbs) = (*pcbs)->next; \
                             } else for (tcp_tmp_pcb = *(pcbs); tcp_tmp_pcb != NULL; tcp_tmp_pcb = tcp_tmp_pcb->next) { \
                                if(tcp_tmp_pcb->next == (npcb)) { \
@@ -383,6 +464,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_PCB_HASH_RMV(pcbs, npcb); \
+                            TCP_PCB_TIMER_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
                             } while(0)
@@ -393,12 +476,17 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_PCB_HASH_REG(pcbs, npcb);                  \
+    TCP_PCB_TIMER_REG(pcbs, npcb);                 \
     tcp_timer_needed();                            \
   } while (0)
 
 #define TCP_RMV(pcbs, npcb)                        \
   do {                                             \
-    if(*(pcbs) == (npcb)) {                        \
+    if (TCP_PCB_LIST_LINKED(pcbs)) {               \
+      TCP_PCB_LIST_UNLINK(npcb);                   \
+    }                                              \
+    else if(*(pcbs) == (npcb)) {                   \
       (*(pcbs)) = (*pcbs)->next;                   \
     }                                              \
     else {                                         \
@@ -413,6 +501,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_PCB_HASH_RMV(pcbs, npcb);                  \
+    TCP_PCB_TIMER_RMV(pcbs, npcb);                 \
   } while(0)
 
 #endif /* LWIP_DEBUG */
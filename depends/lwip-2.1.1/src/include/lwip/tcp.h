@@ -133,16 +133,21 @@ typedef void  (*tcp_err_fn)(void *arg, err_t err);
  */
 typedef err_t (*tcp_connected_fn)(void *arg, struct tcp_pcb *tpcb, err_t err);
 
+#if LWIP_TCP_BUF_LIMITS
+#define TCP_WND_LIMIT(pcb)      ((pcb)->rcv_wnd_max)
+#else
+#define TCP_WND_LIMIT(pcb)      TCP_WND
+#endif
 #if LWIP_WND_SCALE
 #define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
 #define SND_WND_SCALE(pcb, wnd) (((wnd) << (pcb)->snd_scale))
 #define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xFFFF))
-#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND : TCPWND16(TCP_WND)))
+#define TCP_WND_MAX(pcb)        ((tcpwnd_size_t)(((pcb)->flags & TF_WND_SCALE) ? TCP_WND_LIMIT(pcb) : TCPWND16(TCP_WND_LIMIT(pcb))))
 #else
 #define RCV_WND_SCALE(pcb, wnd) (wnd)
 #define SND_WND_SCALE(pcb, wnd) (wnd)
 #define TCPWND16(x)             (x)
-#define TCP_WND_MAX(pcb)        TCP_WND
+#define TCP_WND_MAX(pcb)        TCP_WND_LIMIT(pcb)
 #endif
 /* Increments a tcpwnd_size_t and holds at max value rather than rollover */
 #define TCP_WND_INC(wnd, inc)   do { \
@@ -203,6 +208,31 @@ struct tcp_pcb_ext_args {
 #define TCP_PCB_EXTARGS
 #endif
 
+#if LWIP_TCP_CC
+/** Congestion control hooks, one table per algorithm (see tcp_cc.c).
+ * All are called with the pcb in ESTABLISHED or later. */
+struct tcp_cc_ops {
+  const char *name;
+  /** reset pcb->cc_priv (zeroed before) when the algorithm is attached */
+  void (*init)(struct tcp_pcb *pcb);
+  /** an ACK for new data, also during fast recovery (TF_INFR set) */
+  void (*acked)(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+  /** a duplicate ACK past the third, in fast recovery */
+  void (*dupack)(struct tcp_pcb *pcb);
+  /** loss: set ssthresh and cwnd, on an RTO (rto != 0) or entering fast recovery */
+  void (*loss)(struct tcp_pcb *pcb, u8_t rto);
+  /** fast recovery is over */
+  void (*recovered)(struct tcp_pcb *pcb);
+};
+
+extern const struct tcp_cc_ops tcp_cc_reno;
+extern const struct tcp_cc_ops tcp_cc_cubic;
+extern const struct tcp_cc_ops tcp_cc_bbr;
+
+/** the built in algorithm called name, NULL if none */
+const struct tcp_cc_ops *tcp_cc_find(const char *name);
+#endif /* LWIP_TCP_CC */
+
 typedef u16_t tcpflags_t;
 #define TCP_ALLFLAGS 0xffffU
 
@@ -248,6 +278,18 @@ struct tcp_pcb {
   /* ports are in host byte order */
   u16_t remote_port;
 
+#if LWIP_TCP_PCB_HASH
+  /* next pcb in the same bucket of the 4-tuple hash */
+  struct tcp_pcb *hash_next;
+#endif
+
+#if LWIP_TCP_ACK_BATCH
+  /* next pcb with an ACK held back by the current batch */
+  struct tcp_pcb *batch_next;
+  /* rcv_nxt when the held back ACK was first due */
+  u32_t batch_rcv_nxt;
+#endif
+
   tcpflags_t flags;
 #define TF_ACK_DELAY   0x01U   /* Delayed ACK. */
 #define TF_ACK_NOW     0x02U   /* Immediate ACK. */
@@ -269,6 +311,9 @@ struct tcp_pcb {
 #define TF_RTO         0x0800U /* RTO timer has fired, in-flight data moved to unsent and being retransmitted */
 #if LWIP_TCP_SACK_OUT
 #define TF_SACK        0x1000U /* Selective ACKs enabled */
+#endif
+#if LWIP_TCP_ACK_BATCH
+#define TF_ACK_BATCHED 0x2000U /* pure ACK held back until tcp_batch_end() */
 #endif
 
   /* the rest of the fields are in host byte order
@@ -278,12 +323,30 @@ struct tcp_pcb {
   u8_t polltmr, pollinterval;
   u8_t last_timer;
   u32_t tmr;
+#if LWIP_TCP_TIMER_WHEEL
+  /* previous pcb's next pointer on tcp_active_pcbs / tcp_tw_pcbs */
+  struct tcp_pcb **list_pprev;
+  /* timer wheel slot (or list of pcbs waiting to be rescheduled) */
+  struct tcp_pcb *wheel_next;
+  struct tcp_pcb **wheel_pprev;
+  /* list of pcbs with work for tcp_fasttmr() */
+  struct tcp_pcb *fast_next;
+  struct tcp_pcb **fast_pprev;
+  /* tcp_ticks of the next slow timer run */
+  u32_t wheel_due;
+  /* tcp_ticks rtime, persist_cnt and polltmr have been brought up to */
+  u32_t wheel_base;
+  u8_t wheel_where;
+#endif /* LWIP_TCP_TIMER_WHEEL */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
   tcpwnd_size_t rcv_wnd;   /* receiver window available */
   tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+#if LWIP_TCP_BUF_LIMITS
+  tcpwnd_size_t rcv_wnd_max; /* receiver window once scaling is agreed, <= TCP_WND */
+#endif /* LWIP_TCP_BUF_LIMITS */
 
 #if LWIP_TCP_SACK_OUT
   /* SACK ranges to include in ACK packets (entry is invalid if left==right) */
@@ -295,6 +358,9 @@ struct tcp_pcb {
   s16_t rtime;
 
   u16_t mss;   /* maximum segment size */
+#if LWIP_TCP_TSO
+  u16_t tso_max; /* largest segment tcp_write may build, 0: mss */
+#endif /* LWIP_TCP_TSO */
 
   /* RTT (round trip time) estimation variables */
   u32_t rttest; /* RTT estimate in 500ms ticks */
@@ -315,6 +381,20 @@ struct tcp_pcb {
   /* first byte following last rto byte */
   u32_t rto_end;
 
+#if LWIP_TCP_CC
+  const struct tcp_cc_ops *cc;
+  /* bytes known to have reached the remote host, cumulatively acked or sacked */
+  u32_t cc_delivered;
+  u32_t cc_priv[LWIP_TCP_CC_PRIV_WORDS];
+#endif /* LWIP_TCP_CC */
+
+#if LWIP_TCP_SACK_IN
+  /* highest seqno sacked by the remote host */
+  u32_t sack_high;
+  /* snd_nxt when fast recovery started, partial ACKs below keep it going */
+  u32_t sack_recover;
+#endif /* LWIP_TCP_SACK_IN */
+
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
   u32_t snd_wl1, snd_wl2; /* Sequence and acknowledgement numbers of last
@@ -324,6 +404,9 @@ struct tcp_pcb {
   tcpwnd_size_t snd_wnd_max; /* the maximum sender window announced by the remote host */
 
   tcpwnd_size_t snd_buf;   /* Available buffer space for sending (in bytes). */
+#if LWIP_TCP_BUF_LIMITS
+  tcpwnd_size_t snd_buf_max; /* bytes that may be queued, <= TCP_SND_BUF which snd_buf counts down from */
+#endif /* LWIP_TCP_BUF_LIMITS */
 #define TCP_SNDQUEUELEN_OVERFLOW (0xffffU-3)
   u16_t snd_queuelen; /* Number of pbufs currently in the send buffer. */
 
@@ -339,6 +422,9 @@ struct tcp_pcb {
   struct tcp_seg *unacked;  /* Sent but unacknowledged segments. */
 #if TCP_QUEUE_OOSEQ
   struct tcp_seg *ooseq;    /* Received out of sequence segments. */
+#if TCP_OOSEQ_GLOBAL_MAX_BYTES
+  u32_t ooseq_bytes;        /* bytes on ooseq, counted in tcp_ooseq_bytes */
+#endif /* TCP_OOSEQ_GLOBAL_MAX_BYTES */
 #endif /* TCP_QUEUE_OOSEQ */
 
   struct pbuf *refused_data; /* Data previously received but not yet taken by upper layer */
@@ -430,11 +516,20 @@ void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interv
 /** @ingroup tcp_raw */
 #define          tcp_mss(pcb)             ((pcb)->mss)
 #endif /* LWIP_TCP_TIMESTAMPS */
+#if LWIP_TCP_BUF_LIMITS
+#define          tcp_sndbuf_avail(pcb)    ((tcpwnd_size_t)((pcb)->snd_buf > (TCP_SND_BUF - (pcb)->snd_buf_max) ? \
+                                             (pcb)->snd_buf - (TCP_SND_BUF - (pcb)->snd_buf_max) : 0))
+#else /* LWIP_TCP_BUF_LIMITS */
+#define          tcp_sndbuf_avail(pcb)    ((pcb)->snd_buf)
+#endif /* LWIP_TCP_BUF_LIMITS */
 /** @ingroup tcp_raw */
-#define          tcp_sndbuf(pcb)          (TCPWND16((pcb)->snd_buf))
+#define          tcp_sndbuf(pcb)          (TCPWND16(tcp_sndbuf_avail(pcb)))
 /** @ingroup tcp_raw */
 #define          tcp_sndqueuelen(pcb)     ((pcb)->snd_queuelen)
 /** @ingroup tcp_raw */
+#if LWIP_TCP_TSO
+#define          tcp_set_tso_max(pcb, max) do { (pcb)->tso_max = (max); } while(0)
+#endif /* LWIP_TCP_TSO */
 #define          tcp_nagle_disable(pcb)   tcp_set_flags(pcb, TF_NODELAY)
 /** @ingroup tcp_raw */
 #define          tcp_nagle_enable(pcb)    tcp_clear_flags(pcb, TF_NODELAY)
@@ -455,6 +550,21 @@ void             tcp_backlog_accepted(struct tcp_pcb* pcb);
 #define          tcp_accepted(pcb) do { LWIP_UNUSED_ARG(pcb); } while(0) /* compatibility define, not needed any more */
 
 void             tcp_recved  (struct tcp_pcb *pcb, u16_t len);
+#if LWIP_TCP_BUF_LIMITS
+void             tcp_set_sndbuf_max(struct tcp_pcb *pcb, tcpwnd_size_t max);
+void             tcp_set_rcv_wnd_max(struct tcp_pcb *pcb, tcpwnd_size_t max);
+#endif /* LWIP_TCP_BUF_LIMITS */
+#if LWIP_TCP_CC
+void             tcp_set_cc  (struct tcp_pcb *pcb, const struct tcp_cc_ops *cc);
+#endif /* LWIP_TCP_CC */
+#if LWIP_TCP_ACK_BATCH
+void             tcp_batch_begin(void);
+void             tcp_batch_end(void);
+#endif /* LWIP_TCP_ACK_BATCH */
+#if LWIP_TCP_HDR_PREDICT
+void             tcp_hdr_predict_set(u8_t enable);
+void             tcp_hdr_predict_stat(u32_t *acks, u32_t *data);
+#endif /* LWIP_TCP_HDR_PREDICT */
 err_t            tcp_bind    (struct tcp_pcb *pcb, const ip_addr_t *ipaddr,
                               u16_t port);
 void             tcp_bind_netif(struct tcp_pcb *pcb, const struct netif *netif);
@@ -112,7 +112,7 @@ struct udp_pcb {
   void *recv_arg;
 };
 /* udp_pcbs export for external reference (e.g. SNMP agent) */
-extern struct udp_pcb *udp_pcbs;
+extern LWIP_TLS struct udp_pcb *udp_pcbs;
 
 /* The following functions is the application layer interface to the
    UDP code. */
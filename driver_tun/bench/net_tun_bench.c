@@ -0,0 +1,725 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "ev.h"
+#include "cpe/pal/pal_stdio.h"
+#include "cpe/pal/pal_strings.h"
+#include "cpe/utils/error.h"
+#include "net_schedule.h"
+#include "net_driver.h"
+#include "net_ev_driver.h"
+#include "net_protocol.h"
+#include "net_endpoint.h"
+#include "net_dgram.h"
+#include "net_address.h"
+#include "net_timer.h"
+#include "net_tun_driver.h"
+#include "net_tun_device.h"
+#include "net_tun_wildcard_acceptor.h"
+#include "net_tun_bench_peer.h"
+#include "net_tun_bench_chksum.h"
+#include "lwip/tcp.h"
+
+/*
+ * end to end benchmark: a tun device opened with net_tun_device_init_fd on one end of a
+ * SOCK_SEQPACKET socketpair, the bench peer (its own lwip in its own thread) on the other.
+ * traffic goes through the device, lwip and the net endpoint / dgram layer of the server.
+ */
+
+#if !(NET_TUN_USE_DEV_TUN && NET_TUN_USE_DRIVER)
+#error "net_driver_tun_bench needs the dev tun device on an inner driver"
+#endif
+
+#define NET_TUN_BENCH_PORT_DISCARD 5001
+#define NET_TUN_BENCH_PORT_ECHO 5002
+#define NET_TUN_BENCH_PORT_UDP 5003
+#define NET_TUN_BENCH_PORT_SOURCE 5004
+#define NET_TUN_BENCH_CHECK_MS 5
+#define NET_TUN_BENCH_UDP_SETTLE_NS 50000000u
+#define NET_TUN_BENCH_WAN_BYTES (32ull << 20)
+#define NET_TUN_BENCH_CC_BYTES (4ull << 20)
+#define NET_TUN_BENCH_CC_RTT_MS 50
+
+/*wan: single bulk flow over these emulated rtts unless -d picks one*/
+static const uint32_t s_net_tun_bench_wan_rtts[] = { 50, 200 };
+
+/*cc: the server sends one download per algorithm and loss rate (ppm) unless -c / -l pick one*/
+static const char * s_net_tun_bench_cc_names[] = { "reno", "cubic", "bbr" };
+static const uint32_t s_net_tun_bench_cc_losses[] = { 0, 1000, 10000 };
+
+struct net_tun_bench_options {
+    uint64_t m_bulk_bytes;
+    uint32_t m_rr_count;
+    uint32_t m_rr_size;
+    uint32_t m_udp_count;
+    uint32_t m_udp_size;
+    uint16_t m_mtu;
+    uint16_t m_batch;
+    uint32_t m_budget;
+    uint8_t m_uring;
+    uint8_t m_trust_chksum;
+    uint8_t m_zero_copy;
+    int32_t m_gro;
+    uint32_t m_timeout_ms;
+    uint32_t m_rtt_ms;
+    uint32_t m_tcp_buf;
+    uint32_t m_loss_ppm;
+    uint8_t m_loss_set;
+    const char * m_tcp_cc;
+};
+
+struct net_tun_bench {
+    struct net_tun_bench_options m_options;
+    error_monitor_t m_em;
+    struct ev_loop * m_loop;
+    net_schedule_t m_schedule;
+    net_driver_t m_inner_driver;
+    net_tun_driver_t m_driver;
+    net_protocol_t m_protocol;
+    net_tun_wildcard_acceptor_t m_acceptor;
+    net_timer_t m_check_timer;
+
+    /*current run*/
+    uint32_t m_rtt_ms;
+    uint32_t m_loss_ppm;
+    const char * m_tcp_cc;
+    net_tun_bench_peer_t m_peer;
+    net_dgram_t m_dgram;
+    uint64_t m_tcp_in_bytes;
+    uint64_t m_tcp_out_bytes;
+    uint64_t m_udp_packets;
+    uint64_t m_udp_bytes;
+    uint64_t m_udp_last_ns;
+    uint32_t m_predict_acks;
+    uint32_t m_predict_data;
+};
+typedef struct net_tun_bench * net_tun_bench_t;
+
+static const char * net_tun_bench_mode_str(net_tun_bench_mode_t mode) {
+    switch(mode) {
+    case net_tun_bench_mode_bulk:
+        return "bulk";
+    case net_tun_bench_mode_rr:
+        return "rr";
+    case net_tun_bench_mode_udp:
+        return "udp";
+    case net_tun_bench_mode_download:
+        return "down";
+    }
+    return "unknown";
+}
+
+static uint64_t net_tun_bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*server side: discard, echo or source by local port*/
+static int net_tun_bench_endpoint_input(net_endpoint_t endpoint) {
+    static uint8_t s_source_block[0xFFFF];
+    uint16_t port = net_address_port(net_endpoint_address(endpoint));
+
+    uint32_t size = net_endpoint_buf_size(endpoint, net_ep_buf_read);
+    if (size == 0) return 0;
+
+    if (port == NET_TUN_BENCH_PORT_SOURCE) {
+        void * data;
+        uint64_t bytes;
+
+        /*the request is a byte count, queued at once so the sender is bound by tcp only*/
+        if (size < sizeof(bytes)) return 0;
+        if (net_endpoint_buf_peak_with_size(endpoint, net_ep_buf_read, sizeof(bytes), &data) != 0) return -1;
+        memcpy(&bytes, data, sizeof(bytes));
+        net_endpoint_buf_consume(endpoint, net_ep_buf_read, sizeof(bytes));
+
+        while(bytes > 0) {
+            uint32_t block = bytes > sizeof(s_source_block) ? sizeof(s_source_block) : (uint32_t)bytes;
+            if (net_endpoint_buf_append(endpoint, net_ep_buf_write, s_source_block, block) != 0) return -1;
+            bytes -= block;
+        }
+        return 0;
+    }
+
+    if (port == NET_TUN_BENCH_PORT_ECHO) {
+        void * data;
+        if (net_endpoint_buf_peak_with_size(endpoint, net_ep_buf_read, size, &data) != 0) return -1;
+        if (net_endpoint_buf_append(endpoint, net_ep_buf_write, data, size) != 0) return -1;
+    }
+
+    net_endpoint_buf_consume(endpoint, net_ep_buf_read, size);
+    return 0;
+}
+
+/*bulk data taken straight from lwip's pbufs and dropped*/
+static void net_tun_bench_discard_recv(void * ctx, net_endpoint_t endpoint) {
+    void const * data;
+    uint32_t size;
+
+    while(net_tun_endpoint_recv_peek(endpoint, &data, &size) == 0) {
+        net_tun_endpoint_recv_consume(endpoint, size);
+    }
+}
+
+static int net_tun_bench_on_new_endpoint(void * ctx, net_endpoint_t endpoint) {
+    net_tun_bench_t bench = ctx;
+
+    if (bench->m_options.m_zero_copy
+        && net_address_port(net_endpoint_address(endpoint)) == NET_TUN_BENCH_PORT_DISCARD)
+    {
+        return net_tun_endpoint_set_recv_zero_copy(endpoint, net_tun_bench_discard_recv, bench);
+    }
+
+    return 0;
+}
+
+static void net_tun_bench_data_monitor(void * ctx, net_endpoint_t endpoint, net_data_direction_t direction, uint32_t size) {
+    net_tun_bench_t bench = ctx;
+
+    if (direction == net_data_in) {
+        bench->m_tcp_in_bytes += size;
+    }
+    else {
+        bench->m_tcp_out_bytes += size;
+    }
+}
+
+static void net_tun_bench_dgram_recv(
+    net_dgram_t dgram, void * ctx, void * data, size_t data_size, net_address_t source)
+{
+    net_tun_bench_t bench = ctx;
+
+    bench->m_udp_packets++;
+    bench->m_udp_bytes += data_size;
+    bench->m_udp_last_ns = net_tun_bench_now_ns();
+}
+
+static void net_tun_bench_check_timer_cb(net_timer_t timer, void * ctx) {
+    net_tun_bench_t bench = ctx;
+
+    if (net_tun_bench_peer_is_done(bench->m_peer)) {
+        /*datagrams still queued in the socketpair are part of the run*/
+        if (bench->m_dgram == NULL
+            || bench->m_udp_last_ns + NET_TUN_BENCH_UDP_SETTLE_NS < net_tun_bench_now_ns())
+        {
+            ev_break(bench->m_loop, EVBREAK_ALL);
+            return;
+        }
+    }
+
+    net_timer_active(timer, NET_TUN_BENCH_CHECK_MS);
+}
+
+static net_tun_device_t net_tun_bench_device_create(net_tun_bench_t bench, int fd) {
+    struct net_tun_device_init_data settings;
+    bzero(&settings, sizeof(settings));
+    settings.m_dev_type = net_tun_device_tun;
+    settings.m_init_type = net_tun_device_init_fd;
+    settings.m_io_type = bench->m_options.m_uring ? net_tun_device_io_uring : net_tun_device_io_watcher;
+    settings.m_init_data.m_fd = fd;
+    settings.m_init_data.m_mtu = bench->m_options.m_mtu;
+
+    struct net_address_data_ipv4 ip = { { 10, 0, 0, 1 } };
+    struct net_address_data_ipv4 mask = { { 255, 255, 255, 0 } };
+
+    struct net_tun_device_netif_options netif_settings;
+    bzero(&netif_settings, sizeof(netif_settings));
+    netif_settings.m_ipv4_address = net_address_create_ipv4_from_data(bench->m_schedule, &ip, 0);
+    netif_settings.m_ipv4_mask = net_address_create_ipv4_from_data(bench->m_schedule, &mask, 0);
+    netif_settings.m_skip_input_chksum = bench->m_options.m_trust_chksum;
+
+    net_tun_device_t device = NULL;
+    if (netif_settings.m_ipv4_address && netif_settings.m_ipv4_mask) {
+        device = net_tun_device_create(bench->m_driver, &settings, &netif_settings);
+    }
+    net_tun_device_netif_options_clear(&netif_settings);
+
+    if (device && bench->m_options.m_batch > 1) {
+        net_tun_device_set_output_batch(device, bench->m_options.m_batch, 0);
+    }
+
+    if (device && bench->m_options.m_gro >= 0) {
+        net_tun_device_set_gro(device, (uint16_t)bench->m_options.m_gro);
+    }
+
+    return device;
+}
+
+static void net_tun_bench_report(
+    net_tun_bench_t bench, net_tun_bench_mode_t mode, net_tun_device_t device, net_tun_bench_peer_result_t r,
+    uint64_t server_cpu_ns, uint64_t wall_ns, uint64_t cycles)
+{
+    uint64_t end_ns = r->m_end_ns;
+    uint64_t bytes = r->m_bytes;
+    if (mode == net_tun_bench_mode_udp) {
+        bytes = bench->m_udp_bytes;
+        if (bench->m_udp_last_ns > end_ns) end_ns = bench->m_udp_last_ns;
+    }
+
+    double elapsed = end_ns > r->m_begin_ns ? (double)(end_ns - r->m_begin_ns) / 1e9 : 1e-9;
+    double packets = (double)(r->m_packets_in + r->m_packets_out);
+
+    printf(
+        "%-4s: %.2f MB in %.3f s, %.3f Gbps, %.0f pps (in " FMT_UINT64_T " / out " FMT_UINT64_T ")",
+        net_tun_bench_mode_str(mode), (double)bytes / (1024.0 * 1024.0), elapsed,
+        (double)bytes * 8.0 / elapsed / 1e9, packets / elapsed, r->m_packets_out, r->m_packets_in);
+
+    if (bench->m_rtt_ms) {
+        printf(", rtt %u ms, %.2f MB/s", bench->m_rtt_ms, (double)bytes / (1024.0 * 1024.0) / elapsed);
+    }
+
+    if (bench->m_loss_ppm) {
+        printf(
+            ", loss %.2f%% (" FMT_UINT64_T " dropped)",
+            (double)bench->m_loss_ppm / 10000.0, r->m_packets_dropped);
+    }
+
+    if (bench->m_tcp_cc) {
+        printf(", cc %s", bench->m_tcp_cc);
+    }
+
+    if (mode == net_tun_bench_mode_bulk && bench->m_options.m_zero_copy) {
+        printf(", zero copy");
+    }
+
+#if LWIP_TCP_HDR_PREDICT
+    /*segments the server lwip got, the peer sends them all*/
+    if (mode != net_tun_bench_mode_udp && r->m_packets_out) {
+        printf(
+            ", predicted %u acks / %u data of " FMT_UINT64_T " segments",
+            bench->m_predict_acks, bench->m_predict_data, r->m_packets_out);
+        if (cycles && wall_ns) {
+            printf(
+                " (%.0f cycles/segment)",
+                (double)server_cpu_ns * ((double)cycles / (double)wall_ns) / (double)r->m_packets_out);
+        }
+    }
+#endif
+
+    if (mode != net_tun_bench_mode_udp) {
+        printf(", endpoint in " FMT_UINT64_T " / out " FMT_UINT64_T " bytes", bench->m_tcp_in_bytes, bench->m_tcp_out_bytes);
+    }
+
+    if (mode == net_tun_bench_mode_rr) {
+        printf(
+            ", %.0f trans/s, p50 %.1f us, p99 %.1f us",
+            (double)r->m_transactions / elapsed,
+            (double)r->m_latency_p50_ns / 1e3, (double)r->m_latency_p99_ns / 1e3);
+    }
+
+    struct net_tun_device_gro_stat gro_stat;
+    net_tun_device_gro_stat(device, &gro_stat);
+    if (gro_stat.m_packets) {
+        printf(
+            ", gro " FMT_UINT64_T " segs in " FMT_UINT64_T " packets",
+            gro_stat.m_segments, gro_stat.m_packets);
+    }
+
+    if (mode == net_tun_bench_mode_udp) {
+        uint64_t sent = bench->m_options.m_udp_count;
+        printf(
+            ", received " FMT_UINT64_T "/" FMT_UINT64_T " (%.2f%% lost)",
+            bench->m_udp_packets, sent,
+            sent ? (double)(sent - bench->m_udp_packets) * 100.0 / (double)sent : 0.0);
+    }
+
+    /*cpu time of the bench thread (device + lwip + endpoints), the peer thread is not counted*/
+    if (bytes) {
+        if (cycles && wall_ns) {
+            printf(
+                ", %.2f cycles/byte",
+                (double)server_cpu_ns * ((double)cycles / (double)wall_ns) / (double)bytes);
+        }
+        else {
+            printf(", %.2f ns/byte", (double)server_cpu_ns / (double)bytes);
+        }
+    }
+
+    printf("\n");
+}
+
+static int net_tun_bench_run(
+    net_tun_bench_t bench, net_tun_bench_mode_t mode, uint32_t rtt_ms, uint32_t loss_ppm, const char * tcp_cc)
+{
+    int fds[2] = { -1, -1 };
+    net_tun_device_t device = NULL;
+    int rv = -1;
+
+    if (net_tun_driver_set_tcp_cc(bench->m_driver, tcp_cc) != 0) return -1;
+
+    bench->m_rtt_ms = rtt_ms;
+    bench->m_loss_ppm = loss_ppm;
+    bench->m_tcp_cc = tcp_cc;
+    bench->m_tcp_in_bytes = 0;
+    bench->m_tcp_out_bytes = 0;
+    bench->m_udp_packets = 0;
+    bench->m_udp_bytes = 0;
+    bench->m_udp_last_ns = 0;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+        CPE_ERROR(bench->m_em, "bench: %s: socketpair fail, errno=%d (%s)", net_tun_bench_mode_str(mode), errno, strerror(errno));
+        goto RUN_COMPLETE;
+    }
+
+    device = net_tun_bench_device_create(bench, fds[0]);
+    if (device == NULL) {
+        CPE_ERROR(bench->m_em, "bench: %s: create device fail", net_tun_bench_mode_str(mode));
+        goto RUN_COMPLETE;
+    }
+
+    if (mode == net_tun_bench_mode_udp) {
+        struct net_address_data_ipv4 ip = { { 10, 0, 0, 1 } };
+        net_address_t address = net_address_create_ipv4_from_data(bench->m_schedule, &ip, NET_TUN_BENCH_PORT_UDP);
+        if (address == NULL) goto RUN_COMPLETE;
+
+        bench->m_dgram = net_dgram_create(
+            net_tun_driver_base_driver(bench->m_driver), address, net_tun_bench_dgram_recv, bench);
+        net_address_free(address);
+        if (bench->m_dgram == NULL) {
+            CPE_ERROR(bench->m_em, "bench: %s: create dgram fail", net_tun_bench_mode_str(mode));
+            goto RUN_COMPLETE;
+        }
+    }
+
+    struct net_tun_bench_peer_settings peer_settings;
+    bzero(&peer_settings, sizeof(peer_settings));
+    peer_settings.m_mode = mode;
+    peer_settings.m_fd = fds[1];
+    peer_settings.m_mtu = bench->m_options.m_mtu;
+    peer_settings.m_local_ip = inet_addr("10.0.0.2");
+    peer_settings.m_remote_ip = inet_addr("10.0.0.1");
+    peer_settings.m_timeout_ms = bench->m_options.m_timeout_ms;
+    peer_settings.m_delay_ms = rtt_ms;
+    peer_settings.m_tcp_buf = bench->m_options.m_tcp_buf;
+    peer_settings.m_loss_ppm = loss_ppm;
+    switch(mode) {
+    case net_tun_bench_mode_bulk:
+        peer_settings.m_remote_port = NET_TUN_BENCH_PORT_DISCARD;
+        peer_settings.m_bytes = bench->m_options.m_bulk_bytes;
+        break;
+    case net_tun_bench_mode_rr:
+        peer_settings.m_remote_port = NET_TUN_BENCH_PORT_ECHO;
+        peer_settings.m_count = bench->m_options.m_rr_count;
+        peer_settings.m_size = bench->m_options.m_rr_size;
+        break;
+    case net_tun_bench_mode_udp:
+        peer_settings.m_remote_port = NET_TUN_BENCH_PORT_UDP;
+        peer_settings.m_count = bench->m_options.m_udp_count;
+        peer_settings.m_size = bench->m_options.m_udp_size;
+        break;
+    case net_tun_bench_mode_download:
+        peer_settings.m_remote_port = NET_TUN_BENCH_PORT_SOURCE;
+        peer_settings.m_bytes = bench->m_options.m_bulk_bytes;
+        break;
+    }
+
+    uint64_t cpu_begin = net_tun_bench_thread_cpu_ns();
+    uint64_t wall_begin = net_tun_bench_now_ns();
+    uint64_t cycles_begin = net_tun_bench_cycles();
+#if LWIP_TCP_HDR_PREDICT
+    uint32_t predict_acks_begin;
+    uint32_t predict_data_begin;
+    tcp_hdr_predict_stat(&predict_acks_begin, &predict_data_begin);
+#endif
+
+    bench->m_peer = net_tun_bench_peer_start(&peer_settings);
+    if (bench->m_peer == NULL) goto RUN_COMPLETE;
+
+    net_timer_active(bench->m_check_timer, NET_TUN_BENCH_CHECK_MS);
+    ev_run(bench->m_loop, 0);
+    net_timer_cancel(bench->m_check_timer);
+
+    uint64_t server_cpu_ns = net_tun_bench_thread_cpu_ns() - cpu_begin;
+    uint64_t wall_ns = net_tun_bench_now_ns() - wall_begin;
+    uint64_t cycles = net_tun_bench_cycles() - cycles_begin;
+#if LWIP_TCP_HDR_PREDICT
+    tcp_hdr_predict_stat(&bench->m_predict_acks, &bench->m_predict_data);
+    bench->m_predict_acks -= predict_acks_begin;
+    bench->m_predict_data -= predict_data_begin;
+#endif
+
+    struct net_tun_bench_peer_result result;
+    rv = net_tun_bench_peer_wait(bench->m_peer, &result);
+    bench->m_peer = NULL;
+    if (rv != 0) {
+        CPE_ERROR(bench->m_em, "bench: %s: peer fail", net_tun_bench_mode_str(mode));
+        goto RUN_COMPLETE;
+    }
+
+    net_tun_bench_report(bench, mode, device, &result, server_cpu_ns, wall_ns, cycles);
+
+RUN_COMPLETE:
+    if (bench->m_dgram) {
+        net_dgram_free(bench->m_dgram);
+        bench->m_dgram = NULL;
+    }
+
+    if (device) {
+        net_tun_device_free(device);
+    }
+
+    if (fds[0] != -1) close(fds[0]);
+    if (fds[1] != -1) close(fds[1]);
+
+    return rv;
+}
+
+static void net_tun_bench_usage(const char * name) {
+    fprintf(
+        stderr,
+        "usage: %s [-m bulk|rr|udp|all|wan|cc|predict|chksum] [-B mbytes] [-n count] [-s size] [-M mtu] [-o batch] [-r budget] [-u] [-k] [-g segs] [-z]\n"
+        "          [-d rtt-ms] [-l loss-percent] [-c reno|cubic|bbr] [-w kbytes] [-t timeout-ms]\n"
+        "  -m  wan: one bulk flow over 50 and 200 ms emulated rtt\n"
+        "      cc: the server sends, one flow per algorithm and loss rate (0, 0.1, 1%%) at 50 ms rtt\n"
+        "      predict: bulk and download with tcp header prediction of the server off, then on\n"
+        "  -B  bulk: megabytes to transfer (default 256, wan 32, cc 4), chksum: megabytes per kernel and size\n"
+        "  -n  rr: transactions (default 20000), udp: datagrams (default 200000)\n"
+        "  -s  rr: request size (default 64), udp: datagram size (default 1024)\n"
+        "  -o  output batch flush count (default off)\n"
+        "  -r  read budget in packets per wakeup (default driver setting)\n"
+        "  -u  io_uring device io\n"
+        "  -k  trust input checksums (no verification in lwip)\n"
+        "  -z  bulk: the server reads straight from lwip's pbufs (zero copy receive)\n"
+        "  -g  in order tcp segments merged into one packet before lwip, 1: off (default driver setting)\n"
+        "  -d  emulated rtt in ms, the peer holds back what it sends (wan, cc: the only rtt)\n"
+        "  -l  emulated loss in percent of the packets the device sends (cc: the only loss rate)\n"
+        "  -c  tcp congestion control of the server connections (cc: the only algorithm)\n"
+        "  -w  tcp send buffer / receive window in kbytes, both ends (default driver setting)\n",
+        name);
+}
+
+int main(int argc, char * argv[]) {
+    struct net_tun_bench bench;
+    struct error_monitor em_buf;
+    const char * mode_str = "all";
+    int32_t count = -1;
+    int32_t size = -1;
+    uint8_t bulk_bytes_set = 0;
+    uint32_t i;
+    uint32_t j;
+    int opt;
+    int rv = -1;
+
+    bzero(&bench, sizeof(bench));
+    bench.m_options.m_bulk_bytes = 256ull << 20;
+    bench.m_options.m_rr_count = 20000;
+    bench.m_options.m_rr_size = 64;
+    bench.m_options.m_udp_count = 200000;
+    bench.m_options.m_udp_size = 1024;
+    bench.m_options.m_mtu = 1500;
+    bench.m_options.m_gro = -1;
+    bench.m_options.m_timeout_ms = 60000;
+
+    while((opt = getopt(argc, argv, "m:B:n:s:M:o:r:ukzg:d:l:c:w:t:h")) != -1) {
+        switch(opt) {
+        case 'm':
+            mode_str = optarg;
+            break;
+        case 'B':
+            bench.m_options.m_bulk_bytes = strtoull(optarg, NULL, 10) << 20;
+            bulk_bytes_set = 1;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'M':
+            bench.m_options.m_mtu = (uint16_t)atoi(optarg);
+            break;
+        case 'o':
+            bench.m_options.m_batch = (uint16_t)atoi(optarg);
+            break;
+        case 'r':
+            bench.m_options.m_budget = (uint32_t)atoi(optarg);
+            break;
+        case 'u':
+            bench.m_options.m_uring = 1;
+            break;
+        case 'k':
+            bench.m_options.m_trust_chksum = 1;
+            break;
+        case 'z':
+            bench.m_options.m_zero_copy = 1;
+            break;
+        case 'g':
+            bench.m_options.m_gro = atoi(optarg);
+            break;
+        case 'd':
+            bench.m_options.m_rtt_ms = (uint32_t)atoi(optarg);
+            break;
+        case 'l':
+            bench.m_options.m_loss_ppm = (uint32_t)(atof(optarg) * 10000.0 + 0.5);
+            bench.m_options.m_loss_set = 1;
+            break;
+        case 'c':
+            bench.m_options.m_tcp_cc = optarg;
+            break;
+        case 'w':
+            bench.m_options.m_tcp_buf = (uint32_t)atoi(optarg) * 1024;
+            break;
+        case 't':
+            bench.m_options.m_timeout_ms = (uint32_t)atoi(optarg);
+            break;
+        default:
+            net_tun_bench_usage(argv[0]);
+            return opt == 'h' ? 0 : -1;
+        }
+    }
+
+    if (count > 0) bench.m_options.m_rr_count = bench.m_options.m_udp_count = (uint32_t)count;
+    if (size > 0) bench.m_options.m_rr_size = bench.m_options.m_udp_size = (uint32_t)size;
+
+    cpe_error_monitor_init(&em_buf, cpe_error_log_to_consol, NULL);
+    bench.m_em = &em_buf;
+
+    /*cpu only, runs without a device*/
+    if (strcmp(mode_str, "chksum") == 0) {
+        return net_tun_bench_chksum_run(bench.m_em, bench.m_options.m_bulk_bytes);
+    }
+
+    uint8_t run_bulk = strcmp(mode_str, "all") == 0 || strcmp(mode_str, "bulk") == 0;
+    uint8_t run_rr = strcmp(mode_str, "all") == 0 || strcmp(mode_str, "rr") == 0;
+    uint8_t run_udp = strcmp(mode_str, "all") == 0 || strcmp(mode_str, "udp") == 0;
+    uint8_t run_wan = strcmp(mode_str, "wan") == 0;
+    uint8_t run_cc = strcmp(mode_str, "cc") == 0;
+    uint8_t run_predict = strcmp(mode_str, "predict") == 0;
+    if (!run_bulk && !run_rr && !run_udp && !run_wan && !run_cc && !run_predict) {
+        net_tun_bench_usage(argv[0]);
+        return -1;
+    }
+
+    bench.m_loop = ev_default_loop(0);
+    if (bench.m_loop == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create ev loop fail");
+        return -1;
+    }
+
+    bench.m_schedule = net_schedule_create(NULL, bench.m_em, 2048);
+    if (bench.m_schedule == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create schedule fail");
+        return -1;
+    }
+
+    net_ev_driver_t ev_driver = net_ev_driver_create(bench.m_schedule, bench.m_loop);
+    if (ev_driver == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create ev driver fail");
+        goto COMPLETE;
+    }
+    bench.m_inner_driver = net_ev_driver_base_driver(ev_driver);
+
+    bench.m_driver = net_tun_driver_create(bench.m_schedule, bench.m_inner_driver);
+    if (bench.m_driver == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create tun driver fail");
+        goto COMPLETE;
+    }
+
+    if (bench.m_options.m_budget) {
+        net_tun_driver_set_read_budget(bench.m_driver, bench.m_options.m_budget, 0);
+    }
+    if (bench.m_options.m_tcp_buf) {
+        net_tun_driver_set_tcp_buf(bench.m_driver, bench.m_options.m_tcp_buf, bench.m_options.m_tcp_buf);
+    }
+    if (bench.m_options.m_tcp_cc && net_tun_driver_set_tcp_cc(bench.m_driver, bench.m_options.m_tcp_cc) != 0) {
+        goto COMPLETE;
+    }
+    net_tun_driver_set_data_monitor(bench.m_driver, net_tun_bench_data_monitor, &bench);
+
+    bench.m_protocol =
+        net_protocol_create(
+            bench.m_schedule, "bench",
+            0, NULL, NULL,
+            0, NULL, NULL, net_tun_bench_endpoint_input, NULL, NULL);
+    if (bench.m_protocol == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create protocol fail");
+        goto COMPLETE;
+    }
+
+    bench.m_acceptor =
+        net_tun_wildcard_acceptor_create(
+            bench.m_driver, net_tun_wildcard_acceptor_mode_black, bench.m_protocol,
+            net_tun_bench_on_new_endpoint, &bench);
+    if (bench.m_acceptor == NULL) goto COMPLETE;
+
+    bench.m_check_timer = net_timer_create(bench.m_inner_driver, net_tun_bench_check_timer_cb, &bench);
+    if (bench.m_check_timer == NULL) {
+        CPE_ERROR(bench.m_em, "bench: create check timer fail");
+        goto COMPLETE;
+    }
+
+    uint32_t rtt_ms = bench.m_options.m_rtt_ms;
+    uint32_t loss_ppm = bench.m_options.m_loss_ppm;
+    const char * tcp_cc = bench.m_options.m_tcp_cc;
+
+    rv = 0;
+    if (run_bulk && net_tun_bench_run(&bench, net_tun_bench_mode_bulk, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+    if (run_rr && net_tun_bench_run(&bench, net_tun_bench_mode_rr, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+    if (run_udp && net_tun_bench_run(&bench, net_tun_bench_mode_udp, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+
+    if (run_wan) {
+        if (!bulk_bytes_set) bench.m_options.m_bulk_bytes = NET_TUN_BENCH_WAN_BYTES;
+
+        if (rtt_ms) {
+            if (net_tun_bench_run(&bench, net_tun_bench_mode_bulk, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+        }
+        else {
+            for(i = 0; i < sizeof(s_net_tun_bench_wan_rtts) / sizeof(s_net_tun_bench_wan_rtts[0]); ++i) {
+                if (net_tun_bench_run(&bench, net_tun_bench_mode_bulk, s_net_tun_bench_wan_rtts[i], loss_ppm, tcp_cc) != 0) rv = -1;
+            }
+        }
+    }
+
+    if (run_cc) {
+        if (!bulk_bytes_set) bench.m_options.m_bulk_bytes = NET_TUN_BENCH_CC_BYTES;
+        if (rtt_ms == 0) rtt_ms = NET_TUN_BENCH_CC_RTT_MS;
+
+        for(i = 0; i < sizeof(s_net_tun_bench_cc_names) / sizeof(s_net_tun_bench_cc_names[0]); ++i) {
+            if (tcp_cc && strcmp(tcp_cc, s_net_tun_bench_cc_names[i]) != 0) continue;
+
+            for(j = 0; j < sizeof(s_net_tun_bench_cc_losses) / sizeof(s_net_tun_bench_cc_losses[0]); ++j) {
+                if (bench.m_options.m_loss_set && j > 0) break;
+
+                if (net_tun_bench_run(
+                        &bench, net_tun_bench_mode_download, rtt_ms,
+                        bench.m_options.m_loss_set ? loss_ppm : s_net_tun_bench_cc_losses[j],
+                        s_net_tun_bench_cc_names[i]) != 0)
+                {
+                    rv = -1;
+                }
+            }
+        }
+    }
+
+    if (run_predict) {
+#if LWIP_TCP_HDR_PREDICT
+        for(i = 0; i < 2; ++i) {
+            printf("hdr predict %s\n", i ? "on" : "off");
+            tcp_hdr_predict_set((u8_t)i);
+            if (net_tun_bench_run(&bench, net_tun_bench_mode_bulk, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+            if (net_tun_bench_run(&bench, net_tun_bench_mode_download, rtt_ms, loss_ppm, tcp_cc) != 0) rv = -1;
+        }
+#else
+        CPE_ERROR(bench.m_em, "bench: predict: lwip built without LWIP_TCP_HDR_PREDICT");
+        rv = -1;
+#endif
+    }
+
+COMPLETE:
+    if (bench.m_check_timer) net_timer_free(bench.m_check_timer);
+    if (bench.m_acceptor) net_tun_wildcard_acceptor_free(bench.m_acceptor);
+    if (bench.m_protocol) net_protocol_free(bench.m_protocol);
+    if (bench.m_driver) net_tun_driver_free(bench.m_driver);
+    net_schedule_free(bench.m_schedule);
+
+    return rv;
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include "cpe/pal/pal_stdio.h"
+#include "cpe/pal/pal_string.h"
+#include "lwip/opt.h"
+#include "arch/chksum.h"
+#include "net_tun_bench_peer.h"
+#include "net_tun_bench_chksum.h"
+
+static const int s_net_tun_bench_chksum_sizes[] = { 20, 40, 64, 128, 256, 576, 1500, 4096, 9000, 65535 };
+
+#define NET_TUN_BENCH_CHKSUM_SIZE_COUNT (sizeof(s_net_tun_bench_chksum_sizes) / sizeof(s_net_tun_bench_chksum_sizes[0]))
+#define NET_TUN_BENCH_CHKSUM_BUF_SIZE (65535 + 1)
+
+static volatile u16_t s_net_tun_bench_chksum_sink;
+
+/*dst == NULL: checksum only, otherwise copy into dst, fused by the kernel or a bare memcpy without one*/
+static uint64_t net_tun_bench_chksum_measure(
+    const struct lwip_chksum_kernel * kernel, uint8_t * dst, const uint8_t * src, int size, uint64_t calls)
+{
+    uint64_t c;
+    uint64_t begin_ns = net_tun_bench_now_ns();
+
+    if (dst == NULL) {
+        for(c = 0; c < calls; ++c) {
+            s_net_tun_bench_chksum_sink = kernel->chksum(src, size);
+        }
+    }
+    else if (kernel == NULL) {
+        for(c = 0; c < calls; ++c) {
+            memcpy(dst, src, (size_t)size);
+            s_net_tun_bench_chksum_sink = dst[0];
+        }
+    }
+    else {
+        for(c = 0; c < calls; ++c) {
+            s_net_tun_bench_chksum_sink = kernel->chksum_copy(dst, src, (u16_t)size);
+        }
+    }
+
+    uint64_t ns = net_tun_bench_now_ns() - begin_ns;
+    return ns ? ns : 1;
+}
+
+static void net_tun_bench_chksum_row(
+    const char * name, const struct lwip_chksum_kernel * kernel, uint8_t * dst, const uint8_t * src,
+    uint64_t bytes_per_size)
+{
+    uint32_t i;
+
+    printf("  %-12s", name);
+
+    for(i = 0; i < NET_TUN_BENCH_CHKSUM_SIZE_COUNT; ++i) {
+        int size = s_net_tun_bench_chksum_sizes[i];
+        uint64_t calls = bytes_per_size / (uint64_t)size + 1;
+        uint64_t ns = net_tun_bench_chksum_measure(kernel, dst, src, size, calls);
+
+        printf(
+            " %5d:%6.2f (%.1f)", size,
+            (double)size * (double)calls / (double)ns, (double)ns / (double)calls);
+    }
+
+    printf("\n");
+}
+
+int net_tun_bench_chksum_run(error_monitor_t em, uint64_t bytes_per_size) {
+    uint8_t * buf = malloc(NET_TUN_BENCH_CHKSUM_BUF_SIZE);
+    uint8_t * dst = malloc(NET_TUN_BENCH_CHKSUM_BUF_SIZE);
+    u8_t kernel_count = lwip_chksum_kernel_count();
+    const struct lwip_chksum_kernel * scalar = lwip_chksum_kernel_at(0);
+    char name[32];
+    int rv = 0;
+    u8_t k;
+    uint32_t i;
+    int offset;
+
+    if (buf == NULL || dst == NULL) {
+        CPE_ERROR(em, "bench: chksum: alloc buf fail");
+        rv = -1;
+        goto COMPLETE;
+    }
+
+    for(i = 0; i < NET_TUN_BENCH_CHKSUM_BUF_SIZE; ++i) buf[i] = (uint8_t)rand();
+
+    printf("chksum: selected %s\n", lwip_chksum_kernel_selected()->name);
+
+    for(offset = 0; offset < 2; ++offset) {
+        printf("chksum: offset %d, GB/s (ns/call)\n", offset);
+
+        for(k = 0; k < kernel_count; ++k) {
+            const struct lwip_chksum_kernel * kernel = lwip_chksum_kernel_at(k);
+
+            for(i = 0; i < NET_TUN_BENCH_CHKSUM_SIZE_COUNT; ++i) {
+                int size = s_net_tun_bench_chksum_sizes[i];
+                u16_t expect = scalar->chksum(buf + offset, size);
+
+                if (kernel->chksum(buf + offset, size) != expect
+                    || kernel->chksum_copy(dst, buf + offset, (u16_t)size) != expect
+                    || memcmp(dst, buf + offset, (size_t)size) != 0)
+                {
+                    CPE_ERROR(em, "bench: chksum: %s: size %d offset %d mismatch the scalar kernel", kernel->name, size, offset);
+                    rv = -1;
+                }
+            }
+
+            net_tun_bench_chksum_row(kernel->name, kernel, NULL, buf + offset, bytes_per_size);
+        }
+
+        /*what tcp_write pays per segment with LWIP_CHECKSUM_ON_COPY, against a bare memcpy*/
+        net_tun_bench_chksum_row("memcpy", NULL, dst, buf + offset, bytes_per_size);
+        for(k = 0; k < kernel_count; ++k) {
+            const struct lwip_chksum_kernel * kernel = lwip_chksum_kernel_at(k);
+            snprintf(name, sizeof(name), "%s+copy", kernel->name);
+            net_tun_bench_chksum_row(name, kernel, dst, buf + offset, bytes_per_size);
+        }
+    }
+
+COMPLETE:
+    if (buf) free(buf);
+    if (dst) free(dst);
+    return rv;
+}
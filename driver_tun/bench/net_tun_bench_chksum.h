@@ -0,0 +1,13 @@
+#ifndef NET_TUN_BENCH_CHKSUM_H_INCLEDED
+#define NET_TUN_BENCH_CHKSUM_H_INCLEDED
+#include <stdint.h>
+#include "cpe/utils/error.h"
+
+/*
+ * checksum microbenchmark: every kernel this cpu runs (see arch/chksum.h) over packet
+ * sized buffers at an even and an odd offset, then its fused copy variant against a bare
+ * memcpy. no device and no lwip instance involved.
+ */
+int net_tun_bench_chksum_run(error_monitor_t em, uint64_t bytes_per_size);
+
+#endif
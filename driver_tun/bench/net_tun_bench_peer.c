@@ -0,0 +1,599 @@
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "lwip/init.h"
+#include "lwip/ip.h"
+#include "lwip/ip4.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "net_tun_bench_peer.h"
+
+#define NET_TUN_BENCH_PEER_READ_BATCH 64
+
+typedef struct net_tun_bench_peer_delayed * net_tun_bench_peer_delayed_t;
+struct net_tun_bench_peer_delayed {
+    net_tun_bench_peer_delayed_t m_next;
+    uint64_t m_due_ns;
+    uint16_t m_len;
+};
+
+struct net_tun_bench_peer {
+    struct net_tun_bench_peer_settings m_settings;
+    pthread_t m_thread;
+    uint8_t m_done;
+    uint8_t m_finished; /*set once the thread is done with lwip, read by the bench thread*/
+    struct netif m_netif;
+    struct tcp_pcb * m_tcp;
+    struct udp_pcb * m_udp;
+    uint8_t m_connected;
+    uint8_t m_out_blocked;
+    uint8_t m_failed;
+    uint8_t * m_payload;
+    uint32_t m_payload_size;
+    uint8_t m_buf[0xFFFF];
+    unsigned int m_loss_seed;
+
+    /*delay line, oldest first*/
+    net_tun_bench_peer_delayed_t m_delayed_head;
+    net_tun_bench_peer_delayed_t * m_delayed_tail;
+
+    /*bulk*/
+    uint64_t m_bulk_queued;
+    uint64_t m_bulk_acked;
+
+    /*rr*/
+    uint64_t m_rr_begin_ns;
+    uint32_t m_rr_received;
+    uint32_t m_rr_done;
+    uint64_t * m_latency;
+
+    /*udp*/
+    uint32_t m_udp_sent;
+
+    /*download*/
+    uint64_t m_download_received;
+
+    struct net_tun_bench_peer_result m_result;
+};
+
+static void * net_tun_bench_peer_thread(void * ctx);
+static err_t net_tun_bench_peer_netif_init(struct netif * netif);
+static err_t net_tun_bench_peer_netif_output(struct netif * netif, struct pbuf * p, const ip4_addr_t * ipaddr);
+static err_t net_tun_bench_peer_connected(void * arg, struct tcp_pcb * pcb, err_t err);
+static err_t net_tun_bench_peer_recv(void * arg, struct tcp_pcb * pcb, struct pbuf * p, err_t err);
+static err_t net_tun_bench_peer_sent(void * arg, struct tcp_pcb * pcb, u16_t len);
+static void net_tun_bench_peer_err(void * arg, err_t err);
+static void net_tun_bench_peer_drive(net_tun_bench_peer_t peer);
+static void net_tun_bench_peer_finish(net_tun_bench_peer_t peer, uint8_t ok);
+static int net_tun_bench_peer_send(net_tun_bench_peer_t peer, void const * data, uint16_t len);
+static void net_tun_bench_peer_delayed_flush(net_tun_bench_peer_t peer, uint64_t now_ns);
+static void net_tun_bench_peer_delayed_clear(net_tun_bench_peer_t peer);
+
+uint64_t net_tun_bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t net_tun_bench_thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+net_tun_bench_peer_t net_tun_bench_peer_start(net_tun_bench_peer_settings_t settings) {
+    net_tun_bench_peer_t peer = calloc(1, sizeof(struct net_tun_bench_peer));
+    if (peer == NULL) {
+        fprintf(stderr, "bench: peer: alloc fail\n");
+        return NULL;
+    }
+
+    peer->m_settings = *settings;
+    peer->m_delayed_tail = &peer->m_delayed_head;
+    peer->m_loss_seed = 1;
+    peer->m_payload_size =
+        settings->m_mode == net_tun_bench_mode_bulk ? 0xFFFF
+        : settings->m_mode == net_tun_bench_mode_download ? sizeof(uint64_t)
+        : settings->m_size;
+    if (peer->m_payload_size == 0 || peer->m_payload_size > 0xFFFF) {
+        fprintf(stderr, "bench: peer: payload size %u not support\n", peer->m_payload_size);
+        free(peer);
+        return NULL;
+    }
+
+    peer->m_payload = malloc(peer->m_payload_size);
+    if (peer->m_payload == NULL) {
+        fprintf(stderr, "bench: peer: alloc payload fail\n");
+        free(peer);
+        return NULL;
+    }
+
+    uint32_t i;
+    for(i = 0; i < peer->m_payload_size; ++i) peer->m_payload[i] = (uint8_t)i;
+
+    /*download: the request is the byte count, both ends share the host byte order*/
+    if (settings->m_mode == net_tun_bench_mode_download) memcpy(peer->m_payload, &settings->m_bytes, sizeof(uint64_t));
+
+    if (settings->m_mode == net_tun_bench_mode_rr) {
+        peer->m_latency = calloc(settings->m_count ? settings->m_count : 1, sizeof(uint64_t));
+        if (peer->m_latency == NULL) {
+            fprintf(stderr, "bench: peer: alloc latency samples fail\n");
+            free(peer->m_payload);
+            free(peer);
+            return NULL;
+        }
+    }
+
+    if (pthread_create(&peer->m_thread, NULL, net_tun_bench_peer_thread, peer) != 0) {
+        fprintf(stderr, "bench: peer: create thread fail, errno=%d (%s)\n", errno, strerror(errno));
+        free(peer->m_latency);
+        free(peer->m_payload);
+        free(peer);
+        return NULL;
+    }
+
+    return peer;
+}
+
+uint8_t net_tun_bench_peer_is_done(net_tun_bench_peer_t peer) {
+    return __atomic_load_n(&peer->m_finished, __ATOMIC_ACQUIRE);
+}
+
+int net_tun_bench_peer_wait(net_tun_bench_peer_t peer, net_tun_bench_peer_result_t result) {
+    pthread_join(peer->m_thread, NULL);
+
+    *result = peer->m_result;
+
+    free(peer->m_latency);
+    free(peer->m_payload);
+    free(peer);
+
+    return result->m_ok ? 0 : -1;
+}
+
+static int net_tun_bench_peer_start_traffic(net_tun_bench_peer_t peer) {
+    ip_addr_t remote = IPADDR4_INIT(peer->m_settings.m_remote_ip);
+
+    if (peer->m_settings.m_mode == net_tun_bench_mode_udp) {
+        peer->m_udp = udp_new();
+        if (peer->m_udp == NULL) {
+            fprintf(stderr, "bench: peer: udp_new fail\n");
+            return -1;
+        }
+
+        if (udp_connect(peer->m_udp, &remote, peer->m_settings.m_remote_port) != ERR_OK) {
+            fprintf(stderr, "bench: peer: udp connect fail\n");
+            return -1;
+        }
+
+        peer->m_connected = 1;
+        return 0;
+    }
+
+    peer->m_tcp = tcp_new();
+    if (peer->m_tcp == NULL) {
+        fprintf(stderr, "bench: peer: tcp_new fail\n");
+        return -1;
+    }
+
+    tcp_arg(peer->m_tcp, peer);
+    tcp_recv(peer->m_tcp, net_tun_bench_peer_recv);
+    tcp_sent(peer->m_tcp, net_tun_bench_peer_sent);
+    tcp_err(peer->m_tcp, net_tun_bench_peer_err);
+    if (peer->m_settings.m_mode == net_tun_bench_mode_rr) tcp_nagle_disable(peer->m_tcp);
+    if (peer->m_settings.m_tcp_buf) {
+        tcp_set_sndbuf_max(peer->m_tcp, peer->m_settings.m_tcp_buf);
+        tcp_set_rcv_wnd_max(peer->m_tcp, peer->m_settings.m_tcp_buf);
+    }
+
+    err_t err = tcp_connect(peer->m_tcp, &remote, peer->m_settings.m_remote_port, net_tun_bench_peer_connected);
+    if (err != ERR_OK) {
+        fprintf(stderr, "bench: peer: tcp connect fail, err=%d\n", err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void net_tun_bench_peer_input(net_tun_bench_peer_t peer) {
+    int i;
+    for(i = 0; i < NET_TUN_BENCH_PEER_READ_BATCH; ++i) {
+        ssize_t bytes = recv(peer->m_settings.m_fd, peer->m_buf, sizeof(peer->m_buf), MSG_DONTWAIT);
+        if (bytes <= 0) {
+            if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "bench: peer: recv fail, errno=%d (%s)\n", errno, strerror(errno));
+                peer->m_failed = 1;
+            }
+            return;
+        }
+
+        peer->m_result.m_packets_in++;
+
+        if (peer->m_settings.m_loss_ppm
+            && (uint32_t)rand_r(&peer->m_loss_seed) % 1000000u < peer->m_settings.m_loss_ppm)
+        {
+            peer->m_result.m_packets_dropped++;
+            continue;
+        }
+
+        struct pbuf * p = pbuf_alloc(PBUF_RAW, (u16_t)bytes, PBUF_POOL);
+        if (p == NULL) {
+            fprintf(stderr, "bench: peer: alloc pbuf fail\n");
+            continue;
+        }
+        pbuf_take(p, peer->m_buf, (u16_t)bytes);
+
+        if (peer->m_netif.input(p, &peer->m_netif) != ERR_OK) {
+            pbuf_free(p);
+        }
+    }
+}
+
+static void * net_tun_bench_peer_thread(void * ctx) {
+    net_tun_bench_peer_t peer = ctx;
+    uint64_t cpu_begin;
+    uint64_t deadline_ns;
+    uint64_t next_tmr_ns;
+
+    lwip_init();
+
+    ip4_addr_t addr;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    ip4_addr_set_u32(&addr, peer->m_settings.m_local_ip);
+    IP4_ADDR(&netmask, 255, 255, 255, 255);
+    ip4_addr_set_any(&gw);
+
+    if (!netif_add(&peer->m_netif, &addr, &netmask, &gw, peer, net_tun_bench_peer_netif_init, ip_input)) {
+        fprintf(stderr, "bench: peer: add netif fail\n");
+        net_tun_bench_peer_finish(peer, 0);
+        return NULL;
+    }
+    netif_set_default(&peer->m_netif);
+    netif_set_up(&peer->m_netif);
+    netif_set_link_up(&peer->m_netif);
+
+    cpu_begin = net_tun_bench_thread_cpu_ns();
+    peer->m_result.m_begin_ns = net_tun_bench_now_ns();
+    deadline_ns = peer->m_result.m_begin_ns + (uint64_t)peer->m_settings.m_timeout_ms * 1000000u;
+    next_tmr_ns = peer->m_result.m_begin_ns + TCP_TMR_INTERVAL * 1000000u;
+
+    if (net_tun_bench_peer_start_traffic(peer) != 0) peer->m_failed = 1;
+
+    while(!peer->m_done && !peer->m_failed) {
+        uint64_t now_ns = net_tun_bench_now_ns();
+        if (now_ns >= deadline_ns) {
+            fprintf(stderr, "bench: peer: timeout\n");
+            peer->m_failed = 1;
+            break;
+        }
+
+        if (now_ns >= next_tmr_ns) {
+            tcp_tmr();
+            next_tmr_ns += TCP_TMR_INTERVAL * 1000000u;
+            continue;
+        }
+
+        net_tun_bench_peer_delayed_flush(peer, now_ns);
+
+        struct pollfd pfd = { peer->m_settings.m_fd, POLLIN, 0 };
+        if (peer->m_out_blocked) pfd.events |= POLLOUT;
+
+        int wait_ms = (int)((next_tmr_ns - now_ns) / 1000000u);
+        if (peer->m_delayed_head && !peer->m_out_blocked) {
+            uint64_t due_ns = peer->m_delayed_head->m_due_ns;
+            int due_ms = due_ns > now_ns ? (int)((due_ns - now_ns + 999999u) / 1000000u) : 0;
+            if (due_ms < wait_ms) wait_ms = due_ms;
+        }
+        uint8_t want_send =
+            !peer->m_out_blocked && peer->m_connected
+            && (peer->m_settings.m_mode == net_tun_bench_mode_udp
+                || (peer->m_settings.m_mode == net_tun_bench_mode_bulk && peer->m_bulk_queued < peer->m_settings.m_bytes));
+        if (want_send) wait_ms = 0;
+
+        if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+            fprintf(stderr, "bench: peer: poll fail, errno=%d (%s)\n", errno, strerror(errno));
+            peer->m_failed = 1;
+            break;
+        }
+
+        if (pfd.revents & POLLOUT) peer->m_out_blocked = 0;
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) net_tun_bench_peer_input(peer);
+
+        if (peer->m_connected) net_tun_bench_peer_drive(peer);
+    }
+
+    peer->m_result.m_cpu_ns = net_tun_bench_thread_cpu_ns() - cpu_begin;
+    if (peer->m_result.m_end_ns == 0) peer->m_result.m_end_ns = net_tun_bench_now_ns();
+
+    if (peer->m_tcp) {
+        tcp_arg(peer->m_tcp, NULL);
+        tcp_recv(peer->m_tcp, NULL);
+        tcp_sent(peer->m_tcp, NULL);
+        tcp_err(peer->m_tcp, NULL);
+        if (tcp_close(peer->m_tcp) != ERR_OK) tcp_abort(peer->m_tcp);
+        peer->m_tcp = NULL;
+
+        /*give the fin a chance to reach the server*/
+        net_tun_bench_peer_delayed_flush(peer, UINT64_MAX);
+        net_tun_bench_peer_input(peer);
+    }
+
+    if (peer->m_udp) {
+        udp_remove(peer->m_udp);
+        peer->m_udp = NULL;
+    }
+
+    net_tun_bench_peer_delayed_clear(peer);
+    netif_remove(&peer->m_netif);
+
+    net_tun_bench_peer_finish(peer, !peer->m_failed);
+    return NULL;
+}
+
+static void net_tun_bench_peer_drive(net_tun_bench_peer_t peer) {
+    switch(peer->m_settings.m_mode) {
+    case net_tun_bench_mode_bulk:
+        while(peer->m_tcp && peer->m_bulk_queued < peer->m_settings.m_bytes && !peer->m_out_blocked) {
+            uint64_t left = peer->m_settings.m_bytes - peer->m_bulk_queued;
+            uint32_t size = tcp_sndbuf(peer->m_tcp);
+            if (size > peer->m_payload_size) size = peer->m_payload_size;
+            if (size > left) size = (uint32_t)left;
+            if (size == 0) break;
+
+            if (tcp_write(peer->m_tcp, peer->m_payload, (u16_t)size, 0) != ERR_OK) break;
+            peer->m_bulk_queued += size;
+        }
+        if (peer->m_tcp) tcp_output(peer->m_tcp);
+        break;
+    case net_tun_bench_mode_rr:
+    case net_tun_bench_mode_download:
+        if (peer->m_tcp) tcp_output(peer->m_tcp);
+        break;
+    case net_tun_bench_mode_udp:
+        while(peer->m_udp_sent < peer->m_settings.m_count && !peer->m_out_blocked) {
+            struct pbuf * p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)peer->m_payload_size, PBUF_RAM);
+            if (p == NULL) break;
+
+            memcpy(p->payload, peer->m_payload, peer->m_payload_size);
+            err_t err = udp_send(peer->m_udp, p);
+            pbuf_free(p);
+            if (err != ERR_OK) break;
+
+            peer->m_udp_sent++;
+            peer->m_result.m_bytes += peer->m_payload_size;
+        }
+
+        if (peer->m_udp_sent >= peer->m_settings.m_count) {
+            peer->m_result.m_end_ns = net_tun_bench_now_ns();
+            peer->m_done = 1;
+        }
+        break;
+    }
+}
+
+static void net_tun_bench_peer_rr_send(net_tun_bench_peer_t peer) {
+    peer->m_rr_received = 0;
+    peer->m_rr_begin_ns = net_tun_bench_now_ns();
+    if (tcp_write(peer->m_tcp, peer->m_payload, (u16_t)peer->m_payload_size, 0) != ERR_OK) {
+        fprintf(stderr, "bench: peer: rr: write request fail\n");
+        peer->m_failed = 1;
+        return;
+    }
+    tcp_output(peer->m_tcp);
+}
+
+static err_t net_tun_bench_peer_connected(void * arg, struct tcp_pcb * pcb, err_t err) {
+    net_tun_bench_peer_t peer = arg;
+
+    if (err != ERR_OK) {
+        fprintf(stderr, "bench: peer: connect fail, err=%d\n", err);
+        peer->m_failed = 1;
+        return err;
+    }
+
+    peer->m_connected = 1;
+    peer->m_result.m_begin_ns = net_tun_bench_now_ns();
+
+    if (peer->m_settings.m_mode == net_tun_bench_mode_rr) {
+        if (peer->m_settings.m_count == 0) {
+            peer->m_done = 1;
+        }
+        else {
+            net_tun_bench_peer_rr_send(peer);
+        }
+    }
+    else if (peer->m_settings.m_mode == net_tun_bench_mode_download) {
+        if (tcp_write(pcb, peer->m_payload, (u16_t)peer->m_payload_size, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+            fprintf(stderr, "bench: peer: download: write request fail\n");
+            peer->m_failed = 1;
+            return ERR_OK;
+        }
+        tcp_output(pcb);
+    }
+
+    return ERR_OK;
+}
+
+static err_t net_tun_bench_peer_recv(void * arg, struct tcp_pcb * pcb, struct pbuf * p, err_t err) {
+    net_tun_bench_peer_t peer = arg;
+
+    if (p == NULL) {
+        if (!peer->m_done) {
+            fprintf(stderr, "bench: peer: server closed connection\n");
+            peer->m_failed = 1;
+        }
+        return ERR_OK;
+    }
+
+    uint16_t len = p->tot_len;
+    tcp_recved(pcb, len);
+    pbuf_free(p);
+
+    if (peer->m_settings.m_mode == net_tun_bench_mode_download) {
+        peer->m_download_received += len;
+        peer->m_result.m_bytes = peer->m_download_received;
+        if (peer->m_download_received >= peer->m_settings.m_bytes && !peer->m_done) {
+            peer->m_result.m_end_ns = net_tun_bench_now_ns();
+            peer->m_done = 1;
+        }
+        return ERR_OK;
+    }
+
+    if (peer->m_settings.m_mode != net_tun_bench_mode_rr) return ERR_OK;
+
+    peer->m_rr_received += len;
+    if (peer->m_rr_received < peer->m_payload_size) return ERR_OK;
+
+    if (peer->m_rr_received > peer->m_payload_size) {
+        fprintf(stderr, "bench: peer: rr: response %u overflow request %u\n", peer->m_rr_received, peer->m_payload_size);
+        peer->m_failed = 1;
+        return ERR_OK;
+    }
+
+    peer->m_latency[peer->m_rr_done++] = net_tun_bench_now_ns() - peer->m_rr_begin_ns;
+    peer->m_result.m_transactions++;
+    peer->m_result.m_bytes += peer->m_payload_size;
+
+    if (peer->m_rr_done >= peer->m_settings.m_count) {
+        peer->m_result.m_end_ns = net_tun_bench_now_ns();
+        peer->m_done = 1;
+    }
+    else {
+        net_tun_bench_peer_rr_send(peer);
+    }
+
+    return ERR_OK;
+}
+
+static err_t net_tun_bench_peer_sent(void * arg, struct tcp_pcb * pcb, u16_t len) {
+    net_tun_bench_peer_t peer = arg;
+
+    if (peer->m_settings.m_mode != net_tun_bench_mode_bulk) return ERR_OK;
+
+    peer->m_bulk_acked += len;
+    peer->m_result.m_bytes = peer->m_bulk_acked;
+    if (peer->m_bulk_acked >= peer->m_settings.m_bytes) {
+        peer->m_result.m_end_ns = net_tun_bench_now_ns();
+        peer->m_done = 1;
+    }
+
+    return ERR_OK;
+}
+
+static void net_tun_bench_peer_err(void * arg, err_t err) {
+    net_tun_bench_peer_t peer = arg;
+
+    fprintf(stderr, "bench: peer: tcp error, err=%d\n", err);
+    peer->m_tcp = NULL;
+    peer->m_failed = 1;
+}
+
+static err_t net_tun_bench_peer_netif_init(struct netif * netif) {
+    net_tun_bench_peer_t peer = netif->state;
+
+    netif->name[0] = 'b';
+    netif->name[1] = 'p';
+    netif->mtu = peer->m_settings.m_mtu;
+    netif->output = net_tun_bench_peer_netif_output;
+
+    return ERR_OK;
+}
+
+static err_t net_tun_bench_peer_netif_output(struct netif * netif, struct pbuf * p, const ip4_addr_t * ipaddr) {
+    net_tun_bench_peer_t peer = netif->state;
+    void const * data = p->payload;
+
+    /*on the wire once queued, the packets of the path are bounded by the tcp windows*/
+    if (peer->m_settings.m_delay_ms) {
+        net_tun_bench_peer_delayed_t delayed = malloc(sizeof(struct net_tun_bench_peer_delayed) + p->tot_len);
+        if (delayed == NULL) {
+            fprintf(stderr, "bench: peer: alloc delayed packet fail\n");
+            return ERR_MEM;
+        }
+
+        delayed->m_next = NULL;
+        delayed->m_due_ns = net_tun_bench_now_ns() + (uint64_t)peer->m_settings.m_delay_ms * 1000000u;
+        delayed->m_len = p->tot_len;
+        pbuf_copy_partial(p, delayed + 1, p->tot_len, 0);
+
+        *peer->m_delayed_tail = delayed;
+        peer->m_delayed_tail = &delayed->m_next;
+        return ERR_OK;
+    }
+
+    if (peer->m_out_blocked) return ERR_MEM;
+
+    if (p->next) {
+        pbuf_copy_partial(p, peer->m_buf, p->tot_len, 0);
+        data = peer->m_buf;
+    }
+
+    /*lwip keeps the segment unsent, drive retries once the socket drains*/
+    return net_tun_bench_peer_send(peer, data, p->tot_len) == 0 ? ERR_OK : peer->m_out_blocked ? ERR_MEM : ERR_IF;
+}
+
+static int net_tun_bench_peer_send(net_tun_bench_peer_t peer, void const * data, uint16_t len) {
+    if (send(peer->m_settings.m_fd, data, len, MSG_DONTWAIT) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            peer->m_out_blocked = 1;
+            return -1;
+        }
+
+        fprintf(stderr, "bench: peer: send fail, errno=%d (%s)\n", errno, strerror(errno));
+        peer->m_failed = 1;
+        return -1;
+    }
+
+    peer->m_result.m_packets_out++;
+    return 0;
+}
+
+static void net_tun_bench_peer_delayed_flush(net_tun_bench_peer_t peer, uint64_t now_ns) {
+    while(peer->m_delayed_head && peer->m_delayed_head->m_due_ns <= now_ns && !peer->m_out_blocked) {
+        net_tun_bench_peer_delayed_t delayed = peer->m_delayed_head;
+
+        if (net_tun_bench_peer_send(peer, delayed + 1, delayed->m_len) != 0) {
+            if (peer->m_out_blocked) break;
+        }
+
+        peer->m_delayed_head = delayed->m_next;
+        if (peer->m_delayed_head == NULL) peer->m_delayed_tail = &peer->m_delayed_head;
+        free(delayed);
+    }
+}
+
+static void net_tun_bench_peer_delayed_clear(net_tun_bench_peer_t peer) {
+    while(peer->m_delayed_head) {
+        net_tun_bench_peer_delayed_t delayed = peer->m_delayed_head;
+        peer->m_delayed_head = delayed->m_next;
+        free(delayed);
+    }
+    peer->m_delayed_tail = &peer->m_delayed_head;
+}
+
+static int net_tun_bench_peer_latency_cmp(void const * l, void const * r) {
+    uint64_t lv = *(uint64_t const *)l;
+    uint64_t rv = *(uint64_t const *)r;
+    return lv < rv ? -1 : lv > rv ? 1 : 0;
+}
+
+static void net_tun_bench_peer_finish(net_tun_bench_peer_t peer, uint8_t ok) {
+    if (peer->m_latency && peer->m_rr_done > 0) {
+        qsort(peer->m_latency, peer->m_rr_done, sizeof(uint64_t), net_tun_bench_peer_latency_cmp);
+        peer->m_result.m_latency_p50_ns = peer->m_latency[(peer->m_rr_done - 1) * 50 / 100];
+        peer->m_result.m_latency_p99_ns = peer->m_latency[(peer->m_rr_done - 1) * 99 / 100];
+    }
+
+    peer->m_result.m_ok = ok;
+    __atomic_store_n(&peer->m_finished, 1, __ATOMIC_RELEASE);
+}
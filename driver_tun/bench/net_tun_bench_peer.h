@@ -0,0 +1,61 @@
+#ifndef NET_TUN_BENCH_PEER_H_INCLEDED
+#define NET_TUN_BENCH_PEER_H_INCLEDED
+#include <stdint.h>
+
+/*
+ * the far end of the bench socketpair: a private lwip instance (lwip state is thread local)
+ * running in its own thread, it plays the remote host of the device under test.
+ */
+typedef struct net_tun_bench_peer * net_tun_bench_peer_t;
+
+typedef enum net_tun_bench_mode {
+    net_tun_bench_mode_bulk, /*one tcp connection, peer sends, server discards*/
+    net_tun_bench_mode_rr,   /*one tcp connection, request / echo response ping-pong*/
+    net_tun_bench_mode_udp,  /*udp flood, server counts*/
+    net_tun_bench_mode_download, /*one tcp connection, peer asks for m_bytes, server sends*/
+} net_tun_bench_mode_t;
+
+struct net_tun_bench_peer_settings {
+    net_tun_bench_mode_t m_mode;
+    int m_fd;
+    uint16_t m_mtu;
+    uint32_t m_local_ip;  /*network order*/
+    uint32_t m_remote_ip; /*network order, address of the device under test*/
+    uint16_t m_remote_port;
+    uint64_t m_bytes;     /*bulk: bytes to send, download: bytes to receive*/
+    uint32_t m_count;     /*rr: transactions, udp: datagrams*/
+    uint32_t m_size;      /*rr: request size, udp: datagram size*/
+    uint32_t m_timeout_ms;
+    uint32_t m_delay_ms;  /*packets to the device are held this long, the emulated rtt*/
+    uint32_t m_tcp_buf;   /*tcp send buffer / receive window, 0 keeps the lwip ceiling*/
+    uint32_t m_loss_ppm;  /*packets from the device dropped, parts per million*/
+};
+typedef struct net_tun_bench_peer_settings * net_tun_bench_peer_settings_t;
+
+struct net_tun_bench_peer_result {
+    uint8_t m_ok;
+    uint64_t m_bytes;       /*payload bytes acked (tcp) or sent (udp)*/
+    uint64_t m_transactions;
+    uint64_t m_packets_in;  /*packets read from the socketpair*/
+    uint64_t m_packets_out; /*packets written to the socketpair*/
+    uint64_t m_packets_dropped; /*read but dropped by the emulated loss*/
+    uint64_t m_begin_ns;
+    uint64_t m_end_ns;
+    uint64_t m_cpu_ns;      /*peer thread cpu time*/
+    uint64_t m_latency_p50_ns;
+    uint64_t m_latency_p99_ns;
+};
+typedef struct net_tun_bench_peer_result * net_tun_bench_peer_result_t;
+
+net_tun_bench_peer_t net_tun_bench_peer_start(net_tun_bench_peer_settings_t settings);
+
+/*0 while the peer is still running*/
+uint8_t net_tun_bench_peer_is_done(net_tun_bench_peer_t peer);
+
+/*join the peer thread and free it*/
+int net_tun_bench_peer_wait(net_tun_bench_peer_t peer, net_tun_bench_peer_result_t result);
+
+uint64_t net_tun_bench_now_ns(void);
+uint64_t net_tun_bench_thread_cpu_ns(void);
+
+#endif
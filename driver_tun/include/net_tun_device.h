@@ -13,18 +13,41 @@ typedef enum net_tun_device_init_type {
     net_tun_device_init_string,
 #ifndef CPE_OS_WIN
     net_tun_device_init_fd,
+    net_tun_device_init_pcap, /*replay a capture file, no real device needed*/
+#endif
+#if CPE_OS_LINUX
+    net_tun_device_init_packet, /*attach to an existing interface (veth...) through AF_PACKET rings*/
 #endif
 } net_tun_device_init_type_t;
 
+typedef enum net_tun_device_io_type {
+    net_tun_device_io_watcher,
+    net_tun_device_io_uring,
+} net_tun_device_io_type_t;
+
 struct net_tun_device_init_data {
     net_tun_device_type_t m_dev_type;
     net_tun_device_init_type_t m_init_type;
+    net_tun_device_io_type_t m_io_type;
+    uint8_t m_multi_queue; /*init_string only, attach one more queue (IFF_MULTI_QUEUE)*/
+    uint8_t m_offload; /*tun only, virtio-net header (IFF_VNET_HDR) with checksum and tso offload*/
+    uint8_t m_zero_copy_input; /*read frames straight into pbufs, every queued packet pins a whole frame buffer*/
     union {
         char *m_string;
         struct {
             int m_fd;
             int m_mtu;
         };
+        struct {
+            char * m_if_name;
+            uint8_t m_peer_mac[6]; /*destination of output frames, all zero: broadcast*/
+        } m_packet;
+        struct {
+            char * m_input; /*pcap file fed to the stack*/
+            char * m_output; /*pcap file output packets are written to, NULL: dropped*/
+            int m_mtu;
+            uint8_t m_realtime; /*0: as fast as possible, 1: at the recorded timestamps*/
+        } m_pcap;
     } m_init_data;
 };
 #endif
@@ -42,6 +65,8 @@ struct net_tun_device_netif_options {
     net_address_t m_ipv4_address;
     net_address_t m_ipv4_mask;
     net_address_t m_ipv6_address;
+    uint8_t m_skip_input_chksum;  /*trust the host kernel, no ip/tcp/udp/icmp checksum verification of input*/
+    uint8_t m_skip_output_chksum; /*no checksums on output, only for readers that do not verify them*/
 };
 typedef struct net_tun_device_netif_options * net_tun_device_netif_options_t;
 
@@ -57,6 +82,57 @@ net_tun_device_t net_tun_device_default(net_tun_driver_t driver);
 
 void net_tun_device_clear_all(net_tun_driver_t driver);
 
+/*
+ * queue output packets and write them together, once per loop tick or when flush_count packets
+ * are queued, flush_delay_ms caps how long a packet may wait (0: until the next loop).
+ * flush_count <= 1 disables batching.
+ */
+int net_tun_device_set_output_batch(net_tun_device_t device, uint16_t flush_count, uint16_t flush_delay_ms);
+
+/*checksum work lwip does for the device, can be changed at any time (see netif options)*/
+void net_tun_device_set_chksum(net_tun_device_t device, uint8_t check_input, uint8_t gen_output);
+
+struct net_tun_device_chksum_stat {
+    uint8_t m_check_input;
+    uint8_t m_gen_output;
+    uint8_t m_offload;          /*tcp/udp output checksums are finished by the kernel (virtio-net header)*/
+    uint64_t m_input_packets;
+    uint64_t m_input_trusted;   /*taken without a tcp/udp checksum check*/
+    uint64_t m_output_packets;
+    uint64_t m_output_unsummed; /*sent without a tcp/udp checksum from lwip*/
+};
+
+void net_tun_device_chksum_stat(net_tun_device_t device, struct net_tun_device_chksum_stat * stat);
+
+/*
+ * merge the in order tcp segments a read burst brings for one connection into a single packet
+ * before lwip (receive offload), max_segs caps the segments of a merged packet, <= 1 disables it.
+ */
+void net_tun_device_set_gro(net_tun_device_t device, uint16_t max_segs);
+
+struct net_tun_device_gro_stat {
+    uint16_t m_segs_max;
+    uint64_t m_segments;        /*tcp segments taken by the merge stage*/
+    uint64_t m_packets;         /*packets they reached lwip as*/
+};
+
+void net_tun_device_gro_stat(net_tun_device_t device, struct net_tun_device_gro_stat * stat);
+
+#if NET_TUN_USE_DEV_TUN
+struct net_tun_device_pcap_stat {
+    uint64_t m_input_packets;
+    uint64_t m_input_bytes;
+    uint64_t m_output_packets;
+    uint64_t m_output_bytes;
+    uint64_t m_elapsed_us;
+    uint64_t m_cpu_us;
+    uint8_t m_input_done;
+};
+
+/*replay progress of a pcap device, -1 for other devices*/
+int net_tun_device_pcap_stat(net_tun_device_t device, struct net_tun_device_pcap_stat * stat);
+#endif
+
 void net_tun_device_netif_options_clear(net_tun_device_netif_options_t netif_options);
 
 NET_END_DECL
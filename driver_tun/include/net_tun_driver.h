@@ -30,6 +30,54 @@ void net_tun_driver_set_data_monitor(
     net_tun_driver_t driver,
     net_data_monitor_fun_t monitor_fun, void * monitor_ctx);
 
+/*lwip memory slabs, the pools by type then the heap size classes; lwip state is thread local, call from the driver's thread*/
+struct net_tun_driver_mem_stat {
+    const char * m_name;
+    uint32_t m_size;     /*element size, for heap classes the largest block*/
+    uint32_t m_used;
+    uint32_t m_used_max;
+    uint32_t m_cached;   /*free elements kept for reuse*/
+    uint32_t m_chunks;   /*chunks taken from the schedule allocator*/
+};
+
+uint16_t net_tun_driver_mem_stat_count(net_tun_driver_t driver);
+int net_tun_driver_mem_stat(net_tun_driver_t driver, uint16_t idx, struct net_tun_driver_mem_stat * stat);
+
+/*tcp send buffer and receive window (bytes) of connections created after the call, 0 keeps the current value;
+  lwip clamps them to [2 * TCP_MSS, TCP_SND_BUF / TCP_WND], windows past 64K need the peer to agree on scaling*/
+void net_tun_driver_set_tcp_buf(net_tun_driver_t driver, uint32_t snd_buf, uint32_t rcv_wnd);
+
+/*the same for one endpoint of a tun driver, applied to its connection right away*/
+int net_tun_endpoint_set_tcp_buf(net_endpoint_t endpoint, uint32_t snd_buf, uint32_t rcv_wnd);
+
+/*tcp congestion control of connections created after the call: "reno", "cubic" or "bbr", NULL for lwip's default*/
+int net_tun_driver_set_tcp_cc(net_tun_driver_t driver, const char * name);
+
+/*the same for one endpoint of a tun driver, its connection switches right away*/
+int net_tun_endpoint_set_tcp_cc(net_endpoint_t endpoint, const char * name);
+
+/*
+ * zero copy receive of one endpoint of a tun driver: received data stays in lwip's pbufs instead of
+ * being copied into the endpoint read buffer, recv_fun is called on arrival and the reader takes it
+ * with net_tun_endpoint_recv_peek / net_tun_endpoint_recv_consume. consumed bytes reopen the tcp
+ * receive window, so up to a window of pbufs is held per endpoint.
+ * set it on accept, before data arrives; recv_fun NULL goes back to the read buffer, data still held
+ * is copied over.
+ */
+typedef void (*net_tun_endpoint_recv_fun_t)(void * ctx, net_endpoint_t endpoint);
+int net_tun_endpoint_set_recv_zero_copy(net_endpoint_t endpoint, net_tun_endpoint_recv_fun_t recv_fun, void * recv_ctx);
+
+uint32_t net_tun_endpoint_recv_size(net_endpoint_t endpoint);
+
+/*the first contiguous piece of the held data, -1 when nothing is held*/
+int net_tun_endpoint_recv_peek(net_endpoint_t endpoint, void const ** data, uint32_t * size);
+void net_tun_endpoint_recv_consume(net_endpoint_t endpoint, uint32_t size);
+
+#if NET_TUN_USE_DRIVER
+/*packets / bytes one device may read per wakeup, 0 means no limit*/
+void net_tun_driver_set_read_budget(net_tun_driver_t driver, uint32_t packets, uint32_t bytes);
+#endif
+
 NET_END_DECL
 
 #endif
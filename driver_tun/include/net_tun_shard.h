@@ -0,0 +1,61 @@
+#ifndef NET_TUN_SHARD_H_INCLEDED
+#define NET_TUN_SHARD_H_INCLEDED
+#include "cpe/utils/utils_types.h"
+#include "net_tun_types.h"
+#include "net_tun_device.h"
+
+NET_BEGIN_DECL
+
+#if NET_TUN_USE_DEV_TUN && CPE_OS_LINUX
+
+/*
+ * sharded mode: one IFF_MULTI_QUEUE queue of the same interface per worker thread.
+ * every worker owns its net_schedule, net_tun_driver and lwip instance (lwip state is thread local),
+ * the kernel flow hash keeps a connection on one queue, so shards never share state.
+ *
+ * main_fun runs in the worker thread, it must build the schedule and driver, call
+ * net_tun_shard_device_create, then run the loop until stop_fun (called from the thread
+ * that frees the group) asks it to quit.
+ */
+typedef struct net_tun_shard_group * net_tun_shard_group_t;
+typedef struct net_tun_shard * net_tun_shard_t;
+
+typedef int (*net_tun_shard_main_fun_t)(void * ctx, net_tun_shard_t shard);
+typedef void (*net_tun_shard_stop_fun_t)(void * ctx, net_tun_shard_t shard);
+
+struct net_tun_shard_group_settings {
+    uint16_t m_shard_count; /*0: one shard per online cpu*/
+    uint8_t m_pin_cpu;
+    net_tun_device_type_t m_dev_type;
+    net_tun_device_io_type_t m_io_type;
+    const char * m_dev_name;
+};
+typedef struct net_tun_shard_group_settings * net_tun_shard_group_settings_t;
+
+net_tun_shard_group_t
+net_tun_shard_group_create(
+    mem_allocrator_t alloc, error_monitor_t em,
+    net_tun_shard_group_settings_t settings,
+    net_tun_shard_main_fun_t main_fun, net_tun_shard_stop_fun_t stop_fun, void * ctx);
+
+void net_tun_shard_group_free(net_tun_shard_group_t group);
+
+int net_tun_shard_group_start(net_tun_shard_group_t group);
+
+uint16_t net_tun_shard_group_count(net_tun_shard_group_t group);
+net_tun_shard_t net_tun_shard_group_shard(net_tun_shard_group_t group, uint16_t idx);
+
+net_tun_shard_group_t net_tun_shard_group(net_tun_shard_t shard);
+uint16_t net_tun_shard_id(net_tun_shard_t shard);
+int net_tun_shard_cpu(net_tun_shard_t shard);
+net_tun_device_t net_tun_shard_device(net_tun_shard_t shard);
+
+net_tun_device_t
+net_tun_shard_device_create(
+    net_tun_shard_t shard, net_tun_driver_t driver, net_tun_device_netif_options_t netif_settings);
+
+#endif
+
+NET_END_DECL
+
+#endif
@@ -40,9 +40,21 @@ net_tun_device_create(
     device->m_listener_ip4 = NULL;
     device->m_listener_ip6 = NULL;
     device->m_mtu = 0;
+    device->m_frame_capacity = 0;
     device->m_write_combine_buf = NULL;
     device->m_quitting = 0;
     device->m_dev_name[0] = 0;
+    device->m_chksum_check_input = netif_settings && netif_settings->m_skip_input_chksum ? 0 : 1;
+    device->m_chksum_gen_output = netif_settings && netif_settings->m_skip_output_chksum ? 0 : 1;
+    device->m_chksum_input_packets = 0;
+    device->m_chksum_input_trusted = 0;
+    device->m_chksum_output_packets = 0;
+    device->m_chksum_output_unsummed = 0;
+    net_tun_device_gro_init(device);
+    net_tun_device_output_init(device);
+#if NET_TUN_USE_DRIVER
+    device->m_read_scheduled = 0;
+#endif
     
     if (net_tun_device_init_dev(driver, device, settings) != 0) {
         mem_free(driver->m_alloc, device);
@@ -50,12 +62,14 @@ net_tun_device_create(
     }
 
     assert(device->m_mtu > 0);
+    if (device->m_frame_capacity == 0) device->m_frame_capacity = device->m_mtu;
+
     assert(device->m_write_combine_buf == NULL);
-    device->m_write_combine_buf = mem_alloc(driver->m_alloc, device->m_mtu);
+    device->m_write_combine_buf = mem_alloc(driver->m_alloc, device->m_frame_capacity);
     if (device->m_write_combine_buf == NULL) {
         CPE_ERROR(
-            driver->m_em, "tun: dev %s: alloc write buf fail, mtu=%d",
-            device->m_dev_name, device->m_mtu);
+            driver->m_em, "tun: dev %s: alloc write buf fail, frame=%d",
+            device->m_dev_name, device->m_frame_capacity);
         goto create_errror;
     }
     
@@ -126,6 +140,14 @@ void net_tun_device_free(net_tun_device_t device) {
     
     device->m_quitting = 1;
 
+    net_tun_device_gro_fini(device);
+    net_tun_device_output_flush(device);
+    net_tun_device_output_fini(device);
+
+#if NET_TUN_USE_DRIVER
+    net_tun_driver_read_unschedule(driver, device);
+#endif
+
     net_tun_device_fini_dev(driver, device);
     
     if (device->m_listener_ip4) {
@@ -203,6 +225,7 @@ static int net_tun_device_init_netif(
     netif_set_up(&device->m_netif);
     netif_set_link_up(&device->m_netif);
     netif_set_pretend_tcp(&device->m_netif, 1);
+    net_tun_device_chksum_apply(device);
 
     if (netif_settings->m_ipv6_address) {
         // add IPv6 address
@@ -211,10 +234,69 @@ static int net_tun_device_init_netif(
         netif_ip6_addr_set(&device->m_netif, 0, &ip6addr);
         netif_ip6_addr_set_state(&device->m_netif, 0, IP6_ADDR_VALID);
     }
+
+    /*router solicitations are sent from the timer*/
+    net_tun_driver_timer_wakeup(device->m_driver);
     
     return 0;
 }
 
+u16_t net_tun_device_chksum_flags(net_tun_device_t device) {
+    u16_t flags = NETIF_CHECKSUM_ENABLE_ALL;
+
+    if (!device->m_chksum_check_input) {
+        flags &= ~(NETIF_CHECKSUM_CHECK_IP | NETIF_CHECKSUM_CHECK_UDP | NETIF_CHECKSUM_CHECK_TCP
+                   | NETIF_CHECKSUM_CHECK_ICMP | NETIF_CHECKSUM_CHECK_ICMP6);
+    }
+
+    if (!device->m_chksum_gen_output) {
+        flags &= ~(NETIF_CHECKSUM_GEN_IP | NETIF_CHECKSUM_GEN_UDP | NETIF_CHECKSUM_GEN_TCP
+                   | NETIF_CHECKSUM_GEN_ICMP | NETIF_CHECKSUM_GEN_ICMP6);
+    }
+
+#if NET_TUN_USE_DEV_TUN
+    if (device->m_vnet_hdr_len) {
+        /*the kernel finishes tcp/udp checksum from the virtio-net header*/
+        flags &= ~(NETIF_CHECKSUM_GEN_TCP | NETIF_CHECKSUM_GEN_UDP);
+    }
+#endif
+
+    return flags;
+}
+
+void net_tun_device_chksum_apply(net_tun_device_t device) {
+    NETIF_SET_CHECKSUM_CTRL(&device->m_netif, net_tun_device_chksum_flags(device));
+}
+
+void net_tun_device_set_chksum(net_tun_device_t device, uint8_t check_input, uint8_t gen_output) {
+    net_tun_driver_t driver = device->m_driver;
+
+    device->m_chksum_check_input = check_input ? 1 : 0;
+    device->m_chksum_gen_output = gen_output ? 1 : 0;
+    net_tun_device_chksum_apply(device);
+
+    if (net_tun_driver_debug(driver)) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: chksum: check-input=%d, gen-output=%d, flags=0x%04x",
+            device->m_dev_name, device->m_chksum_check_input, device->m_chksum_gen_output,
+            device->m_netif.chksum_flags);
+    }
+}
+
+void net_tun_device_chksum_stat(net_tun_device_t device, struct net_tun_device_chksum_stat * stat) {
+    stat->m_check_input = device->m_chksum_check_input;
+    stat->m_gen_output = device->m_chksum_gen_output;
+#if NET_TUN_USE_DEV_TUN
+    stat->m_offload = device->m_vnet_hdr_len ? 1 : 0;
+#else
+    stat->m_offload = 0;
+#endif
+    stat->m_input_packets = device->m_chksum_input_packets;
+    stat->m_input_trusted = device->m_chksum_input_trusted;
+    stat->m_output_packets = device->m_chksum_output_packets;
+    stat->m_output_unsummed = device->m_chksum_output_unsummed;
+}
+
 static err_t net_tun_device_netif_init(struct netif *netif) {
     netif->name[0] = 'h';
     netif->name[1] = 'o';
@@ -224,45 +306,76 @@ static err_t net_tun_device_netif_init(struct netif *netif) {
     return ERR_OK;
 }
 
+/*tcp/udp packet whose checksum lwip left to the device*/
+static uint8_t net_tun_device_output_unsummed(net_tun_device_t device, struct pbuf * p) {
+    uint8_t const * iphead = p->payload;
+    uint8_t proto;
+
+    if (p->len < 1) return 0;
+
+    switch(iphead[0] >> 4) {
+    case 4:
+        if (p->len < IP_HLEN) return 0;
+        /*later fragments carry no l4 header*/
+        if (lwip_ntohs(IPH_OFFSET((struct ip_hdr const *)iphead)) & IP_OFFMASK) return 0;
+        proto = iphead[9];
+        break;
+    case 6:
+        if (p->len < IP6_HLEN) return 0;
+        proto = iphead[6];
+        break;
+    default:
+        return 0;
+    }
+
+    switch(proto) {
+    case IP_PROTO_TCP:
+        return (device->m_netif.chksum_flags & NETIF_CHECKSUM_GEN_TCP) ? 0 : 1;
+    case IP_PROTO_UDP:
+        return (device->m_netif.chksum_flags & NETIF_CHECKSUM_GEN_UDP) ? 0 : 1;
+    default:
+        return 0;
+    }
+}
+
 static err_t net_tun_device_netif_do_output(struct netif *netif, struct pbuf *p) {
     net_tun_device_t device = netif->state;
-    net_tun_driver_t driver = device->m_driver;
-    net_driver_t base_driver = net_driver_from_data(driver);
+    uint8_t head[NET_TUN_DEVICE_OUTPUT_HEAD_MAX];
+    uint8_t head_len = 0;
 
     if (device->m_quitting) {
         return ERR_OK;
     }
 
-    if (!p->next) {
-        if (p->len > device->m_mtu) {
-            CPE_ERROR(
-                driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
-                device->m_dev_name, p->len, device->m_mtu);
-            goto out;
-        }
+#if NET_TUN_DEVICE_WRITEV
+    /*device is backed up, tcp keeps the segment unsent and retries once the queue drains*/
+    if (device->m_pending_blocked) {
+        return ERR_MEM;
+    }
+#endif
 
-        net_tun_device_packet_write(device, (uint8_t *)p->payload, p->len);
+#if NET_TUN_USE_DEV_TUN
+    if (device->m_vnet_hdr_len) {
+        assert(device->m_vnet_hdr_len <= sizeof(head));
+        if (net_tun_device_vnet_output_hdr(device, p, head) != 0) return ERR_OK;
+        head_len = device->m_vnet_hdr_len;
     }
-    else {
-        assert(device->m_write_combine_buf);
-
-        void * device_write_buf = device->m_write_combine_buf;
-        int len = 0;
-        do {
-            if (p->len > device->m_mtu - len) {
-                CPE_ERROR(
-                    driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
-                    device->m_dev_name, p->len + len, device->m_mtu);
-                goto out;
-            }
-            memcpy((uint8_t*)device_write_buf + len, p->payload, p->len);
-            len += p->len;
-        } while ((p = p->next));
+#if NET_TUN_USE_AF_PACKET
+    else if (device->m_af_packet) {
+        if (net_tun_device_af_packet_output_hdr(device, p, head) != 0) return ERR_OK;
+        head_len = NET_TUN_ETHERNET_HEADER_LENGTH;
+    }
+#endif
+#endif
 
-        net_tun_device_packet_write(device, device_write_buf, len);
+    if (net_tun_device_output(device, head, head_len, p) != 0) {
+        return ERR_MEM;
     }
 
-out:
+    /*counted once handed over, a segment refused above comes back on retransmit*/
+    device->m_chksum_output_packets++;
+    if (net_tun_device_output_unsummed(device, p)) device->m_chksum_output_unsummed++;
+
     return ERR_OK;
 }
 
@@ -293,41 +406,61 @@ static err_t net_tun_device_netif_input(struct pbuf *p, struct netif * netif) {
 }
 
 int net_tun_device_packet_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * packet_data, uint16_t packet_size) {
-    net_driver_t base_driver = net_driver_from_data(driver);
+    struct pbuf * p = net_tun_device_packet_alloc(driver, device, packet_data, packet_size);
+    if (p == NULL) return -1;
 
-    if (packet_size > device->m_mtu) {
+    return net_tun_device_pbuf_input(driver, device, p);
+}
+
+struct pbuf * net_tun_device_packet_alloc(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * packet_data, uint16_t packet_size) {
+    if (packet_size > device->m_frame_capacity) {
         CPE_ERROR(
             driver->m_em, "tun: %s: input packet length %d overflow, mtu=%d",
             device->m_dev_name, packet_size, device->m_mtu);
-        return -1;
+        return NULL;
     }
 
-    uint8_t const * iphead = packet_data;
-    uint8_t const * data = iphead + TCP_HLEN;
-
-    if (net_driver_debug(base_driver) >= 2) {
-        CPE_INFO(
-            driver->m_em, "tun: %s: <<< %.5d |      %s",
-            device->m_dev_name, packet_size,
-            net_tun_dump_raw_data(
-                net_tun_driver_tmp_buffer(driver), iphead, packet_size,
-                net_driver_debug(base_driver) >= 3));
-    }
-            
     struct pbuf *p = pbuf_alloc(PBUF_RAW, packet_size, PBUF_POOL);
     if (!p) {
         CPE_ERROR(driver->m_em, "tun: %s: packet input: pbuf_alloc fail", device->m_dev_name);
-        return -1;
+        return NULL;
     }
 
-    err_t err = pbuf_take(p, iphead, packet_size);
+    err_t err = pbuf_take(p, packet_data, packet_size);
     if (err != ERR_OK) {
         CPE_ERROR(driver->m_em, "tun: %s: packet input: pbuf_take fail, error=%d (%s)", device->m_dev_name, err, lwip_strerr(err));
         pbuf_free(p);
-        return -1;
+        return NULL;
+    }
+
+    return p;
+}
+
+int net_tun_device_pbuf_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p) {
+    net_driver_t base_driver = net_driver_from_data(driver);
+
+    if (net_driver_debug(base_driver) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: <<< %.5d |      %s",
+            device->m_dev_name, p->tot_len,
+            net_tun_dump_raw_data(
+                net_tun_driver_tmp_buffer(driver), p->payload, p->len,
+                net_driver_debug(base_driver) >= 3));
     }
 
-    err = device->m_netif.input(p, &device->m_netif);
+    net_tun_driver_timer_wakeup(driver);
+
+    /*the vnet input path lifts the check per packet, count what the netif says right now*/
+    device->m_chksum_input_packets++;
+    if (!(device->m_netif.chksum_flags & NETIF_CHECKSUM_CHECK_TCP)) device->m_chksum_input_trusted++;
+
+    if (device->m_gro_active && net_tun_device_gro_input(driver, device, p)) return 0;
+
+    return net_tun_device_pbuf_deliver(driver, device, p);
+}
+
+int net_tun_device_pbuf_deliver(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p) {
+    err_t err = device->m_netif.input(p, &device->m_netif);
     if (err != ERR_OK) {
         CPE_ERROR(driver->m_em, "tun: %s: packet input: input fail, error=%d (%s)", device->m_dev_name, err, lwip_strerr(err));
         pbuf_free(p);
@@ -337,6 +470,20 @@ int net_tun_device_packet_input(net_tun_driver_t driver, net_tun_device_t device
     return 0;
 }
 
+/*a read burst, one ack per connection and segments merged for lwip (see net_tun_device_set_gro)*/
+void net_tun_device_input_begin(net_tun_device_t device) {
+    tcp_batch_begin();
+    device->m_gro_active = device->m_gro_segs_max > 1 ? 1 : 0;
+}
+
+void net_tun_device_input_end(net_tun_device_t device) {
+    if (device->m_gro_active) {
+        device->m_gro_active = 0;
+        net_tun_device_gro_flush(device);
+    }
+    tcp_batch_end();
+}
+
 void net_tun_device_clear_all(net_tun_driver_t driver) {
     while(!TAILQ_EMPTY(&driver->m_devices)) {
         net_tun_device_free(TAILQ_FIRST(&driver->m_devices));
@@ -377,6 +524,12 @@ static int net_tun_device_do_accept(
         return -1;
     }
 
+#if NET_TUN_USE_DEV_TUN
+    if (device->m_vnet_hdr_len) {
+        tcp_set_tso_max(newpcb, NET_TUN_DEVICE_VNET_TSO_MAX);
+    }
+#endif
+
     net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
     net_tun_endpoint_set_pcb(endpoint, newpcb, 1);
     newpcb = NULL;
@@ -0,0 +1,463 @@
+#include <assert.h>
+#include <errno.h>
+#if NET_TUN_USE_AF_PACKET
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#endif
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "cpe/pal/pal_unistd.h"
+#include "cpe/utils/string_utils.h"
+#include "net_tun_device_i.h"
+#include "net_tun_utils.h"
+
+#if NET_TUN_USE_AF_PACKET
+
+/*tx frame data starts where the kernel expects it without PACKET_TX_HAS_OFF*/
+#define NET_TUN_DEVICE_AF_PACKET_TX_DATA_OFFSET (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+struct net_tun_device_af_packet {
+    net_tun_device_t m_device;
+    uint8_t * m_map;
+    size_t m_map_size;
+    uint8_t m_eth_addrs[12]; /*dst and src mac of output frames*/
+
+    /*rx ring, blocks are walked in order, the current one may be left half read when the budget runs out*/
+    uint32_t m_rx_block_size;
+    uint32_t m_rx_block_count;
+    uint32_t m_rx_block_cur;
+    struct tpacket3_hdr * m_rx_frame;
+    uint32_t m_rx_frame_left;
+
+    /*tx ring*/
+    uint8_t * m_tx_ring;
+    uint32_t m_tx_frame_size;
+    uint32_t m_tx_frame_count;
+    uint32_t m_tx_frame_cur;
+    uint16_t m_tx_queued;
+    uint8_t m_tx_batching;
+};
+
+static int net_tun_device_af_packet_setup_ring(net_tun_device_af_packet_t packet);
+static void net_tun_device_af_packet_kick(net_tun_device_af_packet_t packet);
+
+static struct tpacket_block_desc *
+net_tun_device_af_packet_rx_block(net_tun_device_af_packet_t packet, uint32_t idx) {
+    return (struct tpacket_block_desc *)(packet->m_map + (size_t)idx * packet->m_rx_block_size);
+}
+
+static struct tpacket3_hdr *
+net_tun_device_af_packet_tx_frame(net_tun_device_af_packet_t packet, uint32_t idx) {
+    return (struct tpacket3_hdr *)(packet->m_tx_ring + (size_t)idx * packet->m_tx_frame_size);
+}
+
+int net_tun_device_af_packet_init(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_init_data_t settings) {
+    const char * if_name = settings->m_init_data.m_packet.m_if_name;
+    struct ifreq ifr;
+    uint8_t src_mac[6];
+    int if_index;
+
+    device->m_dev_fd = -1;
+    device->m_dev_fd_close = 0;
+
+    if (if_name == NULL || if_name[0] == 0) {
+        CPE_ERROR(driver->m_em, "tun: packet: interface name not set");
+        return -1;
+    }
+    cpe_str_dup(device->m_dev_name, sizeof(device->m_dev_name), if_name);
+
+    device->m_dev_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (device->m_dev_fd < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: socket fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+    device->m_dev_fd_close = 1;
+
+    bzero(&ifr, sizeof(ifr));
+    cpe_str_dup(ifr.ifr_name, sizeof(ifr.ifr_name), device->m_dev_name);
+    if (ioctl(device->m_dev_fd, SIOCGIFINDEX, (void *)&ifr) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: get index fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+    if_index = ifr.ifr_ifindex;
+
+    if (ioctl(device->m_dev_fd, SIOCGIFMTU, (void *)&ifr) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: get mtu fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+    device->m_mtu = ifr.ifr_mtu;
+
+    if (ioctl(device->m_dev_fd, SIOCGIFHWADDR, (void *)&ifr) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: get hwaddr fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+    if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: link type %d not ethernet",
+            device->m_dev_name, ifr.ifr_hwaddr.sa_family);
+        return -1;
+    }
+    memcpy(src_mac, ifr.ifr_hwaddr.sa_data, sizeof(src_mac));
+
+    net_tun_device_af_packet_t packet = mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_af_packet));
+    if (packet == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: packet: alloc fail", device->m_dev_name);
+        return -1;
+    }
+    bzero(packet, sizeof(*packet));
+    packet->m_device = device;
+    packet->m_map = MAP_FAILED;
+    device->m_af_packet = packet;
+
+    uint8_t const * peer_mac = settings->m_init_data.m_packet.m_peer_mac;
+    uint8_t i;
+    for(i = 0; i < 6 && peer_mac[i] == 0; ++i);
+    if (i < 6) {
+        memcpy(packet->m_eth_addrs, peer_mac, 6);
+    }
+    else {
+        memset(packet->m_eth_addrs, 0xFF, 6);
+    }
+    memcpy(packet->m_eth_addrs + 6, src_mac, 6);
+
+    /*link head is stripped on input and added back on output, gro/gso frames of the peer may reach 64k*/
+    device->m_frame_capacity = NET_TUN_ETHERNET_HEADER_LENGTH + 0xFFFF;
+
+    if (net_tun_device_af_packet_setup_ring(packet) != 0) return -1;
+
+    struct sockaddr_ll addr;
+    bzero(&addr, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_index;
+    if (bind(device->m_dev_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: bind fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    CPE_INFO(
+        driver->m_em, "tun: %s: packet: attached, index=%d, mtu=%d, rx %d x %d, tx %d x %d",
+        device->m_dev_name, if_index, device->m_mtu,
+        packet->m_rx_block_count, packet->m_rx_block_size,
+        packet->m_tx_frame_count, packet->m_tx_frame_size);
+
+    return 0;
+}
+
+void net_tun_device_af_packet_fini(net_tun_device_t device) {
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+    if (packet == NULL) return;
+
+    if (packet->m_map != MAP_FAILED) {
+        munmap(packet->m_map, packet->m_map_size);
+        packet->m_map = MAP_FAILED;
+    }
+
+    mem_free(device->m_driver->m_alloc, packet);
+    device->m_af_packet = NULL;
+}
+
+static int net_tun_device_af_packet_setup_ring(net_tun_device_af_packet_t packet) {
+    net_tun_device_t device = packet->m_device;
+    net_tun_driver_t driver = device->m_driver;
+    int fd = device->m_dev_fd;
+    int opt;
+
+    opt = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &opt, sizeof(opt)) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: set version v3 fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    /*a frame the kernel can not send is dropped instead of stalling the ring*/
+    opt = 1;
+    if (setsockopt(fd, SOL_PACKET, PACKET_LOSS, &opt, sizeof(opt)) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: set loss fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    /*optional, frames we send are filtered on input anyway*/
+#ifdef PACKET_IGNORE_OUTGOING
+    opt = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &opt, sizeof(opt));
+#endif
+#ifdef PACKET_QDISC_BYPASS
+    opt = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &opt, sizeof(opt));
+#endif
+
+    struct tpacket_req3 rx_req;
+    bzero(&rx_req, sizeof(rx_req));
+    rx_req.tp_block_size = NET_TUN_DEVICE_AF_PACKET_RX_BLOCK_SIZE;
+    rx_req.tp_block_nr = NET_TUN_DEVICE_AF_PACKET_RX_BLOCK_COUNT;
+    rx_req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    rx_req.tp_frame_nr = rx_req.tp_block_size / rx_req.tp_frame_size * rx_req.tp_block_nr;
+    rx_req.tp_retire_blk_tov = NET_TUN_DEVICE_AF_PACKET_RX_RETIRE_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &rx_req, sizeof(rx_req)) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: setup rx ring fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    /*tx frames are fixed size, a whole ethernet frame has to fit*/
+    uint32_t tx_frame_size = TPACKET_ALIGNMENT << 7;
+    while(tx_frame_size < NET_TUN_DEVICE_AF_PACKET_TX_DATA_OFFSET + NET_TUN_ETHERNET_HEADER_LENGTH + device->m_mtu) {
+        tx_frame_size <<= 1;
+    }
+
+    struct tpacket_req3 tx_req;
+    bzero(&tx_req, sizeof(tx_req));
+    tx_req.tp_block_size =
+        tx_frame_size > NET_TUN_DEVICE_AF_PACKET_TX_BLOCK_SIZE ? tx_frame_size : NET_TUN_DEVICE_AF_PACKET_TX_BLOCK_SIZE;
+    tx_req.tp_block_nr = NET_TUN_DEVICE_AF_PACKET_TX_BLOCK_COUNT;
+    tx_req.tp_frame_size = tx_frame_size;
+    tx_req.tp_frame_nr = tx_req.tp_block_size / tx_req.tp_frame_size * tx_req.tp_block_nr;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: setup tx ring fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    /*rx and tx rings share one mapping, rx first*/
+    size_t rx_size = (size_t)rx_req.tp_block_size * rx_req.tp_block_nr;
+    size_t tx_size = (size_t)tx_req.tp_block_size * tx_req.tp_block_nr;
+    packet->m_map_size = rx_size + tx_size;
+    packet->m_map = mmap(NULL, packet->m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (packet->m_map == MAP_FAILED) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: mmap %d fail, %d %s",
+            device->m_dev_name, (int)packet->m_map_size, errno, strerror(errno));
+        return -1;
+    }
+
+    packet->m_rx_block_size = rx_req.tp_block_size;
+    packet->m_rx_block_count = rx_req.tp_block_nr;
+    packet->m_rx_block_cur = 0;
+    packet->m_rx_frame = NULL;
+    packet->m_rx_frame_left = 0;
+
+    packet->m_tx_ring = packet->m_map + rx_size;
+    packet->m_tx_frame_size = tx_req.tp_frame_size;
+    packet->m_tx_frame_count = tx_req.tp_frame_nr;
+    packet->m_tx_frame_cur = 0;
+    packet->m_tx_queued = 0;
+    packet->m_tx_batching = 0;
+
+    return 0;
+}
+
+int net_tun_device_af_packet_output_hdr(net_tun_device_t device, struct pbuf * p, uint8_t * head) {
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+    uint16_t eth_type = ETH_P_IP;
+
+    if (p->len > 0 && (((uint8_t *)p->payload)[0] >> 4) == 6) {
+        eth_type = ETH_P_IPV6;
+    }
+
+    memcpy(head, packet->m_eth_addrs, sizeof(packet->m_eth_addrs));
+    head[12] = (uint8_t)(eth_type >> 8);
+    head[13] = (uint8_t)(eth_type & 0xFF);
+
+    return 0;
+}
+
+static void net_tun_device_af_packet_frame_input(
+    net_tun_driver_t driver, net_tun_device_t device, struct tpacket3_hdr const * frame)
+{
+    struct sockaddr_ll const * sll =
+        (struct sockaddr_ll const *)((uint8_t const *)frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    uint8_t const * data = (uint8_t const *)frame + frame->tp_mac;
+    uint32_t len = frame->tp_snaplen;
+
+    /*our own output looped back, or unicast to some other host on the link*/
+    if (sll->sll_pkttype == PACKET_OUTGOING || sll->sll_pkttype == PACKET_OTHERHOST) return;
+
+    if (len < NET_TUN_ETHERNET_HEADER_LENGTH) return;
+
+    /*arp and the rest are left to the kernel side of the interface*/
+    uint16_t eth_type = (uint16_t)((data[12] << 8) | data[13]);
+    if (eth_type != ETH_P_IP && eth_type != ETH_P_IPV6) return;
+
+    if (frame->tp_snaplen != frame->tp_len) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: input frame truncated, %d/%d",
+            device->m_dev_name, frame->tp_snaplen, frame->tp_len);
+        return;
+    }
+
+    len -= NET_TUN_ETHERNET_HEADER_LENGTH;
+    if (len > 0xFFFF) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: input packet length %d overflow",
+            device->m_dev_name, len);
+        return;
+    }
+
+    struct pbuf * p = net_tun_device_packet_alloc(driver, device, data + NET_TUN_ETHERNET_HEADER_LENGTH, (uint16_t)len);
+    if (p == NULL) return;
+
+    /*sent by the local stack (partial checksum) or already verified by the nic*/
+    uint8_t csum_valid = (frame->tp_status & TP_STATUS_CSUMNOTREADY) ? 1 : 0;
+#ifdef TP_STATUS_CSUM_VALID
+    if (frame->tp_status & TP_STATUS_CSUM_VALID) csum_valid = 1;
+#endif
+
+    net_tun_device_vnet_pbuf_input(driver, device, p, csum_valid);
+}
+
+static void net_tun_device_af_packet_rx_release(net_tun_device_af_packet_t packet) {
+    struct tpacket_block_desc * block = net_tun_device_af_packet_rx_block(packet, packet->m_rx_block_cur);
+
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+    packet->m_rx_frame = NULL;
+    packet->m_rx_frame_left = 0;
+    packet->m_rx_block_cur = (packet->m_rx_block_cur + 1) % packet->m_rx_block_count;
+}
+
+/*0: drained, 1: budget used up*/
+int net_tun_device_af_packet_read(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget) {
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+
+    for(;;) {
+        if (packet->m_rx_frame == NULL) {
+            struct tpacket_block_desc * block = net_tun_device_af_packet_rx_block(packet, packet->m_rx_block_cur);
+            if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) return 0;
+
+            packet->m_rx_frame = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+            packet->m_rx_frame_left = block->hdr.bh1.num_pkts;
+        }
+
+        if (packet->m_rx_frame_left == 0) {
+            net_tun_device_af_packet_rx_release(packet);
+            continue;
+        }
+
+        struct tpacket3_hdr * frame = packet->m_rx_frame;
+        uint32_t frame_len = frame->tp_snaplen;
+
+        packet->m_rx_frame_left--;
+        packet->m_rx_frame = (struct tpacket3_hdr *)((uint8_t *)frame + frame->tp_next_offset);
+
+        net_tun_device_af_packet_frame_input(driver, device, frame);
+
+        /*hand the block back as soon as its last frame is consumed*/
+        if (packet->m_rx_frame_left == 0) {
+            net_tun_device_af_packet_rx_release(packet);
+        }
+
+        if (!net_tun_read_budget_consume(budget, frame_len)) return 1;
+    }
+}
+
+uint8_t net_tun_device_af_packet_write_ready(net_tun_device_t device) {
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+    struct tpacket3_hdr * frame = net_tun_device_af_packet_tx_frame(packet, packet->m_tx_frame_cur);
+
+    return __atomic_load_n(&frame->tp_status, __ATOMIC_ACQUIRE) == TP_STATUS_AVAILABLE;
+}
+
+int net_tun_device_af_packet_writev(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len) {
+    net_tun_driver_t driver = device->m_driver;
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+    int i;
+
+    if (data_len > packet->m_tx_frame_size - NET_TUN_DEVICE_AF_PACKET_TX_DATA_OFFSET) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: packet: output len %d overflow, frame=%d",
+            device->m_dev_name, data_len, packet->m_tx_frame_size);
+        return 0;
+    }
+
+    if (!net_tun_device_af_packet_write_ready(device)) {
+        /*ring is full, push out what is marked and keep this one until the socket turns writable*/
+        net_tun_device_af_packet_kick(packet);
+        net_tun_device_pending_append(device, iov, iovcnt, data_len);
+        return 0;
+    }
+
+    struct tpacket3_hdr * frame = net_tun_device_af_packet_tx_frame(packet, packet->m_tx_frame_cur);
+    uint8_t * data = (uint8_t *)frame + NET_TUN_DEVICE_AF_PACKET_TX_DATA_OFFSET;
+    uint32_t len = 0;
+    for(i = 0; i < iovcnt; ++i) {
+        memcpy(data + len, iov[i].iov_base, iov[i].iov_len);
+        len += (uint32_t)iov[i].iov_len;
+    }
+    assert(len == data_len);
+
+    frame->tp_len = data_len;
+    frame->tp_next_offset = 0;
+    __atomic_store_n(&frame->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    packet->m_tx_frame_cur = (packet->m_tx_frame_cur + 1) % packet->m_tx_frame_count;
+    packet->m_tx_queued++;
+
+    if (net_tun_driver_debug(driver) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: >>> %.5d |      %s",
+            device->m_dev_name, data_len,
+            net_tun_dump_raw_data(
+                net_tun_driver_tmp_buffer(driver), data, data_len,
+                net_tun_driver_debug(driver) >= 3));
+    }
+
+    /*inside a batch the frames go out with one send at commit*/
+    if (!packet->m_tx_batching) {
+        net_tun_device_af_packet_kick(packet);
+    }
+
+    return 0;
+}
+
+void net_tun_device_af_packet_write_begin(net_tun_device_t device) {
+    device->m_af_packet->m_tx_batching++;
+}
+
+void net_tun_device_af_packet_write_commit(net_tun_device_t device) {
+    net_tun_device_af_packet_t packet = device->m_af_packet;
+
+    assert(packet->m_tx_batching > 0);
+    if (--packet->m_tx_batching == 0) {
+        net_tun_device_af_packet_kick(packet);
+    }
+}
+
+static void net_tun_device_af_packet_kick(net_tun_device_af_packet_t packet) {
+    net_tun_device_t device = packet->m_device;
+
+    if (packet->m_tx_queued == 0) return;
+    packet->m_tx_queued = 0;
+
+    if (send(device->m_dev_fd, NULL, 0, MSG_DONTWAIT) < 0
+        && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+    {
+        CPE_ERROR(
+            device->m_driver->m_em, "tun: %s: packet: send ring fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+    }
+}
+
+#endif
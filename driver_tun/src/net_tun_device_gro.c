@@ -0,0 +1,341 @@
+#include <assert.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/ip6.h"
+#include "lwip/prot/tcp.h"
+#include "net_tun_device_i.h"
+
+/*
+ * receive offload: the tcp segments of a read burst that continue a held segment of the same
+ * flow are chained onto it (headers stripped), lwip gets one packet for the run.
+ * merged packets carry the flags and window of their last segment, their checksums are
+ * verified here (or trusted like the segments were) and lwip does not check them again.
+ */
+
+#define NET_TUN_DEVICE_GRO_FLAGS_STOP (TCP_SYN | TCP_FIN | TCP_RST | TCP_URG | TCP_ECE | TCP_CWR)
+
+struct net_tun_device_gro_seg {
+    uint8_t m_ip_version;
+    uint8_t m_ip_hlen;
+    uint8_t m_tcp_hlen;
+    uint8_t m_key_pos;
+    uint8_t m_key_len;
+    struct tcp_hdr * m_tcphdr;
+    uint32_t m_seq;
+    uint16_t m_payload;
+};
+
+static void net_tun_device_gro_deliver(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p, uint8_t trusted);
+
+void net_tun_device_gro_init(net_tun_device_t device) {
+    device->m_gro_segs_max = NET_TUN_DEVICE_GRO_SEGS_DEFAULT;
+    device->m_gro_active = 0;
+    device->m_gro_evict = 0;
+    device->m_gro_segments = 0;
+    device->m_gro_packets = 0;
+    bzero(device->m_gro_flows, sizeof(device->m_gro_flows));
+}
+
+void net_tun_device_gro_fini(net_tun_device_t device) {
+    uint8_t i;
+    for(i = 0; i < NET_TUN_DEVICE_GRO_FLOWS; ++i) {
+        if (device->m_gro_flows[i].m_packet) {
+            pbuf_free(device->m_gro_flows[i].m_packet);
+            device->m_gro_flows[i].m_packet = NULL;
+        }
+    }
+}
+
+void net_tun_device_set_gro(net_tun_device_t device, uint16_t max_segs) {
+    net_tun_device_gro_flush(device);
+    device->m_gro_segs_max = max_segs;
+}
+
+void net_tun_device_gro_stat(net_tun_device_t device, struct net_tun_device_gro_stat * stat) {
+    stat->m_segs_max = device->m_gro_segs_max;
+    stat->m_segments = device->m_gro_segments;
+    stat->m_packets = device->m_gro_packets;
+}
+
+/*ip and tcp headers in the first pbuf, nothing lwip would treat as more than a plain data segment*/
+static uint8_t net_tun_device_gro_parse(struct pbuf * p, struct net_tun_device_gro_seg * seg) {
+    uint8_t const * data = p->payload;
+    uint16_t l4_len;
+
+    if (p->len < 1) return 0;
+
+    seg->m_ip_version = data[0] >> 4;
+    switch(seg->m_ip_version) {
+    case 4: {
+        struct ip_hdr const * iphdr = p->payload;
+        if (p->len < IP_HLEN || IPH_HL(iphdr) != 5 || IPH_PROTO(iphdr) != IP_PROTO_TCP) return 0;
+        if ((lwip_ntohs(IPH_OFFSET(iphdr)) & (IP_MF | IP_OFFMASK)) != 0) return 0;
+        if (lwip_ntohs(IPH_LEN(iphdr)) != p->tot_len) return 0;
+        seg->m_ip_hlen = IP_HLEN;
+        seg->m_key_pos = 12;
+        seg->m_key_len = 8;
+        break;
+    }
+    case 6: {
+        struct ip6_hdr const * ip6hdr = p->payload;
+        if (p->len < IP6_HLEN || IP6H_NEXTH(ip6hdr) != IP6_NEXTH_TCP) return 0;
+        if (IP6H_PLEN(ip6hdr) + IP6_HLEN != p->tot_len) return 0;
+        seg->m_ip_hlen = IP6_HLEN;
+        seg->m_key_pos = 8;
+        seg->m_key_len = 32;
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    if (p->len < seg->m_ip_hlen + TCP_HLEN) return 0;
+    seg->m_tcphdr = (struct tcp_hdr *)(data + seg->m_ip_hlen);
+    seg->m_tcp_hlen = TCPH_HDRLEN_BYTES(seg->m_tcphdr);
+    if (seg->m_tcp_hlen < TCP_HLEN || p->len < seg->m_ip_hlen + seg->m_tcp_hlen) return 0;
+
+    l4_len = (uint16_t)(p->tot_len - seg->m_ip_hlen);
+    seg->m_payload = (uint16_t)(l4_len - seg->m_tcp_hlen);
+    seg->m_seq = lwip_ntohl(seg->m_tcphdr->seqno);
+
+    return 1;
+}
+
+/*same addresses and ports*/
+static net_tun_device_gro_flow_t
+net_tun_device_gro_find(net_tun_device_t device, struct pbuf * p, struct net_tun_device_gro_seg const * seg) {
+    uint8_t const * key = (uint8_t const *)p->payload + seg->m_key_pos;
+    uint8_t i;
+
+    for(i = 0; i < NET_TUN_DEVICE_GRO_FLOWS; ++i) {
+        net_tun_device_gro_flow_t flow = &device->m_gro_flows[i];
+        if (flow->m_packet == NULL || flow->m_ip_version != seg->m_ip_version) continue;
+
+        uint8_t const * data = flow->m_packet->payload;
+        if (memcmp(data + seg->m_key_pos, key, seg->m_key_len) != 0) continue;
+        if (memcmp(data + seg->m_ip_hlen, seg->m_tcphdr, 4) != 0) continue;
+
+        return flow;
+    }
+
+    return NULL;
+}
+
+/*p->payload at the tcp header*/
+static uint8_t net_tun_device_gro_chksum_ok(struct pbuf * p, uint8_t ip_version, uint8_t const * iphead) {
+    if (ip_version == 4) {
+        struct ip_hdr const * iphdr = (struct ip_hdr const *)iphead;
+        ip4_addr_t src;
+        ip4_addr_t dst;
+
+        if (inet_chksum(iphdr, IP_HLEN) != 0) return 0;
+        ip4_addr_copy(src, iphdr->src);
+        ip4_addr_copy(dst, iphdr->dest);
+        return inet_chksum_pseudo(p, IP_PROTO_TCP, p->tot_len, &src, &dst) == 0 ? 1 : 0;
+    }
+    else {
+        struct ip6_hdr const * ip6hdr = (struct ip6_hdr const *)iphead;
+        ip6_addr_t src;
+        ip6_addr_t dst;
+
+        ip6_addr_copy_from_packed(src, ip6hdr->src);
+        ip6_addr_copy_from_packed(dst, ip6hdr->dest);
+        return ip6_chksum_pseudo(p, IP6_NEXTH_TCP, p->tot_len, &src, &dst) == 0 ? 1 : 0;
+    }
+}
+
+/*checksum of a whole packet, headers are put back before returning*/
+static uint8_t net_tun_device_gro_packet_chksum_ok(struct pbuf * p, uint8_t ip_version, uint8_t ip_hlen) {
+    uint8_t ok = 0;
+    uint8_t const * iphead = p->payload;
+
+    if (pbuf_remove_header(p, ip_hlen) != 0) return 0;
+    ok = net_tun_device_gro_chksum_ok(p, ip_version, iphead);
+    pbuf_header_force(p, (s16_t)ip_hlen);
+
+    return ok;
+}
+
+/*the held head and the new segment agree on everything but seq, window and psh*/
+static uint8_t net_tun_device_gro_can_merge(
+    net_tun_device_t device, net_tun_device_gro_flow_t flow, struct pbuf * p, struct net_tun_device_gro_seg const * seg)
+{
+    uint8_t const * head = flow->m_packet->payload;
+    uint8_t const * data = p->payload;
+    struct tcp_hdr const * head_tcphdr = (struct tcp_hdr const *)(head + flow->m_ip_hlen);
+
+    if (seg->m_seq != flow->m_next_seq) return 0;
+    if (seg->m_payload == 0 || seg->m_payload > flow->m_mss) return 0;
+    if (flow->m_segs >= device->m_gro_segs_max) return 0;
+    if ((uint32_t)flow->m_packet->tot_len + seg->m_payload > 0xFFFF) return 0;
+    if (TCPH_FLAGS(seg->m_tcphdr) & NET_TUN_DEVICE_GRO_FLAGS_STOP) return 0;
+    if (!(TCPH_FLAGS(seg->m_tcphdr) & TCP_ACK)) return 0;
+
+    /*same ack and options (timestamps), the sender state lwip sees does not move inside a run*/
+    if (seg->m_tcp_hlen != flow->m_tcp_hlen) return 0;
+    if (seg->m_tcphdr->ackno != head_tcphdr->ackno) return 0;
+    if (memcmp((uint8_t const *)seg->m_tcphdr + TCP_HLEN, (uint8_t const *)head_tcphdr + TCP_HLEN, seg->m_tcp_hlen - TCP_HLEN) != 0) return 0;
+
+    if (seg->m_ip_version == 4) {
+        struct ip_hdr const * h = (struct ip_hdr const *)head;
+        struct ip_hdr const * n = (struct ip_hdr const *)data;
+        if (IPH_TOS(h) != IPH_TOS(n) || IPH_TTL(h) != IPH_TTL(n)) return 0;
+        if ((IPH_OFFSET(h) ^ IPH_OFFSET(n)) & PP_HTONS(IP_DF)) return 0;
+    }
+    else {
+        struct ip6_hdr const * h = (struct ip6_hdr const *)head;
+        struct ip6_hdr const * n = (struct ip6_hdr const *)data;
+        if (h->_v_tc_fl != n->_v_tc_fl || IP6H_HOPLIM(h) != IP6H_HOPLIM(n)) return 0;
+    }
+
+    return 1;
+}
+
+static void net_tun_device_gro_hold(
+    net_tun_device_t device, net_tun_device_gro_flow_t flow, struct pbuf * p, struct net_tun_device_gro_seg const * seg)
+{
+    flow->m_packet = p;
+    flow->m_ip_version = seg->m_ip_version;
+    flow->m_ip_hlen = seg->m_ip_hlen;
+    flow->m_tcp_hlen = seg->m_tcp_hlen;
+    flow->m_trusted = device->m_chksum_check_input ? 0 : 1;
+    flow->m_verified = 0;
+    flow->m_mss = seg->m_payload;
+    flow->m_segs = 1;
+    flow->m_next_seq = seg->m_seq + seg->m_payload;
+    device->m_gro_segments++;
+}
+
+/*chain the payload of p onto the held head, 0: p is untouched*/
+static uint8_t net_tun_device_gro_merge(
+    net_tun_device_t device, net_tun_device_gro_flow_t flow, struct pbuf * p, struct net_tun_device_gro_seg const * seg)
+{
+    uint8_t const * iphead = p->payload;
+    uint8_t check = device->m_chksum_check_input;
+
+    /*a bad segment is left to lwip, which drops and counts it*/
+    if (!flow->m_trusted && !flow->m_verified) {
+        if (!net_tun_device_gro_packet_chksum_ok(flow->m_packet, flow->m_ip_version, flow->m_ip_hlen)) return 0;
+        flow->m_verified = 1;
+    }
+
+    if (pbuf_remove_header(p, seg->m_ip_hlen) != 0) return 0;
+    if (check && !net_tun_device_gro_chksum_ok(p, seg->m_ip_version, iphead)) {
+        pbuf_header_force(p, (s16_t)seg->m_ip_hlen);
+        return 0;
+    }
+
+    /*what lwip must take from the last segment*/
+    struct tcp_hdr * head_tcphdr = (struct tcp_hdr *)((uint8_t *)flow->m_packet->payload + flow->m_ip_hlen);
+    head_tcphdr->wnd = seg->m_tcphdr->wnd;
+    if (TCPH_FLAGS(seg->m_tcphdr) & TCP_PSH) TCPH_SET_FLAG(head_tcphdr, TCP_PSH);
+
+    pbuf_remove_header(p, seg->m_tcp_hlen);
+    pbuf_cat(flow->m_packet, p);
+
+    device->m_gro_segments++;
+    flow->m_segs++;
+    flow->m_next_seq += seg->m_payload;
+    return 1;
+}
+
+static void net_tun_device_gro_flow_flush(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_gro_flow_t flow) {
+    struct pbuf * p = flow->m_packet;
+    uint8_t trusted = flow->m_trusted;
+
+    flow->m_packet = NULL;
+    device->m_gro_packets++;
+
+    if (flow->m_segs > 1) {
+        if (flow->m_ip_version == 4) {
+            struct ip_hdr * iphdr = p->payload;
+            IPH_LEN_SET(iphdr, lwip_htons(p->tot_len));
+            IPH_CHKSUM_SET(iphdr, 0);
+            IPH_CHKSUM_SET(iphdr, inet_chksum(iphdr, IP_HLEN));
+        }
+        else {
+            struct ip6_hdr * ip6hdr = p->payload;
+            IP6H_PLEN_SET(ip6hdr, (u16_t)(p->tot_len - IP6_HLEN));
+        }
+
+        /*the tcp checksum no longer matches, every segment in it is checked or trusted*/
+        trusted = 1;
+    }
+
+    net_tun_device_gro_deliver(driver, device, p, trusted);
+}
+
+void net_tun_device_gro_flush(net_tun_device_t device) {
+    uint8_t i;
+    for(i = 0; i < NET_TUN_DEVICE_GRO_FLOWS; ++i) {
+        if (device->m_gro_flows[i].m_packet) {
+            net_tun_device_gro_flow_flush(device->m_driver, device, &device->m_gro_flows[i]);
+        }
+    }
+}
+
+/*1: p is held (or merged), 0: deliver p now*/
+uint8_t net_tun_device_gro_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p) {
+    struct net_tun_device_gro_seg seg;
+    uint8_t i;
+
+    if (!net_tun_device_gro_parse(p, &seg)) return 0;
+
+    net_tun_device_gro_flow_t flow = net_tun_device_gro_find(device, p, &seg);
+    if (flow) {
+        if (net_tun_device_gro_can_merge(device, flow, p, &seg) && net_tun_device_gro_merge(device, flow, p, &seg)) {
+            /*a short or pushed segment ends the run, as it does for the sender*/
+            if (seg.m_payload < flow->m_mss
+                || (TCPH_FLAGS(seg.m_tcphdr) & TCP_PSH)
+                || flow->m_segs >= device->m_gro_segs_max)
+            {
+                net_tun_device_gro_flow_flush(driver, device, flow);
+            }
+            return 1;
+        }
+
+        /*anything else of the flow goes after what is held*/
+        net_tun_device_gro_flow_flush(driver, device, flow);
+    }
+
+    if (seg.m_payload == 0
+        || (TCPH_FLAGS(seg.m_tcphdr) & (NET_TUN_DEVICE_GRO_FLAGS_STOP | TCP_PSH))
+        || !(TCPH_FLAGS(seg.m_tcphdr) & TCP_ACK))
+    {
+        return 0;
+    }
+
+    if (flow == NULL) {
+        for(i = 0; i < NET_TUN_DEVICE_GRO_FLOWS; ++i) {
+            if (device->m_gro_flows[i].m_packet == NULL) {
+                flow = &device->m_gro_flows[i];
+                break;
+            }
+        }
+    }
+
+    if (flow == NULL) {
+        flow = &device->m_gro_flows[device->m_gro_evict++ % NET_TUN_DEVICE_GRO_FLOWS];
+        net_tun_device_gro_flow_flush(driver, device, flow);
+    }
+
+    net_tun_device_gro_hold(device, flow, p, &seg);
+    return 1;
+}
+
+/*a flush runs under the checksum flags of the packet that caused it, held packets get their own*/
+static void net_tun_device_gro_deliver(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p, uint8_t trusted) {
+    u16_t chksum_flags = device->m_netif.chksum_flags;
+    u16_t flags = net_tun_device_chksum_flags(device);
+
+    NETIF_SET_CHECKSUM_CTRL(
+        &device->m_netif,
+        trusted ? (flags & ~NETIF_CHECKSUM_CHECK_TCP) : (flags | NETIF_CHECKSUM_CHECK_TCP));
+
+    net_tun_device_pbuf_deliver(driver, device, p);
+
+    NETIF_SET_CHECKSUM_CTRL(&device->m_netif, chksum_flags);
+}
@@ -3,8 +3,68 @@
 #include "net_tun_device.h"
 #include "net_tun_driver_i.h"
 
+/*tun fds take a packet from an iovec, other backends go through the combine buffer*/
+#if NET_TUN_USE_DEV_TUN && ! CPE_OS_WIN
+#include <sys/uio.h>
+#define NET_TUN_DEVICE_WRITEV 1
+#define NET_TUN_DEVICE_WRITEV_MAX 32
+#else
+#define NET_TUN_DEVICE_WRITEV 0
+#endif
+
 #define NET_TUN_ETHERNET_HEADER_LENGTH 14
 
+/*link level header written in front of an ip packet (virtio-net header)*/
+#define NET_TUN_DEVICE_OUTPUT_HEAD_MAX 16
+
+/*largest tcp segment handed to a device with virtio-net header, the kernel cuts it by mss*/
+#define NET_TUN_DEVICE_VNET_TSO_MAX (0xFFFF - 120)
+
+/*receive offload, connections held at once within a read burst*/
+#define NET_TUN_DEVICE_GRO_FLOWS 8
+#define NET_TUN_DEVICE_GRO_SEGS_DEFAULT 8
+typedef struct net_tun_device_gro_flow * net_tun_device_gro_flow_t;
+
+#if NET_TUN_USE_DEV_TUN
+/*zero copy input, free frame buffers kept for reuse*/
+#define NET_TUN_DEVICE_RX_CACHE_COUNT 64
+/*frames filling less than 1/n of a frame buffer are copied out, lwip holding them (ooseq, gro, zero copy receive)
+  must not pin a whole buffer sized for offload (64K) per small segment*/
+#define NET_TUN_DEVICE_RX_COPY_RATIO 4
+typedef struct net_tun_device_rx_pool * net_tun_device_rx_pool_t;
+typedef struct net_tun_device_rx_buf * net_tun_device_rx_buf_t;
+
+/*packets the device refused (EAGAIN), output is held back between high and low*/
+#define NET_TUN_DEVICE_PENDING_MAX 512
+#define NET_TUN_DEVICE_PENDING_HIGH 256
+#define NET_TUN_DEVICE_PENDING_LOW 64
+typedef struct net_tun_device_pending_packet * net_tun_device_pending_packet_t;
+typedef TAILQ_HEAD(net_tun_device_pending_list, net_tun_device_pending_packet) net_tun_device_pending_list_t;
+#endif
+
+#if NET_TUN_USE_DEV_TUN && ! CPE_OS_WIN
+#define NET_TUN_DEVICE_PCAP 1
+typedef struct net_tun_device_pcap * net_tun_device_pcap_t;
+#else
+#define NET_TUN_DEVICE_PCAP 0
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+/*rx blocks are handed over by the kernel when full or after the retire timeout*/
+#define NET_TUN_DEVICE_AF_PACKET_RX_BLOCK_SIZE (1 << 20)
+#define NET_TUN_DEVICE_AF_PACKET_RX_BLOCK_COUNT 8
+#define NET_TUN_DEVICE_AF_PACKET_RX_RETIRE_MS 1
+#define NET_TUN_DEVICE_AF_PACKET_TX_BLOCK_SIZE (1 << 16)
+#define NET_TUN_DEVICE_AF_PACKET_TX_BLOCK_COUNT 4
+typedef struct net_tun_device_af_packet * net_tun_device_af_packet_t;
+#endif
+
+#if NET_TUN_USE_IO_URING
+#define NET_TUN_DEVICE_URING_READ_COUNT 64
+#define NET_TUN_DEVICE_URING_WRITE_COUNT 64
+typedef struct net_tun_device_uring * net_tun_device_uring_t;
+#endif
+
 #if NET_TUN_USE_DEV_NE
 @interface NetTunDeviceBridger : NSObject {
     @public net_tun_device_t m_device;
@@ -12,6 +72,24 @@
 @end
 #endif
 
+struct net_tun_device_output_entry {
+    struct pbuf * m_packet;
+    uint8_t m_head_len;
+    uint8_t m_head[NET_TUN_DEVICE_OUTPUT_HEAD_MAX];
+};
+
+struct net_tun_device_gro_flow {
+    struct pbuf * m_packet;     /*head segment, later ones chained without headers*/
+    uint8_t m_ip_version;
+    uint8_t m_ip_hlen;
+    uint8_t m_tcp_hlen;
+    uint8_t m_trusted;          /*taken while the device was set not to check input checksums*/
+    uint8_t m_verified;         /*head checksum checked here*/
+    uint16_t m_mss;
+    uint16_t m_segs;
+    uint32_t m_next_seq;
+};
+
 struct net_tun_device {
     net_tun_driver_t m_driver;
     TAILQ_ENTRY(net_tun_device) m_next_for_driver;
@@ -19,11 +97,44 @@ struct net_tun_device {
     struct tcp_pcb * m_listener_ip4;
     struct tcp_pcb * m_listener_ip6;
     uint16_t m_mtu;
+    uint32_t m_frame_capacity;
     uint8_t m_quitting;
     char m_dev_name[16];
 
+    /*checksum control, see net_tun_device_chksum_apply*/
+    uint8_t m_chksum_check_input;
+    uint8_t m_chksum_gen_output;
+    uint64_t m_chksum_input_packets;
+    uint64_t m_chksum_input_trusted;
+    uint64_t m_chksum_output_packets;
+    uint64_t m_chksum_output_unsummed;
+
+    /*receive offload, active between net_tun_device_input_begin and end*/
+    uint16_t m_gro_segs_max;
+    uint8_t m_gro_active;
+    uint8_t m_gro_evict;
+    uint64_t m_gro_segments;
+    uint64_t m_gro_packets;
+    struct net_tun_device_gro_flow m_gro_flows[NET_TUN_DEVICE_GRO_FLOWS];
+
     /*device write buf*/
     uint8_t * m_write_combine_buf;
+
+    /*deferred output, packets of one event are queued and written together*/
+    uint16_t m_output_flush_count;
+    uint16_t m_output_flush_delay_ms;
+    uint16_t m_output_queue_size;
+    uint8_t m_output_timer_active;
+    struct net_tun_device_output_entry * m_output_queue;
+#if NET_TUN_USE_DRIVER
+    net_timer_t m_output_timer;
+#endif
+
+    /*read budget ran out, waiting for its round*/
+#if NET_TUN_USE_DRIVER
+    uint8_t m_read_scheduled;
+    TAILQ_ENTRY(net_tun_device) m_next_for_read;
+#endif
     
     /*使用tun设备接口 */
 #if NET_TUN_USE_DEV_TUN
@@ -31,6 +142,21 @@ struct net_tun_device {
     int m_dev_fd;
     uint8_t * m_dev_input_packet;
     net_watcher_t m_watcher;
+    uint8_t m_vnet_hdr_len;
+    net_tun_device_rx_pool_t m_rx_pool;
+    net_tun_device_pending_list_t m_pending;
+    uint16_t m_pending_count;
+    uint8_t m_pending_blocked;
+    uint32_t m_pending_drop_count;
+#if NET_TUN_USE_IO_URING
+    net_tun_device_uring_t m_uring;
+#endif
+#if NET_TUN_USE_AF_PACKET
+    net_tun_device_af_packet_t m_af_packet;
+#endif
+#if NET_TUN_DEVICE_PCAP
+    net_tun_device_pcap_t m_pcap;
+#endif
 #endif
 
     /*使用NetworkExtention设备接口 */
@@ -39,9 +165,13 @@ struct net_tun_device {
     __unsafe_unretained NEPacketTunnelFlow * m_tunnelFlow;
     __unsafe_unretained NSMutableArray<NSData *> * m_packets;
     __unsafe_unretained NSMutableArray<NSNumber *> * m_versions;
+    uint8_t m_packets_batching;
 #endif
 };
 
+u16_t net_tun_device_chksum_flags(net_tun_device_t device);
+void net_tun_device_chksum_apply(net_tun_device_t device);
+
 int net_tun_device_init_dev(
     net_tun_driver_t driver,
     net_tun_device_t device,
@@ -50,6 +180,85 @@ int net_tun_device_init_dev(
 void net_tun_device_fini_dev(net_tun_driver_t driver, net_tun_device_t device);
 
 int net_tun_device_packet_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * data, uint16_t bytes);
+struct pbuf * net_tun_device_packet_alloc(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * data, uint16_t bytes);
+int net_tun_device_pbuf_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p);
+int net_tun_device_pbuf_deliver(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p);
+void net_tun_device_input_begin(net_tun_device_t device);
+void net_tun_device_input_end(net_tun_device_t device);
 int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data_len);
+void net_tun_device_packet_write_begin(net_tun_device_t device);
+uint8_t net_tun_device_read_resume(net_tun_device_t device);
+void net_tun_device_packet_write_commit(net_tun_device_t device);
+
+void net_tun_device_gro_init(net_tun_device_t device);
+void net_tun_device_gro_fini(net_tun_device_t device);
+uint8_t net_tun_device_gro_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p);
+void net_tun_device_gro_flush(net_tun_device_t device);
+
+void net_tun_device_output_init(net_tun_device_t device);
+void net_tun_device_output_fini(net_tun_device_t device);
+int net_tun_device_output(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p);
+void net_tun_device_output_write(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p);
+void net_tun_device_output_flush(net_tun_device_t device);
+
+#if NET_TUN_USE_DEV_TUN
+int net_tun_device_frame_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * data, uint32_t bytes);
+#if NET_TUN_DEVICE_WRITEV
+int net_tun_device_packet_writev(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p);
+
+void net_tun_device_pending_init(net_tun_device_t device);
+void net_tun_device_pending_fini(net_tun_device_t device);
+uint8_t net_tun_device_pending_is_retry(int err);
+int net_tun_device_pending_append(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len);
+int net_tun_device_pending_retry(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len);
+void net_tun_device_pending_drain(net_tun_device_t device);
+#endif
+int net_tun_device_frame_input_rx(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_rx_buf_t buf, uint32_t bytes);
+
+net_tun_device_rx_pool_t net_tun_device_rx_pool_create(net_tun_device_t device, uint8_t head_len, uint16_t cache_max);
+void net_tun_device_rx_pool_free(net_tun_device_rx_pool_t pool);
+net_tun_device_rx_buf_t net_tun_device_rx_buf_alloc(net_tun_device_rx_pool_t pool);
+void net_tun_device_rx_buf_release(net_tun_device_rx_buf_t buf);
+uint8_t * net_tun_device_rx_buf_data(net_tun_device_rx_buf_t buf);
+uint32_t net_tun_device_rx_buf_capacity(net_tun_device_rx_buf_t buf);
+struct pbuf * net_tun_device_rx_buf_pbuf(net_tun_device_rx_buf_t buf, uint32_t offset, uint16_t len);
+
+int net_tun_device_vnet_setup(net_tun_device_t device);
+int net_tun_device_vnet_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size);
+int net_tun_device_vnet_input_hdr(
+    net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size, uint8_t * csum_valid);
+int net_tun_device_vnet_pbuf_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p, uint8_t csum_valid);
+int net_tun_device_vnet_output_hdr(net_tun_device_t device, struct pbuf * p, void * hdr);
+#endif
+
+#if NET_TUN_DEVICE_PCAP
+int net_tun_device_pcap_init(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_init_data_t settings);
+void net_tun_device_pcap_fini(net_tun_device_t device);
+int net_tun_device_pcap_read(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget);
+int net_tun_device_pcap_writev(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len);
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+int net_tun_device_af_packet_init(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_init_data_t settings);
+void net_tun_device_af_packet_fini(net_tun_device_t device);
+int net_tun_device_af_packet_output_hdr(net_tun_device_t device, struct pbuf * p, uint8_t * head);
+int net_tun_device_af_packet_read(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget);
+int net_tun_device_af_packet_writev(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len);
+uint8_t net_tun_device_af_packet_write_ready(net_tun_device_t device);
+void net_tun_device_af_packet_write_begin(net_tun_device_t device);
+void net_tun_device_af_packet_write_commit(net_tun_device_t device);
+#endif
+
+#if NET_TUN_USE_IO_URING
+int net_tun_device_uring_init(net_tun_device_t device);
+void net_tun_device_uring_fini(net_tun_device_t device);
+int net_tun_device_uring_write(net_tun_device_t device, uint8_t const * data, int data_len);
+int net_tun_device_uring_writev(
+    net_tun_device_t device, struct iovec const * iov, int iovcnt, uint8_t head_len, struct pbuf * p, uint32_t data_len);
+uint8_t net_tun_device_uring_write_ready(net_tun_device_t device);
+void net_tun_device_uring_write_begin(net_tun_device_t device);
+uint8_t net_tun_device_uring_read_resume(net_tun_device_t device);
+void net_tun_device_uring_write_commit(net_tun_device_t device);
+#endif
 
 #endif
@@ -26,6 +26,7 @@ int net_tun_device_init_dev(
 
     device->m_packets = [[NSMutableArray<NSData *> alloc] init];
     device->m_versions = [[NSMutableArray<NSNumber *> alloc] init];
+    device->m_packets_batching = 0;
 
     assert(s_tun_driver == NULL);
     s_tun_driver = driver;
@@ -57,6 +58,15 @@ void net_tun_device_fini_dev(net_tun_driver_t driver, net_tun_device_t device) {
     device->m_versions = NULL;
 }
 
+static void net_tun_device_packet_write_packets(net_tun_device_t device) {
+    if ([device->m_packets count] == 0) return;
+
+    [device->m_tunnelFlow writePackets: device->m_packets withProtocols: device->m_versions];
+
+    [device->m_packets removeAllObjects];
+    [device->m_versions removeAllObjects];
+}
+
 int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data_len) {
     assert(data_len >= 0);
     assert(data_len <= device->m_mtu);
@@ -67,10 +77,9 @@ int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data
     [device->m_packets addObject: packageData];
     [device->m_versions addObject: version];
 
-    [device->m_tunnelFlow writePackets: device->m_packets withProtocols: device->m_versions];
-
-    [device->m_packets removeAllObjects];
-    [device->m_versions removeAllObjects];
+    if (!device->m_packets_batching) {
+        net_tun_device_packet_write_packets(device);
+    }
 
     //[packageData release];
     //[version release]; 
@@ -78,6 +87,22 @@ int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data
     return 0;
 }
 
+uint8_t net_tun_device_read_resume(net_tun_device_t device) {
+    /*the flow hands packets over in arrays, there is nothing left to read*/
+    return 0;
+}
+
+void net_tun_device_packet_write_begin(net_tun_device_t device) {
+    device->m_packets_batching++;
+}
+
+void net_tun_device_packet_write_commit(net_tun_device_t device) {
+    assert(device->m_packets_batching > 0);
+    if (--device->m_packets_batching == 0) {
+        net_tun_device_packet_write_packets(device);
+    }
+}
+
 static void net_tun_device_start_read(net_tun_device_t i_device) {
     NetTunDeviceBridger * bridger = i_device->m_bridger;
     [bridger retain];
@@ -111,6 +136,10 @@ static void net_tun_device_start_read(net_tun_device_t i_device) {
                     }
                     
                     net_tun_driver_t driver = device->m_driver;
+
+                    /*replies of the whole read go to the flow with one writePackets*/
+                    net_tun_device_packet_write_begin(device);
+                    net_tun_device_input_begin(device);
                     for(uint32_t i = 0; i < [packets count]; ++i) {
                         NSData * packet = packets[i];
                         uint64_t packet_count = [packet length];
@@ -121,6 +150,9 @@ static void net_tun_device_start_read(net_tun_device_t i_device) {
 
                         net_tun_device_packet_input(driver, device, (uint8_t const *)[packet bytes], (uint16_t)packet_count);
                     }
+                    net_tun_device_input_end(device);
+                    net_tun_device_output_flush(device);
+                    net_tun_device_packet_write_commit(device);
 
                     net_tun_device_start_read(device);
                 });
@@ -0,0 +1,208 @@
+#include <assert.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "net_timer.h"
+#include "net_tun_device_i.h"
+
+#if NET_TUN_USE_DRIVER
+static void net_tun_device_output_timer_cb(net_timer_t timer, void * ctx);
+#endif
+
+void net_tun_device_output_init(net_tun_device_t device) {
+    device->m_output_flush_count = 0;
+    device->m_output_flush_delay_ms = 0;
+    device->m_output_queue_size = 0;
+    device->m_output_timer_active = 0;
+    device->m_output_queue = NULL;
+#if NET_TUN_USE_DRIVER
+    device->m_output_timer = NULL;
+#endif
+}
+
+void net_tun_device_output_fini(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+
+    /*device is going away, queued packets are dropped*/
+    while(device->m_output_queue_size > 0) {
+        pbuf_free(device->m_output_queue[--device->m_output_queue_size].m_packet);
+    }
+
+#if NET_TUN_USE_DRIVER
+    if (device->m_output_timer) {
+        net_timer_free(device->m_output_timer);
+        device->m_output_timer = NULL;
+    }
+#endif
+    device->m_output_timer_active = 0;
+
+    if (device->m_output_queue) {
+        mem_free(driver->m_alloc, device->m_output_queue);
+        device->m_output_queue = NULL;
+    }
+    device->m_output_flush_count = 0;
+}
+
+int net_tun_device_set_output_batch(net_tun_device_t device, uint16_t flush_count, uint16_t flush_delay_ms) {
+    net_tun_driver_t driver = device->m_driver;
+
+    net_tun_device_output_flush(device);
+
+    if (flush_count <= 1) {
+        net_tun_device_output_fini(device);
+        return 0;
+    }
+
+#if NET_TUN_USE_DRIVER
+    if (device->m_output_timer == NULL) {
+        device->m_output_timer = net_timer_create(driver->m_inner_driver, net_tun_device_output_timer_cb, device);
+        if (device->m_output_timer == NULL) {
+            CPE_ERROR(driver->m_em, "tun: %s: output: create flush timer fail", device->m_dev_name);
+            return -1;
+        }
+    }
+#else
+    CPE_ERROR(driver->m_em, "tun: %s: output: batch not support", device->m_dev_name);
+    return -1;
+#endif
+
+    struct net_tun_device_output_entry * queue =
+        mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_output_entry) * flush_count);
+    if (queue == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: output: alloc queue of %d fail", device->m_dev_name, flush_count);
+        return -1;
+    }
+
+    if (device->m_output_queue) {
+        mem_free(driver->m_alloc, device->m_output_queue);
+    }
+
+    device->m_output_queue = queue;
+    device->m_output_flush_count = flush_count;
+    device->m_output_flush_delay_ms = flush_delay_ms;
+
+    return 0;
+}
+
+void net_tun_device_output_write(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p) {
+    net_tun_driver_t driver = device->m_driver;
+    uint8_t head_added = 0;
+
+    /*lwip reserves link header room in front of the ip header*/
+    if (head_len && !p->next && pbuf_add_header(p, head_len) == 0) {
+        memcpy(p->payload, head, head_len);
+        head_added = 1;
+    }
+
+    if (!p->next && (head_len == 0 || head_added)) {
+        if (p->len > device->m_frame_capacity) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
+                device->m_dev_name, p->len, device->m_mtu);
+        }
+        else {
+            net_tun_device_packet_write(device, (uint8_t *)p->payload, p->len);
+        }
+
+        if (head_added) {
+            pbuf_remove_header(p, head_len);
+        }
+        return;
+    }
+
+#if NET_TUN_DEVICE_WRITEV
+    if (net_tun_device_packet_writev(device, head, head_len, p) == 0) return;
+#endif
+
+    /*too many fragments or no iovec support, gather into the combine buffer*/
+    assert(device->m_write_combine_buf);
+
+    uint8_t * device_write_buf = device->m_write_combine_buf;
+    uint32_t len = head_len;
+    memcpy(device_write_buf, head, head_len);
+
+    for(; p; p = p->next) {
+        if (p->len > device->m_frame_capacity - len) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
+                device->m_dev_name, p->len + len, device->m_mtu);
+            return;
+        }
+        memcpy(device_write_buf + len, p->payload, p->len);
+        len += p->len;
+    }
+
+    net_tun_device_packet_write(device, device_write_buf, (int)len);
+}
+
+int net_tun_device_output(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p) {
+    net_tun_driver_t driver = device->m_driver;
+
+    if (device->m_output_flush_count == 0) {
+        net_tun_device_output_write(device, head, head_len, p);
+        return 0;
+    }
+
+    /*lwip reuses volatile (PBUF_REF) data after output returns, those must be copied*/
+    struct pbuf * packet;
+    if (PBUF_NEEDS_COPY(p)) {
+        packet = pbuf_clone(PBUF_LINK, PBUF_RAM, p);
+        if (packet == NULL) {
+            CPE_ERROR(driver->m_em, "tun: %s: output: clone packet fail, len=%d", device->m_dev_name, p->tot_len);
+            return -1;
+        }
+    }
+    else {
+        pbuf_ref(p);
+        packet = p;
+    }
+
+    assert(head_len <= NET_TUN_DEVICE_OUTPUT_HEAD_MAX);
+    assert(device->m_output_queue_size < device->m_output_flush_count);
+    struct net_tun_device_output_entry * entry = device->m_output_queue + device->m_output_queue_size++;
+    entry->m_packet = packet;
+    entry->m_head_len = head_len;
+    memcpy(entry->m_head, head, head_len);
+
+    if (device->m_output_queue_size >= device->m_output_flush_count) {
+        net_tun_device_output_flush(device);
+    }
+#if NET_TUN_USE_DRIVER
+    else if (!device->m_output_timer_active) {
+        device->m_output_timer_active = 1;
+        net_timer_active(device->m_output_timer, device->m_output_flush_delay_ms);
+    }
+#endif
+
+    return 0;
+}
+
+void net_tun_device_output_flush(net_tun_device_t device) {
+    uint16_t i;
+
+    if (device->m_output_queue_size == 0) return;
+
+    net_tun_device_packet_write_begin(device);
+    for(i = 0; i < device->m_output_queue_size; ++i) {
+        struct net_tun_device_output_entry * entry = device->m_output_queue + i;
+        net_tun_device_output_write(device, entry->m_head, entry->m_head_len, entry->m_packet);
+        pbuf_free(entry->m_packet);
+    }
+    device->m_output_queue_size = 0;
+    net_tun_device_packet_write_commit(device);
+
+#if NET_TUN_USE_DRIVER
+    if (device->m_output_timer_active) {
+        device->m_output_timer_active = 0;
+        net_timer_cancel(device->m_output_timer);
+    }
+#endif
+}
+
+#if NET_TUN_USE_DRIVER
+static void net_tun_device_output_timer_cb(net_timer_t timer, void * ctx) {
+    net_tun_device_t device = ctx;
+    device->m_output_timer_active = 0;
+    net_tun_device_output_flush(device);
+}
+#endif
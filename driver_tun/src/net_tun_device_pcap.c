@@ -0,0 +1,440 @@
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_stdio.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "cpe/utils/string_utils.h"
+#include "net_timer.h"
+#include "net_tun_device_i.h"
+#include "net_tun_utils.h"
+
+#if NET_TUN_USE_DEV_TUN
+
+#if NET_TUN_DEVICE_PCAP
+
+#define NET_TUN_PCAP_MAGIC_USEC 0xa1b2c3d4u
+#define NET_TUN_PCAP_MAGIC_NSEC 0xa1b23c4du
+
+#define NET_TUN_PCAP_LINKTYPE_NULL 0
+#define NET_TUN_PCAP_LINKTYPE_ETHERNET 1
+#define NET_TUN_PCAP_LINKTYPE_RAW 101
+#define NET_TUN_PCAP_LINKTYPE_LINUX_SLL 113
+#define NET_TUN_PCAP_LINKTYPE_IPV4 228
+#define NET_TUN_PCAP_LINKTYPE_IPV6 229
+
+struct net_tun_pcap_file_head {
+    uint32_t m_magic;
+    uint16_t m_version_major;
+    uint16_t m_version_minor;
+    int32_t m_thiszone;
+    uint32_t m_sigfigs;
+    uint32_t m_snaplen;
+    uint32_t m_linktype;
+};
+
+struct net_tun_pcap_record_head {
+    uint32_t m_ts_sec;
+    uint32_t m_ts_frac;
+    uint32_t m_caplen;
+    uint32_t m_len;
+};
+
+struct net_tun_device_pcap {
+    net_tun_device_t m_device;
+    FILE * m_input;
+    FILE * m_output;
+    uint32_t m_linktype;
+    uint8_t m_swapped;
+    uint8_t m_nsec;
+    uint8_t m_realtime;
+    uint8_t m_input_done;
+    net_timer_t m_timer;
+
+    /*next record, read ahead so a realtime replay can wait for it*/
+    uint8_t m_has_record;
+    uint32_t m_record_len;
+    int64_t m_record_ts_us;
+    uint8_t * m_buf;
+    uint32_t m_buf_capacity;
+
+    /*recorded time of the first packet against our clock when it was fed*/
+    uint8_t m_base_set;
+    int64_t m_base_ts_us;
+    int64_t m_base_now_us;
+
+    int64_t m_start_us;
+    clock_t m_start_cpu;
+    int64_t m_done_us;
+    clock_t m_done_cpu;
+    uint64_t m_input_packets;
+    uint64_t m_input_bytes;
+    uint64_t m_output_packets;
+    uint64_t m_output_bytes;
+};
+
+static void net_tun_device_pcap_timer_cb(net_timer_t timer, void * ctx);
+static int net_tun_device_pcap_load_record(net_tun_device_pcap_t pcap);
+static void net_tun_device_pcap_input_done(net_tun_device_pcap_t pcap);
+
+static int64_t net_tun_device_pcap_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t net_tun_device_pcap_u32(net_tun_device_pcap_t pcap, uint32_t v) {
+    if (!pcap->m_swapped) return v;
+    return ((v & 0xFF) << 24) | ((v & 0xFF00) << 8) | ((v >> 8) & 0xFF00) | (v >> 24);
+}
+
+int net_tun_device_pcap_init(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_init_data_t settings) {
+    struct net_tun_pcap_file_head head;
+
+    device->m_dev_fd = -1;
+    device->m_dev_fd_close = 0;
+
+    if (settings->m_init_data.m_pcap.m_input == NULL) {
+        CPE_ERROR(driver->m_em, "tun: pcap: input file not set");
+        return -1;
+    }
+    snprintf(device->m_dev_name, sizeof(device->m_dev_name), "pcap");
+
+    net_tun_device_pcap_t pcap = mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_pcap));
+    if (pcap == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: alloc fail", device->m_dev_name);
+        return -1;
+    }
+    bzero(pcap, sizeof(*pcap));
+    pcap->m_device = device;
+    pcap->m_realtime = settings->m_init_data.m_pcap.m_realtime;
+    device->m_pcap = pcap;
+
+    pcap->m_input = fopen(settings->m_init_data.m_pcap.m_input, "rb");
+    if (pcap->m_input == NULL) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: open input %s fail, %d %s",
+            device->m_dev_name, settings->m_init_data.m_pcap.m_input, errno, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&head, sizeof(head), 1, pcap->m_input) != 1) {
+        CPE_ERROR(driver->m_em, "tun: %s: read input file head fail", device->m_dev_name);
+        return -1;
+    }
+
+    switch(head.m_magic) {
+    case NET_TUN_PCAP_MAGIC_USEC:
+        break;
+    case NET_TUN_PCAP_MAGIC_NSEC:
+        pcap->m_nsec = 1;
+        break;
+    default:
+        pcap->m_swapped = 1;
+        if (net_tun_device_pcap_u32(pcap, head.m_magic) == NET_TUN_PCAP_MAGIC_USEC) break;
+        if (net_tun_device_pcap_u32(pcap, head.m_magic) == NET_TUN_PCAP_MAGIC_NSEC) {
+            pcap->m_nsec = 1;
+            break;
+        }
+        CPE_ERROR(driver->m_em, "tun: %s: input magic 0x%x unknown (pcapng not support)", device->m_dev_name, head.m_magic);
+        return -1;
+    }
+
+    pcap->m_linktype = net_tun_device_pcap_u32(pcap, head.m_linktype);
+    switch(pcap->m_linktype) {
+    case NET_TUN_PCAP_LINKTYPE_NULL:
+    case NET_TUN_PCAP_LINKTYPE_ETHERNET:
+    case NET_TUN_PCAP_LINKTYPE_RAW:
+    case NET_TUN_PCAP_LINKTYPE_LINUX_SLL:
+    case NET_TUN_PCAP_LINKTYPE_IPV4:
+    case NET_TUN_PCAP_LINKTYPE_IPV6:
+        break;
+    default:
+        CPE_ERROR(driver->m_em, "tun: %s: input linktype %d not support", device->m_dev_name, pcap->m_linktype);
+        return -1;
+    }
+
+    pcap->m_buf_capacity = 0xFFFF + 64;
+    pcap->m_buf = mem_alloc(driver->m_alloc, pcap->m_buf_capacity);
+    if (pcap->m_buf == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: alloc record buf fail", device->m_dev_name);
+        return -1;
+    }
+
+    if (settings->m_init_data.m_pcap.m_output) {
+        pcap->m_output = fopen(settings->m_init_data.m_pcap.m_output, "wb");
+        if (pcap->m_output == NULL) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: open output %s fail, %d %s",
+                device->m_dev_name, settings->m_init_data.m_pcap.m_output, errno, strerror(errno));
+            return -1;
+        }
+
+        bzero(&head, sizeof(head));
+        head.m_magic = NET_TUN_PCAP_MAGIC_USEC;
+        head.m_version_major = 2;
+        head.m_version_minor = 4;
+        head.m_snaplen = 0xFFFF;
+        head.m_linktype = NET_TUN_PCAP_LINKTYPE_RAW;
+        if (fwrite(&head, sizeof(head), 1, pcap->m_output) != 1) {
+            CPE_ERROR(driver->m_em, "tun: %s: write output file head fail", device->m_dev_name);
+            return -1;
+        }
+    }
+
+    pcap->m_timer = net_timer_create(driver->m_inner_driver, net_tun_device_pcap_timer_cb, device);
+    if (pcap->m_timer == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: create timer fail", device->m_dev_name);
+        return -1;
+    }
+
+    device->m_mtu = settings->m_init_data.m_pcap.m_mtu > 0 ? settings->m_init_data.m_pcap.m_mtu : 1500;
+
+    /*captures may hold offloaded segments bigger than the mtu*/
+    device->m_frame_capacity = 0xFFFF;
+
+    pcap->m_start_us = net_tun_device_pcap_now_us();
+    pcap->m_start_cpu = clock();
+
+    /*first read goes through the driver read schedule once the device is up*/
+    net_timer_active(pcap->m_timer, 0);
+
+    CPE_INFO(
+        driver->m_em, "tun: %s: replay %s%s%s, linktype=%d%s",
+        device->m_dev_name, settings->m_init_data.m_pcap.m_input,
+        pcap->m_output ? " => " : "", pcap->m_output ? settings->m_init_data.m_pcap.m_output : "",
+        pcap->m_linktype, pcap->m_realtime ? ", realtime" : "");
+
+    return 0;
+}
+
+void net_tun_device_pcap_fini(net_tun_device_t device) {
+    net_tun_device_pcap_t pcap = device->m_pcap;
+    if (pcap == NULL) return;
+
+    if (pcap->m_timer) {
+        net_timer_free(pcap->m_timer);
+        pcap->m_timer = NULL;
+    }
+
+    if (pcap->m_input) {
+        fclose(pcap->m_input);
+        pcap->m_input = NULL;
+    }
+
+    if (pcap->m_output) {
+        fclose(pcap->m_output);
+        pcap->m_output = NULL;
+    }
+
+    if (pcap->m_buf) {
+        mem_free(device->m_driver->m_alloc, pcap->m_buf);
+        pcap->m_buf = NULL;
+    }
+
+    mem_free(device->m_driver->m_alloc, pcap);
+    device->m_pcap = NULL;
+}
+
+static void net_tun_device_pcap_timer_cb(net_timer_t timer, void * ctx) {
+    net_tun_device_t device = ctx;
+
+    if (!device->m_read_scheduled) {
+        net_tun_driver_read_schedule(device->m_driver, device);
+    }
+}
+
+/*0: record loaded, -1: end of input*/
+static int net_tun_device_pcap_load_record(net_tun_device_pcap_t pcap) {
+    net_tun_device_t device = pcap->m_device;
+    net_tun_driver_t driver = device->m_driver;
+    struct net_tun_pcap_record_head head;
+
+    if (fread(&head, sizeof(head), 1, pcap->m_input) != 1) return -1;
+
+    uint32_t caplen = net_tun_device_pcap_u32(pcap, head.m_caplen);
+    if (caplen > pcap->m_buf_capacity) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: record len %d overflow, stop replay",
+            device->m_dev_name, caplen);
+        return -1;
+    }
+
+    if (caplen > 0 && fread(pcap->m_buf, caplen, 1, pcap->m_input) != 1) {
+        CPE_ERROR(driver->m_em, "tun: %s: input record truncated", device->m_dev_name);
+        return -1;
+    }
+
+    uint32_t frac = net_tun_device_pcap_u32(pcap, head.m_ts_frac);
+    pcap->m_record_ts_us = (int64_t)net_tun_device_pcap_u32(pcap, head.m_ts_sec) * 1000000
+        + (pcap->m_nsec ? frac / 1000 : frac);
+    pcap->m_record_len = caplen;
+    pcap->m_has_record = 1;
+
+    return 0;
+}
+
+static void net_tun_device_pcap_input_record(net_tun_driver_t driver, net_tun_device_pcap_t pcap) {
+    net_tun_device_t device = pcap->m_device;
+    uint8_t const * data = pcap->m_buf;
+    uint32_t len = pcap->m_record_len;
+    uint16_t eth_type = 0;
+
+    switch(pcap->m_linktype) {
+    case NET_TUN_PCAP_LINKTYPE_NULL:
+        if (len < 4) return;
+        data += 4;
+        len -= 4;
+        break;
+    case NET_TUN_PCAP_LINKTYPE_ETHERNET:
+        if (len < NET_TUN_ETHERNET_HEADER_LENGTH) return;
+        eth_type = (uint16_t)((data[12] << 8) | data[13]);
+        data += NET_TUN_ETHERNET_HEADER_LENGTH;
+        len -= NET_TUN_ETHERNET_HEADER_LENGTH;
+        if (eth_type == 0x8100 && len >= 4) { /*802.1q*/
+            eth_type = (uint16_t)((data[2] << 8) | data[3]);
+            data += 4;
+            len -= 4;
+        }
+        if (eth_type != 0x0800 && eth_type != 0x86DD) return;
+        break;
+    case NET_TUN_PCAP_LINKTYPE_LINUX_SLL:
+        if (len < 16) return;
+        eth_type = (uint16_t)((data[14] << 8) | data[15]);
+        data += 16;
+        len -= 16;
+        if (eth_type != 0x0800 && eth_type != 0x86DD) return;
+        break;
+    default:
+        break;
+    }
+
+    if (len == 0 || len > 0xFFFF) return;
+
+    uint8_t version = data[0] >> 4;
+    if (version != 4 && version != 6) return;
+
+    pcap->m_input_packets++;
+    pcap->m_input_bytes += len;
+
+    net_tun_device_packet_input(driver, device, data, (uint16_t)len);
+}
+
+/*0: input finished or waiting for the next timestamp, 1: budget used up*/
+int net_tun_device_pcap_read(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget) {
+    net_tun_device_pcap_t pcap = device->m_pcap;
+
+    if (pcap->m_input_done) return 0;
+
+    do {
+        if (!pcap->m_has_record && net_tun_device_pcap_load_record(pcap) != 0) {
+            net_tun_device_pcap_input_done(pcap);
+            return 0;
+        }
+
+        if (pcap->m_realtime) {
+            int64_t now_us = net_tun_device_pcap_now_us();
+            if (!pcap->m_base_set) {
+                pcap->m_base_set = 1;
+                pcap->m_base_ts_us = pcap->m_record_ts_us;
+                pcap->m_base_now_us = now_us;
+            }
+
+            int64_t wait_us = (pcap->m_record_ts_us - pcap->m_base_ts_us) - (now_us - pcap->m_base_now_us);
+            if (wait_us > 0) {
+                net_timer_active(pcap->m_timer, (wait_us + 999) / 1000);
+                return 0;
+            }
+        }
+
+        pcap->m_has_record = 0;
+        net_tun_device_pcap_input_record(driver, pcap);
+    } while(net_tun_read_budget_consume(budget, pcap->m_record_len));
+
+    return 1;
+}
+
+static void net_tun_device_pcap_input_done(net_tun_device_pcap_t pcap) {
+    net_tun_device_t device = pcap->m_device;
+    net_tun_driver_t driver = device->m_driver;
+
+    pcap->m_input_done = 1;
+    pcap->m_done_us = net_tun_device_pcap_now_us();
+    pcap->m_done_cpu = clock();
+
+    if (pcap->m_output) fflush(pcap->m_output);
+
+    double elapsed_s = (double)(pcap->m_done_us - pcap->m_start_us) / 1000000.0;
+    double cpu_us = (double)(pcap->m_done_cpu - pcap->m_start_cpu) * 1000000.0 / CLOCKS_PER_SEC;
+
+    CPE_INFO(
+        driver->m_em, "tun: %s: replay done, " FMT_UINT64_T " packets / " FMT_UINT64_T " bytes in %.3fs"
+        ", %.0f pps, %.3f us cpu per packet, output " FMT_UINT64_T " packets",
+        device->m_dev_name, pcap->m_input_packets, pcap->m_input_bytes, elapsed_s,
+        elapsed_s > 0 ? (double)pcap->m_input_packets / elapsed_s : 0.0,
+        pcap->m_input_packets ? cpu_us / (double)pcap->m_input_packets : 0.0,
+        pcap->m_output_packets);
+}
+
+int net_tun_device_pcap_writev(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len) {
+    net_tun_device_pcap_t pcap = device->m_pcap;
+    struct net_tun_pcap_record_head head;
+    struct timespec ts;
+    int i;
+
+    pcap->m_output_packets++;
+    pcap->m_output_bytes += data_len;
+
+    if (pcap->m_output == NULL) return 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    head.m_ts_sec = (uint32_t)ts.tv_sec;
+    head.m_ts_frac = (uint32_t)(ts.tv_nsec / 1000);
+    head.m_caplen = data_len;
+    head.m_len = data_len;
+
+    if (fwrite(&head, sizeof(head), 1, pcap->m_output) != 1) goto WRITE_ERROR;
+    for(i = 0; i < iovcnt; ++i) {
+        if (iov[i].iov_len == 0) continue;
+        if (fwrite(iov[i].iov_base, iov[i].iov_len, 1, pcap->m_output) != 1) goto WRITE_ERROR;
+    }
+
+    return 0;
+
+WRITE_ERROR:
+    CPE_ERROR(
+        device->m_driver->m_em, "tun: %s: write output fail, %d %s, output stopped",
+        device->m_dev_name, errno, strerror(errno));
+    fclose(pcap->m_output);
+    pcap->m_output = NULL;
+    return 0;
+}
+
+int net_tun_device_pcap_stat(net_tun_device_t device, struct net_tun_device_pcap_stat * stat) {
+    net_tun_device_pcap_t pcap = device->m_pcap;
+    if (pcap == NULL) return -1;
+
+    int64_t now_us = pcap->m_input_done ? pcap->m_done_us : net_tun_device_pcap_now_us();
+    clock_t now_cpu = pcap->m_input_done ? pcap->m_done_cpu : clock();
+
+    stat->m_input_packets = pcap->m_input_packets;
+    stat->m_input_bytes = pcap->m_input_bytes;
+    stat->m_output_packets = pcap->m_output_packets;
+    stat->m_output_bytes = pcap->m_output_bytes;
+    stat->m_elapsed_us = (uint64_t)(now_us - pcap->m_start_us);
+    stat->m_cpu_us = (uint64_t)((double)(now_cpu - pcap->m_start_cpu) * 1000000.0 / CLOCKS_PER_SEC);
+    stat->m_input_done = pcap->m_input_done;
+
+    return 0;
+}
+
+#else
+
+int net_tun_device_pcap_stat(net_tun_device_t device, struct net_tun_device_pcap_stat * stat) {
+    return -1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#include <assert.h>
+#include <errno.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_unistd.h"
+#include "net_watcher.h"
+#include "net_tun_device_i.h"
+
+#if NET_TUN_DEVICE_WRITEV
+
+struct net_tun_device_pending_packet {
+    TAILQ_ENTRY(net_tun_device_pending_packet) m_next;
+    uint32_t m_len;
+};
+
+static void net_tun_device_pending_resume(net_tun_device_t device);
+
+void net_tun_device_pending_init(net_tun_device_t device) {
+    TAILQ_INIT(&device->m_pending);
+    device->m_pending_count = 0;
+    device->m_pending_blocked = 0;
+    device->m_pending_drop_count = 0;
+}
+
+void net_tun_device_pending_fini(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+
+    while(!TAILQ_EMPTY(&device->m_pending)) {
+        net_tun_device_pending_packet_t packet = TAILQ_FIRST(&device->m_pending);
+        TAILQ_REMOVE(&device->m_pending, packet, m_next);
+        mem_free(driver->m_alloc, packet);
+    }
+    device->m_pending_count = 0;
+    device->m_pending_blocked = 0;
+}
+
+uint8_t net_tun_device_pending_is_retry(int err) {
+    return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS;
+}
+
+static net_tun_device_pending_packet_t
+net_tun_device_pending_alloc(net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len) {
+    net_tun_driver_t driver = device->m_driver;
+    int i;
+
+    if (device->m_pending_count >= NET_TUN_DEVICE_PENDING_MAX) {
+        device->m_pending_drop_count++;
+        if (net_tun_driver_debug(driver)) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: >>> %.5d |      pending queue full, drop (total %d)",
+                device->m_dev_name, data_len, device->m_pending_drop_count);
+        }
+        return NULL;
+    }
+
+    net_tun_device_pending_packet_t packet =
+        mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_pending_packet) + data_len);
+    if (packet == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: >>> %.5d |      alloc pending fail", device->m_dev_name, data_len);
+        return NULL;
+    }
+
+    uint8_t * data = (uint8_t *)(packet + 1);
+    packet->m_len = 0;
+    for(i = 0; i < iovcnt; ++i) {
+        memcpy(data + packet->m_len, iov[i].iov_base, iov[i].iov_len);
+        packet->m_len += (uint32_t)iov[i].iov_len;
+    }
+    assert(packet->m_len == data_len);
+
+    return packet;
+}
+
+static void net_tun_device_pending_added(net_tun_device_t device) {
+    device->m_pending_count++;
+
+    /*lwip keeps further segments unsent until the queue drains*/
+    if (device->m_pending_count >= NET_TUN_DEVICE_PENDING_HIGH) {
+        device->m_pending_blocked = 1;
+    }
+
+    if (device->m_watcher && device->m_pending_count == 1) {
+        net_watcher_update_write(device->m_watcher, 1);
+    }
+}
+
+int net_tun_device_pending_append(
+    net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len)
+{
+    net_tun_device_pending_packet_t packet = net_tun_device_pending_alloc(device, iov, iovcnt, data_len);
+    if (packet == NULL) return -1;
+
+    TAILQ_INSERT_TAIL(&device->m_pending, packet, m_next);
+    net_tun_device_pending_added(device);
+    return 0;
+}
+
+/*a write the device refused after it left the queue, goes out again before everything queued behind it*/
+int net_tun_device_pending_retry(
+    net_tun_device_t device, struct iovec const * iov, int iovcnt, uint32_t data_len)
+{
+    net_tun_device_pending_packet_t packet = net_tun_device_pending_alloc(device, iov, iovcnt, data_len);
+    if (packet == NULL) return -1;
+
+    TAILQ_INSERT_HEAD(&device->m_pending, packet, m_next);
+    net_tun_device_pending_added(device);
+    return 0;
+}
+
+void net_tun_device_pending_drain(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+
+    net_tun_device_packet_write_begin(device);
+    while(!TAILQ_EMPTY(&device->m_pending)) {
+        net_tun_device_pending_packet_t packet = TAILQ_FIRST(&device->m_pending);
+        uint8_t * data = (uint8_t *)(packet + 1);
+
+#if NET_TUN_USE_IO_URING
+        if (device->m_uring) {
+            if (!net_tun_device_uring_write_ready(device)) break;
+            TAILQ_REMOVE(&device->m_pending, packet, m_next);
+            device->m_pending_count--;
+            net_tun_device_uring_write(device, data, (int)packet->m_len);
+            mem_free(driver->m_alloc, packet);
+            continue;
+        }
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+        if (device->m_af_packet) {
+            if (!net_tun_device_af_packet_write_ready(device)) break;
+            struct iovec iov = { data, packet->m_len };
+            TAILQ_REMOVE(&device->m_pending, packet, m_next);
+            device->m_pending_count--;
+            net_tun_device_af_packet_writev(device, &iov, 1, packet->m_len);
+            mem_free(driver->m_alloc, packet);
+            continue;
+        }
+#endif
+
+        int bytes = (int)write(device->m_dev_fd, data, packet->m_len);
+        if (bytes < 0) {
+            if (net_tun_device_pending_is_retry(errno)) break;
+
+            CPE_ERROR(
+                driver->m_em, "tun: %s: >>> %.5d |      errno=%d (%s)",
+                device->m_dev_name, packet->m_len, errno, strerror(errno));
+        }
+
+        TAILQ_REMOVE(&device->m_pending, packet, m_next);
+        device->m_pending_count--;
+        mem_free(driver->m_alloc, packet);
+    }
+    net_tun_device_packet_write_commit(device);
+
+    if (device->m_watcher && TAILQ_EMPTY(&device->m_pending)) {
+        net_watcher_update_write(device->m_watcher, 0);
+    }
+
+    if (device->m_pending_blocked && device->m_pending_count <= NET_TUN_DEVICE_PENDING_LOW) {
+        device->m_pending_blocked = 0;
+        net_tun_device_pending_resume(device);
+    }
+}
+
+static void net_tun_device_pending_resume(net_tun_device_t device) {
+    struct tcp_pcb * pcb;
+    struct tcp_pcb * next;
+    u8_t netif_idx = netif_get_index(&device->m_netif);
+
+    net_tun_driver_timer_wakeup(device->m_driver);
+
+    for(pcb = tcp_active_pcbs; pcb; pcb = next) {
+        next = pcb->next;
+        if (pcb->unsent == NULL && !(pcb->flags & TF_ACK_NOW)) continue;
+        if (pcb->netif_idx != NETIF_NO_INDEX && pcb->netif_idx != netif_idx) continue;
+
+        tcp_output(pcb);
+        if (device->m_pending_blocked) break;
+    }
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "net_tun_device_i.h"
+
+#if NET_TUN_USE_DEV_TUN
+
+struct net_tun_device_rx_pool {
+    mem_allocrator_t m_alloc;
+    net_tun_device_t m_device; /*NULL once the device is gone, buffers still held by lwip free themselves*/
+    uint32_t m_frame_capacity;
+    uint16_t m_data_pad;
+    uint16_t m_cache_max;
+    uint16_t m_cache_count;
+    uint32_t m_outstanding;
+    net_tun_device_rx_buf_t m_cache;
+};
+
+struct net_tun_device_rx_buf {
+    struct pbuf_custom m_pbuf;
+    net_tun_device_rx_pool_t m_pool;
+    net_tun_device_rx_buf_t m_next;
+};
+
+#define NET_TUN_DEVICE_RX_BUF_HEAD_SIZE ((sizeof(struct net_tun_device_rx_buf) + 15) & ~(size_t)15)
+
+static void net_tun_device_rx_buf_free_fun(struct pbuf * p);
+static void net_tun_device_rx_buf_recycle(net_tun_device_rx_buf_t buf);
+
+net_tun_device_rx_pool_t
+net_tun_device_rx_pool_create(net_tun_device_t device, uint8_t head_len, uint16_t cache_max) {
+    net_tun_driver_t driver = device->m_driver;
+
+    net_tun_device_rx_pool_t pool = mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_rx_pool));
+    if (pool == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: rx: alloc pool fail", device->m_dev_name);
+        return NULL;
+    }
+
+    pool->m_alloc = driver->m_alloc;
+    pool->m_device = device;
+    pool->m_frame_capacity = device->m_frame_capacity;
+    pool->m_data_pad = (uint16_t)((4 - head_len % 4) % 4); /*keep the ip header behind the link head aligned*/
+    pool->m_cache_max = cache_max;
+    pool->m_cache_count = 0;
+    pool->m_outstanding = 0;
+    pool->m_cache = NULL;
+
+    return pool;
+}
+
+void net_tun_device_rx_pool_free(net_tun_device_rx_pool_t pool) {
+    while(pool->m_cache) {
+        net_tun_device_rx_buf_t buf = pool->m_cache;
+        pool->m_cache = buf->m_next;
+        mem_free(pool->m_alloc, buf);
+    }
+    pool->m_cache_count = 0;
+    pool->m_device = NULL;
+
+    if (pool->m_outstanding == 0) {
+        mem_free(pool->m_alloc, pool);
+    }
+}
+
+net_tun_device_rx_buf_t net_tun_device_rx_buf_alloc(net_tun_device_rx_pool_t pool) {
+    net_tun_device_rx_buf_t buf = pool->m_cache;
+
+    if (buf) {
+        pool->m_cache = buf->m_next;
+        pool->m_cache_count--;
+    }
+    else {
+        buf = mem_alloc(pool->m_alloc, NET_TUN_DEVICE_RX_BUF_HEAD_SIZE + pool->m_data_pad + pool->m_frame_capacity);
+        if (buf == NULL) {
+            CPE_ERROR(
+                pool->m_device->m_driver->m_em, "tun: %s: rx: alloc buf fail, frame=%d",
+                pool->m_device->m_dev_name, pool->m_frame_capacity);
+            return NULL;
+        }
+        buf->m_pool = pool;
+    }
+
+    buf->m_next = NULL;
+    pool->m_outstanding++;
+    return buf;
+}
+
+void net_tun_device_rx_buf_release(net_tun_device_rx_buf_t buf) {
+    net_tun_device_rx_buf_recycle(buf);
+}
+
+uint8_t * net_tun_device_rx_buf_data(net_tun_device_rx_buf_t buf) {
+    return ((uint8_t *)buf) + NET_TUN_DEVICE_RX_BUF_HEAD_SIZE + buf->m_pool->m_data_pad;
+}
+
+uint32_t net_tun_device_rx_buf_capacity(net_tun_device_rx_buf_t buf) {
+    return buf->m_pool->m_frame_capacity;
+}
+
+struct pbuf * net_tun_device_rx_buf_pbuf(net_tun_device_rx_buf_t buf, uint32_t offset, uint16_t len) {
+    assert(offset + len <= buf->m_pool->m_frame_capacity);
+
+    buf->m_pbuf.custom_free_function = net_tun_device_rx_buf_free_fun;
+
+    /*PBUF_REF: the frame sits behind our own bookkeeping, lwip must never grow headers into it*/
+    struct pbuf * p = pbuf_alloced_custom(
+        PBUF_RAW, len, PBUF_REF, &buf->m_pbuf, net_tun_device_rx_buf_data(buf) + offset, len);
+    assert(p);
+    return p;
+}
+
+static void net_tun_device_rx_buf_free_fun(struct pbuf * p) {
+    net_tun_device_rx_buf_recycle((net_tun_device_rx_buf_t)p);
+}
+
+static void net_tun_device_rx_buf_recycle(net_tun_device_rx_buf_t buf) {
+    net_tun_device_rx_pool_t pool = buf->m_pool;
+
+    assert(pool->m_outstanding > 0);
+    pool->m_outstanding--;
+
+    if (pool->m_device && pool->m_cache_count < pool->m_cache_max) {
+        buf->m_next = pool->m_cache;
+        pool->m_cache = buf;
+        pool->m_cache_count++;
+        return;
+    }
+
+    mem_free(pool->m_alloc, buf);
+
+    if (pool->m_device == NULL && pool->m_outstanding == 0) {
+        mem_free(pool->m_alloc, pool);
+    }
+}
+
+#endif
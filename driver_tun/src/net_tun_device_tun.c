@@ -23,7 +23,7 @@
 static void net_tun_device_rw_cb(void * ctx, int fd, uint8_t do_read, uint8_t do_write);
 static int net_tun_device_read_config(net_tun_device_t device);
 static int net_tun_device_setup_fd(net_tun_device_t device);
-static int net_tun_device_start_rw(net_tun_device_t device);
+static int net_tun_device_start_rw(net_tun_device_t device, net_tun_device_io_type_t io_type);
 static int net_tun_device_init_dev_by_fd(
     net_tun_driver_t driver, net_tun_device_t device, net_tun_device_init_data_t settings);
 static int net_tun_device_init_dev_by_name(
@@ -36,24 +36,88 @@ int net_tun_device_init_dev(
 {
     assert(settings->m_dev_type == net_tun_device_tun || settings->m_dev_type == net_tun_device_tap);
 
+    device->m_watcher = NULL;
+    device->m_vnet_hdr_len = 0;
+    device->m_rx_pool = NULL;
+#if NET_TUN_DEVICE_WRITEV
+    net_tun_device_pending_init(device);
+#endif
+#if NET_TUN_USE_IO_URING
+    device->m_uring = NULL;
+#endif
+#if NET_TUN_USE_AF_PACKET
+    device->m_af_packet = NULL;
+#endif
+#if NET_TUN_DEVICE_PCAP
+    device->m_pcap = NULL;
+#endif
+    device->m_dev_input_packet = NULL;
+    uint8_t use_rx_pool = settings->m_zero_copy_input;
+
     switch(settings->m_init_type) {
     case net_tun_device_init_fd:
         if (net_tun_device_init_dev_by_fd(driver, device, settings) != 0) goto PROCESS_ERROR;
         break;
+#if NET_TUN_DEVICE_PCAP
+    case net_tun_device_init_pcap:
+        if (net_tun_device_pcap_init(driver, device, settings) != 0) goto PROCESS_ERROR;
+        use_rx_pool = 0;
+        break;
+#endif
     case net_tun_device_init_string:
         if (net_tun_device_init_dev_by_name(driver, device, settings) != 0) goto PROCESS_ERROR;
         break;
+#if CPE_OS_LINUX
+    case net_tun_device_init_packet:
+#if NET_TUN_USE_AF_PACKET
+        if (net_tun_device_af_packet_init(driver, device, settings) != 0) goto PROCESS_ERROR;
+        use_rx_pool = 0; /*frames are read in place from the ring*/
+        break;
+#else
+        CPE_ERROR(driver->m_em, "tun: packet: AF_PACKET ring not support");
+        goto PROCESS_ERROR;
+#endif
+#endif
+    }
+
+    if (settings->m_offload) {
+        if (settings->m_dev_type != net_tun_device_tun || settings->m_init_type != net_tun_device_init_string) {
+            CPE_ERROR(driver->m_em, "tun: %s: offload only support tun device", device->m_dev_name);
+            goto PROCESS_ERROR;
+        }
+        if (net_tun_device_vnet_setup(device) != 0) goto PROCESS_ERROR;
+    }
+
+    /*read buffers below are sized by the frame*/
+    if (device->m_frame_capacity == 0) device->m_frame_capacity = device->m_mtu;
+
+    if (use_rx_pool) {
+        device->m_rx_pool = net_tun_device_rx_pool_create(device, device->m_vnet_hdr_len, NET_TUN_DEVICE_RX_CACHE_COUNT);
+        if (device->m_rx_pool == NULL) goto PROCESS_ERROR;
     }
 
+#if NET_TUN_DEVICE_PCAP
+    /*no fd to watch, the replay drives itself from its timer*/
+    if (device->m_pcap) return 0;
+#endif
+
     if (net_tun_device_setup_fd(device) != 0) goto PROCESS_ERROR;
 
-    device->m_dev_input_packet = NULL;
-    
-    if (net_tun_device_start_rw(device) != 0) goto PROCESS_ERROR;
+    if (net_tun_device_start_rw(device, settings->m_io_type) != 0) goto PROCESS_ERROR;
 
     return 0;
 
 PROCESS_ERROR:
+#if NET_TUN_USE_IO_URING
+    net_tun_device_uring_fini(device);
+#endif
+#if NET_TUN_USE_AF_PACKET
+    net_tun_device_af_packet_fini(device);
+#endif
+#if NET_TUN_DEVICE_PCAP
+    net_tun_device_pcap_fini(device);
+#endif
+
     if (device->m_dev_fd != -1) {
         if (device->m_dev_fd_close) {
             close(device->m_dev_fd);
@@ -67,6 +131,15 @@ PROCESS_ERROR:
         device->m_watcher = NULL;
     }
 
+    if (device->m_rx_pool) {
+        net_tun_device_rx_pool_free(device->m_rx_pool);
+        device->m_rx_pool = NULL;
+    }
+
+#if NET_TUN_DEVICE_WRITEV
+    net_tun_device_pending_fini(device);
+#endif
+
     assert(device->m_dev_input_packet == NULL);
     
     return -1; 
@@ -96,7 +169,7 @@ int net_tun_device_init_dev_by_name(net_tun_driver_t driver, net_tun_device_t de
     if ((device->m_dev_fd = open("/dev/net/tun", O_RDWR)) < 0) {
         CPE_ERROR(
             driver->m_em, "tun: %s: open fail, %d %s",
-            settings->m_init_data.m_dev_name, errno, strerror(errno));
+            settings->m_init_data.m_string, errno, strerror(errno));
         return -1;
     }
     device->m_dev_fd_close = 1;
@@ -105,17 +178,34 @@ int net_tun_device_init_dev_by_name(net_tun_driver_t driver, net_tun_device_t de
     struct ifreq ifr;
     memset(&ifr, 0, sizeof(ifr));
     ifr.ifr_flags |= IFF_NO_PI;
-    if (init_data.dev_type == net_tun_device_tun) {
+    if (settings->m_dev_type == net_tun_device_tun) {
         ifr.ifr_flags |= IFF_TUN;
     } else {
         ifr.ifr_flags |= IFF_TAP;
     }
-    if (init_data.init.string) {
-        snprintf(ifr.ifr_name, IFNAMSIZ, "%s", init_data.init.string);
+#if CPE_OS_LINUX
+    if (settings->m_offload) {
+        ifr.ifr_flags |= IFF_VNET_HDR;
+    }
+#endif
+    if (settings->m_multi_queue) {
+#ifdef IFF_MULTI_QUEUE
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#else
+        CPE_ERROR(
+            driver->m_em, "tun: %s: multi queue not support",
+            settings->m_init_data.m_string);
+        return -1;
+#endif
+    }
+    if (settings->m_init_data.m_string) {
+        snprintf(ifr.ifr_name, IFNAMSIZ, "%s", settings->m_init_data.m_string);
     }
 
     if (ioctl(device->m_dev_fd, TUNSETIFF, (void *) &ifr) < 0) {
-        CPE_ERROR(driver->m_em, "tun: %s: ioctl fail, %d %s", name, errno, strerror(errno));
+        CPE_ERROR(
+            driver->m_em, "tun: %s: ioctl fail, %d %s",
+            settings->m_init_data.m_string, errno, strerror(errno));
         return -1;
     }
     cpe_str_dup(device->m_dev_name, sizeof(device->m_dev_name), ifr.ifr_name);
@@ -124,11 +214,10 @@ int net_tun_device_init_dev_by_name(net_tun_driver_t driver, net_tun_device_t de
     if (sock < 0) {
         CPE_ERROR(
             driver->m_em, "tun: %s: socket fail, %d %s",
-            settings->m_init_data.m_dev_name, errno, strerror(errno));
+            device->m_dev_name, errno, strerror(errno));
         return -1;
     }
 
-    struct ifreq ifr;
     bzero(&ifr, sizeof(ifr));
     cpe_str_dup(ifr.ifr_name, sizeof(ifr.ifr_name), device->m_dev_name);
 
@@ -136,7 +225,7 @@ int net_tun_device_init_dev_by_name(net_tun_driver_t driver, net_tun_device_t de
     if (ioctl(sock, SIOCGIFMTU, (void *)&ifr) < 0) {
         CPE_ERROR(
             driver->m_em, "tun: %s: get mtu fail, %d %s",
-            settings->m_init_data.m_dev_name, errno, strerror(errno));
+            device->m_dev_name, errno, strerror(errno));
         close(sock);
         return -1;
     }
@@ -183,6 +272,16 @@ int net_tun_device_init_dev_by_name(
 #endif
 
 void net_tun_device_fini_dev(net_tun_driver_t driver, net_tun_device_t device) {
+#if NET_TUN_USE_IO_URING
+    net_tun_device_uring_fini(device);
+#endif
+#if NET_TUN_USE_AF_PACKET
+    net_tun_device_af_packet_fini(device);
+#endif
+#if NET_TUN_DEVICE_PCAP
+    net_tun_device_pcap_fini(device);
+#endif
+
     if (device->m_watcher) {
         net_watcher_free(device->m_watcher);
         device->m_watcher = NULL;
@@ -196,6 +295,15 @@ void net_tun_device_fini_dev(net_tun_driver_t driver, net_tun_device_t device) {
     }
     device->m_dev_fd_close = 0;
 
+#if NET_TUN_DEVICE_WRITEV
+    net_tun_device_pending_fini(device);
+#endif
+
+    if (device->m_rx_pool) {
+        net_tun_device_rx_pool_free(device->m_rx_pool);
+        device->m_rx_pool = NULL;
+    }
+
     if (device->m_dev_input_packet) {
         mem_free(driver->m_alloc, device->m_dev_input_packet);
         device->m_dev_input_packet = NULL;
@@ -206,10 +314,47 @@ int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data
     net_tun_driver_t driver = device->m_driver;
 
     assert(data_len >= 0);
-    assert(data_len <= device->m_mtu);
+    assert(data_len <= device->m_frame_capacity);
+
+#if NET_TUN_DEVICE_WRITEV
+    /*keep order behind packets the device refused*/
+    if (!TAILQ_EMPTY(&device->m_pending)) {
+        struct iovec iov = { data, (size_t)data_len };
+        net_tun_device_pending_append(device, &iov, 1, (uint32_t)data_len);
+        return 0;
+    }
+#endif
+
+#if NET_TUN_USE_IO_URING
+    if (device->m_uring) {
+        return net_tun_device_uring_write(device, data, data_len);
+    }
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+    if (device->m_af_packet) {
+        struct iovec iov = { data, (size_t)data_len };
+        return net_tun_device_af_packet_writev(device, &iov, 1, (uint32_t)data_len);
+    }
+#endif
+
+#if NET_TUN_DEVICE_PCAP
+    if (device->m_pcap) {
+        struct iovec iov = { data, (size_t)data_len };
+        return net_tun_device_pcap_writev(device, &iov, 1, (uint32_t)data_len);
+    }
+#endif
 
     int bytes = (int)write(device->m_dev_fd, data, data_len);
     if (bytes < 0) {
+#if NET_TUN_DEVICE_WRITEV
+        if (net_tun_device_pending_is_retry(errno)) {
+            struct iovec iov = { data, (size_t)data_len };
+            net_tun_device_pending_append(device, &iov, 1, (uint32_t)data_len);
+            return 0;
+        }
+#endif
+
         // malformed packets will cause errors, ignore them and act like
         // the packet was accepeted
         CPE_ERROR(
@@ -237,38 +382,287 @@ int net_tun_device_packet_write(net_tun_device_t device, uint8_t *data, int data
     return 0;
 }
 
+#if NET_TUN_DEVICE_WRITEV
+int net_tun_device_packet_writev(net_tun_device_t device, uint8_t const * head, uint8_t head_len, struct pbuf * p) {
+    net_tun_driver_t driver = device->m_driver;
+    struct iovec iov[NET_TUN_DEVICE_WRITEV_MAX];
+    int iovcnt = 0;
+    uint32_t data_len = head_len;
+    struct pbuf * q;
+
+    if (head_len) {
+        iov[iovcnt].iov_base = (void *)head;
+        iov[iovcnt].iov_len = head_len;
+        iovcnt++;
+    }
+
+    for(q = p; q; q = q->next) {
+        if (q->len == 0) continue;
+        if (iovcnt >= NET_TUN_DEVICE_WRITEV_MAX) return -1;
+
+        iov[iovcnt].iov_base = q->payload;
+        iov[iovcnt].iov_len = q->len;
+        iovcnt++;
+        data_len += q->len;
+    }
+
+    if (data_len > device->m_frame_capacity) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
+            device->m_dev_name, data_len, device->m_mtu);
+        return 0;
+    }
+
+    if (!TAILQ_EMPTY(&device->m_pending)) {
+        net_tun_device_pending_append(device, iov, iovcnt, data_len);
+        return 0;
+    }
+
+#if NET_TUN_USE_IO_URING
+    if (device->m_uring) {
+        return net_tun_device_uring_writev(device, iov, iovcnt, head_len, p, data_len);
+    }
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+    if (device->m_af_packet) {
+        return net_tun_device_af_packet_writev(device, iov, iovcnt, data_len);
+    }
+#endif
+
+    if (device->m_pcap) {
+        return net_tun_device_pcap_writev(device, iov, iovcnt, data_len);
+    }
+
+    int bytes = (int)writev(device->m_dev_fd, iov, iovcnt);
+    if (bytes < 0 && net_tun_device_pending_is_retry(errno)) {
+        net_tun_device_pending_append(device, iov, iovcnt, data_len);
+    }
+    else if (bytes < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: >>> %.5d |      errno=%d (%s)",
+            device->m_dev_name, data_len, errno, strerror(errno));
+    }
+    else if (bytes != data_len) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: >>> %.5d |      part, %d/%d",
+            device->m_dev_name, bytes, bytes, data_len);
+    }
+    else if (net_tun_driver_debug(driver) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: >>> %.5d |      %s",
+            device->m_dev_name, data_len,
+            net_tun_dump_raw_data(
+                net_tun_driver_tmp_buffer(driver), p->payload, p->len,
+                net_tun_driver_debug(driver) >= 3));
+    }
+
+    return 0;
+}
+#endif
+
+void net_tun_device_packet_write_begin(net_tun_device_t device) {
+#if NET_TUN_USE_IO_URING
+    if (device->m_uring) {
+        net_tun_device_uring_write_begin(device);
+    }
+#endif
+#if NET_TUN_USE_AF_PACKET
+    if (device->m_af_packet) {
+        net_tun_device_af_packet_write_begin(device);
+    }
+#endif
+}
+
+void net_tun_device_packet_write_commit(net_tun_device_t device) {
+#if NET_TUN_USE_IO_URING
+    if (device->m_uring) {
+        net_tun_device_uring_write_commit(device);
+    }
+#endif
+#if NET_TUN_USE_AF_PACKET
+    if (device->m_af_packet) {
+        net_tun_device_af_packet_write_commit(device);
+    }
+#endif
+}
+
+int net_tun_device_frame_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * data, uint32_t bytes) {
+    if (device->m_vnet_hdr_len) {
+        return net_tun_device_vnet_input(driver, device, data, bytes);
+    }
+    else {
+        return net_tun_device_packet_input(driver, device, data, (uint16_t)bytes);
+    }
+}
+
+int net_tun_device_frame_input_rx(net_tun_driver_t driver, net_tun_device_t device, net_tun_device_rx_buf_t buf, uint32_t bytes) {
+    uint8_t const * frame = net_tun_device_rx_buf_data(buf);
+    uint8_t csum_valid = 0;
+    uint32_t offset = 0;
+
+    if (device->m_vnet_hdr_len) {
+        if (net_tun_device_vnet_input_hdr(driver, device, frame, bytes, &csum_valid) != 0) {
+            net_tun_device_rx_buf_release(buf);
+            return -1;
+        }
+        offset = device->m_vnet_hdr_len;
+    }
+    else if (bytes > device->m_mtu) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: input packet length %d overflow, mtu=%d",
+            device->m_dev_name, bytes, device->m_mtu);
+        net_tun_device_rx_buf_release(buf);
+        return -1;
+    }
+
+    struct pbuf * p;
+    uint32_t len = bytes - offset;
+    if (len * NET_TUN_DEVICE_RX_COPY_RATIO < net_tun_device_rx_buf_capacity(buf)) {
+        /*small against the buffer, a right sized copy and the buffer goes back to the pool now*/
+        p = net_tun_device_packet_alloc(driver, device, frame + offset, (uint16_t)len);
+        net_tun_device_rx_buf_release(buf);
+        if (p == NULL) return -1;
+    }
+    else {
+        /*the pbuf owns the buffer from here, lwip frees it back to the pool*/
+        p = net_tun_device_rx_buf_pbuf(buf, offset, (uint16_t)len);
+    }
+
+    if (device->m_vnet_hdr_len) {
+        return net_tun_device_vnet_pbuf_input(driver, device, p, csum_valid);
+    }
+    else {
+        return net_tun_device_pbuf_input(driver, device, p);
+    }
+}
+
+/*0: drained, 1: budget used up, -1: out of frame buffers*/
+static int net_tun_device_read_rx(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget) {
+    do {
+        net_tun_device_rx_buf_t buf = net_tun_device_rx_buf_alloc(device->m_rx_pool);
+        if (buf == NULL) return -1;
+
+        int bytes = (int)read(device->m_dev_fd, net_tun_device_rx_buf_data(buf), device->m_frame_capacity);
+        if (bytes <= 0) {
+            net_tun_device_rx_buf_release(buf);
+            if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                CPE_ERROR(
+                    driver->m_em, "tun: %s: rw: read data error, errno=%d %s",
+                    device->m_dev_name, errno, strerror(errno));
+            }
+            return 0;
+        }
+
+        assert(bytes <= device->m_frame_capacity);
+
+        net_tun_device_frame_input_rx(driver, device, buf, (uint32_t)bytes);
+
+        if (!net_tun_read_budget_consume(budget, (uint32_t)bytes)) return 1;
+    } while(1);
+}
+
+/*0: drained, 1: budget used up*/
+static int net_tun_device_read_copy(net_tun_driver_t driver, net_tun_device_t device, net_tun_read_budget_t budget) {
+    mem_buffer_clear_data(&driver->m_data_buffer);
+    void * data = mem_buffer_alloc(&driver->m_data_buffer, device->m_frame_capacity);
+    if (data == NULL) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: rw: alloc data, size=%d fail",
+            device->m_dev_name, device->m_frame_capacity);
+        return 0;
+    }
+
+    do {
+        int bytes = (int)read(device->m_dev_fd, data, device->m_frame_capacity);
+        if (bytes <= 0) {
+            if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                CPE_ERROR(
+                    driver->m_em, "tun: %s: rw: read data error, errno=%d %s",
+                    device->m_dev_name, errno, strerror(errno));
+            }
+            return 0;
+        }
+
+        assert(bytes <= device->m_frame_capacity);
+
+        net_tun_device_frame_input(driver, device, data, (uint32_t)bytes);
+
+        if (!net_tun_read_budget_consume(budget, (uint32_t)bytes)) return 1;
+    } while(1);
+}
+
+/*returns 1 when the budget ran out before the device drained*/
+static uint8_t net_tun_device_read_pump(net_tun_driver_t driver, net_tun_device_t device) {
+    struct net_tun_read_budget budget;
+    int rv = -1;
+
+    net_tun_driver_read_budget_init(driver, &budget);
+
+    /*one ack per connection and segments merged for the burst, all out before the output flush*/
+    net_tun_device_input_begin(device);
+
+#if NET_TUN_DEVICE_PCAP
+    if (device->m_pcap) {
+        rv = net_tun_device_pcap_read(driver, device, &budget);
+        goto PUMP_COMPLETE;
+    }
+#endif
+
+#if NET_TUN_USE_AF_PACKET
+    if (device->m_af_packet) {
+        rv = net_tun_device_af_packet_read(driver, device, &budget);
+        goto PUMP_COMPLETE;
+    }
+#endif
+
+    if (device->m_rx_pool) {
+        rv = net_tun_device_read_rx(driver, device, &budget);
+    }
+
+    /*zero copy read stops when out of frame buffers, the rest goes through the copy buffer*/
+    if (rv < 0) {
+        rv = net_tun_device_read_copy(driver, device, &budget);
+    }
+
+#if NET_TUN_DEVICE_PCAP || NET_TUN_USE_AF_PACKET
+PUMP_COMPLETE:
+#endif
+    net_tun_device_input_end(device);
+    net_tun_device_output_flush(device);
+
+    return rv > 0 ? 1 : 0;
+}
+
+uint8_t net_tun_device_read_resume(net_tun_device_t device) {
+#if NET_TUN_USE_IO_URING
+    if (device->m_uring) {
+        return net_tun_device_uring_read_resume(device);
+    }
+#endif
+
+    if (net_tun_device_read_pump(device->m_driver, device)) return 1;
+
+    if (device->m_watcher) net_watcher_update_read(device->m_watcher, 1);
+    return 0;
+}
+
 static void net_tun_device_rw_cb(void * ctx, int fd, uint8_t do_read, uint8_t do_write) {
     net_tun_device_t device = ctx;
     net_tun_driver_t driver = device->m_driver;
+
+#if NET_TUN_DEVICE_WRITEV
+    if (do_write) {
+        net_tun_device_pending_drain(device);
+    }
+#endif
     
     if (do_read) {
-        mem_buffer_clear_data(&driver->m_data_buffer);
-        void * data = mem_buffer_alloc(&driver->m_data_buffer, device->m_mtu);
-        if (data == NULL) {
-            CPE_ERROR(
-                driver->m_em, "tun: %s: rw: alloc data, size=%d fail",
-                device->m_dev_name, device->m_mtu);
-            return;
+        /*more to read, stop watching and wait for the round-robin turn*/
+        if (net_tun_device_read_pump(driver, device)) {
+            net_watcher_update_read(device->m_watcher, 0);
+            net_tun_driver_read_schedule(driver, device);
         }
-        
-        do {
-            int bytes = (int)read(device->m_dev_fd, data, device->m_mtu);
-            if (bytes <= 0) {
-                if (bytes == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
-                    break;
-                }
-                else {
-                    CPE_ERROR(
-                        driver->m_em, "tun: %s: rw: read data error, errno=%d %s",
-                        device->m_dev_name, errno, strerror(errno));
-                    break;
-                }
-            }
-    
-            assert(bytes <= device->m_mtu);
-
-            net_tun_device_packet_input(driver, device, data, (uint16_t)bytes);
-        } while(1);
     }
 }
 
@@ -303,9 +697,33 @@ static int net_tun_device_setup_fd(net_tun_device_t device) {
     return 0;
 }
 
-static int net_tun_device_start_rw(net_tun_device_t device) {
+static int net_tun_device_start_rw(net_tun_device_t device, net_tun_device_io_type_t io_type) {
     net_tun_driver_t driver = device->m_driver;
-    
+
+#if NET_TUN_USE_AF_PACKET
+    /*the rings are served from the watcher*/
+    if (device->m_af_packet && io_type != net_tun_device_io_watcher) {
+        CPE_INFO(driver->m_em, "tun: %s: packet ring use watcher io", device->m_dev_name);
+        io_type = net_tun_device_io_watcher;
+    }
+#endif
+
+    switch(io_type) {
+    case net_tun_device_io_watcher:
+        break;
+    case net_tun_device_io_uring:
+#if NET_TUN_USE_IO_URING
+        if (net_tun_device_uring_init(device) == 0) return 0;
+
+        /*uring init may already switch the fd to blocking mode*/
+        CPE_ERROR(driver->m_em, "tun: %s: uring start fail, fallback to watcher", device->m_dev_name);
+        if (net_tun_device_setup_fd(device) != 0) return -1;
+#else
+        CPE_ERROR(driver->m_em, "tun: %s: uring not support, fallback to watcher", device->m_dev_name);
+#endif
+        break;
+    }
+
     device->m_watcher = net_watcher_create(
         device->m_driver->m_inner_driver, device->m_dev_fd, device, net_tun_device_rw_cb);
     if (device->m_watcher == NULL) {
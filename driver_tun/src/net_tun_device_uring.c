@@ -0,0 +1,777 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "cpe/pal/pal_unistd.h"
+#include "net_watcher.h"
+#include "net_tun_device_i.h"
+#include "net_tun_utils.h"
+
+#if NET_TUN_USE_DEV_TUN && NET_TUN_USE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#define NET_TUN_DEVICE_URING_OP_READ ((uint64_t)1)
+#define NET_TUN_DEVICE_URING_OP_WRITE ((uint64_t)2)
+#define NET_TUN_DEVICE_URING_OP_CANCEL ((uint64_t)3)
+#define NET_TUN_DEVICE_URING_USER_DATA(__op, __slot) (((__op) << 32) | (uint64_t)(__slot))
+
+struct net_tun_device_uring {
+    net_tun_device_t m_device;
+    int m_ring_fd;
+    int m_event_fd;
+    net_watcher_t m_event_watcher;
+    uint8_t m_processing;
+    uint8_t m_closing;
+    uint8_t m_read_stopped;
+    uint32_t m_inflight;
+
+    /*submission queue*/
+    void * m_sq_map;
+    size_t m_sq_map_size;
+    uint32_t * m_sq_head;
+    uint32_t * m_sq_tail;
+    uint32_t * m_sq_array;
+    uint32_t m_sq_mask;
+    uint32_t m_sq_entries;
+    uint32_t m_sq_local_tail;
+    uint32_t m_sq_to_submit;
+    struct io_uring_sqe * m_sqes;
+    size_t m_sqes_size;
+
+    /*completion queue*/
+    void * m_cq_map;
+    size_t m_cq_map_size;
+    uint32_t * m_cq_head;
+    uint32_t * m_cq_tail;
+    uint32_t m_cq_mask;
+    struct io_uring_cqe * m_cqes;
+
+    /*packet buffers*/
+    uint32_t m_buf_size;
+    uint8_t * m_read_bufs;
+    net_tun_device_rx_buf_t m_read_rx[NET_TUN_DEVICE_URING_READ_COUNT]; /*zero copy input, frame buffer per read slot*/
+    uint8_t * m_write_bufs;
+    uint32_t m_write_lens[NET_TUN_DEVICE_URING_WRITE_COUNT];
+    struct pbuf * m_write_pbufs[NET_TUN_DEVICE_URING_WRITE_COUNT]; /*vectored writes keep the chain until completion*/
+    struct iovec m_write_iovs[NET_TUN_DEVICE_URING_WRITE_COUNT][NET_TUN_DEVICE_WRITEV_MAX];
+    uint8_t m_write_iovcnts[NET_TUN_DEVICE_URING_WRITE_COUNT];
+    uint16_t m_write_free[NET_TUN_DEVICE_URING_WRITE_COUNT];
+    uint16_t m_write_free_count;
+};
+
+static void net_tun_device_uring_event_cb(void * ctx, int fd, uint8_t do_read, uint8_t do_write);
+static int net_tun_device_uring_setup_ring(net_tun_device_uring_t uring, uint32_t entries);
+static int net_tun_device_uring_probe(net_tun_device_uring_t uring);
+static void net_tun_device_uring_close_ring(net_tun_device_uring_t uring);
+static int net_tun_device_uring_post_read(net_tun_device_uring_t uring, uint16_t slot);
+static int net_tun_device_uring_submit(net_tun_device_uring_t uring);
+static uint8_t net_tun_device_uring_reap(net_tun_device_uring_t uring, net_tun_read_budget_t budget);
+static uint8_t net_tun_device_uring_process(net_tun_device_uring_t uring);
+
+static int net_tun_uring_sys_setup(uint32_t entries, struct io_uring_params * p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int net_tun_uring_sys_enter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int net_tun_uring_sys_register(int ring_fd, uint32_t opcode, void * arg, uint32_t nr_args) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+int net_tun_device_uring_init(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+    uint16_t i;
+
+    assert(device->m_uring == NULL);
+
+    net_tun_device_uring_t uring = mem_alloc(driver->m_alloc, sizeof(struct net_tun_device_uring));
+    if (uring == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: uring: alloc fail", device->m_dev_name);
+        return -1;
+    }
+
+    bzero(uring, sizeof(*uring));
+    uring->m_device = device;
+    uring->m_ring_fd = -1;
+    uring->m_event_fd = -1;
+    uring->m_buf_size = device->m_frame_capacity;
+
+    if (device->m_rx_pool) {
+        for(i = 0; i < NET_TUN_DEVICE_URING_READ_COUNT; ++i) {
+            uring->m_read_rx[i] = net_tun_device_rx_buf_alloc(device->m_rx_pool);
+            if (uring->m_read_rx[i] == NULL) goto INIT_ERROR;
+        }
+    }
+    else {
+        uring->m_read_bufs = mem_alloc(driver->m_alloc, (size_t)uring->m_buf_size * NET_TUN_DEVICE_URING_READ_COUNT);
+        if (uring->m_read_bufs == NULL) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: uring: alloc read buffers fail, frame=%d",
+                device->m_dev_name, uring->m_buf_size);
+            goto INIT_ERROR;
+        }
+    }
+
+    uring->m_write_bufs = mem_alloc(driver->m_alloc, (size_t)uring->m_buf_size * NET_TUN_DEVICE_URING_WRITE_COUNT);
+    if (uring->m_write_bufs == NULL) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: alloc write buffers fail, frame=%d",
+            device->m_dev_name, uring->m_buf_size);
+        goto INIT_ERROR;
+    }
+
+    for(i = 0; i < NET_TUN_DEVICE_URING_WRITE_COUNT; ++i) {
+        uring->m_write_free[i] = NET_TUN_DEVICE_URING_WRITE_COUNT - 1 - i;
+    }
+    uring->m_write_free_count = NET_TUN_DEVICE_URING_WRITE_COUNT;
+
+    if (net_tun_device_uring_setup_ring(uring, NET_TUN_DEVICE_URING_READ_COUNT + NET_TUN_DEVICE_URING_WRITE_COUNT) != 0) {
+        goto INIT_ERROR;
+    }
+
+    if (net_tun_device_uring_probe(uring) != 0) goto INIT_ERROR;
+
+    uring->m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (uring->m_event_fd < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: create eventfd fail, errno=%d (%s)",
+            device->m_dev_name, errno, strerror(errno));
+        goto INIT_ERROR;
+    }
+
+    if (net_tun_uring_sys_register(uring->m_ring_fd, IORING_REGISTER_EVENTFD, &uring->m_event_fd, 1) != 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: register eventfd fail, errno=%d (%s)",
+            device->m_dev_name, errno, strerror(errno));
+        goto INIT_ERROR;
+    }
+
+    uring->m_event_watcher = net_watcher_create(
+        driver->m_inner_driver, uring->m_event_fd, uring, net_tun_device_uring_event_cb);
+    if (uring->m_event_watcher == NULL) {
+        CPE_ERROR(driver->m_em, "tun: %s: uring: create event watcher fail", device->m_dev_name);
+        goto INIT_ERROR;
+    }
+    net_watcher_update_read(uring->m_event_watcher, 1);
+
+    /*reads are armed inside the ring, the fd must block or every read completes with EAGAIN*/
+    int s = fcntl(device->m_dev_fd, F_GETFL);
+    if (s < 0 || fcntl(device->m_dev_fd, F_SETFL, s & ~O_NONBLOCK) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: clear nonblock fail, errno=%d (%s)",
+            device->m_dev_name, errno, strerror(errno));
+        goto INIT_ERROR;
+    }
+
+    for(i = 0; i < NET_TUN_DEVICE_URING_READ_COUNT; ++i) {
+        if (net_tun_device_uring_post_read(uring, i) != 0) goto INIT_ERROR;
+    }
+
+    if (net_tun_device_uring_submit(uring) != 0) goto INIT_ERROR;
+
+    device->m_uring = uring;
+
+    if (net_tun_driver_debug(driver)) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: uring: started, entries=%d, read-slots=%d, write-slots=%d",
+            device->m_dev_name, uring->m_sq_entries,
+            NET_TUN_DEVICE_URING_READ_COUNT, NET_TUN_DEVICE_URING_WRITE_COUNT);
+    }
+
+    return 0;
+
+INIT_ERROR:
+    device->m_uring = uring;
+    net_tun_device_uring_fini(device);
+    return -1;
+}
+
+void net_tun_device_uring_fini(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+    net_tun_device_uring_t uring = device->m_uring;
+    uint16_t i;
+
+    if (uring == NULL) return;
+
+    if (uring->m_ring_fd != -1) {
+        net_tun_device_uring_close_ring(uring);
+    }
+
+    if (uring->m_event_watcher) {
+        net_watcher_free(uring->m_event_watcher);
+        uring->m_event_watcher = NULL;
+    }
+
+    if (uring->m_event_fd != -1) {
+        close(uring->m_event_fd);
+        uring->m_event_fd = -1;
+    }
+
+    if (uring->m_read_bufs) {
+        mem_free(driver->m_alloc, uring->m_read_bufs);
+        uring->m_read_bufs = NULL;
+    }
+
+    for(i = 0; i < NET_TUN_DEVICE_URING_READ_COUNT; ++i) {
+        if (uring->m_read_rx[i]) {
+            net_tun_device_rx_buf_release(uring->m_read_rx[i]);
+            uring->m_read_rx[i] = NULL;
+        }
+    }
+
+    if (uring->m_write_bufs) {
+        mem_free(driver->m_alloc, uring->m_write_bufs);
+        uring->m_write_bufs = NULL;
+    }
+
+    for(i = 0; i < NET_TUN_DEVICE_URING_WRITE_COUNT; ++i) {
+        if (uring->m_write_pbufs[i]) {
+            pbuf_free(uring->m_write_pbufs[i]);
+            uring->m_write_pbufs[i] = NULL;
+        }
+    }
+
+    mem_free(driver->m_alloc, uring);
+    device->m_uring = NULL;
+}
+
+int net_tun_device_uring_write(net_tun_device_t device, uint8_t const * data, int data_len) {
+    net_tun_driver_t driver = device->m_driver;
+    net_tun_device_uring_t uring = device->m_uring;
+
+    assert(uring);
+    assert(data_len >= 0);
+    assert(data_len <= uring->m_buf_size);
+
+    if (uring->m_write_free_count == 0) {
+        /*all write slots in flight, wait for a completion*/
+        struct iovec iov = { (void *)data, (size_t)data_len };
+        net_tun_device_pending_append(device, &iov, 1, (uint32_t)data_len);
+        return 0;
+    }
+
+    uint16_t slot = uring->m_write_free[--uring->m_write_free_count];
+    uint8_t * buf = uring->m_write_bufs + (size_t)slot * uring->m_buf_size;
+    memcpy(buf, data, data_len);
+    uring->m_write_lens[slot] = (uint32_t)data_len;
+    uring->m_write_iovcnts[slot] = 0;
+
+    uint32_t head = __atomic_load_n(uring->m_sq_head, __ATOMIC_ACQUIRE);
+    assert(uring->m_sq_local_tail - head < uring->m_sq_entries);
+    uint32_t idx = uring->m_sq_local_tail & uring->m_sq_mask;
+    struct io_uring_sqe * sqe = &uring->m_sqes[idx];
+    bzero(sqe, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = device->m_dev_fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = (uint32_t)data_len;
+    sqe->user_data = NET_TUN_DEVICE_URING_USER_DATA(NET_TUN_DEVICE_URING_OP_WRITE, slot);
+    uring->m_sq_array[idx] = idx;
+    uring->m_sq_local_tail++;
+    uring->m_sq_to_submit++;
+    uring->m_inflight++;
+
+    if (net_tun_driver_debug(driver) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: >>> %.5d |      %s",
+            device->m_dev_name, data_len,
+            net_tun_dump_raw_data(
+                net_tun_driver_tmp_buffer(driver), buf, data_len,
+                net_tun_driver_debug(driver) >= 3));
+    }
+
+    /*inside a completion burst all writes go out with the next submit*/
+    if (!uring->m_processing) {
+        net_tun_device_uring_submit(uring);
+    }
+
+    return 0;
+}
+
+int net_tun_device_uring_writev(
+    net_tun_device_t device, struct iovec const * iov, int iovcnt, uint8_t head_len, struct pbuf * p, uint32_t data_len)
+{
+    net_tun_driver_t driver = device->m_driver;
+    net_tun_device_uring_t uring = device->m_uring;
+    struct pbuf * q;
+
+    assert(uring);
+    assert(iovcnt <= NET_TUN_DEVICE_WRITEV_MAX);
+
+    uint8_t is_volatile = 0;
+    for(q = p; q; q = q->next) {
+        if (PBUF_NEEDS_COPY(q)) {
+            is_volatile = 1;
+            break;
+        }
+    }
+
+    if (uring->m_write_free_count == 0 || is_volatile) {
+        /*the chain can not be held until completion, keep a copy*/
+        net_tun_device_pending_append(device, iov, iovcnt, data_len);
+        if (uring->m_write_free_count > 0) net_tun_device_pending_drain(device);
+        return 0;
+    }
+
+    uint16_t slot = uring->m_write_free[--uring->m_write_free_count];
+    struct iovec * slot_iov = uring->m_write_iovs[slot];
+    memcpy(slot_iov, iov, sizeof(struct iovec) * iovcnt);
+
+    /*the head lives on the caller stack, keep a copy in the slot buffer*/
+    if (head_len) {
+        uint8_t * buf = uring->m_write_bufs + (size_t)slot * uring->m_buf_size;
+        memcpy(buf, iov[0].iov_base, head_len);
+        slot_iov[0].iov_base = buf;
+    }
+
+    pbuf_ref(p);
+    assert(uring->m_write_pbufs[slot] == NULL);
+    uring->m_write_pbufs[slot] = p;
+    uring->m_write_lens[slot] = data_len;
+    uring->m_write_iovcnts[slot] = (uint8_t)iovcnt;
+
+    uint32_t head = __atomic_load_n(uring->m_sq_head, __ATOMIC_ACQUIRE);
+    assert(uring->m_sq_local_tail - head < uring->m_sq_entries);
+    uint32_t idx = uring->m_sq_local_tail & uring->m_sq_mask;
+    struct io_uring_sqe * sqe = &uring->m_sqes[idx];
+    bzero(sqe, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = device->m_dev_fd;
+    sqe->addr = (uint64_t)(uintptr_t)slot_iov;
+    sqe->len = (uint32_t)iovcnt;
+    sqe->user_data = NET_TUN_DEVICE_URING_USER_DATA(NET_TUN_DEVICE_URING_OP_WRITE, slot);
+    uring->m_sq_array[idx] = idx;
+    uring->m_sq_local_tail++;
+    uring->m_sq_to_submit++;
+    uring->m_inflight++;
+
+    if (net_tun_driver_debug(driver) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: >>> %.5d |      %s",
+            device->m_dev_name, data_len,
+            net_tun_dump_raw_data(
+                net_tun_driver_tmp_buffer(driver), p->payload, p->len,
+                net_tun_driver_debug(driver) >= 3));
+    }
+
+    if (!uring->m_processing) {
+        net_tun_device_uring_submit(uring);
+    }
+
+    return 0;
+}
+
+uint8_t net_tun_device_uring_write_ready(net_tun_device_t device) {
+    return device->m_uring->m_write_free_count > 0;
+}
+
+void net_tun_device_uring_write_begin(net_tun_device_t device) {
+    net_tun_device_uring_t uring = device->m_uring;
+    assert(uring);
+    uring->m_processing++;
+}
+
+void net_tun_device_uring_write_commit(net_tun_device_t device) {
+    net_tun_device_uring_t uring = device->m_uring;
+    assert(uring);
+    assert(uring->m_processing > 0);
+    if (--uring->m_processing == 0) {
+        net_tun_device_uring_submit(uring);
+    }
+}
+
+static int net_tun_device_uring_setup_ring(net_tun_device_uring_t uring, uint32_t entries) {
+    net_tun_device_t device = uring->m_device;
+    net_tun_driver_t driver = device->m_driver;
+    struct io_uring_params params;
+
+    bzero(&params, sizeof(params));
+    uring->m_ring_fd = net_tun_uring_sys_setup(entries, &params);
+    if (uring->m_ring_fd < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: setup fail, entries=%d, errno=%d (%s)",
+            device->m_dev_name, entries, errno, strerror(errno));
+        uring->m_ring_fd = -1;
+        return -1;
+    }
+
+    uring->m_sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    uring->m_cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->m_cq_map_size > uring->m_sq_map_size) uring->m_sq_map_size = uring->m_cq_map_size;
+        uring->m_cq_map_size = uring->m_sq_map_size;
+    }
+
+    uring->m_sq_map = mmap(
+        NULL, uring->m_sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        uring->m_ring_fd, IORING_OFF_SQ_RING);
+    if (uring->m_sq_map == MAP_FAILED) {
+        uring->m_sq_map = NULL;
+        goto MMAP_ERROR;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->m_cq_map = uring->m_sq_map;
+    }
+    else {
+        uring->m_cq_map = mmap(
+            NULL, uring->m_cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            uring->m_ring_fd, IORING_OFF_CQ_RING);
+        if (uring->m_cq_map == MAP_FAILED) {
+            uring->m_cq_map = NULL;
+            goto MMAP_ERROR;
+        }
+    }
+
+    uring->m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->m_sqes = mmap(
+        NULL, uring->m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        uring->m_ring_fd, IORING_OFF_SQES);
+    if (uring->m_sqes == MAP_FAILED) {
+        uring->m_sqes = NULL;
+        goto MMAP_ERROR;
+    }
+
+    uint8_t * sq = uring->m_sq_map;
+    uring->m_sq_head = (uint32_t *)(sq + params.sq_off.head);
+    uring->m_sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    uring->m_sq_array = (uint32_t *)(sq + params.sq_off.array);
+    uring->m_sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    uring->m_sq_entries = *(uint32_t *)(sq + params.sq_off.ring_entries);
+    uring->m_sq_local_tail = *uring->m_sq_tail;
+    uring->m_sq_to_submit = 0;
+
+    uint8_t * cq = uring->m_cq_map;
+    uring->m_cq_head = (uint32_t *)(cq + params.cq_off.head);
+    uring->m_cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    uring->m_cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    uring->m_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    return 0;
+
+MMAP_ERROR:
+    CPE_ERROR(
+        driver->m_em, "tun: %s: uring: mmap ring fail, errno=%d (%s)",
+        device->m_dev_name, errno, strerror(errno));
+    net_tun_device_uring_close_ring(uring);
+    return -1;
+}
+
+/*rings before 5.6 accept every sqe and fail the ops we use with EINVAL, leave those kernels to the watcher*/
+static int net_tun_device_uring_probe(net_tun_device_uring_t uring) {
+    net_tun_device_t device = uring->m_device;
+    net_tun_driver_t driver = device->m_driver;
+    static uint8_t const s_ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_WRITEV, IORING_OP_ASYNC_CANCEL };
+    struct {
+        struct io_uring_probe m_probe;
+        struct io_uring_probe_op m_ops[64];
+    } probe;
+    uint8_t i;
+
+    bzero(&probe, sizeof(probe));
+    if (net_tun_uring_sys_register(uring->m_ring_fd, IORING_REGISTER_PROBE, &probe, 64) != 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: uring: probe ops fail, errno=%d (%s)",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    for(i = 0; i < CPE_ARRAY_SIZE(s_ops); ++i) {
+        uint8_t op = s_ops[i];
+        if (op > probe.m_probe.last_op || !(probe.m_probe.ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            CPE_ERROR(driver->m_em, "tun: %s: uring: op %d not support", device->m_dev_name, op);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void net_tun_device_uring_close_ring(net_tun_device_uring_t uring) {
+    net_tun_device_t device = uring->m_device;
+    net_tun_driver_t driver = device->m_driver;
+
+    /*kernel still owns the buffers of in-flight ops, cancel and wait them back before unmap*/
+    if (uring->m_sqes && uring->m_inflight > 0) {
+        uint16_t i;
+
+        uring->m_closing = 1;
+        for(i = 0; i < NET_TUN_DEVICE_URING_READ_COUNT; ++i) {
+            uint32_t head = __atomic_load_n(uring->m_sq_head, __ATOMIC_ACQUIRE);
+            if (uring->m_sq_local_tail - head >= uring->m_sq_entries) {
+                net_tun_device_uring_submit(uring);
+                head = __atomic_load_n(uring->m_sq_head, __ATOMIC_ACQUIRE);
+                if (uring->m_sq_local_tail - head >= uring->m_sq_entries) break;
+            }
+
+            uint32_t idx = uring->m_sq_local_tail & uring->m_sq_mask;
+            struct io_uring_sqe * sqe = &uring->m_sqes[idx];
+            bzero(sqe, sizeof(*sqe));
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = NET_TUN_DEVICE_URING_USER_DATA(NET_TUN_DEVICE_URING_OP_READ, i);
+            sqe->user_data = NET_TUN_DEVICE_URING_USER_DATA(NET_TUN_DEVICE_URING_OP_CANCEL, i);
+            uring->m_sq_array[idx] = idx;
+            uring->m_sq_local_tail++;
+            uring->m_sq_to_submit++;
+        }
+        net_tun_device_uring_submit(uring);
+
+        while(uring->m_inflight > 0) {
+            net_tun_device_uring_reap(uring, NULL);
+            if (uring->m_inflight == 0) break;
+
+            if (net_tun_uring_sys_enter(uring->m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                CPE_ERROR(
+                    driver->m_em, "tun: %s: uring: wait %d inflight ops fail, errno=%d (%s)",
+                    device->m_dev_name, uring->m_inflight, errno, strerror(errno));
+                break;
+            }
+        }
+    }
+
+    if (uring->m_sqes) {
+        munmap(uring->m_sqes, uring->m_sqes_size);
+        uring->m_sqes = NULL;
+    }
+
+    if (uring->m_cq_map && uring->m_cq_map != uring->m_sq_map) {
+        munmap(uring->m_cq_map, uring->m_cq_map_size);
+    }
+    uring->m_cq_map = NULL;
+
+    if (uring->m_sq_map) {
+        munmap(uring->m_sq_map, uring->m_sq_map_size);
+        uring->m_sq_map = NULL;
+    }
+
+    close(uring->m_ring_fd);
+    uring->m_ring_fd = -1;
+}
+
+static int net_tun_device_uring_post_read(net_tun_device_uring_t uring, uint16_t slot) {
+    net_tun_device_t device = uring->m_device;
+
+    uint32_t head = __atomic_load_n(uring->m_sq_head, __ATOMIC_ACQUIRE);
+    if (uring->m_sq_local_tail - head >= uring->m_sq_entries) {
+        CPE_ERROR(device->m_driver->m_em, "tun: %s: uring: submission queue full", device->m_dev_name);
+        return -1;
+    }
+
+    uint32_t idx = uring->m_sq_local_tail & uring->m_sq_mask;
+    struct io_uring_sqe * sqe = &uring->m_sqes[idx];
+    bzero(sqe, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = device->m_dev_fd;
+    sqe->addr = (uint64_t)(uintptr_t)(
+        uring->m_read_rx[slot]
+        ? net_tun_device_rx_buf_data(uring->m_read_rx[slot])
+        : uring->m_read_bufs + (size_t)slot * uring->m_buf_size);
+    sqe->len = uring->m_buf_size;
+    sqe->user_data = NET_TUN_DEVICE_URING_USER_DATA(NET_TUN_DEVICE_URING_OP_READ, slot);
+    uring->m_sq_array[idx] = idx;
+    uring->m_sq_local_tail++;
+    uring->m_sq_to_submit++;
+    uring->m_inflight++;
+
+    return 0;
+}
+
+static int net_tun_device_uring_submit(net_tun_device_uring_t uring) {
+    net_tun_device_t device = uring->m_device;
+
+    while(uring->m_sq_to_submit > 0) {
+        __atomic_store_n(uring->m_sq_tail, uring->m_sq_local_tail, __ATOMIC_RELEASE);
+
+        int rv = net_tun_uring_sys_enter(uring->m_ring_fd, uring->m_sq_to_submit, 0, 0);
+        if (rv < 0) {
+            if (errno == EINTR) continue;
+
+            CPE_ERROR(
+                device->m_driver->m_em, "tun: %s: uring: submit %d ops fail, errno=%d (%s)",
+                device->m_dev_name, uring->m_sq_to_submit, errno, strerror(errno));
+            return -1;
+        }
+
+        assert((uint32_t)rv <= uring->m_sq_to_submit);
+        uring->m_sq_to_submit -= (uint32_t)rv;
+        if (rv == 0) break;
+    }
+
+    return 0;
+}
+
+static void net_tun_device_uring_on_read(net_tun_device_uring_t uring, uint16_t slot, int32_t res) {
+    net_tun_device_t device = uring->m_device;
+    net_tun_driver_t driver = device->m_driver;
+
+    if (res == -ECANCELED || uring->m_closing) return;
+
+    if (res > 0 && uring->m_read_rx[slot]) {
+        net_tun_device_rx_buf_t buf = uring->m_read_rx[slot];
+        net_tun_device_rx_buf_t next = net_tun_device_rx_buf_alloc(device->m_rx_pool);
+
+        assert(res <= uring->m_buf_size);
+        if (next) {
+            uring->m_read_rx[slot] = next;
+            net_tun_device_frame_input_rx(driver, device, buf, (uint32_t)res);
+        }
+        else {
+            /*out of frame buffers, copy this one out and keep the buffer on the slot*/
+            net_tun_device_frame_input(driver, device, net_tun_device_rx_buf_data(buf), (uint32_t)res);
+        }
+    }
+    else if (res > 0) {
+        assert(res <= uring->m_buf_size);
+        net_tun_device_frame_input(
+            driver, device, uring->m_read_bufs + (size_t)slot * uring->m_buf_size, (uint32_t)res);
+    }
+    else if (res == 0 || (res != -EAGAIN && res != -EINTR)) {
+        /*eof or a broken fd completes every repost at once, stop reading instead of spinning on it*/
+        uring->m_read_stopped = 1;
+        if (res == 0) {
+            CPE_ERROR(driver->m_em, "tun: %s: rw: read eof, device read stopped", device->m_dev_name);
+        }
+        else {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: rw: read data error, errno=%d %s, device read stopped",
+                device->m_dev_name, -res, strerror(-res));
+        }
+        return;
+    }
+
+    if (device->m_quitting || uring->m_read_stopped) return;
+
+    net_tun_device_uring_post_read(uring, slot);
+}
+
+static void net_tun_device_uring_on_write(net_tun_device_uring_t uring, uint16_t slot, int32_t res) {
+    net_tun_device_t device = uring->m_device;
+    net_tun_driver_t driver = device->m_driver;
+    uint32_t data_len = uring->m_write_lens[slot];
+
+    if (res < 0 && net_tun_device_pending_is_retry(-res) && !uring->m_closing) {
+        /*device refused it, retry from the pending queue ahead of the writes queued after it*/
+        struct iovec iov = { uring->m_write_bufs + (size_t)slot * uring->m_buf_size, data_len };
+        if (uring->m_write_iovcnts[slot]) {
+            net_tun_device_pending_retry(device, uring->m_write_iovs[slot], uring->m_write_iovcnts[slot], data_len);
+        }
+        else {
+            net_tun_device_pending_retry(device, &iov, 1, data_len);
+        }
+    }
+    else if (res < 0) {
+        // malformed packets will cause errors, ignore them and act like
+        // the packet was accepeted
+        CPE_ERROR(
+            driver->m_em, "tun: %s: >>> %.5d |      errno=%d (%s)",
+            device->m_dev_name, data_len, -res, strerror(-res));
+    }
+    else if ((uint32_t)res != data_len) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: >>> %.5d |      part, %d/%d",
+            device->m_dev_name, res, res, data_len);
+    }
+
+    if (uring->m_write_pbufs[slot]) {
+        pbuf_free(uring->m_write_pbufs[slot]);
+        uring->m_write_pbufs[slot] = NULL;
+    }
+
+    assert(uring->m_write_free_count < NET_TUN_DEVICE_URING_WRITE_COUNT);
+    uring->m_write_free[uring->m_write_free_count++] = slot;
+
+    if (!uring->m_closing) {
+        net_tun_device_pending_drain(device);
+    }
+}
+
+/*returns 1 when the read budget ran out with completions left in the ring*/
+static uint8_t net_tun_device_uring_reap(net_tun_device_uring_t uring, net_tun_read_budget_t budget) {
+    uint32_t head = *uring->m_cq_head;
+
+    for(;;) {
+        uint32_t tail = __atomic_load_n(uring->m_cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) break;
+
+        struct io_uring_cqe * cqe = &uring->m_cqes[head & uring->m_cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int32_t res = cqe->res;
+
+        head++;
+        __atomic_store_n(uring->m_cq_head, head, __ATOMIC_RELEASE);
+
+        uint16_t slot = (uint16_t)(user_data & 0xFFFFFFFFu);
+        switch(user_data >> 32) {
+        case NET_TUN_DEVICE_URING_OP_READ:
+            assert(uring->m_inflight > 0);
+            uring->m_inflight--;
+            net_tun_device_uring_on_read(uring, slot, res);
+            if (budget && res > 0 && !net_tun_read_budget_consume(budget, (uint32_t)res)) {
+                return __atomic_load_n(uring->m_cq_tail, __ATOMIC_ACQUIRE) != head;
+            }
+            break;
+        case NET_TUN_DEVICE_URING_OP_WRITE:
+            assert(uring->m_inflight > 0);
+            uring->m_inflight--;
+            net_tun_device_uring_on_write(uring, slot, res);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static uint8_t net_tun_device_uring_process(net_tun_device_uring_t uring) {
+    struct net_tun_read_budget budget;
+
+    net_tun_driver_read_budget_init(uring->m_device->m_driver, &budget);
+
+    uring->m_processing++;
+    net_tun_device_input_begin(uring->m_device);
+    uint8_t more = net_tun_device_uring_reap(uring, &budget);
+    net_tun_device_input_end(uring->m_device);
+    net_tun_device_output_flush(uring->m_device);
+    uring->m_processing--;
+
+    /*reposted reads and every write produced by this burst go out together*/
+    net_tun_device_uring_submit(uring);
+
+    return more;
+}
+
+uint8_t net_tun_device_uring_read_resume(net_tun_device_t device) {
+    return net_tun_device_uring_process(device->m_uring);
+}
+
+static void net_tun_device_uring_event_cb(void * ctx, int fd, uint8_t do_read, uint8_t do_write) {
+    net_tun_device_uring_t uring = ctx;
+    net_tun_device_t device = uring->m_device;
+    uint64_t counter;
+
+    if (!do_read) return;
+
+    if (read(fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+        CPE_ERROR(
+            device->m_driver->m_em, "tun: %s: uring: read eventfd fail, errno=%d (%s)",
+            device->m_dev_name, errno, strerror(errno));
+    }
+
+    /*already waiting for a round-robin turn, completions stay in the ring until then*/
+    if (device->m_read_scheduled) return;
+
+    if (net_tun_device_uring_process(uring)) {
+        net_tun_driver_read_schedule(device->m_driver, device);
+    }
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include <assert.h>
+#include <errno.h>
+#if CPE_OS_LINUX
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <linux/if_tun.h>
+#include <linux/virtio_net.h>
+#endif
+#include "net_tun_driver_i.h"
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_strings.h"
+#include "net_tun_device_i.h"
+
+#if NET_TUN_USE_DEV_TUN
+
+#if CPE_OS_LINUX
+
+static uint16_t net_tun_device_vnet_pseudo_sum(
+    uint8_t const * src, uint8_t const * dst, uint8_t addr_len, uint8_t proto, uint32_t l4_len)
+{
+    uint32_t sum = 0;
+    uint8_t i;
+
+    for(i = 0; i < addr_len; i += 2) {
+        sum += ((uint32_t)src[i] << 8) | src[i + 1];
+        sum += ((uint32_t)dst[i] << 8) | dst[i + 1];
+    }
+    sum += proto;
+    sum += l4_len >> 16;
+    sum += l4_len & 0xFFFF;
+
+    while(sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return (uint16_t)sum;
+}
+
+int net_tun_device_vnet_setup(net_tun_device_t device) {
+    net_tun_driver_t driver = device->m_driver;
+    struct ifreq ifr;
+
+    bzero(&ifr, sizeof(ifr));
+    if (ioctl(device->m_dev_fd, TUNGETIFF, (void *)&ifr) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: get flags fail, %d %s",
+            device->m_dev_name, errno, strerror(errno));
+        return -1;
+    }
+
+    if (!(ifr.ifr_flags & IFF_TUN) || !(ifr.ifr_flags & IFF_VNET_HDR)) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: device not opened as tun with IFF_VNET_HDR, flags=0x%x",
+            device->m_dev_name, ifr.ifr_flags);
+        return -1;
+    }
+
+    int hdr_len = sizeof(struct virtio_net_hdr);
+    if (ioctl(device->m_dev_fd, TUNSETVNETHDRSZ, &hdr_len) < 0) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: set header size %d fail, %d %s",
+            device->m_dev_name, hdr_len, errno, strerror(errno));
+        return -1;
+    }
+
+    /*what the kernel may hand us, our own writes may always carry partial checksum and gso*/
+    unsigned int offload = TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6;
+    if (ioctl(device->m_dev_fd, TUNSETOFFLOAD, offload) < 0) {
+        offload = TUN_F_CSUM;
+        if (ioctl(device->m_dev_fd, TUNSETOFFLOAD, offload) < 0) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: vnet: set offload fail, %d %s",
+                device->m_dev_name, errno, strerror(errno));
+            offload = 0;
+        }
+    }
+
+    device->m_vnet_hdr_len = (uint8_t)hdr_len;
+    device->m_frame_capacity = device->m_vnet_hdr_len + 0xFFFF;
+
+    CPE_INFO(
+        driver->m_em, "tun: %s: vnet: header %d, offload%s%s%s",
+        device->m_dev_name, hdr_len,
+        (offload & TUN_F_CSUM) ? " csum" : "",
+        (offload & TUN_F_TSO4) ? " tso4" : "",
+        (offload & TUN_F_TSO6) ? " tso6" : "");
+
+    return 0;
+}
+
+int net_tun_device_vnet_input_hdr(
+    net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size, uint8_t * csum_valid)
+{
+    struct virtio_net_hdr hdr;
+
+    if (frame_size < device->m_vnet_hdr_len) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: input frame length %d too small",
+            device->m_dev_name, frame_size);
+        return -1;
+    }
+
+    memcpy(&hdr, frame, sizeof(hdr));
+    frame_size -= device->m_vnet_hdr_len;
+
+    switch(hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+    case VIRTIO_NET_HDR_GSO_NONE:
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+        break;
+    default:
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: input gso type %d not support",
+            device->m_dev_name, hdr.gso_type);
+        return -1;
+    }
+
+    if (frame_size > 0xFFFF) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: input packet length %d overflow",
+            device->m_dev_name, frame_size);
+        return -1;
+    }
+
+    /*kernel generated (partial checksum) or already verified*/
+    *csum_valid = (hdr.flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM | VIRTIO_NET_HDR_F_DATA_VALID)) ? 1 : 0;
+
+    return 0;
+}
+
+int net_tun_device_vnet_pbuf_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p, uint8_t csum_valid) {
+    if (!csum_valid) {
+        return net_tun_device_pbuf_input(driver, device, p);
+    }
+
+    /*skip the l4 check for this packet*/
+    u16_t chksum_flags = device->m_netif.chksum_flags;
+    NETIF_SET_CHECKSUM_CTRL(
+        &device->m_netif, chksum_flags & ~(NETIF_CHECKSUM_CHECK_TCP | NETIF_CHECKSUM_CHECK_UDP));
+    int rv = net_tun_device_pbuf_input(driver, device, p);
+    NETIF_SET_CHECKSUM_CTRL(&device->m_netif, chksum_flags);
+
+    return rv;
+}
+
+int net_tun_device_vnet_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size) {
+    uint8_t csum_valid;
+
+    if (net_tun_device_vnet_input_hdr(driver, device, frame, frame_size, &csum_valid) != 0) return -1;
+
+    struct pbuf * p = net_tun_device_packet_alloc(
+        driver, device, frame + device->m_vnet_hdr_len, (uint16_t)(frame_size - device->m_vnet_hdr_len));
+    if (p == NULL) return -1;
+
+    return net_tun_device_vnet_pbuf_input(driver, device, p, csum_valid);
+}
+
+int net_tun_device_vnet_output_hdr(net_tun_device_t device, struct pbuf * p, void * output_hdr) {
+    net_tun_driver_t driver = device->m_driver;
+    struct virtio_net_hdr * hdr = output_hdr;
+    uint8_t * iphead = p->payload;
+    uint16_t l3_len;
+    uint8_t proto;
+    uint8_t const * src;
+    uint8_t const * dst;
+    uint8_t addr_len;
+
+    bzero(hdr, sizeof(*hdr));
+
+    if (p->len < 1) goto CHECK_MTU;
+
+    switch(iphead[0] >> 4) {
+    case 4:
+        if (p->len < 20) goto CHECK_MTU;
+        l3_len = (uint16_t)((iphead[0] & 0x0F) * 4);
+        proto = iphead[9];
+        src = iphead + 12;
+        dst = iphead + 16;
+        addr_len = 4;
+        break;
+    case 6:
+        if (p->len < 40) goto CHECK_MTU;
+        l3_len = 40;
+        proto = iphead[6];
+        src = iphead + 8;
+        dst = iphead + 24;
+        addr_len = 16;
+        break;
+    default:
+        goto CHECK_MTU;
+    }
+
+    uint16_t csum_offset;
+    switch(proto) {
+    case IP_PROTO_TCP:
+        csum_offset = 16;
+        break;
+    case IP_PROTO_UDP:
+        csum_offset = 6;
+        break;
+    default:
+        goto CHECK_MTU;
+    }
+
+    /*lwip builds ip and l4 headers in the first pbuf*/
+    if (p->len < l3_len + csum_offset + 2) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: vnet: output headers not continuous, first pbuf %d",
+            device->m_dev_name, p->len);
+        return -1;
+    }
+
+    /*netif does not generate tcp/udp checksum, let the kernel finish it from the pseudo header sum*/
+    uint16_t sum = net_tun_device_vnet_pseudo_sum(src, dst, addr_len, proto, p->tot_len - l3_len);
+    iphead[l3_len + csum_offset] = (uint8_t)(sum >> 8);
+    iphead[l3_len + csum_offset + 1] = (uint8_t)(sum & 0xFF);
+
+    hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    hdr->csum_start = l3_len;
+    hdr->csum_offset = csum_offset;
+
+#if LWIP_TCP_TSO
+    if (proto == IP_PROTO_TCP && p->tso_mss) {
+        uint16_t tcp_hdr_len = (uint16_t)((iphead[l3_len + 12] >> 4) * 4);
+        if (p->tot_len - l3_len - tcp_hdr_len > p->tso_mss) {
+            hdr->gso_type = addr_len == 4 ? VIRTIO_NET_HDR_GSO_TCPV4 : VIRTIO_NET_HDR_GSO_TCPV6;
+            hdr->gso_size = p->tso_mss;
+            hdr->hdr_len = l3_len + tcp_hdr_len;
+            return 0;
+        }
+    }
+#endif
+
+CHECK_MTU:
+    if (p->tot_len > device->m_mtu) {
+        CPE_ERROR(
+            driver->m_em, "tun: %s: output: len %d overflow, mtu=%d",
+            device->m_dev_name, p->tot_len, device->m_mtu);
+        return -1;
+    }
+
+    return 0;
+}
+
+#else
+
+int net_tun_device_vnet_setup(net_tun_device_t device) {
+    CPE_ERROR(device->m_driver->m_em, "tun: %s: vnet: not support", device->m_dev_name);
+    return -1;
+}
+
+int net_tun_device_vnet_input(net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size) {
+    return -1;
+}
+
+int net_tun_device_vnet_input_hdr(
+    net_tun_driver_t driver, net_tun_device_t device, uint8_t const * frame, uint32_t frame_size, uint8_t * csum_valid)
+{
+    return -1;
+}
+
+int net_tun_device_vnet_pbuf_input(net_tun_driver_t driver, net_tun_device_t device, struct pbuf * p, uint8_t csum_valid) {
+    pbuf_free(p);
+    return -1;
+}
+
+int net_tun_device_vnet_output_hdr(net_tun_device_t device, struct pbuf * p, void * hdr) {
+    return -1;
+}
+
+#endif
+
+#endif
@@ -3,6 +3,9 @@
 #include "lwip/nd6.h"
 #include "lwip/ip4_frag.h"
 #include "lwip/ip6_frag.h"
+#include "lwip/sys.h"
+#include "lwip/memp.h"
+#include "lwip/timeouts.h"
 #include "net_schedule.h"
 #include "net_driver.h"
 #include "net_timer.h"
@@ -17,8 +20,13 @@
 
 static int net_tun_driver_init(net_driver_t driver);
 static void net_tun_driver_fini(net_driver_t driver);
+static void * net_tun_driver_slab_alloc(void * ctx, size_t size);
+static void net_tun_driver_slab_free(void * ctx, void * mem);
+static void net_tun_driver_lwip_release(net_tun_driver_t driver);
+static void net_tun_driver_mem_prewarm(net_tun_driver_t driver);
 #if NET_TUN_USE_DRIVER
 static void net_tun_driver_tcp_timer_cb(net_timer_t timer, void * ctx);
+static void net_tun_driver_read_timer_cb(net_timer_t timer, void * ctx);
 #endif
 
 net_tun_driver_t
@@ -81,11 +89,18 @@ net_tun_driver_create(
         net_driver_free(base_driver);
         return NULL;
     }
-    net_timer_active(driver->m_tcp_timer, TCP_TMR_INTERVAL);
+
+    driver->m_read_timer = net_timer_create(inner_driver, net_tun_driver_read_timer_cb, driver);
+    if (driver->m_read_timer == NULL) {
+        net_driver_free(base_driver);
+        return NULL;
+    }
 #endif
 
     g_lwip_em = driver->m_em;
+    memp_slab_set_allocator(net_tun_driver_slab_alloc, net_tun_driver_slab_free, driver->m_alloc);
     lwip_init();
+    net_tun_driver_mem_prewarm(driver);
     
     return driver;
 }
@@ -112,8 +127,17 @@ static int net_tun_driver_init(net_driver_t base_driver) {
 #if NET_TUN_USE_DRIVER
     driver->m_inner_driver = NULL;
     driver->m_tcp_timer = NULL;
+    driver->m_read_budget_packets = NET_TUN_DRIVER_READ_BUDGET_PACKETS;
+    driver->m_read_budget_bytes = NET_TUN_DRIVER_READ_BUDGET_BYTES;
+    TAILQ_INIT(&driver->m_read_ready_devices);
+    driver->m_read_timer = NULL;
 #endif    
+    driver->m_tcp_snd_buf = NET_TUN_DRIVER_TCP_SND_BUF;
+    driver->m_tcp_rcv_wnd = NET_TUN_DRIVER_TCP_RCV_WND;
+    driver->m_tcp_cc = NULL;
     driver->m_tcp_timer_counter = 0;
+    driver->m_tcp_timer_base_ms = sys_now();
+    driver->m_tcp_timer_next = 0;
 
     TAILQ_INIT(&driver->m_devices);
     TAILQ_INIT(&driver->m_wildcard_acceptors);
@@ -139,12 +163,8 @@ static int net_tun_driver_init(net_driver_t base_driver) {
     driver->m_tcp_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
     dispatch_retain(driver->m_tcp_timer);
     dispatch_source_set_event_handler(driver->m_tcp_timer, ^{ net_tun_dirver_do_timer(driver); });
-    uint64_t tcp_timer_interval = ((uint64_t)TCP_TMR_INTERVAL) * 1000000u;
-    dispatch_source_set_timer(
-        driver->m_tcp_timer,
-        dispatch_time(DISPATCH_TIME_NOW, tcp_timer_interval),
-        tcp_timer_interval,
-        0ULL);
+    /*armed one shot on demand, see net_tun_driver_timer_schedule*/
+    dispatch_source_set_timer(driver->m_tcp_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0ULL);
     dispatch_resume(driver->m_tcp_timer);
 #endif
 
@@ -161,6 +181,11 @@ static void net_tun_driver_fini(net_driver_t base_driver) {
         net_timer_free(driver->m_tcp_timer);
         driver->m_tcp_timer = NULL;
     }
+
+    if (driver->m_read_timer) {
+        net_timer_free(driver->m_read_timer);
+        driver->m_read_timer = NULL;
+    }
 #endif
 
 #if NET_TUN_USE_DQ
@@ -182,6 +207,67 @@ static void net_tun_driver_fini(net_driver_t base_driver) {
     }
 
     mem_buffer_clear(&driver->m_data_buffer);
+
+    /*pcbs outliving their endpoints (time-wait, closing with unsent or ooseq data) and the cyclic timeouts hold slab elements*/
+    net_tun_driver_lwip_release(driver);
+
+    if (net_tun_driver_debug(driver)) {
+        struct net_tun_driver_mem_stat stat;
+        uint16_t i;
+        for(i = 0; i < net_tun_driver_mem_stat_count(driver); ++i) {
+            net_tun_driver_mem_stat(driver, i, &stat);
+            if (stat.m_used_max == 0) continue;
+            CPE_INFO(
+                driver->m_em, "tun: driver: mem %s(%d): used=%d, max=%d, cached=%d, chunks=%d",
+                stat.m_name, stat.m_size, stat.m_used, stat.m_used_max, stat.m_cached, stat.m_chunks);
+        }
+    }
+
+    /*the next lwip_init starts from empty slabs, every chunk must go back to this allocator now*/
+    memp_slab_trim();
+
+    uint16_t i;
+    for(i = 0; i < memp_slab_count(); ++i) {
+        struct memp_slab_stats slab_stats;
+        memp_slab_get_stats(i, &slab_stats);
+        if (slab_stats.chunks == 0) continue;
+        CPE_ERROR(
+            driver->m_em, "tun: driver: mem %s(%d): %d still used, %d chunks leaked",
+            slab_stats.name, slab_stats.size, slab_stats.used, slab_stats.chunks);
+    }
+}
+
+static void net_tun_driver_lwip_release(net_tun_driver_t driver) {
+    uint32_t count = 0;
+
+    /*abandon frees time-wait pcbs directly, the others are orphans whose callbacks were cleared with their endpoint*/
+    while(tcp_active_pcbs) {
+        tcp_abort(tcp_active_pcbs);
+        count++;
+    }
+
+    while(tcp_tw_pcbs) {
+        tcp_abort(tcp_tw_pcbs);
+        count++;
+    }
+
+    while(tcp_listen_pcbs.pcbs) {
+        tcp_close(tcp_listen_pcbs.pcbs);
+        count++;
+    }
+
+    while(tcp_bound_pcbs) {
+        tcp_close(tcp_bound_pcbs);
+        count++;
+    }
+
+    if (count && net_tun_driver_debug(driver)) {
+        CPE_INFO(driver->m_em, "tun: driver: aborted %d tcp pcbs left after endpoints", count);
+    }
+
+#if LWIP_TIMERS
+    sys_untimeout_all();
+#endif
 }
 
 void net_tun_driver_free(net_tun_driver_t driver) {
@@ -205,6 +291,70 @@ void net_tun_driver_set_data_monitor(
     driver->m_data_monitor_ctx = monitor_ctx;
 }
 
+uint16_t net_tun_driver_mem_stat_count(net_tun_driver_t driver) {
+    return memp_slab_count();
+}
+
+int net_tun_driver_mem_stat(net_tun_driver_t driver, uint16_t idx, struct net_tun_driver_mem_stat * stat) {
+    struct memp_slab_stats slab_stats;
+
+    if (idx >= memp_slab_count()) return -1;
+
+    memp_slab_get_stats(idx, &slab_stats);
+    stat->m_name = slab_stats.name;
+    stat->m_size = slab_stats.size;
+    stat->m_used = slab_stats.used;
+    stat->m_used_max = slab_stats.max;
+    stat->m_cached = slab_stats.avail;
+    stat->m_chunks = slab_stats.chunks;
+    return 0;
+}
+
+static void * net_tun_driver_slab_alloc(void * ctx, size_t size) {
+    return mem_alloc((mem_allocrator_t)ctx, size);
+}
+
+static void net_tun_driver_slab_free(void * ctx, void * mem) {
+    mem_free((mem_allocrator_t)ctx, mem);
+}
+
+static void net_tun_driver_mem_prewarm(net_tun_driver_t driver) {
+    if (memp_slab_prewarm(MEMP_TCP_PCB, NET_TUN_DRIVER_PREWARM_TCP_PCB) != ERR_OK
+        || memp_slab_prewarm(MEMP_TCP_SEG, NET_TUN_DRIVER_PREWARM_TCP_SEG) != ERR_OK
+        || memp_slab_prewarm(MEMP_PBUF_POOL, NET_TUN_DRIVER_PREWARM_PBUF_POOL) != ERR_OK
+        || memp_slab_heap_prewarm(TCP_MSS, NET_TUN_DRIVER_PREWARM_SEGMENT) != ERR_OK)
+    {
+        CPE_ERROR(driver->m_em, "tun: driver: prewarm lwip memory fail, allocate on demand");
+    }
+}
+
+#if NET_TUN_USE_DRIVER
+void net_tun_driver_set_read_budget(net_tun_driver_t driver, uint32_t packets, uint32_t bytes) {
+    driver->m_read_budget_packets = packets;
+    driver->m_read_budget_bytes = bytes;
+}
+#endif
+
+void net_tun_driver_set_tcp_buf(net_tun_driver_t driver, uint32_t snd_buf, uint32_t rcv_wnd) {
+    if (snd_buf) driver->m_tcp_snd_buf = snd_buf;
+    if (rcv_wnd) driver->m_tcp_rcv_wnd = rcv_wnd;
+}
+
+int net_tun_driver_set_tcp_cc(net_tun_driver_t driver, const char * name) {
+    const struct tcp_cc_ops * cc = NULL;
+
+    if (name) {
+        cc = tcp_cc_find(name);
+        if (cc == NULL) {
+            CPE_ERROR(driver->m_em, "tun: set tcp cc: unknown algorithm %s", name);
+            return -1;
+        }
+    }
+
+    driver->m_tcp_cc = cc;
+    return 0;
+}
+
 net_schedule_t net_tun_driver_schedule(net_tun_driver_t driver) {
     return net_driver_schedule(net_driver_from_data(driver));
 }
@@ -217,15 +367,27 @@ uint8_t net_tun_driver_debug(net_tun_driver_t driver) {
     return net_driver_debug(net_driver_from_data(driver));
 }
 
+/*delay_ms < 0 disarms*/
+static void net_tun_driver_timer_schedule(net_tun_driver_t driver, int32_t delay_ms) {
 #if NET_TUN_USE_DRIVER
+    if (delay_ms < 0) {
+        net_timer_cancel(driver->m_tcp_timer);
+    }
+    else {
+        net_timer_active(driver->m_tcp_timer, delay_ms);
+    }
+#endif
 
-static void net_tun_driver_tcp_timer_cb(net_timer_t timer, void * ctx) {
-    net_tun_dirver_do_timer(ctx);
-    net_timer_active(timer, TCP_TMR_INTERVAL);
-
+#if NET_TUN_USE_DQ
+    dispatch_source_set_timer(
+        driver->m_tcp_timer,
+        delay_ms < 0 ? DISPATCH_TIME_FOREVER : dispatch_time(DISPATCH_TIME_NOW, ((int64_t)delay_ms) * 1000000),
+        DISPATCH_TIME_FOREVER,
+        0ULL);
+#endif
 }
 
-void net_tun_dirver_do_timer(net_tun_driver_t driver) {
+static void net_tun_driver_timer_tick(net_tun_driver_t driver) {
     tcp_tmr();
     
     driver->m_tcp_timer_counter = (driver->m_tcp_timer_counter + 1) % 4;
@@ -249,4 +411,161 @@ void net_tun_dirver_do_timer(net_tun_driver_t driver) {
     }
 }
 
+static uint8_t net_tun_driver_timer_ip_pending(void) {
+#if IP_REASSEMBLY
+    if (ip_reass_pending()) return 1;
+#endif
+
+#if LWIP_IPV6
+    if (nd6_tmr_pending()) return 1;
+#endif
+
+#if LWIP_IPV6 && LWIP_IPV6_REASS
+    if (ip6_reass_pending()) return 1;
+#endif
+
+    return 0;
+}
+
+/*ticks passed since the last one*/
+static uint32_t net_tun_driver_timer_elapsed(net_tun_driver_t driver, uint32_t now) {
+    int32_t elapsed = (int32_t)(now - driver->m_tcp_timer_base_ms);
+
+    if (elapsed < 0) {
+        /*wall clock stepped back, restart the phase from now*/
+        driver->m_tcp_timer_base_ms = now;
+        return 0;
+    }
+
+    uint32_t ticks = (uint32_t)elapsed / TCP_TMR_INTERVAL;
+    if (ticks > NET_TUN_DRIVER_TIMER_CATCH_UP_MAX) {
+        driver->m_tcp_timer_base_ms = now - NET_TUN_DRIVER_TIMER_CATCH_UP_MAX * TCP_TMR_INTERVAL;
+        ticks = NET_TUN_DRIVER_TIMER_CATCH_UP_MAX;
+    }
+
+    return ticks;
+}
+
+static void net_tun_driver_timer_run(net_tun_driver_t driver, uint32_t ticks) {
+    driver->m_tcp_timer_base_ms += ticks * TCP_TMR_INTERVAL;
+    driver->m_tcp_timer_next = driver->m_tcp_timer_next > ticks ? driver->m_tcp_timer_next - ticks : 0;
+
+    while(ticks-- > 0) {
+        net_tun_driver_timer_tick(driver);
+    }
+}
+
+static void net_tun_driver_timer_arm(net_tun_driver_t driver, uint32_t now) {
+    uint32_t next = tcp_tmr_next();
+
+    if (net_tun_driver_timer_ip_pending()) {
+        /*the ip timers run on every fourth tick*/
+        uint32_t ip_next = 4u - driver->m_tcp_timer_counter;
+        if (next == 0 || ip_next < next) next = ip_next;
+    }
+
+    driver->m_tcp_timer_next = next;
+
+    if (next == 0) {
+        /*lwip is idle, sleep until the next input or endpoint action*/
+        net_tun_driver_timer_schedule(driver, -1);
+        return;
+    }
+
+    int32_t delay = (int32_t)(driver->m_tcp_timer_base_ms + next * TCP_TMR_INTERVAL - now);
+    net_tun_driver_timer_schedule(driver, delay < 0 ? 0 : delay);
+}
+
+void net_tun_driver_timer_wakeup(net_tun_driver_t driver) {
+    if (driver->m_tcp_timer_next == 1) return;
+
+    uint32_t now = sys_now();
+
+    /*catch up on the skipped ticks so lwip sees the right tcp_ticks, they have
+      nothing to do by construction, the due one is still left to the timer*/
+    uint32_t ticks = net_tun_driver_timer_elapsed(driver, now);
+    if (driver->m_tcp_timer_next && ticks >= driver->m_tcp_timer_next) {
+        ticks = driver->m_tcp_timer_next - 1;
+    }
+    net_tun_driver_timer_run(driver, ticks);
+
+    /*lwip is about to be fed, it may have timers from the next tick on*/
+    driver->m_tcp_timer_next = 1;
+    int32_t delay = (int32_t)(driver->m_tcp_timer_base_ms + TCP_TMR_INTERVAL - now);
+    net_tun_driver_timer_schedule(driver, delay < 0 ? 0 : delay);
+}
+
+void net_tun_dirver_do_timer(net_tun_driver_t driver) {
+    net_tun_device_t device;
+    uint32_t now = sys_now();
+
+    /*all ticks due by now, at least the one armed for even if the timer fired a little early*/
+    uint32_t ticks = net_tun_driver_timer_elapsed(driver, now);
+    net_tun_driver_timer_run(driver, ticks > 0 ? ticks : 1);
+
+    TAILQ_FOREACH(device, &driver->m_devices, m_next_for_driver) {
+        net_tun_device_output_flush(device);
+    }
+
+    net_tun_driver_timer_arm(driver, now);
+}
+
+#if NET_TUN_USE_DRIVER
+
+static void net_tun_driver_tcp_timer_cb(net_timer_t timer, void * ctx) {
+    net_tun_dirver_do_timer(ctx);
+}
+
+void net_tun_driver_read_budget_init(net_tun_driver_t driver, net_tun_read_budget_t budget) {
+    budget->m_packets = driver->m_read_budget_packets ? driver->m_read_budget_packets : UINT32_MAX;
+    budget->m_bytes = driver->m_read_budget_bytes ? driver->m_read_budget_bytes : UINT32_MAX;
+}
+
+uint8_t net_tun_read_budget_consume(net_tun_read_budget_t budget, uint32_t bytes) {
+    budget->m_packets = budget->m_packets > 1 ? budget->m_packets - 1 : 0;
+    budget->m_bytes = budget->m_bytes > bytes ? budget->m_bytes - bytes : 0;
+    return budget->m_packets > 0 && budget->m_bytes > 0;
+}
+
+void net_tun_driver_read_schedule(net_tun_driver_t driver, net_tun_device_t device) {
+    if (device->m_read_scheduled) return;
+
+    device->m_read_scheduled = 1;
+    TAILQ_INSERT_TAIL(&driver->m_read_ready_devices, device, m_next_for_read);
+
+    if (!net_timer_is_active(driver->m_read_timer)) {
+        net_timer_active(driver->m_read_timer, 0);
+    }
+}
+
+void net_tun_driver_read_unschedule(net_tun_driver_t driver, net_tun_device_t device) {
+    if (!device->m_read_scheduled) return;
+
+    device->m_read_scheduled = 0;
+    TAILQ_REMOVE(&driver->m_read_ready_devices, device, m_next_for_read);
+}
+
+static void net_tun_driver_read_timer_cb(net_timer_t timer, void * ctx) {
+    net_tun_driver_t driver = ctx;
+    net_tun_device_t device;
+    uint32_t count = 0;
+
+    TAILQ_FOREACH(device, &driver->m_read_ready_devices, m_next_for_read) {
+        count++;
+    }
+
+    /*one budget per device per round, devices still busy go to the tail for the next round*/
+    while(count-- > 0 && !TAILQ_EMPTY(&driver->m_read_ready_devices)) {
+        device = TAILQ_FIRST(&driver->m_read_ready_devices);
+        net_tun_driver_read_unschedule(driver, device);
+        if (net_tun_device_read_resume(device)) {
+            net_tun_driver_read_schedule(driver, device);
+        }
+    }
+
+    if (!TAILQ_EMPTY(&driver->m_read_ready_devices) && !net_timer_is_active(timer)) {
+        net_timer_active(timer, 0);
+    }
+}
+
 #endif
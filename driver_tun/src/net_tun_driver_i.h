@@ -25,6 +25,28 @@ typedef struct net_tun_acceptor * net_tun_acceptor_t;
 typedef struct net_tun_endpoint * net_tun_endpoint_t;
 typedef struct net_tun_dgram * net_tun_dgram_t;
 
+/*ticks replayed at most after a sleep, a longer gap is a wall clock jump*/
+#define NET_TUN_DRIVER_TIMER_CATCH_UP_MAX (3600 * 1000 / TCP_TMR_INTERVAL)
+
+/*lwip objects cached at startup, more are taken from the schedule allocator on demand*/
+#define NET_TUN_DRIVER_PREWARM_TCP_PCB 64
+#define NET_TUN_DRIVER_PREWARM_TCP_SEG 256
+#define NET_TUN_DRIVER_PREWARM_PBUF_POOL 128
+#define NET_TUN_DRIVER_PREWARM_SEGMENT 64 /*full sized PBUF_RAM tcp segments*/
+
+/*default packets / bytes a device reads per wakeup before yielding to the loop*/
+#define NET_TUN_DRIVER_READ_BUDGET_PACKETS 128
+#define NET_TUN_DRIVER_READ_BUDGET_BYTES (512 * 1024)
+
+/*default tcp send buffer / receive window, about 100Mbit at 80ms rtt; lwip caps them at TCP_SND_BUF / TCP_WND*/
+#define NET_TUN_DRIVER_TCP_SND_BUF (1024 * 1024)
+#define NET_TUN_DRIVER_TCP_RCV_WND (1024 * 1024)
+
+typedef struct net_tun_read_budget {
+    uint32_t m_packets;
+    uint32_t m_bytes;
+} * net_tun_read_budget_t;
+
 struct net_tun_driver {
     mem_allocrator_t m_alloc;
     error_monitor_t m_em;
@@ -36,12 +58,26 @@ struct net_tun_driver {
 #if NET_TUN_USE_DRIVER
     net_timer_t m_tcp_timer;
 #endif
+
+    /*devices which ran out of read budget, served round-robin*/
+#if NET_TUN_USE_DRIVER
+    uint32_t m_read_budget_packets;
+    uint32_t m_read_budget_bytes;
+    net_tun_device_list_t m_read_ready_devices;
+    net_timer_t m_read_timer;
+#endif
     
 #if NET_TUN_USE_DQ
     __unsafe_unretained dispatch_source_t m_tcp_timer;    
 #endif
 
+    uint32_t m_tcp_snd_buf;
+    uint32_t m_tcp_rcv_wnd;
+    const struct tcp_cc_ops * m_tcp_cc; /*NULL: LWIP_TCP_CC_DEFAULT*/
+
     uint8_t m_tcp_timer_counter;
+    uint32_t m_tcp_timer_base_ms; /*sys_now() of the last tick, ticks keep this phase*/
+    uint32_t m_tcp_timer_next;    /*ticks after the last one the timer is armed for, 0 while lwip is idle*/
 
     struct mem_buffer m_data_buffer;
 
@@ -63,5 +99,13 @@ net_schedule_t net_tun_driver_schedule(net_tun_driver_t driver);
 uint8_t net_tun_driver_debug(net_tun_driver_t driver);
 
 void net_tun_dirver_do_timer(net_tun_driver_t driver);
+void net_tun_driver_timer_wakeup(net_tun_driver_t driver);
+
+#if NET_TUN_USE_DRIVER
+void net_tun_driver_read_budget_init(net_tun_driver_t driver, net_tun_read_budget_t budget);
+uint8_t net_tun_read_budget_consume(net_tun_read_budget_t budget, uint32_t bytes);
+void net_tun_driver_read_schedule(net_tun_driver_t driver, net_tun_device_t device);
+void net_tun_driver_read_unschedule(net_tun_driver_t driver, net_tun_device_t device);
+#endif
 
 #endif
@@ -15,6 +15,8 @@ static err_t net_tun_endpoint_recv_func(void *arg, struct tcp_pcb *tpcb, struct
 static err_t net_tun_endpoint_sent_func(void *arg, struct tcp_pcb *tpcb, u16_t len);
 static void net_tun_endpoint_err_func(void *arg, err_t err);
 static err_t net_tun_endpoint_connected_func(void *arg, struct tcp_pcb *tpcb, err_t err);
+static err_t net_tun_endpoint_recv_hold(struct net_tun_endpoint * endpoint, struct pbuf * p);
+static void net_tun_endpoint_recv_release(struct net_tun_endpoint * endpoint, uint32_t size);
 static int net_tun_endpoint_do_write(struct net_tun_endpoint * endpoint);
 static uint32_t net_tun_tcp_seg_total_len(struct tcp_seg * seg);
 
@@ -41,6 +43,9 @@ void net_tun_endpoint_set_pcb(struct net_tun_endpoint * endpoint, struct tcp_pcb
         tcp_err(endpoint->m_pcb, net_tun_endpoint_err_func);
         tcp_recv(endpoint->m_pcb, net_tun_endpoint_recv_func);
         tcp_sent(endpoint->m_pcb, net_tun_endpoint_sent_func);
+        tcp_set_sndbuf_max(endpoint->m_pcb, endpoint->m_tcp_snd_buf);
+        tcp_set_rcv_wnd_max(endpoint->m_pcb, endpoint->m_tcp_rcv_wnd);
+        if (endpoint->m_tcp_cc) tcp_set_cc(endpoint->m_pcb, endpoint->m_tcp_cc);
     }
 }
 
@@ -84,6 +89,11 @@ static err_t net_tun_endpoint_recv_func(void *arg, struct tcp_pcb *tpcb, struct
     }
 
     assert(p->tot_len > 0);
+
+    if (endpoint->m_recv_fun) {
+        return net_tun_endpoint_recv_hold(endpoint, p);
+    }
+
     uint32_t total_len = p->tot_len;
     
     uint32_t capacity = total_len;
@@ -139,6 +149,49 @@ static err_t net_tun_endpoint_recv_func(void *arg, struct tcp_pcb *tpcb, struct
     return endpoint->m_pcb_aborted ? ERR_ABRT : ERR_OK;
 }
 
+static err_t net_tun_endpoint_recv_hold(struct net_tun_endpoint * endpoint, struct pbuf * p) {
+    net_endpoint_t base_endpoint = net_endpoint_from_data(endpoint);
+    net_tun_driver_t driver = net_driver_data(net_endpoint_driver(base_endpoint));
+    net_schedule_t schedule = net_endpoint_schedule(base_endpoint);
+    uint32_t total_len = p->tot_len;
+
+    /*linked pbuf by pbuf, the tot_len of the held chain is not kept (it overflows past 64K)*/
+    if (endpoint->m_recv_tail) {
+        endpoint->m_recv_tail->next = p;
+    }
+    else {
+        endpoint->m_recv_head = p;
+    }
+    while(p->next) p = p->next;
+    endpoint->m_recv_tail = p;
+    endpoint->m_recv_size += total_len;
+
+    if (net_endpoint_driver_debug(base_endpoint) || net_schedule_debug(schedule) >= 2) {
+        CPE_INFO(
+            driver->m_em, "tun: %s: <== %d (held %d)",
+            net_endpoint_dump(net_schedule_tmp_buffer(schedule), base_endpoint), total_len, endpoint->m_recv_size);
+    }
+
+    if (driver->m_data_monitor_fun) {
+        driver->m_data_monitor_fun(driver->m_data_monitor_ctx, base_endpoint, net_data_in, total_len);
+    }
+
+    endpoint->m_recv_fun(endpoint->m_recv_ctx, base_endpoint);
+
+    return endpoint->m_pcb_aborted ? ERR_ABRT : ERR_OK;
+}
+
+/*tcp_recved takes at most 64K at once*/
+static void net_tun_endpoint_recv_release(struct net_tun_endpoint * endpoint, uint32_t size) {
+    if (endpoint->m_pcb == NULL) return;
+
+    while(size > 0) {
+        uint16_t len = size > 0xFFFF ? 0xFFFF : (uint16_t)size;
+        tcp_recved(endpoint->m_pcb, len);
+        size -= len;
+    }
+}
+
 static err_t net_tun_endpoint_sent_func(void *arg, struct tcp_pcb *tpcb, u16_t len) {
     net_tun_endpoint_t endpoint = arg;
     net_endpoint_t base_endpoint = net_endpoint_from_data(endpoint);
@@ -268,8 +321,17 @@ static err_t net_tun_endpoint_connected_func(void *arg, struct tcp_pcb *tpcb, er
 
 int net_tun_endpoint_init(net_endpoint_t base_endpoint) {
     net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+    net_tun_driver_t driver = net_driver_data(net_endpoint_driver(base_endpoint));
     endpoint->m_pcb_aborted = 0;
     endpoint->m_pcb = NULL;
+    endpoint->m_tcp_snd_buf = driver->m_tcp_snd_buf;
+    endpoint->m_tcp_rcv_wnd = driver->m_tcp_rcv_wnd;
+    endpoint->m_tcp_cc = driver->m_tcp_cc;
+    endpoint->m_recv_fun = NULL;
+    endpoint->m_recv_ctx = NULL;
+    endpoint->m_recv_head = NULL;
+    endpoint->m_recv_tail = NULL;
+    endpoint->m_recv_size = 0;
     return 0;
 }
 
@@ -280,6 +342,13 @@ void net_tun_endpoint_fini(net_endpoint_t base_endpoint) {
     if (endpoint->m_pcb) {
         net_tun_endpoint_set_pcb(endpoint, NULL, 1);
     }
+
+    if (endpoint->m_recv_head) {
+        pbuf_free(endpoint->m_recv_head);
+        endpoint->m_recv_head = NULL;
+        endpoint->m_recv_tail = NULL;
+        endpoint->m_recv_size = 0;
+    }
 }
 
 void net_tun_endpoint_calc_size(net_endpoint_t base_endpoint, net_endpoint_size_info_t size_info) {
@@ -287,7 +356,7 @@ void net_tun_endpoint_calc_size(net_endpoint_t base_endpoint, net_endpoint_size_
 
     if (endpoint->m_pcb) {
         size_info->m_read = 0;
-        size_info->m_write = endpoint->m_pcb->snd_buf;
+        size_info->m_write = tcp_sndbuf_avail(endpoint->m_pcb);
     }
     else {
         size_info->m_read = 0;
@@ -299,6 +368,8 @@ int net_tun_endpoint_update(net_endpoint_t base_endpoint) {
     net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
     net_tun_driver_t driver = net_driver_data(net_endpoint_driver(base_endpoint));
     err_t err;
+
+    net_tun_driver_timer_wakeup(driver);
     
     switch(net_endpoint_state(base_endpoint)) {
     case net_endpoint_state_read_closed:
@@ -428,6 +499,170 @@ int net_tun_endpoint_get_mss(net_endpoint_t base_endpoint, uint32_t * mss) {
     return 0;
 }
 
+int net_tun_endpoint_set_tcp_buf(net_endpoint_t base_endpoint, uint32_t snd_buf, uint32_t rcv_wnd) {
+    net_tun_driver_t driver = net_tun_driver_cast(net_endpoint_driver(base_endpoint));
+    if (driver == NULL) {
+        CPE_ERROR(
+            net_schedule_em(net_endpoint_schedule(base_endpoint)), "tun: %s: set tcp buf: not a tun endpoint",
+            net_endpoint_dump(net_schedule_tmp_buffer(net_endpoint_schedule(base_endpoint)), base_endpoint));
+        return -1;
+    }
+
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+    if (snd_buf) endpoint->m_tcp_snd_buf = snd_buf;
+    if (rcv_wnd) endpoint->m_tcp_rcv_wnd = rcv_wnd;
+
+    if (endpoint->m_pcb == NULL) return 0;
+
+    net_tun_driver_timer_wakeup(driver);
+    tcp_set_sndbuf_max(endpoint->m_pcb, endpoint->m_tcp_snd_buf);
+    tcp_set_rcv_wnd_max(endpoint->m_pcb, endpoint->m_tcp_rcv_wnd);
+
+    /*a larger send buffer takes what the last write left behind*/
+    if (net_endpoint_state(base_endpoint) == net_endpoint_state_established
+        && !net_endpoint_buf_is_empty(base_endpoint, net_ep_buf_write))
+    {
+        if (net_tun_endpoint_do_write(endpoint) != 0) return -1;
+    }
+
+    return 0;
+}
+
+int net_tun_endpoint_set_tcp_cc(net_endpoint_t base_endpoint, const char * name) {
+    net_tun_driver_t driver = net_tun_driver_cast(net_endpoint_driver(base_endpoint));
+    if (driver == NULL) {
+        CPE_ERROR(
+            net_schedule_em(net_endpoint_schedule(base_endpoint)), "tun: %s: set tcp cc: not a tun endpoint",
+            net_endpoint_dump(net_schedule_tmp_buffer(net_endpoint_schedule(base_endpoint)), base_endpoint));
+        return -1;
+    }
+
+    const struct tcp_cc_ops * cc = &LWIP_TCP_CC_DEFAULT;
+    if (name) {
+        cc = tcp_cc_find(name);
+        if (cc == NULL) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: set tcp cc: unknown algorithm %s",
+                net_endpoint_dump(net_tun_driver_tmp_buffer(driver), base_endpoint), name);
+            return -1;
+        }
+    }
+
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+    endpoint->m_tcp_cc = cc;
+
+    if (endpoint->m_pcb) tcp_set_cc(endpoint->m_pcb, endpoint->m_tcp_cc);
+
+    return 0;
+}
+
+int net_tun_endpoint_set_recv_zero_copy(
+    net_endpoint_t base_endpoint, net_tun_endpoint_recv_fun_t recv_fun, void * recv_ctx)
+{
+    net_tun_driver_t driver = net_tun_driver_cast(net_endpoint_driver(base_endpoint));
+    if (driver == NULL) {
+        CPE_ERROR(
+            net_schedule_em(net_endpoint_schedule(base_endpoint)), "tun: %s: set recv zero copy: not a tun endpoint",
+            net_endpoint_dump(net_schedule_tmp_buffer(net_endpoint_schedule(base_endpoint)), base_endpoint));
+        return -1;
+    }
+
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+
+    if (recv_fun == NULL && endpoint->m_recv_head) {
+        uint32_t size = endpoint->m_recv_size;
+        uint32_t capacity = size;
+        uint8_t * data = net_endpoint_buf_alloc_at_least(base_endpoint, &capacity);
+        if (data == NULL) {
+            CPE_ERROR(
+                driver->m_em, "tun: %s: set recv zero copy: no buffer for held data, size=%d",
+                net_endpoint_dump(net_tun_driver_tmp_buffer(driver), base_endpoint), size);
+            return -1;
+        }
+
+        struct pbuf * p;
+        uint32_t pos = 0;
+        for(p = endpoint->m_recv_head; p; p = p->next) {
+            memcpy(data + pos, p->payload, p->len);
+            pos += p->len;
+        }
+        assert(pos == size);
+
+        pbuf_free(endpoint->m_recv_head);
+        endpoint->m_recv_head = NULL;
+        endpoint->m_recv_tail = NULL;
+        endpoint->m_recv_size = 0;
+        endpoint->m_recv_fun = NULL;
+        endpoint->m_recv_ctx = NULL;
+
+        net_tun_driver_timer_wakeup(driver);
+        net_tun_endpoint_recv_release(endpoint, size);
+
+        return net_endpoint_buf_supply(base_endpoint, net_ep_buf_read, size);
+    }
+
+    endpoint->m_recv_fun = recv_fun;
+    endpoint->m_recv_ctx = recv_ctx;
+    return 0;
+}
+
+uint32_t net_tun_endpoint_recv_size(net_endpoint_t base_endpoint) {
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+    return endpoint->m_recv_size;
+}
+
+int net_tun_endpoint_recv_peek(net_endpoint_t base_endpoint, void const ** data, uint32_t * size) {
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+
+    /*lwip trims retransmitted bytes by emptying pbufs in front*/
+    while(endpoint->m_recv_head && endpoint->m_recv_head->len == 0) {
+        struct pbuf * p = endpoint->m_recv_head;
+        endpoint->m_recv_head = p->next;
+        if (endpoint->m_recv_head == NULL) endpoint->m_recv_tail = NULL;
+        p->next = NULL;
+        pbuf_free(p);
+    }
+
+    if (endpoint->m_recv_head == NULL) {
+        *data = NULL;
+        *size = 0;
+        return -1;
+    }
+
+    *data = endpoint->m_recv_head->payload;
+    *size = endpoint->m_recv_head->len;
+    return 0;
+}
+
+void net_tun_endpoint_recv_consume(net_endpoint_t base_endpoint, uint32_t size) {
+    net_tun_endpoint_t endpoint = net_endpoint_data(base_endpoint);
+    net_tun_driver_t driver = net_driver_data(net_endpoint_driver(base_endpoint));
+    uint32_t left = size;
+
+    assert(size <= endpoint->m_recv_size);
+
+    while(left > 0) {
+        struct pbuf * p = endpoint->m_recv_head;
+        assert(p);
+
+        if (left < p->len) {
+            pbuf_remove_header(p, left);
+            break;
+        }
+
+        left -= p->len;
+        endpoint->m_recv_head = p->next;
+        if (endpoint->m_recv_head == NULL) endpoint->m_recv_tail = NULL;
+        p->next = NULL;
+        pbuf_free(p);
+    }
+
+    endpoint->m_recv_size -= size;
+
+    net_tun_driver_timer_wakeup(driver);
+    net_tun_endpoint_recv_release(endpoint, size);
+}
+
 static int net_tun_endpoint_do_write(struct net_tun_endpoint * endpoint) {
     net_endpoint_t base_endpoint = net_endpoint_from_data(endpoint);
     net_tun_driver_t driver = net_driver_data(net_endpoint_driver(base_endpoint));
@@ -491,7 +726,15 @@ static int net_tun_endpoint_do_write(struct net_tun_endpoint * endpoint) {
 
     if (net_endpoint_is_writeable(base_endpoint)) {
         err_t err = tcp_output(endpoint->m_pcb);
-        if (err != ERR_OK) {
+        if (err == ERR_MEM) {
+            /*device output is backed up, segments stay unsent and go out when it drains*/
+            if (net_endpoint_driver_debug(base_endpoint) || net_schedule_debug(schedule) >= 2) {
+                CPE_INFO(
+                    driver->m_em, "tun: %s: write: device busy, output deferred",
+                    net_endpoint_dump(net_tun_driver_tmp_buffer(driver), base_endpoint));
+            }
+        }
+        else if (err != ERR_OK) {
             CPE_ERROR(
                 driver->m_em, "tun: %s: write: tcp_output fail %d (%s)!",
                 net_endpoint_dump(net_tun_driver_tmp_buffer(driver), base_endpoint), err, lwip_strerr(err));
@@ -522,6 +765,8 @@ int net_tun_endpoint_connect(net_endpoint_t base_endpoint) {
             net_endpoint_dump(net_schedule_tmp_buffer(schedule), base_endpoint));
         return -1;
     }
+
+    net_tun_driver_timer_wakeup(driver);
     
     struct tcp_pcb * pcb = NULL;
     pcb = tcp_new();
@@ -5,6 +5,16 @@
 struct net_tun_endpoint {
     uint8_t m_pcb_aborted;
     struct tcp_pcb * m_pcb;
+    uint32_t m_tcp_snd_buf;
+    uint32_t m_tcp_rcv_wnd;
+    const struct tcp_cc_ops * m_tcp_cc;
+
+    /*zero copy receive, pbufs chained head to tail until the reader consumes them*/
+    net_tun_endpoint_recv_fun_t m_recv_fun;
+    void * m_recv_ctx;
+    struct pbuf * m_recv_head;
+    struct pbuf * m_recv_tail;
+    uint32_t m_recv_size;
 };
 
 int net_tun_endpoint_init(net_endpoint_t base_endpoint);
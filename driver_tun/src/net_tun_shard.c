@@ -0,0 +1,210 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <assert.h>
+#include <sched.h>
+#include "cpe/pal/pal_string.h"
+#include "cpe/pal/pal_unistd.h"
+#include "cpe/utils/string_utils.h"
+#include "net_tun_shard_i.h"
+
+#if NET_TUN_USE_DEV_TUN && CPE_OS_LINUX
+
+static void * net_tun_shard_thread(void * arg);
+
+net_tun_shard_group_t
+net_tun_shard_group_create(
+    mem_allocrator_t alloc, error_monitor_t em,
+    net_tun_shard_group_settings_t settings,
+    net_tun_shard_main_fun_t main_fun, net_tun_shard_stop_fun_t stop_fun, void * ctx)
+{
+    if (settings->m_dev_name == NULL || settings->m_dev_name[0] == 0) {
+        CPE_ERROR(em, "tun: shard: multi queue device must be opened by name!");
+        return NULL;
+    }
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count <= 0) cpu_count = 1;
+
+    uint16_t shard_count = settings->m_shard_count ? settings->m_shard_count : (uint16_t)cpu_count;
+
+    net_tun_shard_group_t group = mem_alloc(alloc, sizeof(struct net_tun_shard_group));
+    if (group == NULL) {
+        CPE_ERROR(em, "tun: shard: alloc group fail!");
+        return NULL;
+    }
+
+    group->m_alloc = alloc;
+    group->m_em = em;
+    group->m_dev_type = settings->m_dev_type;
+    group->m_io_type = settings->m_io_type;
+    cpe_str_dup(group->m_dev_name, sizeof(group->m_dev_name), settings->m_dev_name);
+    group->m_main = main_fun;
+    group->m_stop = stop_fun;
+    group->m_ctx = ctx;
+    group->m_shard_count = shard_count;
+
+    group->m_shards = mem_alloc(alloc, sizeof(struct net_tun_shard) * shard_count);
+    if (group->m_shards == NULL) {
+        CPE_ERROR(em, "tun: shard: alloc %d shards fail!", shard_count);
+        mem_free(alloc, group);
+        return NULL;
+    }
+
+    uint16_t i;
+    for(i = 0; i < shard_count; ++i) {
+        net_tun_shard_t shard = group->m_shards + i;
+        shard->m_group = group;
+        shard->m_id = i;
+        shard->m_cpu = settings->m_pin_cpu ? (int)(i % cpu_count) : -1;
+        shard->m_state = net_tun_shard_state_init;
+        shard->m_thread_started = 0;
+        shard->m_device = NULL;
+    }
+
+    pthread_mutex_init(&group->m_mutex, NULL);
+    pthread_cond_init(&group->m_cond, NULL);
+
+    return group;
+}
+
+void net_tun_shard_group_free(net_tun_shard_group_t group) {
+    uint16_t i;
+
+    for(i = 0; i < group->m_shard_count; ++i) {
+        net_tun_shard_t shard = group->m_shards + i;
+        if (!shard->m_thread_started) continue;
+
+        pthread_mutex_lock(&group->m_mutex);
+        uint8_t need_stop = shard->m_state == net_tun_shard_state_ready;
+        pthread_mutex_unlock(&group->m_mutex);
+
+        if (need_stop) group->m_stop(group->m_ctx, shard);
+    }
+
+    for(i = 0; i < group->m_shard_count; ++i) {
+        net_tun_shard_t shard = group->m_shards + i;
+        if (!shard->m_thread_started) continue;
+
+        pthread_join(shard->m_thread, NULL);
+        shard->m_thread_started = 0;
+    }
+
+    pthread_cond_destroy(&group->m_cond);
+    pthread_mutex_destroy(&group->m_mutex);
+
+    mem_free(group->m_alloc, group->m_shards);
+    mem_free(group->m_alloc, group);
+}
+
+int net_tun_shard_group_start(net_tun_shard_group_t group) {
+    uint16_t i;
+
+    /*queues are attached one by one, the first TUNSETIFF creates the interface*/
+    for(i = 0; i < group->m_shard_count; ++i) {
+        net_tun_shard_t shard = group->m_shards + i;
+        assert(!shard->m_thread_started);
+
+        shard->m_state = net_tun_shard_state_starting;
+        int rv = pthread_create(&shard->m_thread, NULL, net_tun_shard_thread, shard);
+        if (rv != 0) {
+            CPE_ERROR(group->m_em, "tun: shard %d: create thread fail, %d %s", i, rv, strerror(rv));
+            shard->m_state = net_tun_shard_state_failed;
+            return -1;
+        }
+        shard->m_thread_started = 1;
+
+        pthread_mutex_lock(&group->m_mutex);
+        while(shard->m_state == net_tun_shard_state_starting) {
+            pthread_cond_wait(&group->m_cond, &group->m_mutex);
+        }
+        net_tun_shard_state_t state = shard->m_state;
+        pthread_mutex_unlock(&group->m_mutex);
+
+        if (state != net_tun_shard_state_ready) {
+            CPE_ERROR(group->m_em, "tun: shard %d: start fail", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+uint16_t net_tun_shard_group_count(net_tun_shard_group_t group) {
+    return group->m_shard_count;
+}
+
+net_tun_shard_t net_tun_shard_group_shard(net_tun_shard_group_t group, uint16_t idx) {
+    return idx < group->m_shard_count ? group->m_shards + idx : NULL;
+}
+
+net_tun_shard_group_t net_tun_shard_group(net_tun_shard_t shard) {
+    return shard->m_group;
+}
+
+uint16_t net_tun_shard_id(net_tun_shard_t shard) {
+    return shard->m_id;
+}
+
+int net_tun_shard_cpu(net_tun_shard_t shard) {
+    return shard->m_cpu;
+}
+
+net_tun_device_t net_tun_shard_device(net_tun_shard_t shard) {
+    return shard->m_device;
+}
+
+net_tun_device_t
+net_tun_shard_device_create(
+    net_tun_shard_t shard, net_tun_driver_t driver, net_tun_device_netif_options_t netif_settings)
+{
+    net_tun_shard_group_t group = shard->m_group;
+
+    struct net_tun_device_init_data init_data;
+    bzero(&init_data, sizeof(init_data));
+    init_data.m_dev_type = group->m_dev_type;
+    init_data.m_init_type = net_tun_device_init_string;
+    init_data.m_io_type = group->m_io_type;
+    init_data.m_multi_queue = 1;
+    init_data.m_init_data.m_string = group->m_dev_name;
+
+    net_tun_device_t device = net_tun_device_create(driver, &init_data, netif_settings);
+
+    pthread_mutex_lock(&group->m_mutex);
+    shard->m_device = device;
+    shard->m_state = device ? net_tun_shard_state_ready : net_tun_shard_state_failed;
+    pthread_cond_broadcast(&group->m_cond);
+    pthread_mutex_unlock(&group->m_mutex);
+
+    return device;
+}
+
+static void * net_tun_shard_thread(void * arg) {
+    net_tun_shard_t shard = arg;
+    net_tun_shard_group_t group = shard->m_group;
+
+    if (shard->m_cpu >= 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(shard->m_cpu, &cpu_set);
+        int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (rv != 0) {
+            CPE_ERROR(group->m_em, "tun: shard %d: pin to cpu %d fail, %d %s", shard->m_id, shard->m_cpu, rv, strerror(rv));
+        }
+    }
+
+    group->m_main(group->m_ctx, shard);
+
+    pthread_mutex_lock(&group->m_mutex);
+    shard->m_state =
+        shard->m_state == net_tun_shard_state_starting
+        ? net_tun_shard_state_failed
+        : net_tun_shard_state_exited;
+    shard->m_device = NULL;
+    pthread_cond_broadcast(&group->m_cond);
+    pthread_mutex_unlock(&group->m_mutex);
+
+    return NULL;
+}
+
+#endif
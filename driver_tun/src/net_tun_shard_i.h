@@ -0,0 +1,45 @@
+#ifndef NET_TUN_SHARD_I_H_INCLEDED
+#define NET_TUN_SHARD_I_H_INCLEDED
+#include <pthread.h>
+#include "cpe/utils/memory.h"
+#include "cpe/utils/error.h"
+#include "net_tun_shard.h"
+
+#if NET_TUN_USE_DEV_TUN && CPE_OS_LINUX
+
+typedef enum net_tun_shard_state {
+    net_tun_shard_state_init,
+    net_tun_shard_state_starting,
+    net_tun_shard_state_ready,
+    net_tun_shard_state_failed,
+    net_tun_shard_state_exited,
+} net_tun_shard_state_t;
+
+struct net_tun_shard {
+    net_tun_shard_group_t m_group;
+    uint16_t m_id;
+    int m_cpu;
+    net_tun_shard_state_t m_state;
+    uint8_t m_thread_started;
+    pthread_t m_thread;
+    net_tun_device_t m_device;
+};
+
+struct net_tun_shard_group {
+    mem_allocrator_t m_alloc;
+    error_monitor_t m_em;
+    net_tun_device_type_t m_dev_type;
+    net_tun_device_io_type_t m_io_type;
+    char m_dev_name[64];
+    net_tun_shard_main_fun_t m_main;
+    net_tun_shard_stop_fun_t m_stop;
+    void * m_ctx;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    uint16_t m_shard_count;
+    struct net_tun_shard * m_shards;
+};
+
+#endif
+
+#endif